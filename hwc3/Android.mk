@@ -75,6 +75,7 @@ LOCAL_C_INCLUDES := \
 
 LOCAL_SRC_FILES := \
 	Composer.cpp \
+	ComposerApiStats.cpp \
 	ComposerClient.cpp \
 	ComposerCommandEngine.cpp \
 	impl/HalImpl.cpp \
@@ -21,6 +21,9 @@
 #include <android-base/logging.h>
 #include <android/binder_ibinder_platform.h>
 
+#include <string_view>
+
+#include "ComposerApiStats.h"
 #include "Util.h"
 
 namespace aidl::android::hardware::graphics::composer3::impl {
@@ -59,9 +62,20 @@ ndk::ScopedAStatus Composer::createClient(std::shared_ptr<IComposerClient>* outC
     return ndk::ScopedAStatus::ok();
 }
 
-binder_status_t Composer::dump(int fd, const char** /*args*/, uint32_t /*numArgs*/) {
+binder_status_t Composer::dump(int fd, const char** args, uint32_t numArgs) {
     std::string output;
     mHal->dumpDebugInfo(&output);
+
+    auto& apiStats = ComposerApiStats::getInstance();
+    apiStats.dump(&output);
+    // "--reset-api-stats" starts a new collection window after this dump
+    for (uint32_t i = 0; i < numArgs; ++i) {
+        if (std::string_view(args[i]) == "--reset-api-stats") {
+            apiStats.reset();
+            output.append("Composer API latency reset\n");
+        }
+    }
+
     write(fd, output.c_str(), output.size());
     return STATUS_OK;
 }
@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ComposerApiStats.h"
+
+#include <utils/String8.h>
+
+namespace aidl::android::hardware::graphics::composer3::impl {
+
+namespace {
+
+constexpr std::array<const char*, static_cast<size_t>(ComposerApi::COUNT)> kApiNames = {
+        "executeCommands",
+        "validateDisplay",
+        "presentDisplay",
+        "presentOrValidateDisplay",
+        "setActiveConfigWithConstraints",
+};
+
+} // namespace
+
+ComposerApiStats& ComposerApiStats::getInstance() {
+    static ComposerApiStats instance;
+    return instance;
+}
+
+size_t ComposerApiStats::getThreadShard() {
+    static std::atomic<size_t> nextShard = 0;
+    thread_local const size_t shard =
+            nextShard.fetch_add(1, std::memory_order_relaxed) % kShardCount;
+    return shard;
+}
+
+void ComposerApiStats::record(ComposerApi api, nsecs_t durationNs, bool failed) {
+    auto& shard = mShards[getThreadShard()];
+    const auto index = static_cast<size_t>(api);
+    shard.latency[index].insert(durationNs);
+    if (failed) {
+        shard.failures[index].fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void ComposerApiStats::dump(std::string* output) const {
+    ::android::String8 result;
+    result.append("Composer API latency:\n");
+    for (size_t api = 0; api < kApiCount; ++api) {
+        LatencyHistogram merged;
+        uint64_t failures = 0;
+        for (const auto& shard : mShards) {
+            merged.merge(shard.latency[api]);
+            failures += shard.failures[api].load(std::memory_order_relaxed);
+        }
+        merged.dump(result, kApiNames[api]);
+        if (failures) {
+            result.appendFormat("\t\tfailures: %" PRIu64 "\n", failures);
+        }
+    }
+    result.append("\n");
+    output->append(result.c_str(), result.size());
+}
+
+void ComposerApiStats::reset() {
+    for (auto& shard : mShards) {
+        for (auto& histogram : shard.latency) {
+            histogram.reset();
+        }
+        for (auto& failures : shard.failures) {
+            failures.store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+} // namespace aidl::android::hardware::graphics::composer3::impl
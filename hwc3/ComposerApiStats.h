@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <utils/Timers.h>
+
+#include <array>
+#include <atomic>
+#include <string>
+
+#include "LatencyHistogram.h"
+
+namespace aidl::android::hardware::graphics::composer3::impl {
+
+enum class ComposerApi : uint32_t {
+    EXECUTE_COMMANDS = 0,
+    VALIDATE_DISPLAY,
+    PRESENT_DISPLAY,
+    PRESENT_OR_VALIDATE_DISPLAY,
+    SET_ACTIVE_CONFIG_WITH_CONSTRAINTS,
+    COUNT,
+};
+
+/*
+ * Always-on latency histograms of the composer API, one per method. Binder
+ * threads record into their own shard so they don't bounce the same cache
+ * lines, the shards are only summed up when dumping.
+ */
+class ComposerApiStats {
+  public:
+    static ComposerApiStats& getInstance();
+
+    void record(ComposerApi api, nsecs_t durationNs, bool failed);
+    void dump(std::string* output) const;
+    void reset();
+
+  private:
+    static constexpr size_t kShardCount = 8;
+    static constexpr size_t kApiCount = static_cast<size_t>(ComposerApi::COUNT);
+
+    struct alignas(64) Shard {
+        std::array<LatencyHistogram, kApiCount> latency;
+        std::array<std::atomic<uint64_t>, kApiCount> failures{};
+    };
+
+    static size_t getThreadShard();
+
+    std::array<Shard, kShardCount> mShards;
+};
+
+// Records the time spent in the enclosing scope against api
+class ScopedApiLatency {
+  public:
+    explicit ScopedApiLatency(ComposerApi api)
+          : mApi(api), mStartNs(systemTime(SYSTEM_TIME_MONOTONIC)) {}
+    ~ScopedApiLatency() {
+        ComposerApiStats::getInstance().record(mApi, systemTime(SYSTEM_TIME_MONOTONIC) - mStartNs,
+                                               mFailed);
+    }
+
+    void setFailed(bool failed) { mFailed = failed; }
+
+  private:
+    const ComposerApi mApi;
+    const nsecs_t mStartNs;
+    bool mFailed = false;
+};
+
+} // namespace aidl::android::hardware::graphics::composer3::impl
@@ -22,6 +22,7 @@
 #include <android/binder_ibinder_platform.h>
 #include <hardware/hwcomposer2.h>
 
+#include "ComposerApiStats.h"
 #include "Util.h"
 
 namespace aidl::android::hardware::graphics::composer3::impl {
@@ -34,9 +35,41 @@ bool ComposerClient::init() {
         return false;
     }
 
+    auto engine = acquireCommandEngine();
+    if (!engine) {
+        return false;
+    }
+    releaseCommandEngine(std::move(engine));
+
     return true;
 }
 
+std::unique_ptr<ComposerCommandEngine> ComposerClient::acquireCommandEngine() {
+    {
+        std::lock_guard<std::mutex> lock(mCommandEngineMutex);
+        if (!mIdleCommandEngines.empty()) {
+            auto engine = std::move(mIdleCommandEngines.back());
+            mIdleCommandEngines.pop_back();
+            return engine;
+        }
+    }
+
+    // all engines are busy on other displays, the pool grows to the number of
+    // concurrent callers and stays there
+    auto engine = std::make_unique<ComposerCommandEngine>(mHal, mResources.get());
+    auto err = engine->init();
+    if (err != ::android::NO_ERROR) {
+        LOG(ERROR) << "failed to init ComposerCommandEngine " << err;
+        return nullptr;
+    }
+    return engine;
+}
+
+void ComposerClient::releaseCommandEngine(std::unique_ptr<ComposerCommandEngine> engine) {
+    std::lock_guard<std::mutex> lock(mCommandEngineMutex);
+    mIdleCommandEngines.push_back(std::move(engine));
+}
+
 ComposerClient::~ComposerClient() {
     DEBUG_FUNC();
     LOG(DEBUG) << "destroying composer client";
@@ -114,16 +147,16 @@ ndk::ScopedAStatus ComposerClient::executeCommands(const std::vector<DisplayComm
                                                    std::vector<CommandResultPayload>* results) {
     int64_t display = commands.empty() ? -1 : commands[0].display;
     DEBUG_DISPLAY_FUNC(display);
-    ComposerCommandEngine engine(mHal, mResources.get());
-
-    auto err = engine.init();
-    if (err != ::android::NO_ERROR) {
-        LOG(ERROR) << "executeCommands(): init ComposerCommandEngine failed " << err;
-        return TO_BINDER_STATUS(err);
+    ScopedApiLatency apiLatency(ComposerApi::EXECUTE_COMMANDS);
+    auto engine = acquireCommandEngine();
+    if (!engine) {
+        apiLatency.setFailed(true);
+        return TO_BINDER_STATUS(::android::NO_MEMORY);
     }
-
-    err = engine.execute(commands, results);
+    auto err = engine->execute(commands, results);
+    releaseCommandEngine(std::move(engine));
     if (err != ::android::NO_ERROR) {
+        apiLatency.setFailed(true);
         LOG(ERROR) << "executeCommands(): execute failed " << err;
         return TO_BINDER_STATUS(err);
     }
@@ -346,7 +379,9 @@ ndk::ScopedAStatus ComposerClient::setActiveConfigWithConstraints(
         int64_t display, int32_t config, const VsyncPeriodChangeConstraints& constraints,
         VsyncPeriodChangeTimeline* timeline) {
     DEBUG_DISPLAY_FUNC(display);
+    ScopedApiLatency apiLatency(ComposerApi::SET_ACTIVE_CONFIG_WITH_CONSTRAINTS);
     auto err = mHal->setActiveConfigWithConstraints(display, config, constraints, timeline);
+    apiLatency.setFailed(err != HWC2_ERROR_NONE);
     return TO_BINDER_STATUS(err);
 }
 
@@ -21,6 +21,8 @@
 #include <utils/Mutex.h>
 
 #include <memory>
+#include <mutex>
+#include <vector>
 
 #include "ComposerCommandEngine.h"
 #include "include/IComposerHal.h"
@@ -146,9 +148,18 @@ protected:
 
 private:
     void destroyResources();
+    // Takes an idle engine from the pool, or creates one when all are busy
+    std::unique_ptr<ComposerCommandEngine> acquireCommandEngine();
+    void releaseCommandEngine(std::unique_ptr<ComposerCommandEngine> engine);
 
     IComposerHal* mHal;
     std::unique_ptr<IResourceManager> mResources;
+    // executeCommands() is called from the present thread of every display
+    // that supports multi-threaded present. Each call runs on an engine of its
+    // own, the mutex only guards the pool of idle engines.
+    std::mutex mCommandEngineMutex;
+    std::vector<std::unique_ptr<ComposerCommandEngine>>
+            mIdleCommandEngines; // GUARDED_BY(mCommandEngineMutex)
     std::function<void()> mOnClientDestroyed;
     std::unique_ptr<HalEventCallback> mHalEventCallback;
 };
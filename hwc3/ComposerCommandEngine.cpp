@@ -18,8 +18,13 @@
 
 #include <hardware/hwcomposer2.h>
 
-#include <set>
+#include <pthread.h>
+#include <sched.h>
 
+#include <algorithm>
+#include <iterator>
+
+#include "ComposerApiStats.h"
 #include "Util.h"
 
 namespace aidl::android::hardware::graphics::composer3::impl {
@@ -31,12 +36,6 @@ namespace aidl::android::hardware::graphics::composer3::impl {
         }                                                                        \
     } while (0)
 
-#define DISPATCH_LAYER_COMMAND_SIMPLE(display, layerCmd, field, funcName)     \
-    do {                                                                      \
-        dispatchLayerCommand(display, layerCmd.layer, #field, layerCmd.field, \
-                             &IComposerHal::setLayer##funcName);              \
-    } while (0)
-
 #define DISPATCH_DISPLAY_COMMAND(displayCmd, field, funcName)                \
     do {                                                                     \
         if (displayCmd.field) {                                              \
@@ -60,31 +59,53 @@ namespace aidl::android::hardware::graphics::composer3::impl {
 
 int32_t ComposerCommandEngine::init() {
     mWriter = std::make_unique<ComposerServiceWriter>();
-    return (mWriter != nullptr) ? ::android::NO_ERROR : ::android::NO_MEMORY;
+    if (mWriter == nullptr) {
+        return ::android::NO_MEMORY;
+    }
+
+    mDisplaysPendingBrightnessChange.reserve(kReservedDisplays);
+    mChangedLayers.reserve(kReservedLayers);
+    mCompositionTypes.reserve(kReservedLayers);
+    mRequestedLayers.reserve(kReservedLayers);
+    mRequestMasks.reserve(kReservedLayers);
+    mReleasedLayers.reserve(kReservedLayers);
+    return ::android::NO_ERROR;
 }
 
 int32_t ComposerCommandEngine::execute(const std::vector<DisplayCommand>& commands,
                                        std::vector<CommandResultPayload>* result) {
-    std::set<int64_t> displaysPendingBrightenssChange;
-    mCommandIndex = 0;
+    if (groupCommandsByDisplay(commands)) {
+        return executeParallel(commands, result);
+    }
+
+    reset();
     for (const auto& command : commands) {
         dispatchDisplayCommand(command);
         ++mCommandIndex;
-        // The input commands could have 2+ commands for the same display.
-        // If the first has pending brightness change, the second presentDisplay will apply it.
-        if (command.validateDisplay || command.presentDisplay ||
-            command.presentOrValidateDisplay) {
-            displaysPendingBrightenssChange.erase(command.display);
-        } else if (command.brightness) {
-            displaysPendingBrightenssChange.insert(command.display);
-        }
+        trackBrightnessChange(command);
     }
 
     *result = mWriter->getPendingCommandResults();
     mWriter->reset();
 
+    return flushBrightnessChanges();
+}
+
+void ComposerCommandEngine::trackBrightnessChange(const DisplayCommand& command) {
+    // The input commands could have 2+ commands for the same display.
+    // If the first has pending brightness change, the second presentDisplay will apply it.
+    auto& pendingDisplays = mDisplaysPendingBrightnessChange;
+    auto it = std::find(pendingDisplays.begin(), pendingDisplays.end(), command.display);
+    if (command.validateDisplay || command.presentDisplay || command.presentOrValidateDisplay) {
+        if (it != pendingDisplays.end()) pendingDisplays.erase(it);
+    } else if (command.brightness && it == pendingDisplays.end()) {
+        pendingDisplays.push_back(command.display);
+    }
+}
+
+int32_t ComposerCommandEngine::flushBrightnessChanges() {
     // standalone display brightness command shouldn't wait for next present or validate
-    for (auto display : displaysPendingBrightenssChange) {
+    for (auto display : mDisplaysPendingBrightnessChange) {
         auto err = mHal->flushDisplayBrightnessChange(display);
         if (err) {
             return err;
@@ -93,7 +114,145 @@ int32_t ComposerCommandEngine::execute(const std::vector<DisplayCommand>& comman
     return ::android::NO_ERROR;
 }
 
+bool ComposerCommandEngine::groupCommandsByDisplay(const std::vector<DisplayCommand>& commands) {
+    // Groups are recycled across calls so their index vectors keep their capacity
+    mGroupCount = 0;
+    for (size_t i = 0; i < commands.size(); ++i) {
+        auto display = commands[i].display;
+        auto end = mGroups.begin() + mGroupCount;
+        auto it = std::find_if(mGroups.begin(), end,
+                               [display](const auto& group) { return group.display == display; });
+        if (it == end) {
+            if (mGroupCount == mGroups.size()) {
+                mGroups.emplace_back();
+            }
+            it = mGroups.begin() + mGroupCount++;
+            it->display = display;
+            it->indices.clear();
+        }
+        it->indices.push_back(i);
+    }
+    if (mGroupCount < 2) {
+        return false;
+    }
+
+    for (size_t i = 0; i < mGroupCount; ++i) {
+        bool support = false;
+        if (mHal->getDisplayMultiThreadedPresentSupport(mGroups[i].display, support) ||
+            !support) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int32_t ComposerCommandEngine::executeParallel(const std::vector<DisplayCommand>& commands,
+                                               std::vector<CommandResultPayload>* result) {
+    while (mLanes.size() < mGroupCount - 1) {
+        auto engine = std::make_unique<ComposerCommandEngine>(mHal, mResources);
+        auto err = engine->init();
+        if (err != ::android::NO_ERROR) {
+            return err;
+        }
+        mLanes.push_back({std::move(engine), std::make_unique<LaneThread>()});
+    }
+
+    mCommandResults.resize(commands.size());
+    mGroupErrors.assign(mGroupCount, ::android::NO_ERROR);
+    for (size_t i = 1; i < mGroupCount; ++i) {
+        auto& lane = mLanes[i - 1];
+        lane.thread->post([this, &commands, &lane, i] {
+            mGroupErrors[i] = lane.engine->executeDisplayGroup(commands, mGroups[i],
+                                                               mCommandResults);
+        });
+    }
+    mGroupErrors[0] = executeDisplayGroup(commands, mGroups[0], mCommandResults);
+    for (size_t i = 1; i < mGroupCount; ++i) {
+        mLanes[i - 1].thread->wait();
+    }
+
+    result->clear();
+    for (auto& commandResults : mCommandResults) {
+        std::move(commandResults.begin(), commandResults.end(), std::back_inserter(*result));
+        commandResults.clear();
+    }
+
+    for (auto err : mGroupErrors) {
+        if (err) {
+            return err;
+        }
+    }
+    return ::android::NO_ERROR;
+}
+
+int32_t ComposerCommandEngine::executeDisplayGroup(
+        const std::vector<DisplayCommand>& commands, const DisplayGroup& group,
+        std::vector<std::vector<CommandResultPayload>>& outResults) {
+    reset();
+    for (auto index : group.indices) {
+        const auto& command = commands[index];
+        // errors are reported against the index in the whole batch
+        mCommandIndex = static_cast<int32_t>(index);
+        dispatchDisplayCommand(command);
+        trackBrightnessChange(command);
+
+        outResults[index] = mWriter->getPendingCommandResults();
+        mWriter->reset();
+    }
+
+    return flushBrightnessChanges();
+}
+
+ComposerCommandEngine::LaneThread::LaneThread() : mThread([this] { run(); }) {
+    // run at the priority of the binder thread that created the lane
+    sched_param param;
+    int policy;
+    if (pthread_getschedparam(pthread_self(), &policy, &param) == 0) {
+        pthread_setschedparam(mThread.native_handle(), policy, &param);
+    }
+    pthread_setname_np(mThread.native_handle(), "hwc3-lane");
+}
+
+ComposerCommandEngine::LaneThread::~LaneThread() {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mExit = true;
+    }
+    mCondition.notify_all();
+    mThread.join();
+}
+
+void ComposerCommandEngine::LaneThread::post(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mTask = std::move(task);
+    }
+    mCondition.notify_all();
+}
+
+void ComposerCommandEngine::LaneThread::wait() {
+    std::unique_lock<std::mutex> lock(mMutex);
+    mCondition.wait(lock, [this] { return !mTask; });
+}
+
+void ComposerCommandEngine::LaneThread::run() {
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (true) {
+        mCondition.wait(lock, [this] { return mExit || mTask; });
+        if (mExit) {
+            return;
+        }
+
+        lock.unlock();
+        mTask();
+        lock.lock();
+        mTask = nullptr;
+        mCondition.notify_all();
+    }
+}
+
 void ComposerCommandEngine::dispatchDisplayCommand(const DisplayCommand& command) {
+    mClientTargetUpdated = false;
     //  place SetDisplayBrightness before SetLayerWhitePointNits since current
     //  display brightness is used to validate the layer white point nits.
     DISPATCH_DISPLAY_COMMAND(command, brightness, SetDisplayBrightness);
@@ -113,49 +272,52 @@ void ComposerCommandEngine::dispatchDisplayCommand(const DisplayCommand& command
 }
 
 void ComposerCommandEngine::dispatchLayerCommand(int64_t display, const LayerCommand& command) {
-    DISPATCH_LAYER_COMMAND(display, command, cursorPosition, CursorPosition);
-    DISPATCH_LAYER_COMMAND(display, command, buffer, Buffer);
-    DISPATCH_LAYER_COMMAND(display, command, damage, SurfaceDamage);
-    DISPATCH_LAYER_COMMAND(display, command, blendMode, BlendMode);
-    DISPATCH_LAYER_COMMAND(display, command, color, Color);
-    DISPATCH_LAYER_COMMAND(display, command, composition, Composition);
-    DISPATCH_LAYER_COMMAND(display, command, dataspace, Dataspace);
-    DISPATCH_LAYER_COMMAND(display, command, displayFrame, DisplayFrame);
-    DISPATCH_LAYER_COMMAND(display, command, planeAlpha, PlaneAlpha);
+    // The buffer is resolved through the cache here, every other field is
+    // applied by the HAL in one pass over the layer.
+    std::unique_ptr<IBufferReleaser> bufferReleaser;
+    buffer_handle_t hwcBuffer = nullptr;
+    bool hasBuffer = false;
+    if (command.buffer) {
+        bufferReleaser = mResources->createReleaser(true);
+        hasBuffer = executeGetLayerBuffer(display, command.layer, *command.buffer, hwcBuffer,
+                                          bufferReleaser.get());
+    }
+
+    auto err = mHal->applyLayerState(display, command.layer, command,
+                                     hasBuffer ? &hwcBuffer : nullptr);
+    if (err) {
+        LOG(ERROR) << __func__ << ": applyLayerState err " << err;
+        mWriter->setError(mCommandIndex, err);
+    }
+
     DISPATCH_LAYER_COMMAND(display, command, sidebandStream, SidebandStream);
-    DISPATCH_LAYER_COMMAND(display, command, sourceCrop, SourceCrop);
-    DISPATCH_LAYER_COMMAND(display, command, transform, Transform);
-    DISPATCH_LAYER_COMMAND(display, command, visibleRegion, VisibleRegion);
-    DISPATCH_LAYER_COMMAND(display, command, z, ZOrder);
-    DISPATCH_LAYER_COMMAND(display, command, colorTransform, ColorTransform);
-    DISPATCH_LAYER_COMMAND(display, command, brightness, Brightness);
-    DISPATCH_LAYER_COMMAND(display, command, perFrameMetadata, PerFrameMetadata);
-    DISPATCH_LAYER_COMMAND(display, command, perFrameMetadataBlob, PerFrameMetadataBlobs);
-    DISPATCH_LAYER_COMMAND_SIMPLE(display, command, blockingRegion, BlockingRegion);
 }
 
 int32_t ComposerCommandEngine::executeValidateDisplayInternal(int64_t display) {
-    std::vector<int64_t> changedLayers;
-    std::vector<Composition> compositionTypes;
+    ScopedApiLatency apiLatency(ComposerApi::VALIDATE_DISPLAY);
+    mChangedLayers.clear();
+    mCompositionTypes.clear();
     uint32_t displayRequestMask = 0x0;
-    std::vector<int64_t> requestedLayers;
-    std::vector<int32_t> requestMasks;
+    mRequestedLayers.clear();
+    mRequestMasks.clear();
     ClientTargetProperty clientTargetProperty{common::PixelFormat::RGBA_8888,
                                               common::Dataspace::UNKNOWN};
     DimmingStage dimmingStage;
     auto err =
-            mHal->validateDisplay(display, &changedLayers, &compositionTypes, &displayRequestMask,
-                                  &requestedLayers, &requestMasks, &clientTargetProperty,
-                                  &dimmingStage);
+            mHal->validateDisplay(display, &mChangedLayers, &mCompositionTypes,
+                                  &displayRequestMask, &mRequestedLayers, &mRequestMasks,
+                                  &clientTargetProperty, &dimmingStage);
     mResources->setDisplayMustValidateState(display, false);
     if (err == HWC2_ERROR_NONE || err == HWC2_ERROR_HAS_CHANGES) {
-        mWriter->setChangedCompositionTypes(display, changedLayers, compositionTypes);
-        mWriter->setDisplayRequests(display, displayRequestMask, requestedLayers, requestMasks);
+        mWriter->setChangedCompositionTypes(display, mChangedLayers, mCompositionTypes);
+        mWriter->setDisplayRequests(display, displayRequestMask, mRequestedLayers,
+                                    mRequestMasks);
         static constexpr float kBrightness = 1.f;
         mWriter->setClientTargetProperty(display, clientTargetProperty, kBrightness, dimmingStage);
     } else {
         LOG(ERROR) << __func__ << ": err " << err;
         mWriter->setError(mCommandIndex, err);
+        apiLatency.setFailed(true);
     }
     return err;
 }
@@ -185,6 +347,7 @@ void ComposerCommandEngine::executeSetClientTarget(int64_t display, const Client
             LOG(ERROR) << __func__ << " setClientTarget: err " << err;
             mWriter->setError(mCommandIndex, err);
         }
+        mClientTargetUpdated = !err;
     } else {
         LOG(ERROR) << __func__ << " getDisplayClientTarget : err " << err;
         mWriter->setError(mCommandIndex, err);
@@ -237,6 +400,7 @@ void ComposerCommandEngine::executeSetDisplayBrightness(uint64_t display,
 void ComposerCommandEngine::executePresentOrValidateDisplay(
         int64_t display, const std::optional<ClockMonotonicTimestamp> expectedPresentTime,
         int frameIntervalNs) {
+    ScopedApiLatency apiLatency(ComposerApi::PRESENT_OR_VALIDATE_DISPLAY);
     executeSetExpectedPresentTimeInternal(display, expectedPresentTime, frameIntervalNs);
     // First try to Present as is.
     auto presentErr = mResources->mustValidateDisplay(display) ? IComposerClient::EX_NOT_VALIDATED
@@ -250,11 +414,9 @@ void ComposerCommandEngine::executePresentOrValidateDisplay(
     auto validateErr = executeValidateDisplayInternal(display);
     if (validateErr != HWC2_ERROR_NONE && validateErr != HWC2_ERROR_HAS_CHANGES) return;
 
-    bool hasClientComp = false;
-    bool cannotPresentDirectly = (validateErr == HWC2_ERROR_HAS_CHANGES) ||
-            (mHal->getHasClientComposition(display, hasClientComp) == HWC2_ERROR_NONE &&
-             hasClientComp);
-    if (cannotPresentDirectly) {
+    // Anything the speculation can't vouch for rolls back to the plain
+    // validated result and the client finishes the frame itself.
+    if (!canPresentSpeculatively(display, validateErr)) {
         mWriter->setPresentOrValidateResult(display, PresentOrValidate::Result::Validated);
         return;
     }
@@ -267,6 +429,24 @@ void ComposerCommandEngine::executePresentOrValidateDisplay(
     }
 }
 
+bool ComposerCommandEngine::canPresentSpeculatively(int64_t display, int32_t validateErr) {
+    // The client expects changed types back, it has to see them first.
+    if (validateErr == HWC2_ERROR_HAS_CHANGES) return false;
+
+    bool hasClientComp = false;
+    if (mHal->getHasClientComposition(display, hasClientComp) != HWC2_ERROR_NONE) return false;
+    if (!hasClientComp) return true;
+
+    // With client composition the target set in this command must have been
+    // rendered for the same layers the HAL just picked. It is, if the client
+    // rendered it and no layer moved between client and device since the
+    // previous validated frame, i.e. only buffers and damage changed.
+    bool compositionChanged = true;
+    return mClientTargetUpdated &&
+            mHal->getCompositionChanged(display, compositionChanged) == HWC2_ERROR_NONE &&
+            !compositionChanged;
+}
+
 void ComposerCommandEngine::executeAcceptDisplayChanges(int64_t display) {
     auto err = mHal->acceptDisplayChanges(display);
     if (err) {
@@ -276,110 +456,36 @@ void ComposerCommandEngine::executeAcceptDisplayChanges(int64_t display) {
 }
 
 int ComposerCommandEngine::executePresentDisplay(int64_t display) {
+    ScopedApiLatency apiLatency(ComposerApi::PRESENT_DISPLAY);
     ndk::ScopedFileDescriptor presentFence;
-    std::vector<int64_t> layers;
+    mReleasedLayers.clear();
+    // ownership of the fences moves to the writer, so this one can't be reused
     std::vector<ndk::ScopedFileDescriptor> fences;
-    auto err = mHal->presentDisplay(display, presentFence, &layers, &fences);
+    auto err = mHal->presentDisplay(display, presentFence, &mReleasedLayers, &fences);
     if (!err) {
         mWriter->setPresentFence(display, std::move(presentFence));
-        mWriter->setReleaseFences(display, layers, std::move(fences));
+        mWriter->setReleaseFences(display, mReleasedLayers, std::move(fences));
     }
 
+    apiLatency.setFailed(err != HWC2_ERROR_NONE);
     return err;
 }
 
-void ComposerCommandEngine::executeSetLayerCursorPosition(int64_t display, int64_t layer,
-                                       const common::Point& cursorPosition) {
-    auto err = mHal->setLayerCursorPosition(display, layer, cursorPosition.x, cursorPosition.y);
-    if (err) {
-        LOG(ERROR) << __func__ << ": err " << err;
-        mWriter->setError(mCommandIndex, err);
-    }
-}
-
-void ComposerCommandEngine::executeSetLayerBuffer(int64_t display, int64_t layer,
-                                                  const Buffer& buffer) {
+bool ComposerCommandEngine::executeGetLayerBuffer(int64_t display, int64_t layer,
+                                                  const Buffer& buffer, buffer_handle_t& outHandle,
+                                                  IBufferReleaser* bufferReleaser) {
     bool useCache = !buffer.handle;
     buffer_handle_t handle = useCache
                              ? nullptr
                              : ::android::makeFromAidl(*buffer.handle);
-    buffer_handle_t hwcBuffer;
-    auto bufferReleaser = mResources->createReleaser(true);
     auto err = mResources->getLayerBuffer(display, layer, buffer.slot, useCache,
-                                          handle, hwcBuffer, bufferReleaser.get());
-    if (!err) {
-        err = mHal->setLayerBuffer(display, layer, hwcBuffer, buffer.fence);
-        if (err) {
-            LOG(ERROR) << __func__ << ": setLayerBuffer err " << err;
-            mWriter->setError(mCommandIndex, err);
-        }
-    } else {
-        LOG(ERROR) << __func__ << ": getLayerBuffer err " << err;
-        mWriter->setError(mCommandIndex, err);
-    }
-}
-
-void ComposerCommandEngine::executeSetLayerSurfaceDamage(int64_t display, int64_t layer,
-                              const std::vector<std::optional<common::Rect>>& damage) {
-    auto err = mHal->setLayerSurfaceDamage(display, layer, damage);
+                                          handle, outHandle, bufferReleaser);
     if (err) {
-        LOG(ERROR) << __func__ << ": err " << err;
-        mWriter->setError(mCommandIndex, err);
-    }
-}
-
-void ComposerCommandEngine::executeSetLayerBlendMode(int64_t display, int64_t layer,
-                                                     const ParcelableBlendMode& blendMode) {
-    auto err = mHal->setLayerBlendMode(display, layer, blendMode.blendMode);
-    if (err) {
-        LOG(ERROR) << __func__ << ": err " << err;
-        mWriter->setError(mCommandIndex, err);
-    }
-}
-
-void ComposerCommandEngine::executeSetLayerColor(int64_t display, int64_t layer,
-                                                 const Color& color) {
-    auto err = mHal->setLayerColor(display, layer, color);
-    if (err) {
-        LOG(ERROR) << __func__ << ": err " << err;
-        mWriter->setError(mCommandIndex, err);
-    }
-}
-
-void ComposerCommandEngine::executeSetLayerComposition(int64_t display, int64_t layer,
-                                                       const ParcelableComposition& composition) {
-    auto err = mHal->setLayerCompositionType(display, layer, composition.composition);
-    if (err) {
-        LOG(ERROR) << __func__ << ": err " << err;
-        mWriter->setError(mCommandIndex, err);
-    }
-}
-
-void ComposerCommandEngine::executeSetLayerDataspace(int64_t display, int64_t layer,
-                                                     const ParcelableDataspace& dataspace) {
-    auto err = mHal->setLayerDataspace(display, layer, dataspace.dataspace);
-    if (err) {
-        LOG(ERROR) << __func__ << ": err " << err;
-        mWriter->setError(mCommandIndex, err);
-    }
-}
-
-void ComposerCommandEngine::executeSetLayerDisplayFrame(int64_t display, int64_t layer,
-                                                        const common::Rect& rect) {
-    auto err = mHal->setLayerDisplayFrame(display, layer, rect);
-    if (err) {
-        LOG(ERROR) << __func__ << ": err " << err;
-        mWriter->setError(mCommandIndex, err);
-    }
-}
-
-void ComposerCommandEngine::executeSetLayerPlaneAlpha(int64_t display, int64_t layer,
-                                                      const PlaneAlpha& planeAlpha) {
-    auto err = mHal->setLayerPlaneAlpha(display, layer, planeAlpha.alpha);
-    if (err) {
-        LOG(ERROR) << __func__ << ": err " << err;
+        LOG(ERROR) << __func__ << ": getLayerBuffer err " << err;
         mWriter->setError(mCommandIndex, err);
+        return false;
     }
+    return true;
 }
 
 void ComposerCommandEngine::executeSetLayerSidebandStream(int64_t display, int64_t layer,
@@ -399,76 +505,4 @@ void ComposerCommandEngine::executeSetLayerSidebandStream(int64_t display, int64
     }
 }
 
-void ComposerCommandEngine::executeSetLayerSourceCrop(int64_t display, int64_t layer,
-                                                      const common::FRect& sourceCrop) {
-    auto err = mHal->setLayerSourceCrop(display, layer, sourceCrop);
-    if (err) {
-        LOG(ERROR) << __func__ << ": err " << err;
-        mWriter->setError(mCommandIndex, err);
-    }
-}
-
-void ComposerCommandEngine::executeSetLayerTransform(int64_t display, int64_t layer,
-                                                     const ParcelableTransform& transform) {
-    auto err = mHal->setLayerTransform(display, layer, transform.transform);
-    if (err) {
-        LOG(ERROR) << __func__ << ": err " << err;
-        mWriter->setError(mCommandIndex, err);
-    }
-}
-
-void ComposerCommandEngine::executeSetLayerVisibleRegion(int64_t display, int64_t layer,
-                          const std::vector<std::optional<common::Rect>>& visibleRegion) {
-    auto err = mHal->setLayerVisibleRegion(display, layer, visibleRegion);
-    if (err) {
-        LOG(ERROR) << __func__ << ": err " << err;
-        mWriter->setError(mCommandIndex, err);
-    }
-}
-
-void ComposerCommandEngine::executeSetLayerZOrder(int64_t display, int64_t layer,
-                                                  const ZOrder& zOrder) {
-    auto err = mHal->setLayerZOrder(display, layer, zOrder.z);
-    if (err) {
-        LOG(ERROR) << __func__ << ": err " << err;
-        mWriter->setError(mCommandIndex, err);
-    }
-}
-
-void ComposerCommandEngine::executeSetLayerPerFrameMetadata(int64_t display, int64_t layer,
-                const std::vector<std::optional<PerFrameMetadata>>& perFrameMetadata) {
-    auto err = mHal->setLayerPerFrameMetadata(display, layer, perFrameMetadata);
-    if (err) {
-        LOG(ERROR) << __func__ << ": err " << err;
-        mWriter->setError(mCommandIndex, err);
-    }
-}
-
-void ComposerCommandEngine::executeSetLayerColorTransform(int64_t display, int64_t layer,
-                                                       const std::vector<float>& matrix) {
-    auto err = mHal->setLayerColorTransform(display, layer, matrix);
-    if (err) {
-        LOG(ERROR) << __func__ << ": err " << err;
-        mWriter->setError(mCommandIndex, err);
-    }
-}
-
-void ComposerCommandEngine::executeSetLayerBrightness(int64_t display, int64_t layer,
-                                                      const LayerBrightness& brightness) {
-    auto err = mHal->setLayerBrightness(display, layer, brightness.brightness);
-    if (err) {
-        LOG(ERROR) << __func__ << ": err " << err;
-        mWriter->setError(mCommandIndex, err);
-    }
-}
-
-void ComposerCommandEngine::executeSetLayerPerFrameMetadataBlobs(int64_t display, int64_t layer,
-                      const std::vector<std::optional<PerFrameMetadataBlob>>& metadata) {
-    auto err = mHal->setLayerPerFrameMetadataBlobs(display, layer, metadata);
-    if (err) {
-        LOG(ERROR) << __func__ << ": err " << err;
-        mWriter->setError(mCommandIndex, err);
-    }
-}
-
 } // namespace aidl::android::hardware::graphics::composer3::impl
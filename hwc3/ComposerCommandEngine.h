@@ -19,13 +19,27 @@
 #include <android/hardware/graphics/composer3/ComposerServiceWriter.h>
 #include <utils/Mutex.h>
 
+#include <condition_variable>
+#include <functional>
 #include <memory>
+#include <mutex>
+#include <thread>
 
 #include "include/IComposerHal.h"
 #include "include/IResourceManager.h"
 
 namespace aidl::android::hardware::graphics::composer3::impl {
 
+/*
+ * ComposerClient keeps a pool of engines and runs each executeCommands() call
+ * on an idle one, so concurrent calls for different displays don't serialize.
+ * State is reset in place and the scratch vectors below keep their capacity,
+ * so a steady stream of frames doesn't allocate in the engine.
+ *
+ * When a batch carries commands for several displays and all of them report
+ * multi-threaded present support, the commands are grouped per display and
+ * the groups run concurrently, each on its own lane engine and thread.
+ */
 class ComposerCommandEngine {
   public:
       ComposerCommandEngine(IComposerHal* hal, IResourceManager* resources)
@@ -35,15 +49,46 @@ class ComposerCommandEngine {
       int32_t execute(const std::vector<DisplayCommand>& commands,
                       std::vector<CommandResultPayload>* result);
 
-      template <typename InputType, typename Functor>
-      void dispatchLayerCommand(int64_t display, int64_t layer, const std::string& funcName,
-                                const InputType input, const Functor func);
-
       void reset() {
           mWriter->reset();
+          mCommandIndex = 0;
+          mDisplaysPendingBrightnessChange.clear();
       }
 
   private:
+      // Runs posted tasks one at a time on a thread of its own
+      class LaneThread {
+        public:
+          LaneThread();
+          ~LaneThread();
+
+          void post(std::function<void()> task);
+          void wait();
+
+        private:
+          void run();
+
+          std::mutex mMutex;
+          std::condition_variable mCondition;
+          std::function<void()> mTask; // GUARDED_BY(mMutex)
+          bool mExit = false; // GUARDED_BY(mMutex)
+          std::thread mThread;
+      };
+
+      struct DisplayGroup {
+          int64_t display;
+          std::vector<size_t> indices;
+      };
+
+      bool groupCommandsByDisplay(const std::vector<DisplayCommand>& commands);
+      int32_t executeParallel(const std::vector<DisplayCommand>& commands,
+                              std::vector<CommandResultPayload>* result);
+      int32_t executeDisplayGroup(const std::vector<DisplayCommand>& commands,
+                                  const DisplayGroup& group,
+                                  std::vector<std::vector<CommandResultPayload>>& outResults);
+      void trackBrightnessChange(const DisplayCommand& command);
+      int32_t flushBrightnessChanges();
+
       void dispatchDisplayCommand(const DisplayCommand& displayCommand);
       void dispatchLayerCommand(int64_t display, const LayerCommand& displayCommand);
 
@@ -58,41 +103,13 @@ class ComposerCommandEngine {
               int64_t display, const std::optional<ClockMonotonicTimestamp> expectedPresentTime,
               int frameIntervalNs);
       void executeAcceptDisplayChanges(int64_t display);
+      bool canPresentSpeculatively(int64_t display, int32_t validateErr);
       int executePresentDisplay(int64_t display);
 
-      void executeSetLayerCursorPosition(int64_t display, int64_t layer,
-                                         const common::Point& cursorPosition);
-      void executeSetLayerBuffer(int64_t display, int64_t layer, const Buffer& buffer);
-      void executeSetLayerSurfaceDamage(int64_t display, int64_t layer,
-                                        const std::vector<std::optional<common::Rect>>& damage);
-      void executeSetLayerBlendMode(int64_t display, int64_t layer,
-                                    const ParcelableBlendMode& blendMode);
-      void executeSetLayerColor(int64_t display, int64_t layer, const Color& color);
-      void executeSetLayerComposition(int64_t display, int64_t layer,
-                                      const ParcelableComposition& composition);
-      void executeSetLayerDataspace(int64_t display, int64_t layer,
-                                    const ParcelableDataspace& dataspace);
-      void executeSetLayerDisplayFrame(int64_t display, int64_t layer, const common::Rect& rect);
-      void executeSetLayerPlaneAlpha(int64_t display, int64_t layer, const PlaneAlpha& planeAlpha);
+      bool executeGetLayerBuffer(int64_t display, int64_t layer, const Buffer& buffer,
+                                 buffer_handle_t& outHandle, IBufferReleaser* bufferReleaser);
       void executeSetLayerSidebandStream(int64_t display, int64_t layer,
                                          const AidlNativeHandle& sidebandStream);
-      void executeSetLayerSourceCrop(int64_t display, int64_t layer,
-                                     const common::FRect& sourceCrop);
-      void executeSetLayerTransform(int64_t display, int64_t layer,
-                                    const ParcelableTransform& transform);
-      void executeSetLayerVisibleRegion(
-              int64_t display, int64_t layer,
-              const std::vector<std::optional<common::Rect>>& visibleRegion);
-      void executeSetLayerZOrder(int64_t display, int64_t layer, const ZOrder& zOrder);
-      void executeSetLayerPerFrameMetadata(
-              int64_t display, int64_t layer,
-              const std::vector<std::optional<PerFrameMetadata>>& perFrameMetadata);
-      void executeSetLayerColorTransform(int64_t display, int64_t layer,
-                                         const std::vector<float>& colorTransform);
-      void executeSetLayerPerFrameMetadataBlobs(int64_t display, int64_t layer,
-              const std::vector<std::optional<PerFrameMetadataBlob>>& perFrameMetadataBlob);
-      void executeSetLayerBrightness(int64_t display, int64_t layer,
-                                     const LayerBrightness& brightness);
 
       int32_t executeValidateDisplayInternal(int64_t display);
       void executeSetExpectedPresentTimeInternal(
@@ -102,20 +119,35 @@ class ComposerCommandEngine {
       IComposerHal* mHal;
       IResourceManager* mResources;
       std::unique_ptr<ComposerServiceWriter> mWriter;
-      int32_t mCommandIndex;
-};
-
-template <typename InputType, typename Functor>
-void ComposerCommandEngine::dispatchLayerCommand(int64_t display, int64_t layer,
-                                                 const std::string& funcName, const InputType input,
-                                                 const Functor func) {
-    if (input) {
-        auto err = (mHal->*func)(display, layer, *input);
-        if (err) {
-            LOG(ERROR) << funcName << ": err " << err;
-            mWriter->setError(mCommandIndex, err);
-        }
-    }
+      int32_t mCommandIndex = 0;
+      // Whether the display command being dispatched set a client target
+      bool mClientTargetUpdated = false;
+
+      // Few displays at most, a vector beats a set and keeps its capacity
+      static constexpr size_t kReservedDisplays = 4;
+      std::vector<int64_t> mDisplaysPendingBrightnessChange;
+
+      // Reused outputs of validateDisplay and presentDisplay
+      static constexpr size_t kReservedLayers = 32;
+      std::vector<int64_t> mChangedLayers;
+      std::vector<Composition> mCompositionTypes;
+      std::vector<int64_t> mRequestedLayers;
+      std::vector<int32_t> mRequestMasks;
+      std::vector<int64_t> mReleasedLayers;
+
+      // Parallel execution. Group 0 runs on the calling thread, group i on
+      // mLanes[i - 1]. Results are gathered per command index and merged in
+      // order once every group is done. Only the first mGroupCount groups are
+      // in use, the rest are kept for their capacity.
+      struct Lane {
+          std::unique_ptr<ComposerCommandEngine> engine;
+          std::unique_ptr<LaneThread> thread;
+      };
+      std::vector<DisplayGroup> mGroups;
+      size_t mGroupCount = 0;
+      std::vector<int32_t> mGroupErrors;
+      std::vector<Lane> mLanes;
+      std::vector<std::vector<CommandResultPayload>> mCommandResults;
 };
 
 } // namespace aidl::android::hardware::graphics::composer3::impl
@@ -20,6 +20,10 @@
 #include <android-base/logging.h>
 #include <hardware/hwcomposer2.h>
 
+#include <algorithm>
+#include <functional>
+#include <string_view>
+
 #include "ExynosDevice.h"
 #include "ExynosDeviceModule.h"
 #include "ExynosDisplay.h"
@@ -261,7 +265,7 @@ int32_t HalImpl::destroyLayer(int64_t display, int64_t layer) {
     ExynosLayer *halLayer;
     RET_IF_ERR(getHalLayer(display, layer, halLayer));
 
-    return halDisplay->destroyLayer(reinterpret_cast<hwc2_layer_t>(halLayer));
+    return halDisplay->destroyLayer(halLayer->mHandle);
 }
 
 int32_t HalImpl::createVirtualDisplay(uint32_t width, uint32_t height, AidlPixelFormat format,
@@ -769,6 +773,15 @@ int32_t HalImpl::getHasClientComposition(int64_t display, bool& outHasClientComp
     return HWC2_ERROR_NONE;
 }
 
+int32_t HalImpl::getCompositionChanged(int64_t display, bool& outChanged) {
+    ExynosDisplay* halDisplay;
+    RET_IF_ERR(getHalDisplay(display, halDisplay));
+
+    outChanged = halDisplay->isCompositionChanged();
+
+    return HWC2_ERROR_NONE;
+}
+
 int32_t HalImpl::setColorMode(int64_t display, ColorMode mode, RenderIntent intent) {
     ExynosDisplay* halDisplay;
     RET_IF_ERR(getHalDisplay(display, halDisplay));
@@ -897,49 +910,108 @@ int32_t HalImpl::setLayerDisplayFrame(int64_t display, int64_t layer, const comm
     return halLayer->setLayerDisplayFrame(hwcFrame);
 }
 
-int32_t HalImpl::setLayerPerFrameMetadata(int64_t display, int64_t layer,
+// Serialized HDR metadata of the current call. Each binder thread keeps its
+// own, and its capacity, so a steady stream of frames doesn't allocate.
+static thread_local std::vector<uint8_t> gHdrPayload;
+
+static void appendPayload(const void* data, size_t size) {
+    auto bytes = static_cast<const uint8_t*>(data);
+    gHdrPayload.insert(gHdrPayload.end(), bytes, bytes + size);
+}
+
+static size_t hashPayload() {
+    return std::hash<std::string_view>{}(
+            std::string_view(reinterpret_cast<const char*>(gHdrPayload.data()),
+                             gHdrPayload.size()));
+}
+
+// HDR metadata goes from the AIDL vectors straight into the layer's meta
+// parcel, and not at all if the payload matches what the parcel holds.
+static int32_t setPerFrameMetadata(ExynosLayer* halLayer,
                            const std::vector<std::optional<PerFrameMetadata>>& metadata) {
-    ExynosLayer *halLayer;
-    RET_IF_ERR(getHalLayer(display, layer, halLayer));
+    gHdrPayload.clear();
+    for (const auto& entry : metadata) {
+        if (entry) {
+            appendPayload(&entry->key, sizeof(entry->key));
+            appendPayload(&entry->value, sizeof(entry->value));
+        }
+    }
+    const size_t hash = hashPayload();
 
-    uint32_t count = metadata.size();
-    std::vector<int32_t> keys;
-    std::vector<float> values;
+    bool changed;
+    RET_IF_ERR(halLayer->beginHdrMetadata(VIDEO_INFO_TYPE_HDR_STATIC, hash, gHdrPayload.data(),
+                                          gHdrPayload.size(), changed));
+    if (!changed) {
+        return HWC2_ERROR_NONE;
+    }
 
-    for (uint32_t ix = 0; ix < count; ++ix) {
-        if (metadata[ix]) {
+    for (const auto& entry : metadata) {
+        if (entry) {
             int32_t key;
-            a2h::translate(metadata[ix]->key, key);
-            keys.push_back(key);
-            values.push_back(metadata[ix]->value);
+            a2h::translate(entry->key, key);
+            RET_IF_ERR(halLayer->setHdrStaticMetadata(key, entry->value));
         }
     }
-
-    return halLayer->setLayerPerFrameMetadata(count, keys.data(), values.data());
+    halLayer->endHdrMetadata(VIDEO_INFO_TYPE_HDR_STATIC, hash, gHdrPayload.data(),
+                             gHdrPayload.size());
+    return HWC2_ERROR_NONE;
 }
 
-int32_t HalImpl::setLayerPerFrameMetadataBlobs(int64_t display, int64_t layer,
-                           const std::vector<std::optional<PerFrameMetadataBlob>>& blobs) {
+int32_t HalImpl::setLayerPerFrameMetadata(int64_t display, int64_t layer,
+                           const std::vector<std::optional<PerFrameMetadata>>& metadata) {
     ExynosLayer *halLayer;
     RET_IF_ERR(getHalLayer(display, layer, halLayer));
 
-    uint32_t count = blobs.size();
-    std::vector<int32_t> keys;
-    std::vector<uint32_t> sizes;
-    std::vector<uint8_t> values;
+    return setPerFrameMetadata(halLayer, metadata);
+}
 
-    for (uint32_t ix = 0; ix < count; ++ix) {
-        if (blobs[ix]) {
+static int32_t setPerFrameMetadataBlobs(ExynosLayer* halLayer,
+                           const std::vector<std::optional<PerFrameMetadataBlob>>& blobs) {
+    gHdrPayload.clear();
+    bool hasBlob = false;
+    for (const auto& entry : blobs) {
+        if (entry) {
+            // the size keeps the boundaries of consecutive blobs apart
+            const uint32_t size = static_cast<uint32_t>(entry->blob.size());
+            appendPayload(&entry->key, sizeof(entry->key));
+            appendPayload(&size, sizeof(size));
+            appendPayload(entry->blob.data(), entry->blob.size());
+            hasBlob = true;
+        }
+    }
+    if (!hasBlob) {
+        return HWC2_ERROR_NONE;
+    }
+    const size_t hash = hashPayload();
+
+    bool changed;
+    if (halLayer->beginHdrMetadata(VIDEO_INFO_TYPE_HDR_DYNAMIC, hash, gHdrPayload.data(),
+                                   gHdrPayload.size(), changed) != NO_ERROR) {
+        return HWC2_ERROR_UNSUPPORTED;
+    }
+    if (!changed) {
+        return HWC2_ERROR_NONE;
+    }
+
+    for (const auto& entry : blobs) {
+        if (entry) {
             int32_t key;
-            a2h::translate(blobs[ix]->key, key);
-            keys.push_back(key);
-            sizes.push_back(blobs[ix]->blob.size());
-            values.insert(values.end(), blobs[ix]->blob.begin(), blobs[ix]->blob.end());
+            a2h::translate(entry->key, key);
+            RET_IF_ERR(halLayer->setHdrDynamicMetadata(key, entry->blob.data(),
+                                                       entry->blob.size()));
         }
     }
+    halLayer->endHdrMetadata(VIDEO_INFO_TYPE_HDR_DYNAMIC, hash, gHdrPayload.data(),
+                             gHdrPayload.size());
+    return HWC2_ERROR_NONE;
+}
+
+int32_t HalImpl::setLayerPerFrameMetadataBlobs(int64_t display, int64_t layer,
+                           const std::vector<std::optional<PerFrameMetadataBlob>>& blobs) {
+    ExynosLayer *halLayer;
+    RET_IF_ERR(getHalLayer(display, layer, halLayer));
 
-    return halLayer->setLayerPerFrameMetadataBlobs(count, keys.data(), sizes.data(),
-                                                   values.data());
+    return setPerFrameMetadataBlobs(halLayer, blobs);
 }
 
 int32_t HalImpl::setLayerPlaneAlpha(int64_t display, int64_t layer, float alpha) {
@@ -1012,6 +1084,132 @@ int32_t HalImpl::setLayerZOrder(int64_t display, int64_t layer, uint32_t z) {
     return halLayer->setLayerZOrder(z);
 }
 
+static bool isSameRegion(const ::android::Vector<hwc_rect_t>& current,
+                         const std::vector<std::optional<common::Rect>>& region) {
+    size_t i = 0;
+    for (const auto& rect : region) {
+        if (!rect) {
+            continue;
+        }
+        if (i >= current.size()) {
+            return false;
+        }
+        const hwc_rect_t& cur = current[i++];
+        if (cur.left != rect->left || cur.top != rect->top || cur.right != rect->right ||
+            cur.bottom != rect->bottom) {
+            return false;
+        }
+    }
+    return i == current.size();
+}
+
+static bool isSameColorTransform(const ExynosLayer& halLayer, const std::vector<float>& matrix) {
+    const auto& current = halLayer.mLayerColorTransform;
+    return current.enable && matrix.size() >= current.mat.size() &&
+            std::equal(current.mat.begin(), current.mat.end(), matrix.begin());
+}
+
+int32_t HalImpl::applyLayerState(int64_t display, int64_t layer, const LayerCommand& command,
+                                 const buffer_handle_t* buffer) {
+    ExynosLayer *halLayer;
+    RET_IF_ERR(getHalLayer(display, layer, halLayer));
+
+    // Keep going after a failed field like the single setters do, the first
+    // error is the one reported back.
+    int32_t err = HWC2_ERROR_NONE;
+    const auto check = [&err](int32_t ret) {
+        if (ret != HWC2_ERROR_NONE && err == HWC2_ERROR_NONE) {
+            err = ret;
+        }
+    };
+
+    // The setters drop unchanged values themselves. The checks below only
+    // cover the fields whose setters would copy or validate regardless.
+    halLayer->beginStateUpdate();
+    if (command.cursorPosition) {
+        check(halLayer->setCursorPosition(command.cursorPosition->x,
+                                          command.cursorPosition->y));
+    }
+    if (command.buffer && buffer) {
+        int32_t hwcFd;
+        a2h::translate(command.buffer->fence, hwcFd);
+        check(halLayer->setLayerBuffer(*buffer, hwcFd));
+    }
+    if (command.damage && !isSameRegion(halLayer->mDamageRects, *command.damage)) {
+        std::vector<hwc_rect_t> hwcDamage;
+        a2h::translate(*command.damage, hwcDamage);
+        hwc_region_t region = { hwcDamage.size(), hwcDamage.data() };
+        check(halLayer->setLayerSurfaceDamage(region));
+    }
+    if (command.blendMode) {
+        int32_t hwcMode;
+        a2h::translate(command.blendMode->blendMode, hwcMode);
+        check(halLayer->setLayerBlendMode(hwcMode));
+    }
+    if (command.color) {
+        hwc_color_t hwcColor;
+        a2h::translate(*command.color, hwcColor);
+        check(halLayer->setLayerColor(hwcColor));
+    }
+    if (command.composition) {
+        int32_t hwcType;
+        a2h::translate(command.composition->composition, hwcType);
+        check(halLayer->setLayerCompositionType(hwcType));
+    }
+    if (command.dataspace) {
+        int32_t hwcDataspace;
+        a2h::translate(command.dataspace->dataspace, hwcDataspace);
+        check(halLayer->setLayerDataspace(hwcDataspace));
+    }
+    if (command.displayFrame) {
+        hwc_rect_t hwcFrame;
+        a2h::translate(*command.displayFrame, hwcFrame);
+        check(halLayer->setLayerDisplayFrame(hwcFrame));
+    }
+    if (command.planeAlpha) {
+        check(halLayer->setLayerPlaneAlpha(command.planeAlpha->alpha));
+    }
+    if (command.sourceCrop) {
+        hwc_frect_t hwcCrop;
+        a2h::translate(*command.sourceCrop, hwcCrop);
+        check(halLayer->setLayerSourceCrop(hwcCrop));
+    }
+    if (command.transform) {
+        int32_t hwcTransform;
+        a2h::translate(command.transform->transform, hwcTransform);
+        check(halLayer->setLayerTransform(hwcTransform));
+    }
+    if (command.visibleRegion) {
+        std::vector<hwc_rect_t> hwcVisible;
+        a2h::translate(*command.visibleRegion, hwcVisible);
+        hwc_region_t region = { hwcVisible.size(), hwcVisible.data() };
+        check(halLayer->setLayerVisibleRegion(region));
+    }
+    if (command.z) {
+        check(halLayer->setLayerZOrder(command.z->z));
+    }
+    if (command.colorTransform && !isSameColorTransform(*halLayer, *command.colorTransform)) {
+        check(halLayer->setLayerColorTransform(command.colorTransform->data()));
+    }
+    if (command.brightness) {
+        check(halLayer->setLayerBrightness(command.brightness->brightness));
+    }
+    if (command.perFrameMetadata) {
+        check(setPerFrameMetadata(halLayer, *command.perFrameMetadata));
+    }
+    if (command.perFrameMetadataBlob) {
+        check(setPerFrameMetadataBlobs(halLayer, *command.perFrameMetadataBlob));
+    }
+    if (command.blockingRegion) {
+        std::vector<hwc_rect_t> halBlockingRegion;
+        a2h::translate(*command.blockingRegion, halBlockingRegion);
+        check(halLayer->setLayerBlockingRegion(halBlockingRegion));
+    }
+    halLayer->endStateUpdate();
+
+    return err;
+}
+
 int32_t HalImpl::setOutputBuffer(int64_t display, buffer_handle_t buffer,
                                  const ndk::ScopedFileDescriptor& releaseFence) {
     ExynosDisplay* halDisplay;
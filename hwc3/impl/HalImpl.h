@@ -105,6 +105,7 @@ class HalImpl : public IComposerHal {
                             const ndk::ScopedFileDescriptor& fence, common::Dataspace dataspace,
                             const std::vector<common::Rect>& damage) override;
     int32_t getHasClientComposition(int64_t display, bool& outHasClientComp) override;
+    int32_t getCompositionChanged(int64_t display, bool& outChanged) override;
     int32_t setColorMode(int64_t display, ColorMode mode, RenderIntent intent) override;
     int32_t setColorTransform(int64_t display, const std::vector<float>& matrix) override;
     int32_t setContentType(int64_t display, ContentType contentType) override;
@@ -138,6 +139,8 @@ class HalImpl : public IComposerHal {
                           const std::vector<std::optional<common::Rect>>& visible) override;
     int32_t setLayerBrightness(int64_t display, int64_t layer, float brightness) override;
     int32_t setLayerZOrder(int64_t display, int64_t layer, uint32_t z) override;
+    int32_t applyLayerState(int64_t display, int64_t layer, const LayerCommand& command,
+                            const buffer_handle_t* buffer) override;
     int32_t setOutputBuffer(int64_t display, buffer_handle_t buffer,
                             const ndk::ScopedFileDescriptor& releaseFence) override;
     int32_t setPowerMode(int64_t display, PowerMode mode) override;
@@ -15,237 +15,372 @@
  */
 
 #include <aidlcommonsupport/NativeHandle.h>
+#include <hardware/hwcomposer2.h>
+
+#include <array>
 
 #include "ResourceManager.h"
 #include "TranslateHwcAidl.h"
 
-using android::hardware::graphics::composer::V2_1::Display;
 using android::hardware::graphics::composer::V2_1::Error;
-using android::hardware::graphics::composer::V2_1::Layer;
+
+namespace {
+
+// Binder threads create and drop releasers in pairs, so a few free blocks
+// per thread serve nearly every allocation without taking a lock.
+struct ReleaserFreeList {
+    static constexpr size_t kMaxBlocks = 16;
+    std::array<void*, kMaxBlocks> blocks;
+    size_t count = 0;
+
+    ~ReleaserFreeList() {
+        while (count > 0) {
+            ::operator delete(blocks[--count]);
+        }
+    }
+};
+
+thread_local ReleaserFreeList gReleaserFreeList;
+
+} // namespace
 
 namespace aidl::android::hardware::graphics::composer3::impl {
 
 std::unique_ptr<IResourceManager> IResourceManager::create() {
-    return std::make_unique<ResourceManager>();
+    auto resources = std::make_unique<ResourceManager>();
+    if (!resources->init()) {
+        return nullptr;
+    }
+    return resources;
 }
 
-std::unique_ptr<IBufferReleaser> ResourceManager::createReleaser(bool isBuffer) {
-    return std::make_unique<BufferReleaser>(isBuffer);
+void BufferReleaser::reset(ComposerHandleImporter* importer, const native_handle_t* handle) {
+    if (mHandle) {
+        if (mIsBuffer) {
+            mImporter->freeBuffer(mHandle);
+        } else {
+            mImporter->freeStream(mHandle);
+        }
+    }
+    mImporter = importer;
+    mHandle = handle;
 }
 
-void ResourceManager::clear(RemoveDisplay removeDisplay) {
-    mResources->clear([removeDisplay](Display hwcDisplay, bool isVirtual,
-                                      const std::vector<Layer> hwcLayers) {
-        int64_t display;
-        std::vector<int64_t> layers;
-        h2a::translate(hwcDisplay, display);
-        h2a::translate(hwcLayers, layers);
+void* BufferReleaser::operator new(size_t size) {
+    auto& freeList = gReleaserFreeList;
+    if (size == sizeof(BufferReleaser) && freeList.count > 0) {
+        return freeList.blocks[--freeList.count];
+    }
+    return ::operator new(size);
+}
 
-        removeDisplay(display, isVirtual, layers);
-    });
+void BufferReleaser::operator delete(void* ptr) {
+    auto& freeList = gReleaserFreeList;
+    if (ptr && freeList.count < ReleaserFreeList::kMaxBlocks) {
+        freeList.blocks[freeList.count++] = ptr;
+        return;
+    }
+    ::operator delete(ptr);
 }
 
-bool ResourceManager::hasDisplay(int64_t display) {
-    Display hwcDisplay;
-    a2h::translate(display, hwcDisplay);
+ResourceManager::DisplayResource::~DisplayResource() {
+    for (auto handle : mClientTargets) {
+        if (handle) mImporter.freeBuffer(handle);
+    }
+    for (auto handle : mOutputBuffers) {
+        if (handle) mImporter.freeBuffer(handle);
+    }
+    if (mReadbackBuffer) mImporter.freeBuffer(mReadbackBuffer);
+    for (const auto& [id, layer] : mLayers) {
+        releaseLayer(layer);
+    }
+}
 
-    return mResources->hasDisplay(hwcDisplay);
+void ResourceManager::DisplayResource::releaseLayer(const LayerResource& layer) {
+    for (auto handle : layer.buffers) {
+        if (handle) mImporter.freeBuffer(handle);
+    }
+    if (layer.sidebandStream) mImporter.freeStream(layer.sidebandStream);
 }
 
-int32_t ResourceManager::addPhysicalDisplay(int64_t display) {
-    Display hwcDisplay;
-    a2h::translate(display, hwcDisplay);
+const native_handle_t** ResourceManager::DisplayResource::getSlot(Cache cache, int64_t layer,
+                                                                  uint32_t slot,
+                                                                  int32_t& outErr) {
+    std::vector<const native_handle_t*>* slots = nullptr;
+    switch (cache) {
+        case Cache::CLIENT_TARGET:
+            slots = &mClientTargets;
+            break;
+        case Cache::OUTPUT_BUFFER:
+            slots = &mOutputBuffers;
+            break;
+        case Cache::READBACK_BUFFER:
+            return &mReadbackBuffer;
+        case Cache::LAYER_BUFFER:
+        case Cache::LAYER_SIDEBAND_STREAM: {
+            auto it = mLayers.find(layer);
+            if (it == mLayers.end()) {
+                outErr = HWC2_ERROR_BAD_LAYER;
+                return nullptr;
+            }
+            if (cache == Cache::LAYER_SIDEBAND_STREAM) {
+                return &it->second.sidebandStream;
+            }
+            slots = &it->second.buffers;
+            break;
+        }
+    }
+
+    if (slot >= slots->size()) {
+        outErr = HWC2_ERROR_BAD_PARAMETER;
+        return nullptr;
+    }
+    return &(*slots)[slot];
+}
 
-    Error hwcErr = mResources->addPhysicalDisplay(hwcDisplay);
+bool ResourceManager::init() {
+    return mImporter.init();
+}
 
-    int32_t err;
-    h2a::translate(hwcErr, err);
-    return err;
+std::unique_ptr<IBufferReleaser> ResourceManager::createReleaser(bool isBuffer) {
+    return std::make_unique<BufferReleaser>(isBuffer);
+}
+
+std::shared_ptr<ResourceManager::DisplayResource> ResourceManager::findDisplay(int64_t display) {
+    std::shared_lock lock(mDisplaysMutex);
+    auto it = mDisplays.find(display);
+    return it == mDisplays.end() ? nullptr : it->second;
 }
 
+void ResourceManager::clear(RemoveDisplay removeDisplay) {
+    std::unique_lock lock(mDisplaysMutex);
+    for (const auto& [display, displayResource] : mDisplays) {
+        std::vector<int64_t> layers;
+        {
+            std::lock_guard displayLock(displayResource->mMutex);
+            layers.reserve(displayResource->mLayers.size());
+            for (const auto& [layer, layerResource] : displayResource->mLayers) {
+                layers.push_back(layer);
+            }
+        }
+
+        removeDisplay(display, displayResource->mIsVirtual, layers);
+    }
+    mDisplays.clear();
+}
 
-int32_t ResourceManager::addVirtualDisplay(int64_t display, uint32_t outputBufferCacheSize) {
-    Display hwcDisplay;
-    a2h::translate(display, hwcDisplay);
+bool ResourceManager::hasDisplay(int64_t display) {
+    std::shared_lock lock(mDisplaysMutex);
+    return mDisplays.find(display) != mDisplays.end();
+}
 
-    Error hwcErr = mResources->addVirtualDisplay(hwcDisplay, outputBufferCacheSize);
+int32_t ResourceManager::addDisplay(int64_t display, bool isVirtual,
+                                    uint32_t outputBufferCacheSize) {
+    auto displayResource =
+            std::make_shared<DisplayResource>(mImporter, isVirtual, outputBufferCacheSize);
 
-    int32_t err;
-    h2a::translate(hwcErr, err);
-    return err;
+    std::unique_lock lock(mDisplaysMutex);
+    if (!mDisplays.emplace(display, std::move(displayResource)).second) {
+        return HWC2_ERROR_BAD_PARAMETER;
+    }
+    return HWC2_ERROR_NONE;
 }
 
-int32_t ResourceManager::removeDisplay(int64_t display) {
-    Display hwcDisplay;
-    a2h::translate(display, hwcDisplay);
+int32_t ResourceManager::addPhysicalDisplay(int64_t display) {
+    return addDisplay(display, false /* isVirtual */, 0);
+}
 
-    Error hwcErr = mResources->removeDisplay(hwcDisplay);
+int32_t ResourceManager::addVirtualDisplay(int64_t display, uint32_t outputBufferCacheSize) {
+    return addDisplay(display, true /* isVirtual */, outputBufferCacheSize);
+}
 
-    int32_t err;
-    h2a::translate(hwcErr, err);
-    return err;
+int32_t ResourceManager::removeDisplay(int64_t display) {
+    std::shared_ptr<DisplayResource> displayResource;
+    {
+        std::unique_lock lock(mDisplaysMutex);
+        auto it = mDisplays.find(display);
+        if (it == mDisplays.end()) {
+            return HWC2_ERROR_BAD_DISPLAY;
+        }
+        displayResource = std::move(it->second);
+        mDisplays.erase(it);
+    }
+
+    // The handles are freed when the last reference goes, outside of the lock
+    return HWC2_ERROR_NONE;
 }
 
 int32_t ResourceManager::setDisplayClientTargetCacheSize(int64_t display,
                                                          uint32_t clientTargetCacheSize) {
-    Display hwcDisplay;
-    a2h::translate(display, hwcDisplay);
-
-    Error hwcErr = mResources->setDisplayClientTargetCacheSize(hwcDisplay, clientTargetCacheSize);
-
-    int32_t err;
-    h2a::translate(hwcErr, err);
-    return err;
+    auto displayResource = findDisplay(display);
+    if (!displayResource) {
+        return HWC2_ERROR_BAD_DISPLAY;
+    }
+
+    std::lock_guard lock(displayResource->mMutex);
+    if (displayResource->mClientTargetsInitialized) {
+        return HWC2_ERROR_BAD_PARAMETER;
+    }
+    displayResource->mClientTargets.assign(clientTargetCacheSize, nullptr);
+    displayResource->mClientTargetsInitialized = true;
+    return HWC2_ERROR_NONE;
 }
 
 int32_t ResourceManager::getDisplayClientTargetCacheSize(int64_t display, size_t* outCacheSize) {
-    Display hwcDisplay;
-    a2h::translate(display, hwcDisplay);
-
-    Error hwcErr = mResources->getDisplayClientTargetCacheSize(hwcDisplay, outCacheSize);
-
-    int32_t err;
-    h2a::translate(hwcErr, err);
-    return err;
+    auto displayResource = findDisplay(display);
+    if (!displayResource) {
+        return HWC2_ERROR_BAD_DISPLAY;
+    }
+
+    std::lock_guard lock(displayResource->mMutex);
+    if (!displayResource->mClientTargetsInitialized) {
+        return HWC2_ERROR_BAD_DISPLAY;
+    }
+    *outCacheSize = displayResource->mClientTargets.size();
+    return HWC2_ERROR_NONE;
 }
 
 int32_t ResourceManager::getDisplayOutputBufferCacheSize(int64_t display, size_t* outCacheSize) {
-    Display hwcDisplay;
-    a2h::translate(display, hwcDisplay);
-
-    Error hwcErr = mResources->getDisplayOutputBufferCacheSize(hwcDisplay, outCacheSize);
-
-    int32_t err;
-    h2a::translate(hwcErr, err);
-    return err;
+    auto displayResource = findDisplay(display);
+    if (!displayResource) {
+        return HWC2_ERROR_BAD_DISPLAY;
+    }
+
+    std::lock_guard lock(displayResource->mMutex);
+    *outCacheSize = displayResource->mOutputBuffers.size();
+    return HWC2_ERROR_NONE;
 }
 
 int32_t ResourceManager::addLayer(int64_t display, int64_t layer, uint32_t bufferCacheSize) {
-    Display hwcDisplay;
-    Layer hwcLayer;
-
-    a2h::translate(display, hwcDisplay);
-    a2h::translate(layer, hwcLayer);
-
-    Error hwcErr = mResources->addLayer(hwcDisplay, hwcLayer, bufferCacheSize);
-
-    int32_t err;
-    h2a::translate(hwcErr, err);
-    return err;
+    auto displayResource = findDisplay(display);
+    if (!displayResource) {
+        return HWC2_ERROR_BAD_DISPLAY;
+    }
+
+    LayerResource layerResource;
+    layerResource.buffers.assign(bufferCacheSize, nullptr);
+
+    std::lock_guard lock(displayResource->mMutex);
+    if (!displayResource->mLayers.emplace(layer, std::move(layerResource)).second) {
+        return HWC2_ERROR_BAD_LAYER;
+    }
+    return HWC2_ERROR_NONE;
 }
 
 int32_t ResourceManager::removeLayer(int64_t display, int64_t layer) {
-    Display hwcDisplay;
-    Layer hwcLayer;
-
-    a2h::translate(display, hwcDisplay);
-    a2h::translate(layer, hwcLayer);
-    Error hwcErr = mResources->removeLayer(hwcDisplay, hwcLayer);
-
-    int32_t err;
-    h2a::translate(hwcErr, err);
-    return err;
+    auto displayResource = findDisplay(display);
+    if (!displayResource) {
+        return HWC2_ERROR_BAD_DISPLAY;
+    }
+
+    LayerResource layerResource;
+    {
+        std::lock_guard lock(displayResource->mMutex);
+        auto it = displayResource->mLayers.find(layer);
+        if (it == displayResource->mLayers.end()) {
+            return HWC2_ERROR_BAD_LAYER;
+        }
+        layerResource = std::move(it->second);
+        displayResource->mLayers.erase(it);
+    }
+
+    displayResource->releaseLayer(layerResource);
+    return HWC2_ERROR_NONE;
 }
 
 void ResourceManager::setDisplayMustValidateState(int64_t display, bool mustValidate) {
-    Display hwcDisplay;
-    a2h::translate(display, hwcDisplay);
-
-    mResources->setDisplayMustValidateState(hwcDisplay, mustValidate);
+    auto displayResource = findDisplay(display);
+    if (displayResource) {
+        displayResource->mMustValidate = mustValidate;
+    }
 }
 
 bool ResourceManager::mustValidateDisplay(int64_t display) {
-    Display hwcDisplay;
-    a2h::translate(display, hwcDisplay);
-
-    return mResources->mustValidateDisplay(hwcDisplay);
+    auto displayResource = findDisplay(display);
+    return displayResource ? displayResource->mMustValidate.load() : false;
 }
 
-int32_t ResourceManager::getDisplayReadbackBuffer(int64_t display, const buffer_handle_t handle,
-                                                  buffer_handle_t& outHandle,
-                                                  IBufferReleaser* bufReleaser) {
-    Display hwcDisplay;
-    a2h::translate(display, hwcDisplay);
-
+int32_t ResourceManager::getHandle(int64_t display, int64_t layer, uint32_t slot, Cache cache,
+                                   bool fromCache, const buffer_handle_t rawHandle,
+                                   buffer_handle_t& outHandle, IBufferReleaser* bufReleaser) {
     // dynamic_cast is not available
     auto br = static_cast<BufferReleaser*>(bufReleaser);
-    Error hwcErr = mResources->getDisplayReadbackBuffer(hwcDisplay, handle, &outHandle,
-                                                        br->getReplacedHandle());
 
-    int32_t err;
-    h2a::translate(hwcErr, err);
+    // import outside of any lock, the raw handle is ignored for cache lookups
+    const native_handle_t* importedHandle = nullptr;
+    if (!fromCache) {
+        Error hwcErr = br->isBuffer() ? mImporter.importBuffer(rawHandle, &importedHandle)
+                                      : mImporter.importStream(rawHandle, &importedHandle);
+        if (hwcErr != Error::NONE) {
+            int32_t err;
+            h2a::translate(hwcErr, err);
+            return err;
+        }
+    }
+
+    int32_t err = HWC2_ERROR_NONE;
+    auto displayResource = findDisplay(display);
+    if (!displayResource) {
+        err = HWC2_ERROR_BAD_DISPLAY;
+    } else {
+        std::lock_guard lock(displayResource->mMutex);
+        auto handle = displayResource->getSlot(cache, layer, slot, err);
+        if (handle && fromCache) {
+            outHandle = *handle;
+        } else if (handle) {
+            br->reset(&mImporter, *handle);
+            *handle = importedHandle;
+            outHandle = importedHandle;
+        }
+    }
+
+    if (err != HWC2_ERROR_NONE && importedHandle) {
+        if (br->isBuffer()) {
+            mImporter.freeBuffer(importedHandle);
+        } else {
+            mImporter.freeStream(importedHandle);
+        }
+    }
     return err;
 }
 
+int32_t ResourceManager::getDisplayReadbackBuffer(int64_t display, const buffer_handle_t handle,
+                                                  buffer_handle_t& outHandle,
+                                                  IBufferReleaser* bufReleaser) {
+    return getHandle(display, 0, 0, Cache::READBACK_BUFFER, false /* fromCache */, handle,
+                     outHandle, bufReleaser);
+}
+
 int32_t ResourceManager::getDisplayClientTarget(int64_t display, uint32_t slot, bool fromCache,
                                                 const buffer_handle_t handle,
                                                 buffer_handle_t& outHandle,
                                                 IBufferReleaser* bufReleaser) {
-    Display hwcDisplay;
-    a2h::translate(display, hwcDisplay);
-
-    auto br = static_cast<BufferReleaser*>(bufReleaser);
-    Error hwcErr = mResources->getDisplayClientTarget(hwcDisplay, slot, fromCache, handle,
-                                                      &outHandle, br->getReplacedHandle());
-
-    int32_t err;
-    h2a::translate(hwcErr, err);
-    return err;
+    return getHandle(display, 0, slot, Cache::CLIENT_TARGET, fromCache, handle, outHandle,
+                     bufReleaser);
 }
 
 int32_t ResourceManager::getDisplayOutputBuffer(int64_t display, uint32_t slot, bool fromCache,
                                    const buffer_handle_t handle,
                                    buffer_handle_t& outHandle,
                                    IBufferReleaser* bufReleaser) {
-    Display hwcDisplay;
-    a2h::translate(display, hwcDisplay);
-
-    auto br = static_cast<BufferReleaser*>(bufReleaser);
-    Error hwcErr = mResources->getDisplayOutputBuffer(hwcDisplay, slot, fromCache, handle,
-                                                      &outHandle, br->getReplacedHandle());
-
-    int32_t err;
-    h2a::translate(hwcErr, err);
-    return err;
+    return getHandle(display, 0, slot, Cache::OUTPUT_BUFFER, fromCache, handle, outHandle,
+                     bufReleaser);
 }
 
 int32_t ResourceManager::getLayerBuffer(int64_t display, int64_t layer, uint32_t slot,
                                         bool fromCache, const buffer_handle_t rawHandle,
                                         buffer_handle_t& outBufferHandle,
                                         IBufferReleaser* bufReleaser) {
-    Display hwcDisplay;
-    a2h::translate(display, hwcDisplay);
-
-    Layer hwcLayer;
-    a2h::translate(layer, hwcLayer);
-
-    auto br = static_cast<BufferReleaser*>(bufReleaser);
-    Error hwcErr = mResources->getLayerBuffer(hwcDisplay, hwcLayer, slot, fromCache,
-                                                rawHandle, &outBufferHandle,
-                                                br->getReplacedHandle());
-
-    int32_t err;
-    h2a::translate(hwcErr, err);
-    return err;
+    return getHandle(display, layer, slot, Cache::LAYER_BUFFER, fromCache, rawHandle,
+                     outBufferHandle, bufReleaser);
 }
 
 int32_t ResourceManager::getLayerSidebandStream(int64_t display, int64_t layer,
                                                 const buffer_handle_t rawHandle,
                                                 buffer_handle_t& outStreamHandle,
                                                 IBufferReleaser* bufReleaser) {
-    Display hwcDisplay;
-    a2h::translate(display, hwcDisplay);
-
-    Layer hwcLayer;
-    a2h::translate(layer, hwcLayer);
-
-    auto br = static_cast<BufferReleaser*>(bufReleaser);
-    Error hwcErr = mResources->getLayerSidebandStream(hwcDisplay, hwcLayer, rawHandle,
-                                                      &outStreamHandle, br->getReplacedHandle());
-
-    int32_t err;
-    h2a::translate(hwcErr, err);
-    return err;
+    return getHandle(display, layer, 0, Cache::LAYER_SIDEBAND_STREAM, false /* fromCache */,
+                     rawHandle, outStreamHandle, bufReleaser);
 }
 
 } // namespace aidl::android::hardware::graphics::composer3::impl
@@ -18,29 +18,46 @@
 
 #include <composer-resources/2.2/ComposerResources.h>
 
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
 #include "include/IResourceManager.h"
 
-using android::hardware::graphics::composer::V2_2::hal::ComposerResources;
+using android::hardware::graphics::composer::V2_1::hal::ComposerHandleImporter;
 
 namespace aidl::android::hardware::graphics::composer3::impl {
 
-// Wrapper of ComposerResources before there is an aidl version
-class BufferReleaser : public IBufferReleaser {
+// Holds the handle replaced in a cache slot and releases it at destruction.
+// One is created for every buffer update, so their storage is recycled
+// through a per thread free list instead of the heap.
+class BufferReleaser final : public IBufferReleaser {
   public:
-    BufferReleaser(bool isBuffer) : mReplacedHandle(isBuffer) {}
-    virtual ~BufferReleaser() = default;
+    BufferReleaser(bool isBuffer) : mIsBuffer(isBuffer) {}
+    virtual ~BufferReleaser() { reset(); }
+
+    bool isBuffer() const { return mIsBuffer; }
+    void reset(ComposerHandleImporter* importer = nullptr,
+               const native_handle_t* handle = nullptr);
 
-    ComposerResources::ReplacedHandle* getReplacedHandle() { return &mReplacedHandle; }
+    static void* operator new(size_t size);
+    static void operator delete(void* ptr);
 
   private:
-    // ReplacedHandle releases buffer at its destruction.
-    ComposerResources::ReplacedHandle mReplacedHandle;
+    const bool mIsBuffer;
+    ComposerHandleImporter* mImporter = nullptr;
+    const native_handle_t* mHandle = nullptr;
 };
 
 class ResourceManager : public IResourceManager {
   public:
     virtual ~ResourceManager() = default;
 
+    bool init();
+
     std::unique_ptr<IBufferReleaser> createReleaser(bool isBuffer) override;
     void clear(RemoveDisplay removeDisplay) override;
     bool hasDisplay(int64_t display) override;
@@ -73,7 +90,60 @@ class ResourceManager : public IResourceManager {
                                    buffer_handle_t& outStreamHandle,
                                    IBufferReleaser* bufReleaser) override;
   private:
-    std::unique_ptr<ComposerResources> mResources = ComposerResources::create();
+    enum class Cache {
+        CLIENT_TARGET,
+        OUTPUT_BUFFER,
+        READBACK_BUFFER,
+        LAYER_BUFFER,
+        LAYER_SIDEBAND_STREAM,
+    };
+
+    // Slot arrays are sized when the display or layer is added and never
+    // grow, a lookup is an index into them.
+    struct LayerResource {
+        std::vector<const native_handle_t*> buffers;
+        const native_handle_t* sidebandStream = nullptr;
+    };
+
+    class DisplayResource {
+      public:
+        DisplayResource(ComposerHandleImporter& importer, bool isVirtual,
+                        uint32_t outputBufferCacheSize)
+              : mImporter(importer),
+                mIsVirtual(isVirtual),
+                mOutputBuffers(outputBufferCacheSize, nullptr) {}
+        ~DisplayResource();
+
+        const native_handle_t** getSlot(Cache cache, int64_t layer, uint32_t slot,
+                                        int32_t& outErr);
+        void releaseLayer(const LayerResource& layer);
+
+        ComposerHandleImporter& mImporter;
+        const bool mIsVirtual;
+        std::atomic<bool> mMustValidate{true};
+
+        // Protects everything below, each display has its own lock so
+        // displays don't contend on buffer updates
+        std::mutex mMutex;
+        bool mClientTargetsInitialized = false; // GUARDED_BY(mMutex)
+        std::vector<const native_handle_t*> mClientTargets; // GUARDED_BY(mMutex)
+        std::vector<const native_handle_t*> mOutputBuffers; // GUARDED_BY(mMutex)
+        const native_handle_t* mReadbackBuffer = nullptr; // GUARDED_BY(mMutex)
+        std::unordered_map<int64_t, LayerResource> mLayers; // GUARDED_BY(mMutex)
+    };
+
+    std::shared_ptr<DisplayResource> findDisplay(int64_t display);
+    int32_t addDisplay(int64_t display, bool isVirtual, uint32_t outputBufferCacheSize);
+    int32_t getHandle(int64_t display, int64_t layer, uint32_t slot, Cache cache,
+                      bool fromCache, const buffer_handle_t rawHandle,
+                      buffer_handle_t& outHandle, IBufferReleaser* bufReleaser);
+
+    ComposerHandleImporter mImporter;
+
+    // Only taken exclusively to add or remove displays
+    std::shared_mutex mDisplaysMutex;
+    std::unordered_map<int64_t, std::shared_ptr<DisplayResource>>
+            mDisplays; // GUARDED_BY(mDisplaysMutex)
 };
 
 } // namespace aidl::android::hardware::graphics::composer3::impl
@@ -182,6 +182,7 @@ class IComposerHal {
                                     common::Dataspace dataspace,
                                     const std::vector<common::Rect>& damage) = 0; // cmd
     virtual int32_t getHasClientComposition(int64_t display, bool& outHasClientComp) = 0;
+    virtual int32_t getCompositionChanged(int64_t display, bool& outChanged) = 0;
     virtual int32_t setColorMode(int64_t display, ColorMode mode, RenderIntent intent) = 0;
     virtual int32_t setColorTransform(int64_t display, const std::vector<float>& matrix) = 0; // cmd
     virtual int32_t setContentType(int64_t display, ContentType contentType) = 0;
@@ -219,6 +220,10 @@ class IComposerHal {
                                  const std::vector<std::optional<common::Rect>>& visible) = 0;
     virtual int32_t setLayerBrightness(int64_t display, int64_t layer, float brightness) = 0;
     virtual int32_t setLayerZOrder(int64_t display, int64_t layer, uint32_t z) = 0;
+    // Applies every field of a layer command but the sideband stream. buffer is
+    // the resolved handle of command.buffer, or null to leave the buffer alone.
+    virtual int32_t applyLayerState(int64_t display, int64_t layer, const LayerCommand& command,
+                                    const buffer_handle_t* buffer) = 0;
     virtual int32_t setOutputBuffer(int64_t display, buffer_handle_t buffer,
                                     const ndk::ScopedFileDescriptor& releaseFence) = 0;
     virtual int32_t setPowerMode(int64_t display, PowerMode mode) = 0;
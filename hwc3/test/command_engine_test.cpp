@@ -0,0 +1,331 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <hardware/hwcomposer2.h>
+
+#include <cstdlib>
+#include <new>
+
+#include "ComposerCommandEngine.h"
+#include "ResourceManager.h"
+
+namespace {
+
+// Heap allocations made by the test thread while counting is on. Other
+// threads and the gtest bookkeeping around the counted frames are ignored.
+thread_local bool gCountAllocations = false;
+thread_local size_t gAllocations = 0;
+
+} // namespace
+
+// new[], the nothrow forms and sized delete all forward to these two
+void* operator new(size_t size) {
+    if (gCountAllocations) {
+        ++gAllocations;
+    }
+    void* ptr = malloc(size ? size : 1);
+    if (!ptr) {
+        abort();
+    }
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+    free(ptr);
+}
+
+namespace aidl::android::hardware::graphics::composer3::impl {
+namespace {
+
+constexpr int64_t kDisplay = 0;
+constexpr int64_t kExternalDisplay = 1;
+constexpr size_t kLayerCount = 8;
+constexpr uint32_t kBufferCacheSize = 3;
+constexpr int kWarmupFrames = 4;
+constexpr int kFrames = 100;
+
+// Accepts everything and reports no composition changes, no display
+// requests and no fences, so the only results of a frame are the ones the
+// engine always writes for validate and present.
+class FakeComposerHal : public IComposerHal {
+  public:
+    int32_t getDisplayMultiThreadedPresentSupport(const int64_t& display,
+                                                  bool& outSupport) override {
+        outSupport = false;
+        return 0;
+    }
+    int32_t presentDisplay(int64_t display, ndk::ScopedFileDescriptor& fence,
+                           std::vector<int64_t>* outLayers,
+                           std::vector<ndk::ScopedFileDescriptor>* outReleaseFences) override {
+        return 0;
+    }
+    int32_t validateDisplay(int64_t display, std::vector<int64_t>* outChangedLayers,
+                            std::vector<Composition>* outCompositionTypes,
+                            uint32_t* outDisplayRequestMask,
+                            std::vector<int64_t>* outRequestedLayers,
+                            std::vector<int32_t>* outRequestMasks,
+                            ClientTargetProperty* outClientTargetProperty,
+                            DimmingStage* outDimmingStage) override {
+        return 0;
+    }
+    void getCapabilities(std::vector<Capability>* caps) override {}
+    void dumpDebugInfo(std::string* output) override {}
+    bool hasCapability(Capability cap) override { return false; }
+    void registerEventCallback(EventCallback* callback) override {}
+    void unregisterEventCallback() override {}
+    int32_t acceptDisplayChanges(int64_t display) override { return 0; }
+    int32_t createLayer(int64_t display, int64_t* outLayer) override { return 0; }
+    int32_t createVirtualDisplay(uint32_t width, uint32_t height, AidlPixelFormat format,
+                                 VirtualDisplay* outDisplay) override { return 0; }
+    int32_t destroyLayer(int64_t display, int64_t layer) override { return 0; }
+    int32_t destroyVirtualDisplay(int64_t display) override { return 0; }
+    int32_t flushDisplayBrightnessChange(int64_t display) override { return 0; }
+    int32_t getActiveConfig(int64_t display, int32_t* outConfig) override { return 0; }
+    int32_t getColorModes(int64_t display, std::vector<ColorMode>* outModes) override { return 0; }
+    int32_t getDataspaceSaturationMatrix(common::Dataspace dataspace,
+                                         std::vector<float>* matrix) override { return 0; }
+    int32_t getDisplayAttribute(int64_t display, int32_t config, DisplayAttribute attribute,
+                                int32_t* outValue) override { return 0; }
+    int32_t getDisplayBrightnessSupport(int64_t display, bool& outSupport) override { return 0; }
+    int32_t getDisplayIdleTimerSupport(int64_t display, bool& outSupport) override { return 0; }
+    int32_t getDisplayCapabilities(int64_t display,
+                                   std::vector<DisplayCapability>* caps) override { return 0; }
+    int32_t getDisplayConfigs(int64_t display, std::vector<int32_t>* configs) override { return 0; }
+    int32_t getDisplayConfigurations(
+            int64_t display, int32_t maxFrameIntervalNs,
+            std::vector<DisplayConfiguration>* configs) override { return 0; }
+    int32_t notifyExpectedPresent(int64_t display,
+                                  const ClockMonotonicTimestamp& expectedPresentTime,
+                                  int32_t frameIntervalNs) override { return 0; }
+    int32_t getDisplayConnectionType(int64_t display,
+                                     DisplayConnectionType* outType) override { return 0; }
+    int32_t getDisplayIdentificationData(int64_t display,
+                                         DisplayIdentification *id) override { return 0; }
+    int32_t getDisplayName(int64_t display, std::string* outName) override { return 0; }
+    int32_t getDisplayVsyncPeriod(int64_t display, int32_t* outVsyncPeriod) override { return 0; }
+    int32_t getDisplayedContentSample(int64_t display, int64_t maxFrames, int64_t timestamp,
+                                      DisplayContentSample* samples) override { return 0; }
+    int32_t getDisplayedContentSamplingAttributes(
+            int64_t display, DisplayContentSamplingAttributes* attrs) override { return 0; }
+    int32_t getDisplayPhysicalOrientation(int64_t display,
+                                          common::Transform* orientation) override { return 0; }
+    int32_t getDozeSupport(int64_t display, bool& outSupport) override { return 0; }
+    int32_t getHdrCapabilities(int64_t display, HdrCapabilities* caps) override { return 0; }
+    int32_t getOverlaySupport(OverlayProperties* caps) override { return 0; }
+    int32_t getMaxVirtualDisplayCount(int32_t* count) override { return 0; }
+    int32_t getPerFrameMetadataKeys(int64_t display,
+                                    std::vector<PerFrameMetadataKey>* keys) override { return 0; }
+    int32_t getReadbackBufferAttributes(int64_t display,
+                                        ReadbackBufferAttributes* attrs) override { return 0; }
+    int32_t getReadbackBufferFence(int64_t display,
+                                   ndk::ScopedFileDescriptor* aqcuireFence) override { return 0; }
+    int32_t getRenderIntents(int64_t display, ColorMode mode,
+                             std::vector<RenderIntent>* intents) override { return 0; }
+    int32_t getSupportedContentTypes(int64_t display,
+                                     std::vector<ContentType>* types) override { return 0; }
+    int32_t setActiveConfig(int64_t display, int32_t config) override { return 0; }
+    int32_t setActiveConfigWithConstraints(
+            int64_t display, int32_t config,
+            const VsyncPeriodChangeConstraints& vsyncPeriodChangeConstraints,
+            VsyncPeriodChangeTimeline* timeline) override { return 0; }
+    int32_t setBootDisplayConfig(int64_t display, int32_t config) override { return 0; }
+    int32_t clearBootDisplayConfig(int64_t display) override { return 0; }
+    int32_t getPreferredBootDisplayConfig(int64_t display, int32_t* config) override { return 0; }
+    int32_t getHdrConversionCapabilities(
+            std::vector<common::HdrConversionCapability>*) override { return 0; }
+    int32_t setHdrConversionStrategy(const common::HdrConversionStrategy&,
+                                     common::Hdr*) override { return 0; }
+    int32_t setAutoLowLatencyMode(int64_t display, bool on) override { return 0; }
+    int32_t setClientTarget(int64_t display, buffer_handle_t target,
+                            const ndk::ScopedFileDescriptor& fence, common::Dataspace dataspace,
+                            const std::vector<common::Rect>& damage) override { return 0; }
+    int32_t getHasClientComposition(int64_t display, bool& outHasClientComp) override { return 0; }
+    int32_t getCompositionChanged(int64_t display, bool& outChanged) override { return 0; }
+    int32_t setColorMode(int64_t display, ColorMode mode,
+                         RenderIntent intent) override { return 0; }
+    int32_t setColorTransform(int64_t display,
+                              const std::vector<float>& matrix) override { return 0; }
+    int32_t setContentType(int64_t display, ContentType contentType) override { return 0; }
+    int32_t setDisplayBrightness(int64_t display, float brightness) override { return 0; }
+    int32_t setDisplayedContentSamplingEnabled(int64_t display, bool enable,
+                                               FormatColorComponent componentMask,
+                                               int64_t maxFrames) override { return 0; }
+    int32_t setLayerBlendMode(int64_t display, int64_t layer,
+                              common::BlendMode mode) override { return 0; }
+    int32_t setLayerBuffer(int64_t display, int64_t layer, buffer_handle_t buffer,
+                           const ndk::ScopedFileDescriptor& acquireFence) override { return 0; }
+    int32_t setLayerColor(int64_t display, int64_t layer, Color color) override { return 0; }
+    int32_t setLayerColorTransform(int64_t display, int64_t layer,
+                                   const std::vector<float>& matrix) override { return 0; }
+    int32_t setLayerCompositionType(int64_t display, int64_t layer,
+                                    Composition type) override { return 0; }
+    int32_t setLayerCursorPosition(int64_t display, int64_t layer, int32_t x,
+                                   int32_t y) override { return 0; }
+    int32_t setLayerDataspace(int64_t display, int64_t layer,
+                              common::Dataspace dataspace) override { return 0; }
+    int32_t setLayerDisplayFrame(int64_t display, int64_t layer,
+                                 const common::Rect& frame) override { return 0; }
+    int32_t setLayerPerFrameMetadata(
+            int64_t display, int64_t layer,
+            const std::vector<std::optional<PerFrameMetadata>>& metadata) override { return 0; }
+    int32_t setLayerPerFrameMetadataBlobs(
+            int64_t display, int64_t layer,
+            const std::vector<std::optional<PerFrameMetadataBlob>>& blobs) override { return 0; }
+    int32_t setLayerPlaneAlpha(int64_t display, int64_t layer, float alpha) override { return 0; }
+    int32_t setLayerSidebandStream(int64_t display, int64_t layer,
+                                   buffer_handle_t stream) override { return 0; }
+    int32_t setLayerSourceCrop(int64_t display, int64_t layer,
+                               const common::FRect& crop) override { return 0; }
+    int32_t setLayerSurfaceDamage(
+            int64_t display, int64_t layer,
+            const std::vector<std::optional<common::Rect>>& damage) override { return 0; }
+    int32_t setLayerTransform(int64_t display, int64_t layer,
+                              common::Transform transform) override { return 0; }
+    int32_t setLayerVisibleRegion(
+            int64_t display, int64_t layer,
+            const std::vector<std::optional<common::Rect>>& visible) override { return 0; }
+    int32_t setLayerBrightness(int64_t display, int64_t layer,
+                               float brightness) override { return 0; }
+    int32_t setLayerZOrder(int64_t display, int64_t layer, uint32_t z) override { return 0; }
+    int32_t applyLayerState(int64_t display, int64_t layer, const LayerCommand& command,
+                            const buffer_handle_t* buffer) override { return 0; }
+    int32_t setOutputBuffer(int64_t display, buffer_handle_t buffer,
+                            const ndk::ScopedFileDescriptor& releaseFence) override { return 0; }
+    int32_t setPowerMode(int64_t display, PowerMode mode) override { return 0; }
+    int32_t setReadbackBuffer(int64_t display, buffer_handle_t buffer,
+                              const ndk::ScopedFileDescriptor& releaseFence) override { return 0; }
+    int32_t setVsyncEnabled(int64_t display, bool enabled) override { return 0; }
+    int32_t setExpectedPresentTime(int64_t display,
+                                   const std::optional<ClockMonotonicTimestamp> expectedPresentTime,
+                                   int frameIntervalNs) override { return 0; }
+    int32_t setIdleTimerEnabled(int64_t display, int32_t timeout) override { return 0; }
+    int32_t getRCDLayerSupport(int64_t display, bool& outSupport) override { return 0; }
+    int32_t setLayerBlockingRegion(
+            int64_t display, int64_t layer,
+            const std::vector<std::optional<common::Rect>>& blockingRegion) override { return 0; }
+    int32_t setRefreshRateChangedCallbackDebugEnabled(int64_t display,
+                                                      bool enabled) override { return 0; }
+};
+
+class CommandEngineTest : public ::testing::Test {
+  protected:
+    void SetUp() override {
+        ASSERT_EQ(::android::NO_ERROR, mEngine.init());
+        for (auto display : {kDisplay, kExternalDisplay}) {
+            ASSERT_EQ(HWC2_ERROR_NONE, mResources.addPhysicalDisplay(display));
+            for (int64_t layer = 1; layer <= static_cast<int64_t>(kLayerCount); ++layer) {
+                ASSERT_EQ(HWC2_ERROR_NONE,
+                          mResources.addLayer(display, layer, kBufferCacheSize));
+            }
+        }
+    }
+
+    // A frame updating every layer of the display: a cached buffer, a
+    // position and an alpha, the way a scrolling list looks to the HAL.
+    static DisplayCommand layerUpdates(int64_t display) {
+        DisplayCommand command;
+        command.display = display;
+        for (int64_t layer = 1; layer <= static_cast<int64_t>(kLayerCount); ++layer) {
+            LayerCommand layerCommand;
+            layerCommand.layer = layer;
+            layerCommand.buffer = Buffer();
+            layerCommand.buffer->slot = static_cast<int32_t>(layer % kBufferCacheSize);
+            layerCommand.displayFrame = common::Rect{0, 0, 100, 100};
+            layerCommand.planeAlpha = PlaneAlpha{0.5f};
+            command.layers.push_back(std::move(layerCommand));
+        }
+        return command;
+    }
+
+    static DisplayCommand validateAndPresent(int64_t display) {
+        auto command = layerUpdates(display);
+        command.validateDisplay = true;
+        command.acceptDisplayChanges = true;
+        command.presentDisplay = true;
+        return command;
+    }
+
+    // Runs the frame until the engine's vectors settle, then returns the
+    // allocations of the next kFrames frames.
+    template <typename Frame>
+    static size_t countAllocations(Frame&& frame) {
+        for (int i = 0; i < kWarmupFrames; ++i) {
+            frame();
+        }
+        gAllocations = 0;
+        gCountAllocations = true;
+        for (int i = 0; i < kFrames; ++i) {
+            frame();
+        }
+        gCountAllocations = false;
+        return gAllocations;
+    }
+
+    // The reset-and-execute loop ComposerClient runs for each executeCommands()
+    size_t countEngineAllocations(const std::vector<DisplayCommand>& commands) {
+        std::vector<CommandResultPayload> results;
+        int32_t err = ::android::NO_ERROR;
+        auto allocations = countAllocations([&] {
+            mEngine.reset();
+            err |= mEngine.execute(commands, &results);
+        });
+        EXPECT_EQ(::android::NO_ERROR, err);
+        return allocations;
+    }
+
+    FakeComposerHal mHal;
+    ResourceManager mResources;
+    ComposerCommandEngine mEngine{&mHal, &mResources};
+};
+
+TEST_F(CommandEngineTest, LayerUpdatesDoNotAllocate) {
+    const std::vector<DisplayCommand> commands = {layerUpdates(kDisplay),
+                                                  layerUpdates(kExternalDisplay)};
+    EXPECT_EQ(0u, countEngineAllocations(commands));
+}
+
+// Validate and present results are handed to binder as payloads the writer
+// builds fresh for every frame. Those allocations belong to the interface,
+// anything on top of them would be the engine's.
+TEST_F(CommandEngineTest, PresentAllocatesOnlyItsResults) {
+    const std::vector<DisplayCommand> commands = {validateAndPresent(kDisplay),
+                                                  validateAndPresent(kExternalDisplay)};
+    const std::vector<int64_t> noLayers;
+    const std::vector<Composition> noCompositionTypes;
+    const std::vector<int32_t> noRequestMasks;
+    ComposerServiceWriter writer;
+    std::vector<CommandResultPayload> results;
+    auto writerAllocations = countAllocations([&] {
+        writer.reset();
+        for (const auto& command : commands) {
+            writer.setChangedCompositionTypes(command.display, noLayers, noCompositionTypes);
+            writer.setDisplayRequests(command.display, 0, noLayers, noRequestMasks);
+            writer.setClientTargetProperty(command.display,
+                                           ClientTargetProperty{common::PixelFormat::RGBA_8888,
+                                                                common::Dataspace::UNKNOWN},
+                                           1.f, DimmingStage{});
+            writer.setPresentFence(command.display, ndk::ScopedFileDescriptor());
+            writer.setReleaseFences(command.display, noLayers, {});
+        }
+        results = writer.getPendingCommandResults();
+    });
+
+    EXPECT_EQ(writerAllocations, countEngineAllocations(commands));
+}
+
+} // namespace
+} // namespace aidl::android::hardware::graphics::composer3::impl
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <hardware/hwcomposer2.h>
+
+#include "ResourceManager.h"
+
+using aidl::android::hardware::graphics::composer3::impl::ResourceManager;
+
+namespace {
+
+constexpr int64_t kDisplay = 0;
+constexpr int64_t kVirtualDisplay = 1;
+constexpr int64_t kLayer = 1;
+constexpr uint32_t kBufferCacheSize = 3;
+
+} // namespace
+
+TEST(ResourceManagerTest, DuplicateDisplayIsRejected) {
+    ResourceManager resources;
+    ASSERT_EQ(HWC2_ERROR_NONE, resources.addPhysicalDisplay(kDisplay));
+    EXPECT_EQ(HWC2_ERROR_BAD_PARAMETER, resources.addPhysicalDisplay(kDisplay));
+    EXPECT_EQ(HWC2_ERROR_BAD_PARAMETER, resources.addVirtualDisplay(kDisplay, kBufferCacheSize));
+
+    // the first display keeps its caches
+    size_t cacheSize = kBufferCacheSize;
+    ASSERT_EQ(HWC2_ERROR_NONE, resources.getDisplayOutputBufferCacheSize(kDisplay, &cacheSize));
+    EXPECT_EQ(0u, cacheSize);
+
+    ASSERT_EQ(HWC2_ERROR_NONE, resources.addVirtualDisplay(kVirtualDisplay, kBufferCacheSize));
+    EXPECT_EQ(HWC2_ERROR_BAD_PARAMETER, resources.addPhysicalDisplay(kVirtualDisplay));
+
+    // a removed display can be added again
+    ASSERT_EQ(HWC2_ERROR_NONE, resources.removeDisplay(kDisplay));
+    EXPECT_EQ(HWC2_ERROR_NONE, resources.addPhysicalDisplay(kDisplay));
+}
+
+TEST(ResourceManagerTest, DuplicateLayerIsRejected) {
+    ResourceManager resources;
+    ASSERT_EQ(HWC2_ERROR_NONE, resources.addPhysicalDisplay(kDisplay));
+    ASSERT_EQ(HWC2_ERROR_NONE, resources.addLayer(kDisplay, kLayer, kBufferCacheSize));
+    EXPECT_EQ(HWC2_ERROR_BAD_LAYER, resources.addLayer(kDisplay, kLayer, 1));
+
+    // the first layer keeps its slots
+    buffer_handle_t handle = nullptr;
+    auto releaser = resources.createReleaser(true /* isBuffer */);
+    EXPECT_EQ(HWC2_ERROR_NONE,
+              resources.getLayerBuffer(kDisplay, kLayer, kBufferCacheSize - 1,
+                                       true /* fromCache */, nullptr, handle, releaser.get()));
+
+    // the same layer id on another display is a different layer
+    ASSERT_EQ(HWC2_ERROR_NONE, resources.addPhysicalDisplay(kVirtualDisplay));
+    EXPECT_EQ(HWC2_ERROR_NONE, resources.addLayer(kVirtualDisplay, kLayer, kBufferCacheSize));
+
+    ASSERT_EQ(HWC2_ERROR_NONE, resources.removeLayer(kDisplay, kLayer));
+    EXPECT_EQ(HWC2_ERROR_NONE, resources.addLayer(kDisplay, kLayer, kBufferCacheSize));
+}
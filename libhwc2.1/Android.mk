@@ -32,6 +32,7 @@ LOCAL_C_INCLUDES += \
 LOCAL_SRC_FILES := \
 	libdrmresource/utils/worker.cpp \
 	libdrmresource/drm/resourcemanager.cpp \
+	libdrmresource/drm/drmblobcache.cpp \
 	libdrmresource/drm/drmdevice.cpp \
 	libdrmresource/drm/drmconnector.cpp \
 	libdrmresource/drm/drmcrtc.cpp \
@@ -40,6 +41,7 @@ LOCAL_SRC_FILES := \
 	libdrmresource/drm/drmplane.cpp \
 	libdrmresource/drm/drmproperty.cpp \
 	libdrmresource/drm/drmeventlistener.cpp \
+	libdrmresource/drm/vsyncmodel.cpp \
 	libdrmresource/drm/vsyncworker.cpp
 
 LOCAL_CFLAGS := -DHLOG_CODE=0
@@ -125,12 +127,20 @@ LOCAL_C_INCLUDES += \
         $(TOP)/hardware/google/graphics/$(soc_ver)
 LOCAL_SRC_FILES := \
 	libhwchelper/ExynosHWCHelper.cpp \
+	libhwchelper/LatencyHistogram.cpp \
 	ExynosHWCDebug.cpp \
 	libdevice/BrightnessController.cpp \
+	libdevice/BrightnessTransaction.cpp \
 	libdevice/ExynosDisplay.cpp \
 	libdevice/ExynosDevice.cpp \
 	libdevice/ExynosLayer.cpp \
+	libdevice/FrameTimeline.cpp \
+	libdevice/HintSessionController.cpp \
 	libdevice/HistogramDevice.cpp \
+	libdevice/HistogramQueryPipeline.cpp \
+	libdevice/RefreshRateVoteEngine.cpp \
+	libdevice/SoftwareHistogram.cpp \
+	libdevice/SysfsWatcher.cpp \
 	libmaindisplay/ExynosPrimaryDisplay.cpp \
 	libresource/ExynosMPP.cpp \
 	libresource/ExynosResourceManager.cpp \
@@ -140,6 +150,7 @@ LOCAL_SRC_FILES := \
 	libdisplayinterface/ExynosDisplayInterface.cpp \
 	libdisplayinterface/ExynosDeviceDrmInterface.cpp \
 	libdisplayinterface/ExynosDisplayDrmInterface.cpp \
+	libvrr/FrameInsertionPolicy.cpp \
 	libvrr/VariableRefreshRateController.cpp \
 	pixel-display.cpp \
 	histogram_mediator.cpp
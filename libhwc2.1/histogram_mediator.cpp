@@ -15,6 +15,8 @@
  */
 #include "histogram_mediator.h"
 
+#include "SoftwareHistogram.h"
+
 histogram::HistogramMediator::HistogramMediator(ExynosDisplay *display) {
     mDisplay = display;
     ExynosDisplayDrmInterface *moduleDisplayInterface =
@@ -68,8 +70,7 @@ void histogram::HistogramMediator::HistogramReceiver::callbackHistogram(char16_t
 }
 
 int histogram::HistogramMediator::calculateThreshold(const RoiRect &roi) {
-    int threshold = ((roi.bottom - roi.top) * (roi.right - roi.left)) >> 16;
-    return threshold + 1;
+    return SoftwareHistogram::calculateThreshold(roi.right - roi.left, roi.bottom - roi.top);
 }
 
 histogram::HistogramErrorCode histogram::HistogramMediator::setRoiWeightThreshold(
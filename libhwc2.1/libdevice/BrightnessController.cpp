@@ -17,7 +17,7 @@
 #define ATRACE_TAG (ATRACE_TAG_GRAPHICS | ATRACE_TAG_HAL)
 
 #include <cutils/properties.h>
-#include <poll.h>
+#include <inttypes.h>
 
 #include "BrightnessController.h"
 #include "ExynosHWCModule.h"
@@ -230,8 +230,7 @@ void BrightnessController::initDimmingUsage() {
 void BrightnessController::initBrightnessSysfs() {
     String8 nodeName;
     nodeName.appendFormat(BRIGHTNESS_SYSFS_NODE, mPanelIndex);
-    mBrightnessOfs.open(nodeName.c_str(), std::ofstream::out);
-    if (mBrightnessOfs.fail()) {
+    if (mTransaction.openSysfsNode(Attr::BRIGHTNESS_LEVEL, nodeName.c_str()) != 0) {
         ALOGE("%s %s fail to open", __func__, nodeName.c_str());
         return;
     }
@@ -250,15 +249,15 @@ void BrightnessController::initBrightnessSysfs() {
 
     nodeName.clear();
     nodeName.appendFormat(kGlobalAclModeFileNode, mPanelIndex);
-    mAclModeOfs.open(nodeName.c_str(), std::ofstream::out);
-    if (mAclModeOfs.fail()) {
+    if (mTransaction.openSysfsNode(Attr::ACL_MODE, nodeName.c_str()) != 0) {
         ALOGI("%s %s not supported", __func__, nodeName.c_str());
     } else {
         String8 propName;
         propName.appendFormat(kAclModeDefaultPropName, mPanelIndex);
 
         mAclModeDefault = static_cast<AclMode>(property_get_int32(propName, 0));
-        mAclMode.set_dirty();
+        // written with the first brightness
+        mTransaction.store(Attr::ACL_MODE, toUnderlying(mAclMode));
     }
 }
 
@@ -269,8 +268,7 @@ void BrightnessController::initCabcSysfs() {
     String8 nodeName;
     nodeName.appendFormat(kLocalCabcModeFileNode, mPanelIndex);
 
-    mCabcModeOfs.open(nodeName.c_str(), std::ofstream::out);
-    if (mCabcModeOfs.fail()) {
+    if (mTransaction.openSysfsNode(Attr::CABC_MODE, nodeName.c_str()) != 0) {
         ALOGE("%s %s fail to open", __func__, nodeName.c_str());
         return;
     }
@@ -335,13 +333,14 @@ void BrightnessController::processDimmingOff() {
 }
 
 int BrightnessController::updateAclMode() {
-    if (!mAclModeOfs.is_open()) return HWC2_ERROR_UNSUPPORTED;
+    if (!mTransaction.hasSysfsNode(Attr::ACL_MODE)) return HWC2_ERROR_UNSUPPORTED;
 
     if (mColorRenderIntent.get() == ColorRenderIntent::COLORIMETRIC) {
-        mAclMode.store(AclMode::ACL_ENHANCED);
+        mAclMode = AclMode::ACL_ENHANCED;
     } else {
-        mAclMode.store(mAclModeDefault);
+        mAclMode = mAclModeDefault;
     }
+    mTransaction.store(Attr::ACL_MODE, toUnderlying(mAclMode));
 
     if (applyAclViaSysfs() == HWC2_ERROR_NO_RESOURCES)
         ALOGW("%s try to apply acl_mode when brightness changed", __func__);
@@ -350,20 +349,14 @@ int BrightnessController::updateAclMode() {
 }
 
 int BrightnessController::applyAclViaSysfs() {
-    if (!mAclModeOfs.is_open()) return NO_ERROR;
-    if (!mAclMode.is_dirty()) return NO_ERROR;
-
-    mAclModeOfs.seekp(std::ios_base::beg);
-    mAclModeOfs << std::to_string(static_cast<uint8_t>(mAclMode.get()));
-    mAclModeOfs.flush();
-    if (mAclModeOfs.fail()) {
-        ALOGW("%s write acl_mode to %d error = %s", __func__, mAclMode.get(), strerror(errno));
-        mAclModeOfs.clear();
+    if (!mTransaction.isPending(Attr::ACL_MODE)) return NO_ERROR;
+
+    if (int ret = mTransaction.flush(BrightnessTransaction::bit(Attr::ACL_MODE)); ret != 0) {
+        ALOGW("%s write acl_mode to %d error = %s", __func__, mAclMode, strerror(-ret));
         return HWC2_ERROR_NO_RESOURCES;
     }
 
-    mAclMode.clear_dirty();
-    ALOGI("%s acl_mode = %d", __func__, mAclMode.get());
+    ALOGI("%s acl_mode = %d", __func__, mAclMode);
 
     return NO_ERROR;
 }
@@ -372,6 +365,7 @@ int BrightnessController::processDisplayBrightness(float brightness, const nsecs
                                                    bool waitPresent) {
     uint32_t level;
     bool ghbm;
+    uint64_t request;
 
     if (mIgnoreBrightnessUpdateRequests) {
         ALOGI("%s: Brightness update is ignored. requested: %f, current: %f",
@@ -403,6 +397,8 @@ int BrightnessController::processDisplayBrightness(float brightness, const nsecs
         if (!mBrightnessFloatReq.is_dirty()) {
             return NO_ERROR;
         }
+        // supersedes the sysfs writes still waiting for a drm path check
+        request = ++mBrightnessRequests;
 
         // check if it will go drm path for below cases.
         // case 1: hbm state will change
@@ -430,22 +426,46 @@ int BrightnessController::processDisplayBrightness(float brightness, const nsecs
     }
 
     // Sysfs path is faster than drm path. If there is an unchecked drm path change, the sysfs
-    // path should check the sysfs content.
-    if (mUncheckedGbhmRequest) {
-        ATRACE_NAME("check_ghbm_mode");
-        checkSysfsStatus(GetPanelSysfileByIndex(kGlobalHbmModeFileNode),
-                         {std::to_string(toUnderlying(mPendingGhbmStatus.load()))}, vsyncNs * 5);
-        mUncheckedGbhmRequest = false;
+    // path should check the sysfs content. The check completes on the sysfs watcher rather
+    // than blocking the caller, which applies the brightness then unless a newer request
+    // came in meanwhile.
+    auto apply = [this, level, request]() { applyBrightnessViaSysfs(level, request); };
+    auto checkLhbmThenApply = [this, vsyncNs, apply]() {
+        if (!checkDrmPathChange(mUncheckedLhbmRequest, kLocalHbmModeFileNode,
+                                std::to_string(mPendingLhbmStatus), vsyncNs, apply)) {
+            apply();
+        }
+    };
+    if (checkDrmPathChange(mUncheckedGbhmRequest, kGlobalHbmModeFileNode,
+                           std::to_string(toUnderlying(mPendingGhbmStatus.load())), vsyncNs,
+                           checkLhbmThenApply)) {
+        return NO_ERROR;
+    }
+    if (checkDrmPathChange(mUncheckedLhbmRequest, kLocalHbmModeFileNode,
+                           std::to_string(mPendingLhbmStatus), vsyncNs, apply)) {
+        return NO_ERROR;
     }
 
-    if (mUncheckedLhbmRequest) {
-        ATRACE_NAME("check_lhbm_mode");
-        checkSysfsStatus(GetPanelSysfileByIndex(kLocalHbmModeFileNode),
-                         {std::to_string(mPendingLhbmStatus)}, vsyncNs * 5);
-        mUncheckedLhbmRequest = false;
+    return applyBrightnessViaSysfs(level, request);
+}
+
+bool BrightnessController::checkDrmPathChange(std::atomic<bool>& unchecked,
+                                              const char* filePattern, const std::string& value,
+                                              const nsecs_t vsyncNs, std::function<void()> then) {
+    if (!unchecked) {
+        return false;
     }
 
-    return applyBrightnessViaSysfs(level);
+    ATRACE_NAME("check_drm_path_change");
+    mSysfsWatcher.watch(GetPanelSysfileByIndex(filePattern), {value}, vsyncNs * 5,
+                        [&unchecked, then = std::move(then)](int status, const std::string&) {
+                            if (status == -ECANCELED) {
+                                return;
+                            }
+                            unchecked = false;
+                            then();
+                        });
+    return true;
 }
 
 int BrightnessController::ignoreBrightnessUpdateRequests(bool ignore) {
@@ -521,14 +541,14 @@ int BrightnessController::applyPendingChangeViaSysfs(const nsecs_t vsyncNs) {
         level = mBrightnessLevel.get();
     }
 
-    if (mUncheckedBlRequest) {
-        ATRACE_NAME("check_bl_value");
-        checkSysfsStatus(GetPanelSysfileByIndex(BRIGHTNESS_SYSFS_NODE),
-                         {std::to_string(mPendingBl)}, vsyncNs * 5);
-        mUncheckedBlRequest = false;
+    // the pending change is looked up again once the drm path brightness is checked
+    if (checkDrmPathChange(mUncheckedBlRequest, BRIGHTNESS_SYSFS_NODE,
+                           std::to_string(mPendingBl), vsyncNs,
+                           [this, vsyncNs]() { applyPendingChangeViaSysfs(vsyncNs); })) {
+        return NO_ERROR;
     }
 
-    return applyBrightnessViaSysfs(level);
+    return applyBrightnessViaSysfs(level, ++mBrightnessRequests);
 }
 
 int BrightnessController::processLocalHbm(bool on) {
@@ -650,7 +670,9 @@ void BrightnessController::onClearDisplay(bool needModeClear) {
     resetLhbmState();
     mInstantHbmReq.reset(false);
 
-    if (mBrightnessLevel.is_dirty()) applyBrightnessViaSysfs(mBrightnessLevel.get());
+    if (mBrightnessLevel.is_dirty()) {
+        applyBrightnessViaSysfs(mBrightnessLevel.get(), ++mBrightnessRequests);
+    }
 
     if (!needModeClear) return;
 
@@ -668,17 +690,20 @@ void BrightnessController::onClearDisplay(bool needModeClear) {
         mDimming.store(true);
     }
     mOperationRate.reset(0);
+    mTransaction.reset(Attr::BRIGHTNESS_LEVEL, 0);
+    mTransaction.reset(Attr::HBM_MODE, toUnderlying(HbmMode::OFF));
+    mTransaction.reset(Attr::DIMMING, false);
+    mTransaction.reset(Attr::OPERATION_RATE, 0);
 
     std::lock_guard<std::recursive_mutex> lock1(mCabcModeMutex);
     mCabcMode.reset(CabcMode::OFF);
+    mTransaction.reset(Attr::CABC_MODE, toUnderlying(CabcMode::OFF));
 }
 
 int BrightnessController::prepareFrameCommit(ExynosDisplay& display, const DrmConnector& connector,
                                              ExynosDisplayDrmInterface::DrmModeAtomicReq& drmReq,
                                              const bool mixedComposition, bool& ghbmSync,
                                              bool& lhbmSync, bool& blSync, bool& opRateSync) {
-    int ret;
-
     ghbmSync = false;
     lhbmSync = false;
     blSync = false;
@@ -698,21 +723,20 @@ int BrightnessController::prepareFrameCommit(ExynosDisplay& display, const DrmCo
         }
     }
 
+    // stage the dirty states, the transaction writes those the panel does not have yet
     if (mDimming.is_dirty()) {
-        if ((ret = drmReq.atomicAddProperty(connector.id(), connector.dimming_on(),
-                                            mDimming.get())) < 0) {
-            ALOGE("%s: Fail to set dimming_on property", __func__);
-        }
+        mTransaction.store(Attr::DIMMING, mDimming.get());
         mDimming.clear_dirty();
     }
 
+    bool lhbmAdjustedBl = false;
     if (mLhbm.is_dirty() && mLhbmSupported) {
-        if ((ret = drmReq.atomicAddProperty(connector.id(), connector.lhbm_on(),
-                                            mLhbm.get())) < 0) {
-            ALOGE("%s: Fail to set lhbm_on property", __func__);
-        } else {
-            lhbmSync = true;
+        // As kernel timeout timer might disable LHBM without letting HWC know, LHBM on is
+        // written even when the panel should have it on already.
+        if (mLhbm.get()) {
+            mTransaction.invalidate(Attr::LHBM);
         }
+        mTransaction.store(Attr::LHBM, mLhbm.get());
 
         auto dbv = mBrightnessLevel.get();
         auto old_dbv = dbv;
@@ -739,14 +763,8 @@ int BrightnessController::prepareFrameCommit(ExynosDisplay& display, const DrmCo
         if (mLhbmBrightnessAdj) {
             // case 1: lhbm on and dbv is changed, use the new dbv
             // case 2: lhbm off and dbv was changed at lhbm on, use current dbv
-            if ((ret = drmReq.atomicAddProperty(connector.id(),
-                                               connector.brightness_level(), dbv)) < 0) {
-                ALOGE("%s: Fail to set brightness_level property", __func__);
-            } else {
-                blSync = true;
-                mUncheckedBlRequest = true;
-                mPendingBl = dbv;
-            }
+            mTransaction.store(Attr::BRIGHTNESS_LEVEL, dbv);
+            lhbmAdjustedBl = true;
         }
 
         // mLhbmBrightnessAdj will last from LHBM on to off
@@ -759,54 +777,114 @@ int BrightnessController::prepareFrameCommit(ExynosDisplay& display, const DrmCo
 
     if (mBrightnessLevel.is_dirty()) {
         // skip if lhbm has updated bl
-        if (!blSync) {
-            if ((ret = drmReq.atomicAddProperty(connector.id(),
-                                                connector.brightness_level(),
-                                                mBrightnessLevel.get())) < 0) {
-                ALOGE("%s: Fail to set brightness_level property", __func__);
-            } else {
-                mUncheckedBlRequest = true;
-                mPendingBl = mBrightnessLevel.get();
-                blSync = sync;
-            }
+        if (!lhbmAdjustedBl) {
+            mTransaction.store(Attr::BRIGHTNESS_LEVEL, mBrightnessLevel.get());
         }
         mBrightnessLevel.clear_dirty();
         mPrevDisplayWhitePointNits = mDisplayWhitePointNits;
     }
 
     if (mGhbm.is_dirty() && mGhbmSupported) {
-        HbmMode hbmMode = mGhbm.get();
-        auto [hbmEnum, ret] = DrmEnumParser::halToDrmEnum(static_cast<int32_t>(hbmMode),
-                                                          mHbmModeEnums);
-        if (ret < 0) {
-            ALOGE("Fail to convert hbm mode(%d)", hbmMode);
-            return ret;
-        }
-
-        if ((ret = drmReq.atomicAddProperty(connector.id(), connector.hbm_mode(),
-                                            hbmEnum)) < 0) {
-            ALOGE("%s: Fail to set hbm_mode property", __func__);
-        } else {
-            ghbmSync = sync;
-        }
+        mTransaction.store(Attr::HBM_MODE, toUnderlying(mGhbm.get()));
         mGhbm.clear_dirty();
     }
 
     mHdrLayerState.clear_dirty();
 
     if (mOperationRate.is_dirty()) {
-        if ((ret = drmReq.atomicAddProperty(connector.id(), connector.operation_rate(),
-                                            mOperationRate.get())) < 0) {
-            ALOGE("%s: Fail to set operation_rate property", __func__);
-        } else {
-            opRateSync = sync;
-        }
+        mTransaction.store(Attr::OPERATION_RATE, mOperationRate.get());
         mOperationRate.clear_dirty();
     }
 
+    // all the changes go into this commit, a change that fails stays pending for the next one
+    std::vector<BrightnessTransaction::Change> committed;
+    mTransaction.commit(
+            [this, &connector, &drmReq](Attr attr, uint64_t value) -> int {
+                return addBrightnessProperty(connector, drmReq, attr, value);
+            },
+            kDrmAttrs, &committed);
+
+    for (const auto& change : committed) {
+        switch (change.attr) {
+            case Attr::LHBM:
+                lhbmSync = true;
+                break;
+            case Attr::BRIGHTNESS_LEVEL:
+                mUncheckedBlRequest = true;
+                mPendingBl = change.value;
+                blSync = lhbmAdjustedBl || sync;
+                break;
+            case Attr::HBM_MODE:
+                ghbmSync = sync;
+                break;
+            case Attr::OPERATION_RATE:
+                opRateSync = sync;
+                break;
+            default:
+                break;
+        }
+    }
+    mLastCommitted = std::move(committed);
+
     return NO_ERROR;
 }
 
+int BrightnessController::addBrightnessProperty(const DrmConnector& connector,
+                                                ExynosDisplayDrmInterface::DrmModeAtomicReq& drmReq,
+                                                Attr attr, uint64_t value) {
+    const DrmProperty* property = nullptr;
+    switch (attr) {
+        case Attr::BRIGHTNESS_LEVEL:
+            property = &connector.brightness_level();
+            break;
+        case Attr::HBM_MODE: {
+            auto [hbmEnum, ret] = DrmEnumParser::halToDrmEnum(static_cast<int32_t>(value),
+                                                              mHbmModeEnums);
+            if (ret < 0) {
+                ALOGE("Fail to convert hbm mode(%" PRIu64 ")", value);
+                return ret;
+            }
+            property = &connector.hbm_mode();
+            value = hbmEnum;
+            break;
+        }
+        case Attr::DIMMING:
+            property = &connector.dimming_on();
+            break;
+        case Attr::LHBM:
+            property = &connector.lhbm_on();
+            break;
+        case Attr::OPERATION_RATE:
+            property = &connector.operation_rate();
+            break;
+        default:
+            return -EINVAL;
+    }
+
+    if (!property->id()) {
+        // retrying would not help, drop the change
+        ALOGE("%s: %s property is not available", __func__,
+              BrightnessTransaction::attrName(attr));
+        return NO_ERROR;
+    }
+
+    int ret = drmReq.atomicAddProperty(connector.id(), *property, value);
+    if (ret < 0) {
+        ALOGE("%s: Fail to set %s property", __func__, BrightnessTransaction::attrName(attr));
+        return ret;
+    }
+    return NO_ERROR;
+}
+
+void BrightnessController::onFrameCommitFailed() {
+    std::lock_guard<std::recursive_mutex> lock(mBrightnessMutex);
+    // the panel kept its previous values, write the changes again
+    for (const auto& change : mLastCommitted) {
+        mTransaction.invalidate(change.attr);
+    }
+    mLastCommitted.clear();
+}
+
 void BrightnessController::DimmingMsgHandler::handleMessage(const ::android::Message& message) {
     ALOGI("%s %d", __func__, message.what);
 
@@ -970,98 +1048,19 @@ int BrightnessController::queryBrightness(float brightness, bool *ghbm, uint32_t
     return NO_ERROR;
 }
 
-// Return immediately if it's already in the status. Otherwise poll the status
+// Return immediately if it's already in the status. Otherwise wait for the status on the
+// sysfs watcher, which keeps the file open.
 int BrightnessController::checkSysfsStatus(const std::string& file,
                                            const std::vector<std::string>& expectedValue,
                                            const nsecs_t timeoutNs) {
     ATRACE_CALL();
 
-    if (expectedValue.size() == 0) {
-      return -EINVAL;
-    }
-
-    char buf[16];
-    UniqueFd fd = open(file.c_str(), O_RDONLY);
-    if (fd.get() < 0) {
-        ALOGE("%s failed to open sysfs %s: %s", __func__, file.c_str(), strerror(errno));
-        return -ENOENT;
+    const int ret = mSysfsWatcher.watch(file, expectedValue, timeoutNs).get();
+    if (ret == -ETIMEDOUT) {
+        ALOGW("%s poll %s timeout", __func__, file.c_str());
+    } else if (ret != OK && ret != -EINVAL) {
+        ALOGE("%s failed to read sysfs %s: %s", __func__, file.c_str(), strerror(-ret));
     }
-
-    int size = read(fd.get(), buf, sizeof(buf));
-    if (size <= 0) {
-        ALOGE("%s failed to read from %s: %s", __func__, file.c_str(), strerror(errno));
-        return -EIO;
-    }
-
-    // '- 1' to remove trailing '\n'
-    std::string val = std::string(buf, size - 1);
-    if (std::find(expectedValue.begin(), expectedValue.end(), val) != expectedValue.end()) {
-        return OK;
-    } else if (timeoutNs == 0) {
-        // not get the expected value and no intention to wait
-        return -EINVAL;
-    }
-
-    struct pollfd pfd;
-    int ret = -EINVAL;
-
-    auto startTime = systemTime(SYSTEM_TIME_MONOTONIC);
-    pfd.fd = fd.get();
-    pfd.events = POLLPRI;
-    while (true) {
-        auto currentTime = systemTime(SYSTEM_TIME_MONOTONIC);
-        // int64_t for nsecs_t
-        auto remainTimeNs = timeoutNs - (currentTime - startTime);
-        if (remainTimeNs <= 0) {
-            remainTimeNs = ms2ns(1);
-        }
-        int pollRet = poll(&pfd, 1, ns2ms(remainTimeNs));
-        if (pollRet == 0) {
-            ALOGW("%s poll %s timeout", __func__, file.c_str());
-            // time out
-            ret = -ETIMEDOUT;
-            break;
-        } else if (pollRet > 0) {
-            if (!(pfd.revents & POLLPRI)) {
-                continue;
-            }
-
-            lseek(fd.get(), 0, SEEK_SET);
-            size = read(fd.get(), buf, sizeof(buf));
-            if (size > 0) {
-                val = std::string(buf, size - 1);
-                if (std::find(expectedValue.begin(), expectedValue.end(), val) !=
-                    expectedValue.end()) {
-                    ret = OK;
-                    break;
-                } else {
-                    std::string values;
-                    for (auto& s : expectedValue) {
-                        values += s + std::string(" ");
-                    }
-                    if (values.size() > 0) {
-                        values.resize(values.size() - 1);
-                    }
-                    ALOGW("%s read %s expected %s after notified on file %s", __func__, val.c_str(),
-                          values.c_str(), file.c_str());
-                }
-            } else {
-                ret = -EIO;
-                ALOGE("%s failed to read after notified %d on file %s", __func__, errno,
-                      file.c_str());
-                break;
-            }
-        } else {
-            if (errno == EAGAIN || errno == EINTR) {
-                continue;
-            }
-
-            ALOGE("%s poll failed %d on file %s", __func__, errno, file.c_str());
-            ret = -errno;
-            break;
-        }
-    };
-
     return ret;
 }
 
@@ -1069,6 +1068,7 @@ void BrightnessController::resetLhbmState() {
     std::lock_guard<std::recursive_mutex> lock(mBrightnessMutex);
     mLhbmReq.reset(false);
     mLhbm.reset(false);
+    mTransaction.reset(Attr::LHBM, false);
     mLhbmBrightnessAdj = false;
 }
 
@@ -1078,7 +1078,9 @@ void BrightnessController::setOutdoorVisibility(LbeState state) {
 }
 
 int BrightnessController::updateCabcMode() {
-    if (!mCabcSupport || mCabcModeOfs.fail()) return HWC2_ERROR_UNSUPPORTED;
+    if (!mCabcSupport || !mTransaction.hasSysfsNode(Attr::CABC_MODE)) {
+        return HWC2_ERROR_UNSUPPORTED;
+    }
 
     std::lock_guard<std::recursive_mutex> lock(mCabcModeMutex);
     CabcMode mode;
@@ -1098,14 +1100,13 @@ int BrightnessController::updateCabcMode() {
 }
 
 int BrightnessController::applyBrightnessViaSysfs(uint32_t level) {
-    if (mBrightnessOfs.is_open()) {
+    if (mTransaction.hasSysfsNode(Attr::BRIGHTNESS_LEVEL)) {
         ATRACE_NAME("write_bl_sysfs");
-        mBrightnessOfs.seekp(std::ios_base::beg);
-        mBrightnessOfs << std::to_string(level);
-        mBrightnessOfs.flush();
-        if (mBrightnessOfs.fail()) {
+        mTransaction.store(Attr::BRIGHTNESS_LEVEL, level);
+        // acl or cabc changes still pending go out with the brightness
+        if (mTransaction.flush(kSysfsAttrs) != 0 &&
+            mTransaction.isPending(Attr::BRIGHTNESS_LEVEL)) {
             ALOGE("%s fail to write brightness %d", __func__, level);
-            mBrightnessOfs.clear();
             return HWC2_ERROR_NO_RESOURCES;
         }
 
@@ -1122,16 +1123,23 @@ int BrightnessController::applyBrightnessViaSysfs(uint32_t level) {
     return HWC2_ERROR_UNSUPPORTED;
 }
 
+int BrightnessController::applyBrightnessViaSysfs(uint32_t level, uint64_t request) {
+    // held across the write, a newer request is either seen here or writes after
+    std::lock_guard<std::mutex> lock(mSysfsBrightnessMutex);
+    if (request != mBrightnessRequests) {
+        ALOGI("%s drop brightness %u of a superseded request", __func__, level);
+        return NO_ERROR;
+    }
+    return applyBrightnessViaSysfs(level);
+}
+
 int BrightnessController::applyCabcModeViaSysfs(uint8_t mode) {
-    if (!mCabcModeOfs.is_open()) return HWC2_ERROR_UNSUPPORTED;
+    if (!mTransaction.hasSysfsNode(Attr::CABC_MODE)) return HWC2_ERROR_UNSUPPORTED;
 
     ATRACE_NAME("write_cabc_mode_sysfs");
-    mCabcModeOfs.seekp(std::ios_base::beg);
-    mCabcModeOfs << std::to_string(mode);
-    mCabcModeOfs.flush();
-    if (mCabcModeOfs.fail()) {
+    mTransaction.store(Attr::CABC_MODE, mode);
+    if (mTransaction.flush(BrightnessTransaction::bit(Attr::CABC_MODE)) != 0) {
         ALOGE("%s fail to write CabcMode %d", __func__, mode);
-        mCabcModeOfs.clear();
         return HWC2_ERROR_NO_RESOURCES;
     }
     ALOGI("%s Cabc_Mode=%d", __func__, mode);
@@ -1185,7 +1193,8 @@ void BrightnessController::dump(String8& result) {
 
     result.appendFormat("BrightnessController:\n");
     result.appendFormat("\tsysfs support %d, max %d, valid brightness table %d, "
-                        "lhbm supported %d, ghbm supported %d\n", mBrightnessOfs.is_open(),
+                        "lhbm supported %d, ghbm supported %d\n",
+                        mTransaction.hasSysfsNode(Attr::BRIGHTNESS_LEVEL),
                         mMaxBrightness, mBrightnessIntfSupported, mLhbmSupported, mGhbmSupported);
     result.appendFormat("\trequests: enhance hbm %d, lhbm %d, "
                         "brightness %f, instant hbm %d, DimBrightness %d\n",
@@ -1202,12 +1211,27 @@ void BrightnessController::dump(String8& result) {
                         mHbmDimming, mHbmDimmingTimeUs);
     result.appendFormat("\twhite point nits current %f, previous %f\n", mDisplayWhitePointNits,
                         mPrevDisplayWhitePointNits);
-    result.appendFormat("\tcabc supported %d, cabcMode %d\n", mCabcModeOfs.is_open(),
-                        mCabcMode.get());
+    result.appendFormat("\tcabc supported %d, cabcMode %d\n",
+                        mTransaction.hasSysfsNode(Attr::CABC_MODE), mCabcMode.get());
     result.appendFormat("\tignore brightness update request %d\n", mIgnoreBrightnessUpdateRequests);
-    result.appendFormat("\tacl mode supported %d, acl mode %d\n", mAclModeOfs.is_open(),
-                        mAclMode.get());
+    result.appendFormat("\tacl mode supported %d, acl mode %d\n",
+                        mTransaction.hasSysfsNode(Attr::ACL_MODE), mAclMode);
     result.appendFormat("\toperation rate %d\n", mOperationRate.get());
+    const auto stats = mTransaction.stats();
+    result.appendFormat("\ttransaction: stores %" PRIu64 ", dropped %" PRIu64 ", commits %" PRIu64
+                        " (%" PRIu64 " properties), flushes %" PRIu64 " (%" PRIu64
+                        " writes), errors %" PRIu64 "\n",
+                        stats.stores, stats.dropped, stats.commits, stats.properties,
+                        stats.flushes, stats.sysfsWrites, stats.errors);
+    const auto watcherStats = mSysfsWatcher.stats();
+    result.appendFormat("\tsysfs watcher: watches %" PRIu64 " (%" PRIu64 " immediate), matched %"
+                        PRIu64 ", timeouts %" PRIu64 ", notifications %" PRIu64 "\n",
+                        watcherStats.watches, watcherStats.immediate, watcherStats.matched,
+                        watcherStats.timeouts, watcherStats.notifications);
+    for (const auto& change : mTransaction.diff()) {
+        result.appendFormat("\t\tpending %s %" PRIu64 "\n",
+                            BrightnessTransaction::attrName(change.attr), change.value);
+    }
 
     result.appendFormat("\n");
 }
@@ -24,7 +24,9 @@
 #include <fstream>
 #include <thread>
 
+#include "BrightnessTransaction.h"
 #include "ExynosDisplayDrmInterface.h"
+#include "SysfsWatcher.h"
 
 /**
  * Brightness change requests come from binder calls or HWC itself.
@@ -116,6 +118,11 @@ public:
                            ExynosDisplayDrmInterface::DrmModeAtomicReq& drmReq,
                            const bool mixedComposition, bool& ghbmSync, bool& lhbmSync,
                            bool& blSync, bool& opRateSync);
+    /**
+     * the atomic commit prepared by prepareFrameCommit failed, its brightness
+     * changes are written again with the next frame
+     */
+    void onFrameCommitFailed();
 
     bool isGhbmSupported() { return mGhbmSupported; }
     bool isLhbmSupported() { return mLhbmSupported; }
@@ -369,6 +376,17 @@ private:
     static constexpr const char* kAclModeDefaultPropName =
             "vendor.display.%d.brightness.acl.default";
 
+    using Attr = BrightnessTransaction::Attr;
+    // states written as connector properties of a frame commit
+    static constexpr uint32_t kDrmAttrs = BrightnessTransaction::bit(Attr::BRIGHTNESS_LEVEL) |
+            BrightnessTransaction::bit(Attr::HBM_MODE) | BrightnessTransaction::bit(Attr::DIMMING) |
+            BrightnessTransaction::bit(Attr::LHBM) |
+            BrightnessTransaction::bit(Attr::OPERATION_RATE);
+    // states written to sysfs nodes
+    static constexpr uint32_t kSysfsAttrs = BrightnessTransaction::bit(Attr::BRIGHTNESS_LEVEL) |
+            BrightnessTransaction::bit(Attr::ACL_MODE) |
+            BrightnessTransaction::bit(Attr::CABC_MODE);
+
     int queryBrightness(float brightness, bool* ghbm = nullptr, uint32_t* level = nullptr,
                         float *nits = nullptr);
     void initBrightnessTable(const DrmDevice& device, const DrmConnector& connector);
@@ -376,7 +394,18 @@ private:
     void initCabcSysfs();
     void initDimmingUsage();
     int applyBrightnessViaSysfs(uint32_t level);
+    // Applies the level of a brightness request unless a newer request
+    // superseded it
+    int applyBrightnessViaSysfs(uint32_t level, uint64_t request);
     int applyCabcModeViaSysfs(uint8_t mode);
+    // If the drm path change is unchecked, waits for the sysfs file to have the value on the
+    // sysfs watcher and runs then. Returns false when there is nothing to check.
+    bool checkDrmPathChange(std::atomic<bool>& unchecked, const char* filePattern,
+                            const std::string& value, const nsecs_t vsyncNs,
+                            std::function<void()> then);
+    int addBrightnessProperty(const DrmConnector& connector,
+                              ExynosDisplayDrmInterface::DrmModeAtomicReq& drmReq, Attr attr,
+                              uint64_t value);
     int updateStates(); // REQUIRES(mBrightnessMutex)
     void dimmingThread();
     void processDimmingOff();
@@ -414,6 +443,13 @@ private:
     CtrlValue<bool> mDimBrightnessReq;    // GUARDED_BY(mBrightnessMutex)
     CtrlValue<uint32_t> mOperationRate;   // GUARDED_BY(mBrightnessMutex)
 
+    // The states above are staged in the transaction, which writes the ones
+    // the panel does not have yet in one frame commit or one sysfs flush. It
+    // holds the sysfs nodes of brightness, acl and cabc.
+    BrightnessTransaction mTransaction;
+    // written by the last prepareFrameCommit
+    std::vector<BrightnessTransaction::Change> mLastCommitted; // GUARDED_BY(mBrightnessMutex)
+
     // Indicating if the last LHBM on has changed the brightness level
     bool mLhbmBrightnessAdj = false;
 
@@ -434,6 +470,11 @@ private:
     // indicating an unchecked brightness change in drm path
     std::atomic<bool> mUncheckedBlRequest = false;
     std::atomic<uint32_t> mPendingBl = 0;
+    // brightness requests so far. A sysfs write deferred by the checks above
+    // is dropped if a newer request came in before the check completed.
+    std::atomic<uint64_t> mBrightnessRequests = 0;
+    // serializes the sysfs writes of the requests with the check above
+    std::mutex mSysfsBrightnessMutex;
 
     // these are dimming related
     BrightnessDimmingUsage mBrightnessDimmingUsage = BrightnessDimmingUsage::NORMAL;
@@ -445,9 +486,7 @@ private:
     ::android::sp<DimmingMsgHandler> mDimmingHandler;
 
     // sysfs path
-    std::ofstream mBrightnessOfs;
     uint32_t mMaxBrightness = 0; // read from sysfs
-    std::ofstream mCabcModeOfs;
     bool mCabcSupport = false;
     uint32_t mDimBrightness = 0;
 
@@ -464,8 +503,7 @@ private:
         ACL_ENHANCED,
     };
 
-    std::ofstream mAclModeOfs;
-    CtrlValue<AclMode> mAclMode;
+    AclMode mAclMode = AclMode::ACL_OFF;
     AclMode mAclModeDefault = AclMode::ACL_OFF;
 
     // state for control CABC state
@@ -482,6 +520,10 @@ private:
     bool mOutdoorVisibility = false; // GUARDED_BY(mCabcModeMutex)
     bool isHdrLayerOn() { return mHdrLayerState.get() == HdrLayerState::kHdrLarge; }
     CtrlValue<CabcMode> mCabcMode; // GUARDED_BY(mCabcModeMutex)
+
+    // Shared by the sysfs status checks of the panel. Last so that its pending
+    // checks are cancelled before the states they apply are gone.
+    SysfsWatcher mSysfsWatcher;
 };
 
 #endif // _BRIGHTNESS_CONTROLLER_H_
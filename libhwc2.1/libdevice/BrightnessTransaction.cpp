@@ -0,0 +1,212 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "BrightnessTransaction.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+BrightnessTransaction::~BrightnessTransaction() {
+    for (auto& state : mStates) {
+        if (state.fd >= 0) {
+            close(state.fd);
+        }
+    }
+}
+
+int BrightnessTransaction::openSysfsNode(Attr attr, const std::string& path) {
+    const int fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -errno;
+    }
+
+    std::scoped_lock lock(mMutex);
+    State& state = mStates[static_cast<size_t>(attr)];
+    if (state.fd >= 0) {
+        close(state.fd);
+    }
+    state.fd = fd;
+    return 0;
+}
+
+bool BrightnessTransaction::hasSysfsNode(Attr attr) const {
+    std::scoped_lock lock(mMutex);
+    return mStates[static_cast<size_t>(attr)].fd >= 0;
+}
+
+void BrightnessTransaction::store(Attr attr, uint64_t value) {
+    std::scoped_lock lock(mMutex);
+    mStates[static_cast<size_t>(attr)].pending = value;
+    mStats.stores++;
+}
+
+void BrightnessTransaction::reset(Attr attr, uint64_t value) {
+    std::scoped_lock lock(mMutex);
+    State& state = mStates[static_cast<size_t>(attr)];
+    state.pending.reset();
+    state.applied = value;
+}
+
+void BrightnessTransaction::invalidate(Attr attr) {
+    std::scoped_lock lock(mMutex);
+    State& state = mStates[static_cast<size_t>(attr)];
+    if (!state.pending) {
+        state.pending = state.applied;
+    }
+    state.applied.reset();
+}
+
+std::optional<uint64_t> BrightnessTransaction::value(Attr attr) const {
+    std::scoped_lock lock(mMutex);
+    const State& state = mStates[static_cast<size_t>(attr)];
+    return state.pending ? state.pending : state.applied;
+}
+
+std::optional<uint64_t> BrightnessTransaction::applied(Attr attr) const {
+    std::scoped_lock lock(mMutex);
+    return mStates[static_cast<size_t>(attr)].applied;
+}
+
+bool BrightnessTransaction::isPending(Attr attr) const {
+    std::scoped_lock lock(mMutex);
+    const State& state = mStates[static_cast<size_t>(attr)];
+    return state.pending && state.pending != state.applied;
+}
+
+void BrightnessTransaction::dropUnchangedLocked(uint32_t mask) {
+    for (size_t i = 0; i < kAttrCount; ++i) {
+        State& state = mStates[i];
+        if ((mask & bit(static_cast<Attr>(i))) && state.pending &&
+            state.pending == state.applied) {
+            state.pending.reset();
+            mStats.dropped++;
+        }
+    }
+}
+
+std::vector<BrightnessTransaction::Change> BrightnessTransaction::diffLocked(uint32_t mask) const {
+    std::vector<Change> changes;
+    for (size_t i = 0; i < kAttrCount; ++i) {
+        const State& state = mStates[i];
+        if ((mask & bit(static_cast<Attr>(i))) && state.pending &&
+            state.pending != state.applied) {
+            changes.push_back({static_cast<Attr>(i), *state.pending});
+        }
+    }
+    return changes;
+}
+
+void BrightnessTransaction::appliedLocked(const Change& change) {
+    State& state = mStates[static_cast<size_t>(change.attr)];
+    state.applied = change.value;
+    state.pending.reset();
+}
+
+std::vector<BrightnessTransaction::Change> BrightnessTransaction::diff(uint32_t mask) const {
+    std::scoped_lock lock(mMutex);
+    return diffLocked(mask);
+}
+
+int BrightnessTransaction::commit(const PropertyWriter& writer, uint32_t mask,
+                                  std::vector<Change>* committed) {
+    std::scoped_lock lock(mMutex);
+    dropUnchangedLocked(mask);
+    const std::vector<Change> changes = diffLocked(mask);
+    if (changes.empty()) {
+        return 0;
+    }
+
+    mStats.commits++;
+    int ret = 0;
+    for (const Change& change : changes) {
+        if (int err = writer(change.attr, change.value); err != 0) {
+            mStats.errors++;
+            if (ret == 0) {
+                ret = err;
+            }
+            continue;
+        }
+        mStats.properties++;
+        appliedLocked(change);
+        if (committed) {
+            committed->push_back(change);
+        }
+    }
+    return ret;
+}
+
+int BrightnessTransaction::flush(uint32_t mask, std::vector<Change>* written) {
+    std::scoped_lock lock(mMutex);
+    dropUnchangedLocked(mask);
+    std::vector<Change> changes;
+    for (const Change& change : diffLocked(mask)) {
+        if (mStates[static_cast<size_t>(change.attr)].fd >= 0) {
+            changes.push_back(change);
+        }
+    }
+    if (changes.empty()) {
+        return 0;
+    }
+
+    mStats.flushes++;
+    int ret = 0;
+    for (const Change& change : changes) {
+        // sysfs takes the whole value in one write from the start of the node
+        const std::string text = std::to_string(change.value);
+        const ssize_t n =
+                pwrite(mStates[static_cast<size_t>(change.attr)].fd, text.c_str(), text.size(), 0);
+        if (n != static_cast<ssize_t>(text.size())) {
+            mStats.errors++;
+            if (ret == 0) {
+                ret = n < 0 ? -errno : -EIO;
+            }
+            continue;
+        }
+        mStats.sysfsWrites++;
+        appliedLocked(change);
+        if (written) {
+            written->push_back(change);
+        }
+    }
+    return ret;
+}
+
+BrightnessTransaction::Stats BrightnessTransaction::stats() const {
+    std::scoped_lock lock(mMutex);
+    return mStats;
+}
+
+const char* BrightnessTransaction::attrName(Attr attr) {
+    switch (attr) {
+        case Attr::BRIGHTNESS_LEVEL:
+            return "brightness_level";
+        case Attr::HBM_MODE:
+            return "hbm_mode";
+        case Attr::DIMMING:
+            return "dimming_on";
+        case Attr::LHBM:
+            return "lhbm_on";
+        case Attr::OPERATION_RATE:
+            return "operation_rate";
+        case Attr::ACL_MODE:
+            return "acl_mode";
+        case Attr::CABC_MODE:
+            return "cabc_mode";
+        default:
+            return "unknown";
+    }
+}
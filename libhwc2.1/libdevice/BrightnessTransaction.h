@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <array>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Brightness related panel attributes of one display, pending and applied.
+//
+// Requests store the value they want for an attribute. Nothing is written
+// until the next commit() (drm properties of a frame) or flush() (sysfs
+// nodes), which write only the attributes whose pending value differs from
+// the value the panel has, all in one go. An attribute changed and changed
+// back before that costs no write at all.
+//
+// The applied value of an attribute is shared by both paths, a brightness
+// level set through the drm property is not written again through sysfs.
+// A write that fails keeps its value pending for the next commit or flush.
+//
+// Thread safe.
+class BrightnessTransaction {
+public:
+    enum class Attr : uint32_t {
+        BRIGHTNESS_LEVEL = 0,
+        HBM_MODE,
+        DIMMING,
+        LHBM,
+        OPERATION_RATE,
+        ACL_MODE,
+        CABC_MODE,
+        COUNT,
+    };
+    static constexpr size_t kAttrCount = static_cast<size_t>(Attr::COUNT);
+
+    // Bit masks of attributes for commit(), flush() and diff()
+    static constexpr uint32_t bit(Attr attr) { return 1u << static_cast<uint32_t>(attr); }
+    static constexpr uint32_t kAllAttrs = (1u << kAttrCount) - 1;
+
+    struct Change {
+        Attr attr;
+        uint64_t value;
+
+        bool operator==(const Change& other) const {
+            return attr == other.attr && value == other.value;
+        }
+    };
+
+    struct Stats {
+        uint64_t stores = 0;
+        // pending values that turned out to be the applied one
+        uint64_t dropped = 0;
+        uint64_t commits = 0;
+        uint64_t properties = 0;
+        uint64_t flushes = 0;
+        uint64_t sysfsWrites = 0;
+        uint64_t errors = 0;
+    };
+
+    // Adds one attribute to the frame commit, e.g. to the atomic request.
+    // Returns 0 on success.
+    using PropertyWriter = std::function<int(Attr attr, uint64_t value)>;
+
+    ~BrightnessTransaction();
+
+    // The sysfs node of an attribute, kept open for flush(). Returns 0 or
+    // -errno when the node cannot be opened.
+    int openSysfsNode(Attr attr, const std::string& path);
+    bool hasSysfsNode(Attr attr) const;
+
+    void store(Attr attr, uint64_t value);
+    // The panel has the value already, e.g. after a reset
+    void reset(Attr attr, uint64_t value);
+    // The value of the panel is unknown, the pending value (or the applied
+    // one when nothing is pending) is written on the next commit or flush
+    void invalidate(Attr attr);
+
+    // The value the panel will have after the pending changes, if known
+    std::optional<uint64_t> value(Attr attr) const;
+    std::optional<uint64_t> applied(Attr attr) const;
+    bool isPending(Attr attr) const;
+
+    // The changes of the attributes in mask that a commit or flush would write
+    std::vector<Change> diff(uint32_t mask = kAllAttrs) const;
+
+    // Writes the changed attributes in mask through the writer and returns the
+    // ones written successfully in *committed. Returns 0, or the first error
+    // of the writer.
+    int commit(const PropertyWriter& writer, uint32_t mask,
+               std::vector<Change>* committed = nullptr);
+
+    // Writes the changed attributes in mask that have a sysfs node, one write
+    // per node. Returns 0, or the first write error as -errno.
+    int flush(uint32_t mask = kAllAttrs, std::vector<Change>* written = nullptr);
+
+    Stats stats() const;
+    static const char* attrName(Attr attr);
+
+private:
+    struct State {
+        std::optional<uint64_t> pending;
+        std::optional<uint64_t> applied;
+        int fd = -1;
+    };
+
+    // Moves the pending values equal to the applied ones out of the way
+    void dropUnchangedLocked(uint32_t mask);
+    std::vector<Change> diffLocked(uint32_t mask) const;
+    void appliedLocked(const Change& change);
+
+    mutable std::mutex mMutex;
+    std::array<State, kAttrCount> mStates;
+    Stats mStats;
+};
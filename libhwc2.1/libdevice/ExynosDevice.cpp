@@ -148,6 +148,10 @@ ExynosDevice::ExynosDevice(bool vrrApiSupported)
         exynos_display->mDeconNodeName.appendFormat("%s", display_t.decon_node_name.c_str());
         mDisplays.add(exynos_display);
         mDisplayMap.insert(std::make_pair(exynos_display->mDisplayId, exynos_display));
+        if (exynos_display->mDisplayId < kDisplayTableSize)
+            mDisplayTable[exynos_display->mDisplayId] = exynos_display;
+        else
+            ALOGE("Display id(%u) is out of the display table", exynos_display->mDisplayId);
 
 #ifndef FORCE_DISABLE_DR
         if (exynos_display->mDRDefault) exynosHWCControl.useDynamicRecomp = true;
@@ -225,6 +229,8 @@ void ExynosDevice::initDeviceInterface(uint32_t interfaceType)
             ALOGD("Remove display[%d], Failed to initialize display interface", i);
             mDisplays.removeAt(i);
             mDisplayMap.erase(display->mDisplayId);
+            if (display->mDisplayId < kDisplayTableSize)
+                mDisplayTable[display->mDisplayId] = nullptr;
             delete display;
         } else {
             i++;
@@ -32,6 +32,7 @@
 #include <utils/Trace.h>
 #include <utils/Vector.h>
 
+#include <array>
 #include <atomic>
 #include <map>
 #include <thread>
@@ -155,6 +156,9 @@ class ExynosDevice {
          */
         android::Vector< ExynosDisplay* > mDisplays;
         std::map<uint32_t, ExynosDisplay *> mDisplayMap;
+        /* Same content as mDisplayMap, indexed by display id for getDisplay() */
+        static constexpr size_t kDisplayTableSize = HWC_NUM_DISPLAY_TYPES << DISPLAYID_MASK_LEN;
+        std::array<ExynosDisplay *, kDisplayTableSize> mDisplayTable{};
 
         int mNumVirtualDisplay;
 
@@ -235,7 +239,9 @@ class ExynosDevice {
         /**
          * @param display
          */
-        ExynosDisplay* getDisplay(uint32_t display) { return mDisplayMap[display]; }
+        ExynosDisplay* getDisplay(uint32_t display) {
+            return (display < kDisplayTableSize) ? mDisplayTable[display] : nullptr;
+        }
 
         /**
          * Device Functions for HWC 2.0
@@ -61,6 +61,8 @@ constexpr float kDynamicRecompFpsThreshold = 1.0 / 5.0; // 1 frame update per 5
 
 constexpr float nsecsPerSec = std::chrono::nanoseconds(1s).count();
 constexpr int64_t nsecsIdleHintTimeout = std::chrono::nanoseconds(100ms).count();
+// a present fence that has not signaled by then is given up
+constexpr int kPresentFenceWaitTimeoutMs = 1000;
 
 ExynosDisplay::PowerHalHintWorker::PowerHalHintWorker(uint32_t displayId,
                                                       const String8& displayTraceName)
@@ -79,7 +81,9 @@ ExynosDisplay::PowerHalHintWorker::PowerHalHintWorker(uint32_t displayId,
         mDeathRecipient(AIBinder_DeathRecipient_new(BinderDiedCallback)),
         mPowerHalExtAidl(nullptr),
         mPowerHalAidl(nullptr),
-        mPowerHintSession(nullptr) {
+        mPowerHintSession(nullptr),
+        mHintSessionController({.normalizeTarget = sNormalizeTarget,
+                                .useRateLimiter = sUseRateLimiter}) {
     if (property_get_bool("vendor.display.powerhal_hint_per_display", false)) {
         std::string displayIdStr = std::to_string(displayId);
         mIdleHintStr = "DISPLAY_" + displayIdStr + "_IDLE";
@@ -98,6 +102,57 @@ int ExynosDisplay::PowerHalHintWorker::Init() {
     return InitWorker();
 }
 
+ExynosDisplay::PresentFenceWorker::PresentFenceWorker(ExynosDisplay* display)
+      : Worker("PresentFences", HAL_PRIORITY_URGENT_DISPLAY), mDisplay(display) {}
+
+ExynosDisplay::PresentFenceWorker::~PresentFenceWorker() {
+    Exit();
+
+    PendingFence pending;
+    while (mFences.pop(pending)) {
+        fence_close(pending.fence, mDisplay, FENCE_TYPE_RETIRE, FENCE_IP_DPP);
+    }
+}
+
+void ExynosDisplay::PresentFenceWorker::queue(uint64_t frameNumber, int32_t fence) {
+    // started on the first present
+    if (!initialized()) {
+        InitWorker();
+    }
+
+    Lock();
+    const bool queued = mFences.push({frameNumber, fence});
+    Unlock();
+    if (!queued) {
+        // the frame is given up once newer frames resolve
+        fence_close(fence, mDisplay, FENCE_TYPE_RETIRE, FENCE_IP_DPP);
+        return;
+    }
+    Signal();
+}
+
+void ExynosDisplay::PresentFenceWorker::Routine() {
+    Lock();
+    if (mFences.empty() && WaitForSignalOrExitLocked() == -EINTR) {
+        Unlock();
+        return;
+    }
+    Unlock();
+
+    PendingFence pending;
+    while (mFences.pop(pending)) {
+        nsecs_t signalTime = SIGNAL_TIME_INVALID;
+        if (sync_wait(pending.fence, kPresentFenceWaitTimeoutMs) == 0) {
+            signalTime = mDisplay->getSignalTime(pending.fence);
+        }
+        if (!mDisplay->mFrameTimeline.setPresentFenceTime(pending.frameNumber, signalTime)) {
+            ALOGW("%s: frame %" PRIu64 " present fence time dropped",
+                  mDisplay->mDisplayName.c_str(), pending.frameNumber);
+        }
+        fence_close(pending.fence, mDisplay, FENCE_TYPE_RETIRE, FENCE_IP_DPP);
+    }
+}
+
 void ExynosDisplay::PowerHalHintWorker::BinderDiedCallback(void *cookie) {
     ALOGE("PowerHal is died");
     auto powerHint = reinterpret_cast<PowerHalHintWorker *>(cookie);
@@ -364,7 +419,7 @@ void ExynosDisplay::PowerHalHintWorker::forceUpdateHints(void) {
     Lock();
     mLastRefreshRateHint = 0;
     mNeedUpdateRefreshRateHint = true;
-    mLastErrorSent = std::nullopt;
+    mHintSessionController.forceReport();
     if (mIdleHintSupportIsChecked && mIdleHintIsSupported) {
         mForceUpdateIdleHint = true;
     }
@@ -386,16 +441,15 @@ int32_t ExynosDisplay::PowerHalHintWorker::sendActualWorkDuration() {
         return NO_ERROR;
     }
 
-    if (mActualWorkDuration.has_value()) {
-        mLastErrorSent = *mActualWorkDuration - mTargetWorkDuration;
+    std::vector<WorkDuration> hintQueue;
+    for (const auto &duration :
+         mHintSessionController.takeReport(systemTime(SYSTEM_TIME_MONOTONIC))) {
+        hintQueue.push_back({.timeStampNanos = duration.timeStampNanos,
+                             .durationNanos = duration.durationNanos});
     }
-
-    std::vector<WorkDuration> hintQueue(std::move(mPowerHintQueue));
-    mPowerHintQueue.clear();
     Unlock();
 
-    ALOGV("Sending hint update batch");
-    mLastActualReportTimestamp = systemTime(SYSTEM_TIME_MONOTONIC);
+    ALOGV("Sending hint update batch of %zu", hintQueue.size());
     auto ret = mPowerHintSession->reportActualWorkDuration(hintQueue);
     if (!ret.isOk()) {
         ALOGW("Failed to report power hint session timing:  %s %s", ret.getMessage(),
@@ -425,8 +479,7 @@ int32_t ExynosDisplay::PowerHalHintWorker::updateTargetWorkDuration() {
         return NO_ERROR;
     }
 
-    nsecs_t targetWorkDuration = mTargetWorkDuration;
-    mLastTargetDurationReported = targetWorkDuration;
+    nsecs_t targetWorkDuration = mHintSessionController.takeTargetUpdate();
     Unlock();
 
     ALOGV("Sending target time: %lld ns", static_cast<long long>(targetWorkDuration));
@@ -443,66 +496,57 @@ int32_t ExynosDisplay::PowerHalHintWorker::updateTargetWorkDuration() {
     return ret.isOk() ? NO_ERROR : -EINVAL;
 }
 
-void ExynosDisplay::PowerHalHintWorker::signalActualWorkDuration(nsecs_t actualDurationNanos) {
+void ExynosDisplay::PowerHalHintWorker::signalFrameStart(nsecs_t vsyncPeriodNanos,
+                                                         nsecs_t targetDurationNanos,
+                                                         bool validating) {
     ATRACE_CALL();
-
     if (!usePowerHintSession()) {
         return;
     }
     Lock();
-    nsecs_t reportedDurationNs = actualDurationNanos;
-    if (sNormalizeTarget) {
-        reportedDurationNs += mLastTargetDurationReported - mTargetWorkDuration;
-    } else {
-        if (mLastTargetDurationReported != kDefaultTarget.count() && mTargetWorkDuration != 0) {
-            reportedDurationNs =
-                    static_cast<int64_t>(static_cast<long double>(mLastTargetDurationReported) /
-                                         mTargetWorkDuration * actualDurationNanos);
-        }
-    }
-
-    mActualWorkDuration = reportedDurationNs;
-    WorkDuration duration = {.timeStampNanos = systemTime(), .durationNanos = reportedDurationNs};
+    mHintSessionController.beginFrame(systemTime(SYSTEM_TIME_MONOTONIC), vsyncPeriodNanos,
+                                      targetDurationNanos, validating);
 
     if (sTraceHintSessionData) {
-        DISPLAY_ATRACE_INT64("Measured duration", actualDurationNanos);
-        DISPLAY_ATRACE_INT64("Target error term", mTargetWorkDuration - actualDurationNanos);
-
-        DISPLAY_ATRACE_INT64("Reported duration", reportedDurationNs);
-        DISPLAY_ATRACE_INT64("Reported target", mLastTargetDurationReported);
-        DISPLAY_ATRACE_INT64("Reported target error term",
-                             mLastTargetDurationReported - reportedDurationNs);
+        DISPLAY_ATRACE_INT64("Time target", mHintSessionController.frameTargetNs());
+        auto predicted = mHintSessionController.predict(vsyncPeriodNanos, validating);
+        if (predicted.has_value()) DISPLAY_ATRACE_INT64("Predicted duration", *predicted);
     }
-    ALOGV("Sending actual work duration of: %" PRId64 " on reported target: %" PRId64
-          " with error: %" PRId64,
-          reportedDurationNs, mLastTargetDurationReported,
-          mLastTargetDurationReported - reportedDurationNs);
-
-    mPowerHintQueue.push_back(duration);
-
-    bool shouldSignal = needSendActualWorkDurationLocked();
+    bool shouldSignal = needUpdateTargetWorkDurationLocked() || needSendActualWorkDurationLocked();
     Unlock();
     if (shouldSignal) {
         Signal();
     }
 }
 
-void ExynosDisplay::PowerHalHintWorker::signalTargetWorkDuration(nsecs_t targetDurationNanos) {
+void ExynosDisplay::PowerHalHintWorker::signalFrameEnd(std::optional<nsecs_t> validateNanos,
+                                                       nsecs_t presentNanos) {
     ATRACE_CALL();
     if (!usePowerHintSession()) {
         return;
     }
     Lock();
-    mTargetWorkDuration = targetDurationNanos - kTargetSafetyMargin.count();
+    mHintSessionController.endFrame(systemTime(SYSTEM_TIME_MONOTONIC), validateNanos,
+                                    presentNanos);
 
-    if (sTraceHintSessionData) DISPLAY_ATRACE_INT64("Time target", mTargetWorkDuration);
-    bool shouldSignal = false;
-    if (!sNormalizeTarget) {
-        shouldSignal = needUpdateTargetWorkDurationLocked();
-        if (shouldSignal && mActualWorkDuration.has_value() && sTraceHintSessionData) {
-            DISPLAY_ATRACE_INT64("Target error term", *mActualWorkDuration - mTargetWorkDuration);
-        }
+    nsecs_t actualDurationNanos = validateNanos.value_or(0) + presentNanos;
+    nsecs_t targetDurationNanos = mHintSessionController.frameTargetNs();
+    nsecs_t reportedTargetNanos = mHintSessionController.lastTargetReportedNs();
+    nsecs_t reportedDurationNs = *mHintSessionController.lastReportedDurationNs();
+    if (sTraceHintSessionData) {
+        DISPLAY_ATRACE_INT64("Measured duration", actualDurationNanos);
+        DISPLAY_ATRACE_INT64("Target error term", targetDurationNanos - actualDurationNanos);
+
+        DISPLAY_ATRACE_INT64("Reported duration", reportedDurationNs);
+        DISPLAY_ATRACE_INT64("Reported target", reportedTargetNanos);
+        DISPLAY_ATRACE_INT64("Reported target error term",
+                             reportedTargetNanos - reportedDurationNs);
     }
+    ALOGV("Queueing actual work duration of: %" PRId64 " on reported target: %" PRId64
+          " with error: %" PRId64,
+          reportedDurationNs, reportedTargetNanos, reportedTargetNanos - reportedDurationNs);
+
+    bool shouldSignal = needSendActualWorkDurationLocked();
     Unlock();
     if (shouldSignal) {
         Signal();
@@ -563,6 +607,13 @@ void ExynosDisplay::PowerHalHintWorker::Routine() {
     if (!mNeedUpdateRefreshRateHint && !needUpdateIdleHintLocked(timeout) &&
         !needSendActualWorkDurationLocked() && !needStartHintSession &&
         !needUpdateTargetWorkDurationLocked()) {
+        // wake up for the durations held back by the rate limiter
+        int64_t reportTimeout = useHintSession
+                ? mHintSessionController.nextReportDelayNs(systemTime(SYSTEM_TIME_MONOTONIC))
+                : -1;
+        if (reportTimeout >= 0 && (timeout < 0 || reportTimeout < timeout)) {
+            timeout = reportTimeout;
+        }
         ret = WaitForSignalOrExitLocked(timeout);
     }
 
@@ -648,8 +699,7 @@ void ExynosDisplay::PowerHalHintWorker::removeBinderTid(pid_t tid) {
 int32_t ExynosDisplay::PowerHalHintWorker::startHintSession() {
     Lock();
     std::vector<int> tids(mBinderTids.begin(), mBinderTids.end());
-    nsecs_t targetWorkDuration =
-            sNormalizeTarget ? mLastTargetDurationReported : mTargetWorkDuration;
+    nsecs_t targetWorkDuration = mHintSessionController.takeSessionTarget();
     // we want to stay locked during this one since it assigns "mPowerHintSession"
     auto ret = mPowerHalAidl->createHintSession(getpid(), static_cast<uid_t>(getuid()), tids,
                                                 targetWorkDuration, &mPowerHintSession);
@@ -661,8 +711,6 @@ int32_t ExynosDisplay::PowerHalHintWorker::startHintSession() {
         }
         Unlock();
         return -EINVAL;
-    } else {
-        mLastTargetDurationReported = targetWorkDuration;
     }
     Unlock();
     return NO_ERROR;
@@ -704,25 +752,13 @@ bool ExynosDisplay::PowerHalHintWorker::usePowerHintSession() {
 }
 
 bool ExynosDisplay::PowerHalHintWorker::needUpdateTargetWorkDurationLocked() {
-    if (!usePowerHintSession() || sNormalizeTarget) return false;
-    // to disable the rate limiter we just use a max deviation of 1
-    nsecs_t maxDeviation = sUseRateLimiter ? kAllowedDeviation.count() : 1;
-    // report if the change in target from our last submission to now exceeds the threshold
-    return abs(mTargetWorkDuration - mLastTargetDurationReported) >= maxDeviation;
+    if (!usePowerHintSession()) return false;
+    return mHintSessionController.needTargetUpdate();
 }
 
 bool ExynosDisplay::PowerHalHintWorker::needSendActualWorkDurationLocked() {
-    if (!usePowerHintSession() || mPowerHintQueue.size() == 0 || !mActualWorkDuration.has_value()) {
-        return false;
-    }
-    if (!mLastErrorSent.has_value() ||
-        (systemTime(SYSTEM_TIME_MONOTONIC) - mLastActualReportTimestamp) > kStaleTimeout.count()) {
-        return true;
-    }
-    // to effectively disable the rate limiter we just use a max deviation of 1
-    nsecs_t maxDeviation = sUseRateLimiter ? kAllowedDeviation.count() : 1;
-    // report if the change in error term from our last submission to now exceeds the threshold
-    return abs((*mActualWorkDuration - mTargetWorkDuration) - *mLastErrorSent) >= maxDeviation;
+    if (!usePowerHintSession()) return false;
+    return mHintSessionController.needReport(systemTime(SYSTEM_TIME_MONOTONIC));
 }
 
 // track the tid of any thread that calls in and remove it on thread death
@@ -1038,6 +1074,7 @@ ExynosDisplay::ExynosDisplay(uint32_t type, uint32_t index, ExynosDevice* device
         mVsyncAppliedTimeLine{false, 0, systemTime(SYSTEM_TIME_MONOTONIC)},
         mConfigRequestState(hwc_request_state_t::SET_CONFIG_STATE_DONE),
         mPowerHalHint(mDisplayId, mDisplayTraceName),
+        mPresentFenceWorker(this),
         mErrLogFileWriter(2, ERR_LOG_SIZE),
         mDebugDumpFileWriter(10, 1, ".dump"),
         mFenceFileWriter(2, FENCE_ERR_LOG_SIZE),
@@ -1170,11 +1207,12 @@ void ExynosDisplay::initDisplay() {
 int32_t ExynosDisplay::destroyLayer(hwc2_layer_t outLayer) {
 
     Mutex::Autolock lock(mDRMutex);
-    ExynosLayer *layer = (ExynosLayer *)outLayer;
+    ExynosLayer *layer = mLayerHandles.get(outLayer);
 
     if (layer == nullptr) {
         return HWC2_ERROR_BAD_LAYER;
     }
+    mLayerHandles.remove(outLayer);
 
     if (mLayers.remove(layer) < 0) {
         auto it = std::find(mIgnoreLayers.begin(), mIgnoreLayers.end(), layer);
@@ -1206,6 +1244,7 @@ int32_t ExynosDisplay::destroyLayer(hwc2_layer_t outLayer) {
  */
 void ExynosDisplay::destroyLayers() {
     Mutex::Autolock lock(mDRMutex);
+    mLayerHandles.clear();
     for (uint32_t index = 0; index < mLayers.size();) {
         ExynosLayer *layer = mLayers[index];
         mLayers.removeAt(index);
@@ -1220,21 +1259,11 @@ void ExynosDisplay::destroyLayers() {
 }
 
 ExynosLayer *ExynosDisplay::checkLayer(hwc2_layer_t addr) {
-    ExynosLayer *temp = (ExynosLayer *)addr;
-    if (!mLayers.isEmpty()) {
-        for (size_t i = 0; i < mLayers.size(); i++) {
-            if (mLayers[i] == temp)
-                return mLayers[i];
-        }
+    ExynosLayer *layer = mLayerHandles.get(addr);
+    if (layer == nullptr) [[unlikely]] {
+        ALOGE("HWC2 : %s : %d, wrong layer request!", __func__, __LINE__);
     }
-
-    if (mIgnoreLayers.size()) {
-        auto it = std::find(mIgnoreLayers.begin(), mIgnoreLayers.end(), temp);
-        return (it == mIgnoreLayers.end()) ? NULL : *it;
-    }
-
-    ALOGE("HWC2 : %s : %d, wrong layer request!", __func__, __LINE__);
-    return NULL;
+    return layer;
 }
 
 void ExynosDisplay::checkIgnoreLayers() {
@@ -3016,7 +3045,8 @@ int32_t ExynosDisplay::createLayer(hwc2_layer_t* outLayer) {
     /* TODO : Set z-order to max, check outLayer address? */
     layer->setLayerZOrder(1000);
 
-    *outLayer = (hwc2_layer_t)layer;
+    layer->mHandle = mLayerHandles.insert(layer);
+    *outLayer = layer->mHandle;
     setGeometryChanged(GEOMETRY_DISPLAY_LAYER_ADDED);
 
     return HWC2_ERROR_NONE;
@@ -3090,7 +3120,7 @@ int32_t ExynosDisplay::getChangedCompositionTypes(
             count++;
         } else {
             if (count < num) {
-                out_layers[count] = (hwc2_layer_t)layer;
+                out_layers[count] = layer->mHandle;
                 out_types[count] = type;
                 count++;
             } else {
@@ -3254,7 +3284,7 @@ int32_t ExynosDisplay::getDisplayRequests(
                 if ((outLayers != NULL) && (outLayerRequests != NULL)) {
                     if (requestNum >= *outNumElements)
                         return -1;
-                    outLayers[requestNum] = (hwc2_layer_t)layer;
+                    outLayers[requestNum] = layer->mHandle;
                     outLayerRequests[requestNum] = HWC2_LAYER_REQUEST_CLEAR_CLIENT_TARGET;
                 }
                 requestNum++;
@@ -3318,7 +3348,7 @@ int32_t ExynosDisplay::getReleaseFences(
                 if (deviceLayerNum < *outNumElements) {
                     // transfer fence ownership to the caller
                     setFenceName(mLayers[i]->mReleaseFence, FENCE_LAYER_RELEASE_DPP);
-                    outLayers[deviceLayerNum] = (hwc2_layer_t)mLayers[i];
+                    outLayers[deviceLayerNum] = mLayers[i]->mHandle;
                     outFences[deviceLayerNum] = mLayers[i]->mReleaseFence;
                     mLayers[i]->mReleaseFence = -1;
 
@@ -3420,22 +3450,26 @@ int32_t ExynosDisplay::presentDisplay(int32_t* outRetireFence) {
     const bool mixedComposition = isMixedComposition();
     // store this once here for the whole frame so it's consistent
     mUsePowerHints = usePowerHintSession();
+    const nsecs_t presentStartTime = systemTime(SYSTEM_TIME_MONOTONIC);
+    if (!mFrameTimeline.frameValidated()) {
+        // load target time here if validation was skipped
+        mExpectedPresentTime = getExpectedPresentTime(presentStartTime);
+        mFrameTimeline.beginFrame(presentStartTime, mExpectedPresentTime, mVsyncPeriod, false);
+    }
+    mFrameTimeline.beginPresent(presentStartTime);
+    // every early return leaves the frame unpublished, the next present must
+    // not pick up its stale expected present time
+    funcReturnCallback frameTimelineCallback([&]() { mFrameTimeline.abortFrame(); });
     if (mUsePowerHints) {
         // adds + removes the tid for adpf tracking
         mPowerHalHint.trackThisThread();
-        mPresentStartTime = systemTime(SYSTEM_TIME_MONOTONIC);
+        mPresentStartTime = presentStartTime;
         if (!mValidateStartTime.has_value()) {
             mValidationDuration = std::nullopt;
-            // load target time here if validation was skipped
-            mExpectedPresentTime = getExpectedPresentTime(mPresentStartTime);
             auto target = min(mExpectedPresentTime - mPresentStartTime,
                               static_cast<nsecs_t>(mVsyncPeriod));
-            mPowerHalHint.signalTargetWorkDuration(target);
-            // if we did not validate (have not sent hint yet) and have data for this case
-            std::optional<nsecs_t> predictedDuration = getPredictedDuration(false);
-            if (predictedDuration.has_value()) {
-                mPowerHalHint.signalActualWorkDuration(*predictedDuration);
-            }
+            // we did not validate, so the hint for this frame has not been sent yet
+            mPowerHalHint.signalFrameStart(mVsyncPeriod, target, false);
         }
         mRetireFenceWaitTime = std::nullopt;
         mValidateStartTime = std::nullopt;
@@ -3443,6 +3477,7 @@ int32_t ExynosDisplay::presentDisplay(int32_t* outRetireFence) {
 
     int ret = HWC2_ERROR_NONE;
     String8 errString;
+    nsecs_t stageStartTime = 0;
     thread_local bool setTaskProfileDone = false;
 
     if (setTaskProfileDone == false) {
@@ -3584,6 +3619,7 @@ int32_t ExynosDisplay::presentDisplay(int32_t* outRetireFence) {
         return ret;
     }
 
+    stageStartTime = systemTime(SYSTEM_TIME_MONOTONIC);
     if ((mDisplayControl.earlyStartMPP == false) &&
         ((ret = doExynosComposition()) != NO_ERROR)) {
         errString.appendFormat("exynosComposition fail (%d)\n", ret);
@@ -3629,6 +3665,10 @@ int32_t ExynosDisplay::presentDisplay(int32_t* outRetireFence) {
             }
         }
     }
+    if (mDisplayControl.earlyStartMPP == false) {
+        mFrameTimeline.addStage(FrameTimelineRecord::STAGE_M2M, stageStartTime,
+                                systemTime(SYSTEM_TIME_MONOTONIC));
+    }
 
     if ((ret = setWinConfigData()) != NO_ERROR) {
         errString.appendFormat("setWinConfigData fail (%d)\n", ret);
@@ -3653,12 +3693,15 @@ int32_t ExynosDisplay::presentDisplay(int32_t* outRetireFence) {
 
     setDisplayWinConfigData();
 
+    stageStartTime = systemTime(SYSTEM_TIME_MONOTONIC);
     if ((ret = deliverWinConfigData()) != NO_ERROR) {
         HWC_LOGE(this, "%s:: fail to deliver win_config (%d)", __func__, ret);
         if (mDpuData.retire_fence > 0)
             fence_close(mDpuData.retire_fence, this, FENCE_TYPE_RETIRE, FENCE_IP_DPP);
         mDpuData.retire_fence = -1;
     }
+    mFrameTimeline.addStage(FrameTimelineRecord::STAGE_COMMIT, stageStartTime,
+                            systemTime(SYSTEM_TIME_MONOTONIC));
 
     setReleaseFences();
 
@@ -3677,7 +3720,11 @@ int32_t ExynosDisplay::presentDisplay(int32_t* outRetireFence) {
         *outRetireFence = -1;
 
     /* Update last retire fence */
-    mLastRetireFence = fence_close(mLastRetireFence, this, FENCE_TYPE_RETIRE, FENCE_IP_DPP);
+    // it belongs to the last published frame, the worker reads its signal time
+    // and closes it
+    if (fence_valid(mLastRetireFence)) {
+        mPresentFenceWorker.queue(mFrameTimeline.lastFrameNumber(), mLastRetireFence);
+    }
     mLastRetireFence = hwc_dup((*outRetireFence), this, FENCE_TYPE_RETIRE, FENCE_IP_DPP, true);
     setFenceName(mLastRetireFence, FENCE_RETIRE);
 
@@ -3739,14 +3786,15 @@ int32_t ExynosDisplay::presentDisplay(int32_t* outRetireFence) {
         static const constexpr std::chrono::nanoseconds kFlingerOffset = 300us;
         nsecs_t now = systemTime() + kFlingerOffset.count();
 
-        updateAverages(now);
         nsecs_t duration = now - mPresentStartTime;
         if (mRetireFenceWaitTime.has_value() && mRetireFenceAcquireTime.has_value()) {
             duration = now - *mRetireFenceAcquireTime + *mRetireFenceWaitTime - mPresentStartTime;
         }
-        mPowerHalHint.signalActualWorkDuration(duration + mValidationDuration.value_or(0));
+        mPowerHalHint.signalFrameEnd(mValidationDuration, duration);
     }
 
+    mFrameTimeline.endFrame(systemTime(SYSTEM_TIME_MONOTONIC));
+
     mPriorFrameMixedComposition = mixedComposition;
 
     tryUpdateBtsFromOperationRate(false);
@@ -4664,16 +4712,13 @@ int32_t ExynosDisplay::validateDisplay(
     mUpdateCallCnt++;
     mLastUpdateTimeStamp = systemTime(SYSTEM_TIME_MONOTONIC);
 
+    mExpectedPresentTime = getExpectedPresentTime(mLastUpdateTimeStamp);
+    mFrameTimeline.beginFrame(mLastUpdateTimeStamp, mExpectedPresentTime, mVsyncPeriod, true);
     if (usePowerHintSession()) {
         mValidateStartTime = mLastUpdateTimeStamp;
-        mExpectedPresentTime = getExpectedPresentTime(*mValidateStartTime);
         auto target =
                 min(mExpectedPresentTime - *mValidateStartTime, static_cast<nsecs_t>(mVsyncPeriod));
-        mPowerHalHint.signalTargetWorkDuration(target);
-        std::optional<nsecs_t> predictedDuration = getPredictedDuration(true);
-        if (predictedDuration.has_value()) {
-            mPowerHalHint.signalActualWorkDuration(*predictedDuration);
-        }
+        mPowerHalHint.signalFrameStart(mVsyncPeriod, target, true);
     }
 
     checkIgnoreLayers();
@@ -4694,7 +4739,11 @@ int32_t ExynosDisplay::validateDisplay(
             mDevice->dynamicRecompositionThreadCreate();
     }
 
-    if ((ret = mResourceManager->assignResource(this)) != NO_ERROR) {
+    const nsecs_t assignStartTime = systemTime(SYSTEM_TIME_MONOTONIC);
+    ret = mResourceManager->assignResource(this);
+    mFrameTimeline.addStage(FrameTimelineRecord::STAGE_ASSIGN, assignStartTime,
+                            systemTime(SYSTEM_TIME_MONOTONIC));
+    if (ret != NO_ERROR) {
         validateError = true;
         HWC_LOGE(this, "%s:: assignResource() fail, display(%d), ret(%d)", __func__, mDisplayId, ret);
         String8 errString;
@@ -4769,6 +4818,8 @@ int32_t ExynosDisplay::validateDisplay(
 
     mSkipFrame = false;
 
+    mFrameTimeline.endValidate(systemTime(SYSTEM_TIME_MONOTONIC));
+
     if ((*outNumTypes == 0) && (*outNumRequests == 0))
         return HWC2_ERROR_NONE;
 
@@ -4784,6 +4835,7 @@ int32_t ExynosDisplay::startPostProcessing()
     ATRACE_CALL();
     int ret = NO_ERROR;
     String8 errString;
+    const nsecs_t startTime = systemTime(SYSTEM_TIME_MONOTONIC);
 
     float assignedCapacity = mResourceManager->getAssignedCapacity(MPP_G2D);
 
@@ -4822,6 +4874,8 @@ int32_t ExynosDisplay::startPostProcessing()
             }
         }
     }
+    mFrameTimeline.addStage(FrameTimelineRecord::STAGE_M2M, startTime,
+                            systemTime(SYSTEM_TIME_MONOTONIC));
     return ret;
 err:
     printDebugInfos(errString);
@@ -4898,6 +4952,50 @@ void ExynosDisplay::dump(String8& result)
     if (mHistogramController) {
         mHistogramController->dump(result);
     }
+    if (mDisplayInterface) {
+        mDisplayInterface->dump(result);
+    }
+    dumpFrameTimeline(result);
+}
+
+void ExynosDisplay::dumpFrameTimeline(String8& result) const {
+    static constexpr size_t kMaxDumpFrames = 16;
+    const auto stats = mFrameTimeline.stats();
+    result.appendFormat("Frame timeline: %" PRIu64 " frames, %" PRIu64 " late (", stats.frames,
+                        stats.lateFrames);
+    for (int32_t stage = 0; stage < FrameTimelineRecord::NUM_STAGES; ++stage) {
+        result.appendFormat("%s%s %" PRIu64, stage ? ", " : "",
+                            FrameTimelineRecord::stageName(stage), stats.lateByStage[stage]);
+    }
+    result.appendFormat(")\n");
+
+    // durations in us, relative to the start of the frame
+    const auto records = mFrameTimeline.snapshot();
+    const size_t first = records.size() > kMaxDumpFrames ? records.size() - kMaxDumpFrames : 0;
+    if (first < records.size()) {
+        result.appendFormat("\t   frame period validate assign   m2m present commit   fence  late "
+                            "blame\n");
+    }
+    for (size_t i = first; i < records.size(); ++i) {
+        const FrameTimelineRecord& r = records[i];
+        const int64_t startNs = r.validateStartNs ? r.validateStartNs : r.presentStartNs;
+        result.appendFormat("\t%8" PRIu64 " %6" PRId64 " %8" PRId64 " %6" PRId64 " %5" PRId64
+                            " %7" PRId64 " %6" PRId64,
+                            r.frameNumber, r.vsyncPeriodNs / 1000,
+                            r.stageNs[FrameTimelineRecord::STAGE_VALIDATE] / 1000,
+                            r.stageNs[FrameTimelineRecord::STAGE_ASSIGN] / 1000,
+                            r.stageNs[FrameTimelineRecord::STAGE_M2M] / 1000,
+                            r.stageNs[FrameTimelineRecord::STAGE_PRESENT] / 1000,
+                            r.stageNs[FrameTimelineRecord::STAGE_COMMIT] / 1000);
+        if (r.presentFenceNs > 0) {
+            result.appendFormat(" %7" PRId64 " %5" PRId64 " %s\n",
+                                (r.presentFenceNs - startNs) / 1000, r.lateNs / 1000,
+                                FrameTimelineRecord::stageName(r.lateStage));
+        } else {
+            result.appendFormat(" %7s\n", r.presentFenceNs ? "lost" : "pending");
+        }
+    }
+    result.appendFormat("\n");
 }
 
 void ExynosDisplay::dumpConfig(String8 &result, const exynos_win_config_data &c)
@@ -6179,6 +6277,14 @@ nsecs_t ExynosDisplay::getPredictedPresentTime(nsecs_t startTime) {
         ALOGV("Could not predict expected present time, fall back on target of one vsync");
         expectedPresentTime = startTime + mVsyncPeriod;
     }
+    // Snap to the nearest vsync of the grid fitted to the hardware vsync timestamps, it is less
+    // jittery than a single fence signal time.
+    int64_t vsyncTime;
+    if (mDisplayInterface->getPredictedVsyncTime(expectedPresentTime - mVsyncPeriod / 2,
+                                                 &vsyncTime) &&
+        vsyncTime >= startTime) {
+        expectedPresentTime = vsyncTime;
+    }
     return expectedPresentTime;
 }
 
@@ -6210,30 +6316,6 @@ nsecs_t ExynosDisplay::getSignalTime(int32_t fd) const {
     return nsecs_t(timestamp);
 }
 
-std::optional<nsecs_t> ExynosDisplay::getPredictedDuration(bool duringValidation) {
-    AveragesKey beforeFenceKey(mLayers.size(), duringValidation, true);
-    AveragesKey afterFenceKey(mLayers.size(), duringValidation, false);
-    if (mRollingAverages.count(beforeFenceKey) == 0 || mRollingAverages.count(afterFenceKey) == 0) {
-        return std::nullopt;
-    }
-    nsecs_t beforeReleaseFence = mRollingAverages[beforeFenceKey].average;
-    nsecs_t afterReleaseFence = mRollingAverages[afterFenceKey].average;
-    return std::make_optional(afterReleaseFence + beforeReleaseFence);
-}
-
-void ExynosDisplay::updateAverages(nsecs_t endTime) {
-    if (!mRetireFenceWaitTime.has_value() || !mRetireFenceAcquireTime.has_value()) {
-        return;
-    }
-    nsecs_t beforeFenceTime =
-            mValidationDuration.value_or(0) + (*mRetireFenceWaitTime - mPresentStartTime);
-    nsecs_t afterFenceTime = endTime - *mRetireFenceAcquireTime;
-    mRollingAverages[AveragesKey(mLayers.size(), mValidationDuration.has_value(), true)].insert(
-            beforeFenceTime);
-    mRollingAverages[AveragesKey(mLayers.size(), mValidationDuration.has_value(), false)].insert(
-            afterFenceTime);
-}
-
 int32_t ExynosDisplay::getRCDLayerSupport(bool &outSupport) const {
     outSupport = mDebugRCDLayerEnabled && mDpuData.rcdConfigs.size() > 0;
     return NO_ERROR;
@@ -6605,16 +6687,22 @@ void ExynosDisplay::resetColorMappingInfoForClientComp() {
 }
 
 void ExynosDisplay::storePrevValidateCompositionType() {
+    bool changed = mClientCompositionInfo.mPrevHasCompositionLayer !=
+            mClientCompositionInfo.mHasCompositionLayer;
+
     for (uint32_t i = 0; i < mIgnoreLayers.size(); i++) {
         ExynosLayer *layer = mIgnoreLayers[i];
+        changed |= layer->mPrevValidateCompositionType != layer->mValidateCompositionType;
         layer->mPrevValidateCompositionType = layer->mValidateCompositionType;
     }
 
     for (uint32_t i = 0; i < mLayers.size(); i++) {
         ExynosLayer *layer = mLayers[i];
+        changed |= layer->mPrevValidateCompositionType != layer->mValidateCompositionType;
         layer->mPrevValidateCompositionType = layer->mValidateCompositionType;
     }
     mClientCompositionInfo.mPrevHasCompositionLayer = mClientCompositionInfo.mHasCompositionLayer;
+    mCompositionChanged = changed;
 }
 
 displaycolor::DisplayType ExynosDisplay::getDcDisplayType() const {
@@ -35,6 +35,8 @@
 #include "ExynosHwc3Types.h"
 #include "ExynosMPP.h"
 #include "ExynosResourceManager.h"
+#include "FrameTimeline.h"
+#include "HintSessionController.h"
 #include "drmeventlistener.h"
 #include "worker.h"
 
@@ -463,6 +465,9 @@ class ExynosDisplay {
          */
         ExynosSortedLayer mLayers;
         std::vector<ExynosLayer*> mIgnoreLayers;
+        /* Resolves client layer handles to mLayers and mIgnoreLayers entries */
+        static constexpr size_t kReservedLayerHandles = 64;
+        HandleSlotTable<ExynosLayer> mLayerHandles{kReservedLayerHandles};
 
         ExynosResourceManager *mResourceManager;
 
@@ -608,6 +613,9 @@ class ExynosDisplay {
         int32_t addClientCompositionLayer(uint32_t layerIndex);
         int32_t removeClientCompositionLayer(uint32_t layerIndex);
         bool hasClientComposition();
+        /* Whether the last validateDisplay() gave any layer a composition type
+         * other than the one it had in the previous validated frame */
+        bool isCompositionChanged() const { return mCompositionChanged; }
         int32_t addExynosCompositionLayer(uint32_t layerIndex, float totalUsedCapa);
 
         bool isPowerModeOff() const;
@@ -1407,8 +1415,11 @@ class ExynosDisplay {
 
             void signalRefreshRate(hwc2_power_mode_t powerMode, int32_t refreshRate);
             void signalNonIdle();
-            void signalActualWorkDuration(nsecs_t actualDurationNanos);
-            void signalTargetWorkDuration(nsecs_t targetDurationNanos);
+            // A frame starts with targetDurationNanos left until it is due
+            void signalFrameStart(nsecs_t vsyncPeriodNanos, nsecs_t targetDurationNanos,
+                                  bool validating);
+            // The frame ends, validateNanos is empty when validation was skipped
+            void signalFrameEnd(std::optional<nsecs_t> validateNanos, nsecs_t presentNanos);
 
             void addBinderTid(pid_t tid);
             void removeBinderTid(pid_t tid);
@@ -1492,12 +1503,6 @@ class ExynosDisplay {
 
             // for normal power HAL hints
             std::shared_ptr<aidl::android::hardware::power::IPower> mPowerHalAidl;
-            // Max amount the error term can vary without causing an actual value report,
-            // as well as the target durations if not normalized
-            static constexpr const std::chrono::nanoseconds kAllowedDeviation = 300us;
-            // Target value used for initialization and normalization,
-            // the actual value does not really matter
-            static constexpr const std::chrono::nanoseconds kDefaultTarget = 50ms;
             // Whether to normalize all the actual values as error terms relative to a constant
             // target. This saves a binder call by not setting the target
             static const bool sNormalizeTarget;
@@ -1506,8 +1511,8 @@ class ExynosDisplay {
             // Whether we use or disable the rate limiter for target and actual values
             static const bool sUseRateLimiter;
             std::shared_ptr<aidl::android::hardware::power::IPowerHintSession> mPowerHintSession;
-            // queue of actual durations waiting to be reported
-            std::vector<WorkDuration> mPowerHintQueue;
+            // work prediction, batching and rate limiting of the hint session reports
+            HintSessionController mHintSessionController GUARDED_BY(mutex_);
             // display-specific binder thread tids
             std::set<pid_t> mBinderTids;
             // indicates that the tid list has changed, so the session must be rebuilt
@@ -1524,45 +1529,10 @@ class ExynosDisplay {
             bool mHintSessionSupportChecked = false;
             // used to indicate to all displays whether hint sessions are enabled/supported
             static SharedDisplayData sSharedDisplayData GUARDED_BY(sSharedDisplayMutex);
-            // latest target that was signalled
-            nsecs_t mTargetWorkDuration = kDefaultTarget.count();
-            // last target duration reported to PowerHAL
-            nsecs_t mLastTargetDurationReported = kDefaultTarget.count();
-            // latest actual duration signalled
-            std::optional<nsecs_t> mActualWorkDuration;
-            // last error term reported to PowerHAL, used for rate limiting
-            std::optional<nsecs_t> mLastErrorSent;
-            // timestamp of the last report we sent, used to avoid stale sessions
-            nsecs_t mLastActualReportTimestamp = 0;
-            // amount of time after the last message was sent before the session goes stale
-            // actually 100ms but we use 80 here to ideally avoid going stale
-            static constexpr const std::chrono::nanoseconds kStaleTimeout = 80ms;
-            // An adjustable safety margin which moves the "target" earlier to allow flinger to
-            // go a bit over without dropping a frame, especially since we can't measure
-            // the exact time HWC finishes composition so "actual" durations are measured
-            // from the end of present() instead, which is a bit later.
-            static constexpr const std::chrono::nanoseconds kTargetSafetyMargin = 2ms;
         };
 
-        // union here permits use as a key in the unordered_map without a custom hash
-        union AveragesKey {
-            struct {
-                uint16_t layers;
-                bool validated;
-                bool beforeReleaseFence;
-            };
-            uint32_t value;
-            AveragesKey(size_t layers, bool validated, bool beforeReleaseFence)
-                  : layers(static_cast<uint16_t>(layers)),
-                    validated(validated),
-                    beforeReleaseFence(beforeReleaseFence) {}
-            operator uint32_t() const { return value; }
-        };
-
-        static const constexpr int kAveragesBufferSize = 3;
         static const constexpr nsecs_t SIGNAL_TIME_PENDING = INT64_MAX;
         static const constexpr nsecs_t SIGNAL_TIME_INVALID = -1;
-        std::unordered_map<uint32_t, RollingAverage<kAveragesBufferSize>> mRollingAverages;
         // mPowerHalHint should be declared only after mDisplayId and mDisplayTraceName have been
         // declared since mDisplayId and mDisplayTraceName are needed as the parameter of
         // PowerHalHintWorker's constructor
@@ -1588,9 +1558,35 @@ class ExynosDisplay {
         nsecs_t getExpectedPresentTime(nsecs_t startTime);
         nsecs_t getPredictedPresentTime(nsecs_t startTime);
         nsecs_t getSignalTime(int32_t fd) const;
-        void updateAverages(nsecs_t endTime);
-        std::optional<nsecs_t> getPredictedDuration(bool duringValidation);
         atomic_bool mDebugRCDLayerEnabled = true;
+        // stage timestamps of the latest frames, see dumpFrameTimeline()
+        FrameTimeline mFrameTimeline;
+        void dumpFrameTimeline(String8& result) const;
+
+        // Reads the present fence signal times for mFrameTimeline off the
+        // present path
+        class PresentFenceWorker : public Worker {
+        public:
+            explicit PresentFenceWorker(ExynosDisplay* display);
+            ~PresentFenceWorker() override;
+            // Composition thread only, takes the fence over
+            void queue(uint64_t frameNumber, int32_t fence);
+
+        protected:
+            void Routine() override;
+
+        private:
+            struct PendingFence {
+                uint64_t frameNumber;
+                int32_t fence;
+            };
+            ExynosDisplay* mDisplay;
+            android::hardware::graphics::composer::SpscRing<PendingFence,
+                                                            FrameTimeline::kMaxAwaitingFences>
+                    mFences;
+        };
+        // after mFrameTimeline, the worker stops before the timeline goes
+        PresentFenceWorker mPresentFenceWorker;
 
     protected:
         inline uint32_t getDisplayVsyncPeriodFromConfig(hwc2_config_t config) {
@@ -1611,6 +1607,9 @@ class ExynosDisplay {
          * Exteranal : Plug-in, default */
         virtual bool isEnabled() { return mPlugState; }
 
+        // Frame timeline ring in the FrameTimeline::exportBinary() format
+        std::vector<uint8_t> exportFrameTimeline() const { return mFrameTimeline.exportBinary(); }
+
         // Resource TDM (Time-Division Multiplexing)
         std::map<std::pair<int32_t, int32_t>, DisplayTDMInfo> mDisplayTDMInfo;
 
@@ -1749,6 +1748,7 @@ class ExynosDisplay {
 
         void resetColorMappingInfoForClientComp();
         void storePrevValidateCompositionType();
+        bool mCompositionChanged = true;
 };
 
 #endif //_EXYNOSDISPLAY_H
@@ -17,6 +17,7 @@
 #include <aidl/android/hardware/graphics/common/BufferUsage.h>
 #include <utils/Errors.h>
 #include <linux/videodev2.h>
+#include <string.h>
 #include <sys/mman.h>
 #include <hardware/hwcomposer_defs.h>
 #include <hardware/exynos/ion.h>
@@ -224,6 +225,8 @@ int32_t ExynosLayer::doPreProcess()
                         mMetaParcel->eType = metaData->eType;
                         if (metaData->eType & VIDEO_INFO_TYPE_HDR_STATIC) {
                             mMetaParcel->sHdrStaticInfo = metaData->sHdrStaticInfo;
+                            /* no longer what the hash of SF's payload describes */
+                            mHdrStaticHash = 0;
                             HDEBUGLOGD(eDebugLayer, "HWC2: Static metadata min(%d), max(%d)",
                                     mMetaParcel->sHdrStaticInfo.sType1.mMinDisplayLuminance,
                                     mMetaParcel->sHdrStaticInfo.sType1.mMaxDisplayLuminance);
@@ -232,6 +235,7 @@ int32_t ExynosLayer::doPreProcess()
                             /* Reserved field for dynamic meta data */
                             /* Currently It's not be used not only HWC but also OMX */
                             mMetaParcel->sHdrDynamicInfo = metaData->sHdrDynamicInfo;
+                            mHdrDynamicHash = 0;
                             HDEBUGLOGD(eDebugLayer, "HWC2: Layer has dynamic metadata");
                         }
                     }
@@ -647,66 +651,13 @@ int32_t ExynosLayer::setLayerPerFrameMetadata(uint32_t numElements,
 {
     if (allocMetaParcel() != NO_ERROR)
         return -1;
-    unsigned int multipliedVal = 50000;
     mMetaParcel->eType =
         static_cast<ExynosVideoInfoType>(mMetaParcel->eType | VIDEO_INFO_TYPE_HDR_STATIC);
+    mHdrStaticHash = 0;
     for (uint32_t i = 0; i < numElements; i++) {
-        HDEBUGLOGD(eDebugLayer, "HWC2: setLayerPerFrameMetadata key(%d), value(%7.5f)",
-                keys[i], metadata[i]);
-        switch (keys[i]) {
-            case HWC2_DISPLAY_RED_PRIMARY_X:
-                mMetaParcel->sHdrStaticInfo.sType1.mR.x =
-                    (unsigned int)(metadata[i] * multipliedVal);
-                break;
-            case HWC2_DISPLAY_RED_PRIMARY_Y:
-                mMetaParcel->sHdrStaticInfo.sType1.mR.y =
-                    (unsigned int)(metadata[i] * multipliedVal);
-                break;
-            case HWC2_DISPLAY_GREEN_PRIMARY_X:
-                mMetaParcel->sHdrStaticInfo.sType1.mG.x =
-                    (unsigned int)(metadata[i] * multipliedVal);
-                break;
-            case HWC2_DISPLAY_GREEN_PRIMARY_Y:
-                mMetaParcel->sHdrStaticInfo.sType1.mG.y =
-                    (unsigned int)(metadata[i] * multipliedVal);
-                break;
-            case HWC2_DISPLAY_BLUE_PRIMARY_X:
-                mMetaParcel->sHdrStaticInfo.sType1.mB.x =
-                    (unsigned int)(metadata[i] * multipliedVal);
-                break;
-            case HWC2_DISPLAY_BLUE_PRIMARY_Y:
-                mMetaParcel->sHdrStaticInfo.sType1.mB.y =
-                    (unsigned int)(metadata[i] * multipliedVal);
-                break;
-            case HWC2_WHITE_POINT_X:
-                mMetaParcel->sHdrStaticInfo.sType1.mW.x =
-                    (unsigned int)(metadata[i] * multipliedVal);
-                break;
-            case HWC2_WHITE_POINT_Y:
-                mMetaParcel->sHdrStaticInfo.sType1.mW.y =
-                    (unsigned int)(metadata[i] * multipliedVal);
-                break;
-            case HWC2_MAX_LUMINANCE:
-                mMetaParcel->sHdrStaticInfo.sType1.mMaxDisplayLuminance =
-                    (unsigned int)(metadata[i] * 10000);
-                break;
-            case HWC2_MIN_LUMINANCE:
-                mMetaParcel->sHdrStaticInfo.sType1.mMinDisplayLuminance =
-                    (unsigned int)(metadata[i] * 10000);
-                break;
-            case HWC2_MAX_CONTENT_LIGHT_LEVEL:
-                /* Should be checked */
-                mMetaParcel->sHdrStaticInfo.sType1.mMaxContentLightLevel =
-                    (unsigned int)(metadata[i]);
-                break;
-            case HWC2_MAX_FRAME_AVERAGE_LIGHT_LEVEL:
-                /* Should be checked */
-                mMetaParcel->sHdrStaticInfo.sType1.mMaxFrameAverageLightLevel =
-                    (unsigned int)(metadata[i]);
-                break;
-            default:
-                return HWC2_ERROR_UNSUPPORTED;
-        }
+        int32_t ret = setHdrStaticMetadata(keys[i], metadata[i]);
+        if (ret != NO_ERROR)
+            return ret;
     }
     return NO_ERROR;
 }
@@ -715,25 +666,125 @@ int32_t ExynosLayer::setLayerPerFrameMetadataBlobs(uint32_t numElements, const i
         const uint8_t* metadata)
 {
     const uint8_t *metadata_start = metadata;
+    mHdrDynamicHash = 0;
     for (uint32_t i = 0; i < numElements; i++) {
-        HDEBUGLOGD(eDebugLayer, "HWC2: setLayerPerFrameMetadataBlobs key(%d)", keys[i]);
-        switch (keys[i]) {
-        case HWC2_HDR10_PLUS_SEI:
-            if (allocMetaParcel() == NO_ERROR) {
-                mMetaParcel->eType =
-                    static_cast<ExynosVideoInfoType>(mMetaParcel->eType | VIDEO_INFO_TYPE_HDR_DYNAMIC);
-                ExynosHdrDynamicInfo *info = &(mMetaParcel->sHdrDynamicInfo);
-                Exynos_parsing_user_data_registered_itu_t_t35(info, (void*)metadata_start,
-                                                              sizes[i]);
-            } else {
-                ALOGE("Layer has no metaParcel!");
-                return HWC2_ERROR_UNSUPPORTED;
-            }
+        int32_t ret = setHdrDynamicMetadata(keys[i], metadata_start, sizes[i]);
+        if (ret != HWC2_ERROR_NONE)
+            return ret;
+        metadata_start += sizes[i];
+    }
+    return HWC2_ERROR_NONE;
+}
+
+int32_t ExynosLayer::beginHdrMetadata(uint32_t type, size_t hash, const uint8_t* payload,
+                                      size_t size, bool& outChanged)
+{
+    if (allocMetaParcel() != NO_ERROR)
+        return -1;
+
+    bool isStatic = (type == VIDEO_INFO_TYPE_HDR_STATIC);
+    size_t& lastHash = isStatic ? mHdrStaticHash : mHdrDynamicHash;
+    const std::vector<uint8_t>& lastPayload = isStatic ? mHdrStaticPayload : mHdrDynamicPayload;
+    /* eType is cleared when the dataspace changes, the parcel must be rewritten then.
+     * A matching hash alone isn't enough, the bytes must match too. */
+    outChanged = !(mMetaParcel->eType & type) || (lastHash != hash) ||
+            (lastPayload.size() != size) ||
+            (size > 0 && memcmp(lastPayload.data(), payload, size) != 0);
+    if (!outChanged)
+        return NO_ERROR;
+
+    /* no hash until endHdrMetadata(), a failed entry leaves the parcel to be rewritten */
+    lastHash = 0;
+    return NO_ERROR;
+}
+
+void ExynosLayer::endHdrMetadata(uint32_t type, size_t hash, const uint8_t* payload, size_t size)
+{
+    if (mMetaParcel == nullptr)
+        return;
+
+    mMetaParcel->eType = static_cast<ExynosVideoInfoType>(mMetaParcel->eType | type);
+    bool isStatic = (type == VIDEO_INFO_TYPE_HDR_STATIC);
+    size_t& lastHash = isStatic ? mHdrStaticHash : mHdrDynamicHash;
+    std::vector<uint8_t>& lastPayload = isStatic ? mHdrStaticPayload : mHdrDynamicPayload;
+    lastHash = hash;
+    /* keeps its capacity, a payload of the same size is copied without allocating */
+    lastPayload.assign(payload, payload + size);
+}
+
+int32_t ExynosLayer::setHdrStaticMetadata(int32_t /*hw2_per_frame_metadata_key_t*/ key,
+                                          float value)
+{
+    unsigned int multipliedVal = 50000;
+    HDEBUGLOGD(eDebugLayer, "HWC2: setLayerPerFrameMetadata key(%d), value(%7.5f)", key, value);
+    switch (key) {
+        case HWC2_DISPLAY_RED_PRIMARY_X:
+            mMetaParcel->sHdrStaticInfo.sType1.mR.x = (unsigned int)(value * multipliedVal);
+            break;
+        case HWC2_DISPLAY_RED_PRIMARY_Y:
+            mMetaParcel->sHdrStaticInfo.sType1.mR.y = (unsigned int)(value * multipliedVal);
+            break;
+        case HWC2_DISPLAY_GREEN_PRIMARY_X:
+            mMetaParcel->sHdrStaticInfo.sType1.mG.x = (unsigned int)(value * multipliedVal);
+            break;
+        case HWC2_DISPLAY_GREEN_PRIMARY_Y:
+            mMetaParcel->sHdrStaticInfo.sType1.mG.y = (unsigned int)(value * multipliedVal);
+            break;
+        case HWC2_DISPLAY_BLUE_PRIMARY_X:
+            mMetaParcel->sHdrStaticInfo.sType1.mB.x = (unsigned int)(value * multipliedVal);
+            break;
+        case HWC2_DISPLAY_BLUE_PRIMARY_Y:
+            mMetaParcel->sHdrStaticInfo.sType1.mB.y = (unsigned int)(value * multipliedVal);
+            break;
+        case HWC2_WHITE_POINT_X:
+            mMetaParcel->sHdrStaticInfo.sType1.mW.x = (unsigned int)(value * multipliedVal);
+            break;
+        case HWC2_WHITE_POINT_Y:
+            mMetaParcel->sHdrStaticInfo.sType1.mW.y = (unsigned int)(value * multipliedVal);
+            break;
+        case HWC2_MAX_LUMINANCE:
+            mMetaParcel->sHdrStaticInfo.sType1.mMaxDisplayLuminance =
+                (unsigned int)(value * 10000);
+            break;
+        case HWC2_MIN_LUMINANCE:
+            mMetaParcel->sHdrStaticInfo.sType1.mMinDisplayLuminance =
+                (unsigned int)(value * 10000);
+            break;
+        case HWC2_MAX_CONTENT_LIGHT_LEVEL:
+            /* Should be checked */
+            mMetaParcel->sHdrStaticInfo.sType1.mMaxContentLightLevel = (unsigned int)(value);
+            break;
+        case HWC2_MAX_FRAME_AVERAGE_LIGHT_LEVEL:
+            /* Should be checked */
+            mMetaParcel->sHdrStaticInfo.sType1.mMaxFrameAverageLightLevel = (unsigned int)(value);
             break;
         default:
-            return HWC2_ERROR_BAD_PARAMETER;
+            /* partially written, don't let the next frame skip on a matching hash */
+            mHdrStaticHash = 0;
+            return HWC2_ERROR_UNSUPPORTED;
+    }
+    return NO_ERROR;
+}
+
+int32_t ExynosLayer::setHdrDynamicMetadata(int32_t /*hw2_per_frame_metadata_key_t*/ key,
+                                           const uint8_t* blob, uint32_t size)
+{
+    HDEBUGLOGD(eDebugLayer, "HWC2: setLayerPerFrameMetadataBlobs key(%d)", key);
+    switch (key) {
+    case HWC2_HDR10_PLUS_SEI:
+        if (allocMetaParcel() == NO_ERROR) {
+            mMetaParcel->eType =
+                static_cast<ExynosVideoInfoType>(mMetaParcel->eType | VIDEO_INFO_TYPE_HDR_DYNAMIC);
+            ExynosHdrDynamicInfo *info = &(mMetaParcel->sHdrDynamicInfo);
+            Exynos_parsing_user_data_registered_itu_t_t35(info, (void*)blob, size);
+        } else {
+            ALOGE("Layer has no metaParcel!");
+            return HWC2_ERROR_UNSUPPORTED;
         }
-        metadata_start += sizes[i];
+        break;
+    default:
+        mHdrDynamicHash = 0;
+        return HWC2_ERROR_BAD_PARAMETER;
     }
     return HWC2_ERROR_NONE;
 }
@@ -1190,12 +1241,26 @@ void ExynosLayer::printLayer()
 
 void ExynosLayer::setGeometryChanged(uint64_t changedBit)
 {
+    if (mDeferGeometryChanged) {
+        mDeferredGeometryChanged |= changedBit;
+        return;
+    }
+
     mLastUpdateTime = systemTime(CLOCK_MONOTONIC);
     mGeometryChanged |= changedBit;
     if (mRequestedCompositionType != HWC2_COMPOSITION_REFRESH_RATE_INDICATOR)
         mDisplay->setGeometryChanged(changedBit);
 }
 
+void ExynosLayer::endStateUpdate()
+{
+    mDeferGeometryChanged = false;
+    if (mDeferredGeometryChanged) {
+        setGeometryChanged(mDeferredGeometryChanged);
+        mDeferredGeometryChanged = 0;
+    }
+}
+
 int ExynosLayer::allocMetaParcel()
 {
     /* Already allocated */
@@ -25,6 +25,7 @@
 
 #include <array>
 #include <unordered_map>
+#include <vector>
 
 #include "ExynosDisplay.h"
 #include "ExynosHWC.h"
@@ -90,6 +91,9 @@ class ExynosLayer : public ExynosMPPSource {
 
         ExynosDisplay* mDisplay;
 
+        /* Handle given to the client, see ExynosDisplay::mLayerHandles */
+        hwc2_layer_t mHandle = 0;
+
         /**
          * Layer's compositionType
          *
@@ -411,6 +415,23 @@ class ExynosLayer : public ExynosMPPSource {
         int32_t setLayerPerFrameMetadataBlobs(uint32_t numElements, const int32_t* keys, const uint32_t* sizes,
                 const uint8_t* metadata);
 
+        /*
+         * Per-frame HDR metadata written entry by entry from the caller's own
+         * storage. payload is the caller's serialized form of the entries and
+         * hash its hash. beginHdrMetadata() sets outChanged to false when the
+         * parcel was last written from a payload of the same hash and bytes,
+         * the entries can be skipped then. Once every entry is set,
+         * endHdrMetadata() flags the type in the parcel and keeps a copy of
+         * the payload. type is VIDEO_INFO_TYPE_HDR_STATIC or
+         * VIDEO_INFO_TYPE_HDR_DYNAMIC.
+         */
+        int32_t beginHdrMetadata(uint32_t type, size_t hash, const uint8_t* payload, size_t size,
+                                 bool& outChanged);
+        void endHdrMetadata(uint32_t type, size_t hash, const uint8_t* payload, size_t size);
+        int32_t setHdrStaticMetadata(int32_t /*hw2_per_frame_metadata_key_t*/ key, float value);
+        int32_t setHdrDynamicMetadata(int32_t /*hw2_per_frame_metadata_key_t*/ key,
+                                      const uint8_t* blob, uint32_t size);
+
         int32_t setLayerColorTransform(const float* matrix);
         /* setLayerGenericMetadata(..., keyLength, key, mandatory, valueLength, value)
          * Descriptor: HWC2_FUNCTION_SET_LAYER_GENERIC_METADATA
@@ -508,12 +529,27 @@ class ExynosLayer : public ExynosMPPSource {
         size_t getDisplayFrameArea() { return HEIGHT(mDisplayFrame) * WIDTH(mDisplayFrame); }
         void setGeometryChanged(uint64_t changedBit);
         void clearGeometryChanged() {mGeometryChanged = 0;};
+        /*
+         * Geometry changes raised between begin and end are collected and
+         * propagated to the display once, in endStateUpdate().
+         */
+        void beginStateUpdate() { mDeferGeometryChanged = true; };
+        void endStateUpdate();
         bool isDimLayer();
         const ExynosVideoMeta* getMetaParcel() { return mMetaParcel; };
 
     private:
         ExynosVideoMeta *mMetaParcel;
         int allocMetaParcel();
+
+        bool mDeferGeometryChanged = false;
+        uint64_t mDeferredGeometryChanged = 0;
+
+        /* Payloads of the metadata last written to mMetaParcel, and their hashes */
+        size_t mHdrStaticHash = 0;
+        size_t mHdrDynamicHash = 0;
+        std::vector<uint8_t> mHdrStaticPayload;
+        std::vector<uint8_t> mHdrDynamicPayload;
 };
 
 #endif //_EXYNOSLAYER_H
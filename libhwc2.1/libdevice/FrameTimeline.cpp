@@ -0,0 +1,312 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "FrameTimeline.h"
+
+#include <algorithm>
+
+namespace {
+// reads racing with the writer are retried this many times before the
+// record is skipped
+constexpr int kMaxReadRetries = 4;
+
+void appendUint32(std::vector<uint8_t>* out, uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+        out->push_back(static_cast<uint8_t>(value >> (8 * i)));
+    }
+}
+
+void appendInt64(std::vector<uint8_t>* out, int64_t value) {
+    const uint64_t bits = static_cast<uint64_t>(value);
+    for (int i = 0; i < 8; ++i) {
+        out->push_back(static_cast<uint8_t>(bits >> (8 * i)));
+    }
+}
+} // namespace
+
+const char* FrameTimelineRecord::stageName(int32_t stage) {
+    switch (stage) {
+        case STAGE_VALIDATE:
+            return "validate";
+        case STAGE_ASSIGN:
+            return "assign";
+        case STAGE_M2M:
+            return "m2m";
+        case STAGE_PRESENT:
+            return "present";
+        case STAGE_COMMIT:
+            return "commit";
+        case STAGE_FENCE:
+            return "fence";
+        default:
+            return "-";
+    }
+}
+
+FrameTimeline::FrameTimeline(size_t capacity)
+      : mCapacity(std::max<size_t>(capacity, 1)), mSlots(new Slot[mCapacity]) {}
+
+void FrameTimeline::beginFrame(int64_t nowNs, int64_t expectedPresentNs, int64_t vsyncPeriodNs,
+                               bool validating) {
+    collectPresentFenceTimes();
+    mCurrent = FrameTimelineRecord();
+    mCurrent.vsyncPeriodNs = vsyncPeriodNs;
+    mCurrent.expectedPresentNs = expectedPresentNs;
+    if (validating) {
+        mCurrent.validateStartNs = nowNs;
+    }
+    mNestedNs = 0;
+    mOpen = true;
+}
+
+void FrameTimeline::endValidate(int64_t nowNs) {
+    if (!mOpen || mCurrent.validateStartNs == 0) {
+        return;
+    }
+    mCurrent.validateEndNs = nowNs;
+    mCurrent.stageNs[FrameTimelineRecord::STAGE_VALIDATE] =
+            std::max<int64_t>(nowNs - mCurrent.validateStartNs - mNestedNs, 0);
+    mNestedNs = 0;
+}
+
+void FrameTimeline::beginPresent(int64_t nowNs) {
+    if (!mOpen) {
+        return;
+    }
+    mCurrent.presentStartNs = nowNs;
+    mNestedNs = 0;
+}
+
+void FrameTimeline::addStage(int32_t stage, int64_t startNs, int64_t endNs) {
+    if (!mOpen || stage < 0 || stage >= FrameTimelineRecord::NUM_WORK_STAGES ||
+        stage == FrameTimelineRecord::STAGE_VALIDATE ||
+        stage == FrameTimelineRecord::STAGE_PRESENT) {
+        return;
+    }
+    const int64_t durationNs = std::max<int64_t>(endNs - startNs, 0);
+    mCurrent.stageNs[stage] += durationNs;
+    mNestedNs += durationNs;
+    if (stage == FrameTimelineRecord::STAGE_COMMIT) {
+        if (mCurrent.commitStartNs == 0) {
+            mCurrent.commitStartNs = startNs;
+        }
+        mCurrent.commitEndNs = endNs;
+    }
+}
+
+void FrameTimeline::endFrame(int64_t nowNs) {
+    if (!mOpen) {
+        return;
+    }
+    mOpen = false;
+    if (mCurrent.presentStartNs != 0) {
+        mCurrent.presentEndNs = nowNs;
+        mCurrent.stageNs[FrameTimelineRecord::STAGE_PRESENT] =
+                std::max<int64_t>(nowNs - mCurrent.presentStartNs - mNestedNs, 0);
+    }
+    collectPresentFenceTimes();
+    // the oldest frame waited long enough
+    if (mAwaitingCount == kMaxAwaitingFences) {
+        resolveOldest(-1);
+    }
+    mCurrent.frameNumber = mPublished.load(std::memory_order_relaxed) + 1;
+    publish(mCurrent);
+    mAwaiting[(mAwaitingHead + mAwaitingCount) % kMaxAwaitingFences] = mCurrent;
+    mAwaitingCount++;
+}
+
+void FrameTimeline::abortFrame() {
+    mOpen = false;
+    mNestedNs = 0;
+}
+
+void FrameTimeline::collectPresentFenceTimes() {
+    FenceTime fenceTime;
+    while (mFenceTimes.pop(fenceTime)) {
+        while (mAwaitingCount > 0 &&
+               mAwaiting[mAwaitingHead].frameNumber <= fenceTime.frameNumber) {
+            resolveOldest(mAwaiting[mAwaitingHead].frameNumber == fenceTime.frameNumber
+                                  ? fenceTime.signalNs
+                                  : -1);
+        }
+    }
+}
+
+bool FrameTimeline::setPresentFenceTime(uint64_t frameNumber, int64_t signalNs) {
+    return mFenceTimes.push({frameNumber, signalNs});
+}
+
+void FrameTimeline::resolveOldest(int64_t signalNs) {
+    FrameTimelineRecord& record = mAwaiting[mAwaitingHead];
+    mAwaitingHead = (mAwaitingHead + 1) % kMaxAwaitingFences;
+    mAwaitingCount--;
+
+    record.presentFenceNs = signalNs > 0 ? signalNs : -1;
+    if (signalNs > 0) {
+        attribute(&record);
+        mFrames.fetch_add(1, std::memory_order_relaxed);
+        if (record.lateStage != FrameTimelineRecord::kNoStage) {
+            mLateFrames.fetch_add(1, std::memory_order_relaxed);
+            mLateByStage[record.lateStage].fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    // the slot may already hold a newer frame when the ring is tiny
+    if (mPublished.load(std::memory_order_relaxed) - record.frameNumber < mCapacity) {
+        publish(record);
+    }
+}
+
+void FrameTimeline::attribute(FrameTimelineRecord* record) const {
+    const int64_t periodNs = record->vsyncPeriodNs;
+    record->lateNs = record->presentFenceNs - record->expectedPresentNs;
+    if (periodNs <= 0 || record->expectedPresentNs <= 0 || record->lateNs <= periodNs / 2) {
+        record->lateStage = FrameTimelineRecord::kNoStage;
+        return;
+    }
+
+    record->lateStage = FrameTimelineRecord::STAGE_FENCE;
+    int64_t worstOverrunNs = 0;
+    for (int32_t stage = 0; stage < FrameTimelineRecord::NUM_WORK_STAGES; ++stage) {
+        const int64_t overrunNs =
+                record->stageNs[stage] - periodNs * kStageBudgetPercent[stage] / 100;
+        if (overrunNs > worstOverrunNs) {
+            worstOverrunNs = overrunNs;
+            record->lateStage = stage;
+        }
+    }
+}
+
+void FrameTimeline::pack(const FrameTimelineRecord& record, int64_t* words) {
+    size_t i = 0;
+    words[i++] = static_cast<int64_t>(record.frameNumber);
+    words[i++] = record.vsyncPeriodNs;
+    words[i++] = record.expectedPresentNs;
+    words[i++] = record.validateStartNs;
+    words[i++] = record.validateEndNs;
+    words[i++] = record.presentStartNs;
+    words[i++] = record.presentEndNs;
+    words[i++] = record.commitStartNs;
+    words[i++] = record.commitEndNs;
+    words[i++] = record.presentFenceNs;
+    for (int64_t stageNs : record.stageNs) {
+        words[i++] = stageNs;
+    }
+    words[i++] = record.lateStage;
+    words[i++] = record.lateNs;
+}
+
+void FrameTimeline::unpack(const int64_t* words, FrameTimelineRecord* record) {
+    size_t i = 0;
+    record->frameNumber = static_cast<uint64_t>(words[i++]);
+    record->vsyncPeriodNs = words[i++];
+    record->expectedPresentNs = words[i++];
+    record->validateStartNs = words[i++];
+    record->validateEndNs = words[i++];
+    record->presentStartNs = words[i++];
+    record->presentEndNs = words[i++];
+    record->commitStartNs = words[i++];
+    record->commitEndNs = words[i++];
+    record->presentFenceNs = words[i++];
+    for (int64_t& stageNs : record->stageNs) {
+        stageNs = words[i++];
+    }
+    record->lateStage = static_cast<int32_t>(words[i++]);
+    record->lateNs = words[i++];
+}
+
+void FrameTimeline::publish(const FrameTimelineRecord& record) {
+    Slot& slot = mSlots[(record.frameNumber - 1) % mCapacity];
+    int64_t words[kRecordWords];
+    pack(record, words);
+
+    const uint32_t seq = slot.seq.load(std::memory_order_relaxed);
+    slot.seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < kRecordWords; ++i) {
+        slot.words[i].store(words[i], std::memory_order_relaxed);
+    }
+    slot.seq.store(seq + 2, std::memory_order_release);
+
+    if (record.frameNumber > mPublished.load(std::memory_order_relaxed)) {
+        mPublished.store(record.frameNumber, std::memory_order_release);
+    }
+}
+
+bool FrameTimeline::read(uint64_t frameNumber, FrameTimelineRecord* record) const {
+    const Slot& slot = mSlots[(frameNumber - 1) % mCapacity];
+    int64_t words[kRecordWords];
+    for (int attempt = 0; attempt < kMaxReadRetries; ++attempt) {
+        const uint32_t seq = slot.seq.load(std::memory_order_acquire);
+        if (seq & 1) {
+            continue;
+        }
+        for (size_t i = 0; i < kRecordWords; ++i) {
+            words[i] = slot.words[i].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.seq.load(std::memory_order_relaxed) != seq) {
+            continue;
+        }
+        unpack(words, record);
+        // overwritten by a newer frame since the caller looked
+        return record->frameNumber == frameNumber;
+    }
+    return false;
+}
+
+std::vector<FrameTimelineRecord> FrameTimeline::snapshot() const {
+    const uint64_t published = mPublished.load(std::memory_order_acquire);
+    const uint64_t first = published > mCapacity ? published - mCapacity + 1 : 1;
+
+    std::vector<FrameTimelineRecord> records;
+    records.reserve(published - first + 1);
+    FrameTimelineRecord record;
+    for (uint64_t frameNumber = first; frameNumber <= published; ++frameNumber) {
+        if (read(frameNumber, &record)) {
+            records.push_back(record);
+        }
+    }
+    return records;
+}
+
+FrameTimeline::Stats FrameTimeline::stats() const {
+    Stats stats;
+    stats.frames = mFrames.load(std::memory_order_relaxed);
+    stats.lateFrames = mLateFrames.load(std::memory_order_relaxed);
+    for (int32_t stage = 0; stage < FrameTimelineRecord::NUM_STAGES; ++stage) {
+        stats.lateByStage[stage] = mLateByStage[stage].load(std::memory_order_relaxed);
+    }
+    return stats;
+}
+
+std::vector<uint8_t> FrameTimeline::exportBinary() const {
+    const std::vector<FrameTimelineRecord> records = snapshot();
+
+    std::vector<uint8_t> out;
+    out.reserve(4 * sizeof(uint32_t) + records.size() * kRecordWords * sizeof(int64_t));
+    appendUint32(&out, kExportMagic);
+    appendUint32(&out, kExportVersion);
+    appendUint32(&out, static_cast<uint32_t>(records.size()));
+    appendUint32(&out, static_cast<uint32_t>(kRecordWords));
+    int64_t words[kRecordWords];
+    for (const FrameTimelineRecord& record : records) {
+        pack(record, words);
+        for (int64_t word : words) {
+            appendInt64(&out, word);
+        }
+    }
+    return out;
+}
@@ -0,0 +1,183 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "../libvrr/SpscRing.h"
+
+// Where the time of a frame went, from the start of validate to the vsync the
+// frame was scanned out on.
+struct FrameTimelineRecord {
+    // Stages of the composer work of a frame. Each one accounts for its own
+    // time only, validate and present exclude the stages they run.
+    enum Stage : int32_t {
+        STAGE_VALIDATE = 0,
+        STAGE_ASSIGN,  // resource assignment
+        STAGE_M2M,     // G2D composition and M2M MPP processing
+        STAGE_PRESENT,
+        STAGE_COMMIT,  // win config delivery, i.e. the atomic commit
+        NUM_WORK_STAGES,
+        // None of the stages overran, the present fence signaled late anyway
+        STAGE_FENCE = NUM_WORK_STAGES,
+        NUM_STAGES,
+    };
+    static constexpr int32_t kNoStage = -1;
+
+    uint64_t frameNumber = 0;
+    int64_t vsyncPeriodNs = 0;
+    // vsync the frame was due on
+    int64_t expectedPresentNs = 0;
+    // 0 when validation was skipped
+    int64_t validateStartNs = 0;
+    int64_t validateEndNs = 0;
+    int64_t presentStartNs = 0;
+    int64_t presentEndNs = 0;
+    int64_t commitStartNs = 0;
+    int64_t commitEndNs = 0;
+    // vsync the frame was scanned out on, 0 until known and -1 when the
+    // fence was lost
+    int64_t presentFenceNs = 0;
+    int64_t stageNs[NUM_WORK_STAGES] = {};
+    // stage the frame is blamed on, kNoStage when on time
+    int32_t lateStage = kNoStage;
+    int64_t lateNs = 0;
+
+    static const char* stageName(int32_t stage);
+};
+
+// Ring of the latest frame timelines of a display.
+//
+// Written by the composition thread only. Readers (dumpsys, the HWC service)
+// never block the writer: every slot is a seqlock over atomic words, a read
+// that races with a write of the same slot is retried and then skipped.
+//
+// Present fences are read off the present path. A resolver thread hands the
+// signal times over through a lock-free ring, the writer picks them up when
+// the next frame begins or ends. Frames wait for their fence until
+// kMaxAwaitingFences newer frames are waiting too.
+//
+// A frame is late when its present fence signals more than half a vsync
+// after the expected present time. It is then attributed to the stage that
+// overran its share of the vsync period by the most, or to the fence when no
+// stage did.
+class FrameTimeline {
+public:
+    static constexpr size_t kDefaultCapacity = 128;
+    static constexpr size_t kMaxAwaitingFences = 8;
+
+    // Share of the vsync period each stage may take, in percent
+    static constexpr int32_t kStageBudgetPercent[FrameTimelineRecord::NUM_WORK_STAGES] =
+            {20, 10, 30, 10, 30};
+
+    struct Stats {
+        uint64_t frames = 0;
+        uint64_t lateFrames = 0;
+        uint64_t lateByStage[FrameTimelineRecord::NUM_STAGES] = {};
+    };
+
+    explicit FrameTimeline(size_t capacity = kDefaultCapacity);
+
+    // Writer side, composition thread only.
+    //
+    // A frame begins at validate, or at present when validation was skipped.
+    // An open frame that never presented is dropped.
+    void beginFrame(int64_t nowNs, int64_t expectedPresentNs, int64_t vsyncPeriodNs,
+                    bool validating);
+    bool frameOpen() const { return mOpen; }
+    // Whether the open frame began at validate
+    bool frameValidated() const { return mOpen && mCurrent.validateStartNs != 0; }
+    void endValidate(int64_t nowNs);
+    void beginPresent(int64_t nowNs);
+    void addStage(int32_t stage, int64_t startNs, int64_t endNs);
+    // Publishes the frame, its present fence resolves later
+    void endFrame(int64_t nowNs);
+    // Drops the open frame without publishing it, for a present that returned
+    // early. A no-op once the frame ended.
+    void abortFrame();
+    // Number of the last published frame, 0 before the first one
+    uint64_t lastFrameNumber() const { return mPublished.load(std::memory_order_relaxed); }
+    // Applies the fence times handed over by setPresentFenceTime(). Done when
+    // a frame begins or ends, only needed on its own to catch up when idle.
+    void collectPresentFenceTimes();
+
+    // Resolver side, a single thread other than the writer may take it.
+    //
+    // Present fence signal time of a published frame, anything not positive
+    // gives the frame up. Older frames still waiting are given up too, their
+    // fences were never handed over. False when the handoff is full.
+    bool setPresentFenceTime(uint64_t frameNumber, int64_t signalNs);
+
+    // Reader side, any thread.
+    //
+    // Records oldest first
+    std::vector<FrameTimelineRecord> snapshot() const;
+    Stats stats() const;
+    // Little endian: magic, version, record count and words per record as
+    // uint32_t, then the records as int64_t words in field order.
+    std::vector<uint8_t> exportBinary() const;
+
+    static constexpr uint32_t kExportMagic = 0x4c544646; // "FFTL"
+    static constexpr uint32_t kExportVersion = 1;
+    static constexpr size_t kRecordWords = 12 + FrameTimelineRecord::NUM_WORK_STAGES;
+
+private:
+    struct Slot {
+        std::atomic<uint32_t> seq{0};
+        std::atomic<int64_t> words[kRecordWords];
+    };
+
+    struct FenceTime {
+        uint64_t frameNumber;
+        int64_t signalNs;
+    };
+
+    static void pack(const FrameTimelineRecord& record, int64_t* words);
+    static void unpack(const int64_t* words, FrameTimelineRecord* record);
+    void publish(const FrameTimelineRecord& record);
+    bool read(uint64_t frameNumber, FrameTimelineRecord* record) const;
+    void attribute(FrameTimelineRecord* record) const;
+    // resolves the oldest frame waiting for its fence
+    void resolveOldest(int64_t signalNs);
+
+    const size_t mCapacity;
+    std::unique_ptr<Slot[]> mSlots;
+    // frames published, frame n lives in slot (n - 1) % mCapacity
+    std::atomic<uint64_t> mPublished{0};
+
+    std::atomic<uint64_t> mFrames{0};
+    std::atomic<uint64_t> mLateFrames{0};
+    std::atomic<uint64_t> mLateByStage[FrameTimelineRecord::NUM_STAGES] = {};
+
+    android::hardware::graphics::composer::SpscRing<FenceTime, 2 * kMaxAwaitingFences>
+            mFenceTimes;
+
+    // writer only
+    FrameTimelineRecord mCurrent;
+    bool mOpen = false;
+    // nested stage time to take out of validate and present
+    int64_t mNestedNs = 0;
+    // frames waiting for their fence, oldest at mAwaitingHead
+    std::array<FrameTimelineRecord, kMaxAwaitingFences> mAwaiting;
+    size_t mAwaitingHead = 0;
+    size_t mAwaitingCount = 0;
+};
@@ -0,0 +1,190 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "HintSessionController.h"
+
+#include <stdlib.h>
+
+#include <algorithm>
+
+HintSessionController::HintSessionController(const Config& config)
+      : mConfig(config),
+        mFrameTargetNs(config.defaultTargetNs),
+        mLastTargetReportedNs(config.defaultTargetNs) {}
+
+int32_t HintSessionController::refreshRateOf(int64_t vsyncPeriodNs) {
+    if (vsyncPeriodNs <= 0) {
+        return 0;
+    }
+    return static_cast<int32_t>((1000000000 + vsyncPeriodNs / 2) / vsyncPeriodNs);
+}
+
+void HintSessionController::beginFrame(int64_t nowNs, int64_t vsyncPeriodNs, int64_t targetNs,
+                                       bool validating) {
+    mRefreshRate = refreshRateOf(vsyncPeriodNs);
+    mFrameTargetNs = targetNs - mConfig.targetSafetyMarginNs;
+    mModels[mRefreshRate].target.insert(mFrameTargetNs);
+
+    // Report the prediction right away, PowerHAL can ramp up before the
+    // frame is measured.
+    mPredictedNs = predict(vsyncPeriodNs, validating);
+    if (mPredictedNs.has_value()) {
+        queueDuration(nowNs, *mPredictedNs);
+    }
+}
+
+void HintSessionController::endFrame(int64_t nowNs, std::optional<int64_t> validateNs,
+                                     int64_t presentNs) {
+    RateModel& model = mModels[mRefreshRate];
+    if (validateNs.has_value()) {
+        model.validate.insert(*validateNs);
+    }
+    model.present[validateNs.has_value()].insert(presentNs);
+
+    const int64_t actualNs = validateNs.value_or(0) + presentNs;
+    mStats.frames++;
+    if (mPredictedNs.has_value()) {
+        mStats.predictions++;
+        mStats.predictionErrorNs += llabs(*mPredictedNs - actualNs);
+        mPredictedNs.reset();
+    }
+    queueDuration(nowNs, actualNs);
+}
+
+std::optional<int64_t> HintSessionController::predict(int64_t vsyncPeriodNs,
+                                                      bool validating) const {
+    auto it = mModels.find(refreshRateOf(vsyncPeriodNs));
+    if (it == mModels.end()) {
+        return std::nullopt;
+    }
+    const RateModel& model = it->second;
+    if (!model.present[validating].value.has_value()) {
+        return std::nullopt;
+    }
+    if (!validating) {
+        return model.present[false].value;
+    }
+    if (!model.validate.value.has_value()) {
+        return std::nullopt;
+    }
+    return *model.validate.value + *model.present[true].value;
+}
+
+void HintSessionController::queueDuration(int64_t nowNs, int64_t durationNs) {
+    int64_t reportedNs = durationNs;
+    if (mConfig.normalizeTarget) {
+        reportedNs += mLastTargetReportedNs - mFrameTargetNs;
+    } else if (mLastTargetReportedNs != mConfig.defaultTargetNs && mFrameTargetNs != 0) {
+        reportedNs = static_cast<int64_t>(static_cast<long double>(mLastTargetReportedNs) /
+                                          mFrameTargetNs * durationNs);
+    }
+    mLastReportedDurationNs = reportedNs;
+
+    if (mQueue.size() >= mConfig.maxQueuedDurations) {
+        mQueue.erase(mQueue.begin());
+        mStats.durationsDropped++;
+    }
+    mQueue.push_back({.timeStampNanos = nowNs, .durationNanos = reportedNs});
+}
+
+int64_t HintSessionController::maxDeviationNs() const {
+    // to disable the rate limiter we just use a max deviation of 1
+    return mConfig.useRateLimiter ? mConfig.allowedDeviationNs : 1;
+}
+
+// The smoothed target of the current refresh rate, the raw frame target
+// without the rate limiter.
+int64_t HintSessionController::targetCandidateNs() const {
+    if (!mConfig.useRateLimiter) {
+        return mFrameTargetNs;
+    }
+    auto it = mModels.find(mRefreshRate);
+    if (it == mModels.end() || !it->second.target.value.has_value()) {
+        return mFrameTargetNs;
+    }
+    return *it->second.target.value;
+}
+
+bool HintSessionController::needTargetUpdate() const {
+    if (mConfig.normalizeTarget) {
+        return false;
+    }
+    return llabs(targetCandidateNs() - mLastTargetReportedNs) >= maxDeviationNs();
+}
+
+int64_t HintSessionController::takeTargetUpdate() {
+    mLastTargetReportedNs = targetCandidateNs();
+    mStats.targetUpdates++;
+    return mLastTargetReportedNs;
+}
+
+int64_t HintSessionController::takeSessionTarget() {
+    if (!mConfig.normalizeTarget) {
+        mLastTargetReportedNs = targetCandidateNs();
+    }
+    return mLastTargetReportedNs;
+}
+
+bool HintSessionController::errorDeviates() const {
+    if (!mLastReportedDurationNs.has_value() || !mLastErrorSentNs.has_value()) {
+        return false;
+    }
+    return llabs((*mLastReportedDurationNs - mFrameTargetNs) - *mLastErrorSentNs) >=
+            maxDeviationNs();
+}
+
+bool HintSessionController::needReport(int64_t nowNs) const {
+    if (mQueue.empty()) {
+        return false;
+    }
+    if (!mLastErrorSentNs.has_value() || nowNs - mLastReportNs > mConfig.staleTimeoutNs) {
+        return true;
+    }
+    if (!mConfig.useRateLimiter) {
+        return errorDeviates();
+    }
+    if (mQueue.size() >= mConfig.maxQueuedDurations) {
+        return true;
+    }
+    return errorDeviates() && nowNs - mLastReportNs >= mConfig.minReportIntervalNs;
+}
+
+int64_t HintSessionController::nextReportDelayNs(int64_t nowNs) const {
+    if (mQueue.empty()) {
+        return -1;
+    }
+    if (needReport(nowNs)) {
+        return 0;
+    }
+    int64_t dueNs = mLastReportNs + mConfig.staleTimeoutNs + 1;
+    if (mConfig.useRateLimiter && errorDeviates()) {
+        dueNs = std::min(dueNs, mLastReportNs + mConfig.minReportIntervalNs);
+    }
+    return std::max<int64_t>(dueNs - nowNs, 0);
+}
+
+std::vector<HintWorkDuration> HintSessionController::takeReport(int64_t nowNs) {
+    if (mLastReportedDurationNs.has_value()) {
+        mLastErrorSentNs = *mLastReportedDurationNs - mFrameTargetNs;
+    }
+    mLastReportNs = nowNs;
+    mStats.reports++;
+    mStats.durationsReported += mQueue.size();
+
+    std::vector<HintWorkDuration> batch;
+    batch.swap(mQueue);
+    return batch;
+}
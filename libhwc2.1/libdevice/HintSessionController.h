@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <map>
+#include <optional>
+#include <vector>
+
+// Work duration as reported to the PowerHAL hint session
+struct HintWorkDuration {
+    int64_t timeStampNanos;
+    int64_t durationNanos;
+};
+
+// Decides what a display reports to its PowerHAL hint session and when.
+//
+// Frame work is predicted from a model of validate and present durations kept
+// per refresh rate, so the prediction is right from the first frame after a
+// refresh rate switch. Actual durations are queued and sent in batches, at
+// most one batch per minReportIntervalNs unless the session is about to go
+// stale. The reported target follows the smoothed target of the current
+// refresh rate rather than the per-frame one.
+//
+// Only bookkeeping, the caller makes the binder calls with what
+// takeTargetUpdate() and takeReport() return. Not thread safe.
+class HintSessionController {
+public:
+    struct Config {
+        // Smallest change of target or error term worth a report
+        int64_t allowedDeviationNs = 300000; // 300 us
+        // Reports held back for at most this long, about one 60Hz frame
+        int64_t minReportIntervalNs = 16000000; // 16 ms
+        // Session goes stale after 100 ms without a report, keep a margin
+        int64_t staleTimeoutNs = 80000000; // 80 ms
+        // A full queue is sent right away, the oldest durations are dropped
+        // when nothing takes it
+        size_t maxQueuedDurations = 64;
+        // Moves the target earlier so small overruns don't drop a frame
+        int64_t targetSafetyMarginNs = 2000000; // 2 ms
+        // Target used before any frame and for normalization
+        int64_t defaultTargetNs = 50000000; // 50 ms
+        // Report error terms relative to a constant target instead of
+        // updating the target
+        bool normalizeTarget = false;
+        // Without it every change of error term and target is reported
+        bool useRateLimiter = true;
+    };
+
+    struct Stats {
+        uint64_t frames = 0;
+        uint64_t reports = 0;
+        uint64_t durationsReported = 0;
+        uint64_t durationsDropped = 0;
+        uint64_t targetUpdates = 0;
+        uint64_t predictions = 0;
+        // Sum of |predicted - measured| over the predicted frames
+        int64_t predictionErrorNs = 0;
+    };
+
+    HintSessionController() : HintSessionController(Config()) {}
+    explicit HintSessionController(const Config& config);
+
+    // A frame starts with targetNs left until it is due. Queues the predicted
+    // work of the frame when the model knows its refresh rate.
+    void beginFrame(int64_t nowNs, int64_t vsyncPeriodNs, int64_t targetNs, bool validating);
+    // The frame ends, validateNs is empty when validation was skipped.
+    void endFrame(int64_t nowNs, std::optional<int64_t> validateNs, int64_t presentNs);
+
+    std::optional<int64_t> predict(int64_t vsyncPeriodNs, bool validating) const;
+
+    bool needTargetUpdate() const;
+    // Returns the target to send and takes it as reported
+    int64_t takeTargetUpdate();
+
+    bool needReport(int64_t nowNs) const;
+    // Time until a held back report is due, -1 when none is waiting
+    int64_t nextReportDelayNs(int64_t nowNs) const;
+    // Returns the batch to send and takes it as reported
+    std::vector<HintWorkDuration> takeReport(int64_t nowNs);
+    // The next queued duration is reported whatever the rate limiter says
+    void forceReport() { mLastErrorSentNs.reset(); }
+
+    // Target to create a session with, taken as reported
+    int64_t takeSessionTarget();
+
+    int64_t frameTargetNs() const { return mFrameTargetNs; }
+    int64_t lastTargetReportedNs() const { return mLastTargetReportedNs; }
+    std::optional<int64_t> lastReportedDurationNs() const { return mLastReportedDurationNs; }
+    const Stats& stats() const { return mStats; }
+
+private:
+    // Exponential moving average, 1 / kModelWeight per sample
+    struct Average {
+        static constexpr int64_t kModelWeight = 4;
+        std::optional<int64_t> value;
+        void insert(int64_t sample) {
+            value = value.has_value() ? *value + (sample - *value) / kModelWeight : sample;
+        }
+    };
+
+    struct RateModel {
+        Average validate;
+        // Indexed by whether the frame was validated, present does more work
+        // when validation was skipped.
+        Average present[2];
+        Average target;
+    };
+
+    static int32_t refreshRateOf(int64_t vsyncPeriodNs);
+    void queueDuration(int64_t nowNs, int64_t durationNs);
+    int64_t maxDeviationNs() const;
+    int64_t targetCandidateNs() const;
+    bool errorDeviates() const;
+
+    const Config mConfig;
+    std::map<int32_t, RateModel> mModels;
+    int32_t mRefreshRate = 0;
+
+    // target of the current frame, safety margin applied
+    int64_t mFrameTargetNs;
+    int64_t mLastTargetReportedNs;
+    std::optional<int64_t> mPredictedNs;
+
+    std::vector<HintWorkDuration> mQueue;
+    // latest duration queued, as reported
+    std::optional<int64_t> mLastReportedDurationNs;
+    // error term of the last batch sent
+    std::optional<int64_t> mLastErrorSentNs;
+    int64_t mLastReportNs = 0;
+
+    Stats mStats;
+};
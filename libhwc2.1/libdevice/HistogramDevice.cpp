@@ -18,13 +18,16 @@
 
 #include "HistogramDevice.h"
 
+#include <cutils/properties.h>
 #include <drm/samsung_drm.h>
+#include <inttypes.h>
 
 #include <sstream>
 #include <string>
 
 #include "ExynosDisplayDrmInterface.h"
 #include "ExynosHWCHelper.h"
+#include "SoftwareHistogram.h"
 #include "android-base/macros.h"
 
 /**
@@ -59,8 +62,7 @@ HistogramDevice::ChannelInfo::ChannelInfo()
         requestedRoi(DISABLED_ROI),
         requestedBlockingRoi(DISABLED_ROI),
         workingConfig(),
-        threshold(0),
-        histDataCollecting(false) {}
+        threshold(0) {}
 
 HistogramDevice::ChannelInfo::ChannelInfo(const ChannelInfo& other) {
     std::scoped_lock lock(other.channelInfoMutex);
@@ -71,7 +73,6 @@ HistogramDevice::ChannelInfo::ChannelInfo(const ChannelInfo& other) {
     requestedBlockingRoi = other.requestedBlockingRoi;
     workingConfig = other.workingConfig;
     threshold = other.threshold;
-    histDataCollecting = other.histDataCollecting;
 }
 
 HistogramDevice::HistogramDevice(ExynosDisplay* display, uint8_t channelCount,
@@ -80,6 +81,7 @@ HistogramDevice::HistogramDevice(ExynosDisplay* display, uint8_t channelCount,
 
     // TODO: b/295786065 - Get available channels from crtc property.
     initChannels(channelCount, reservedChannels);
+    initQueryPipeline(channelCount);
 
     /* Create the death recipient which will be deleted in the destructor */
     mDeathRecipient = AIBinder_DeathRecipient_new(histogramOnBinderDied);
@@ -280,18 +282,8 @@ void HistogramDevice::handleDrmEvent(void* event) {
         return;
     }
 
-    ChannelInfo& channel = mChannels[channelId];
-    std::unique_lock<std::mutex> lock(channel.histDataCollectingMutex);
-
-    /* Check if the histogram channel is collecting the histogram data */
-    if (channel.histDataCollecting == true) {
-        std::memcpy(channel.histData, buffer, HISTOGRAM_BIN_COUNT * sizeof(char16_t));
-        channel.histDataCollecting = false;
-    } else {
-        ALOGW("%s: histogram channel #%u: ignore the histogram channel event", __func__, channelId);
-    }
-
-    channel.histDataCollecting_cv.notify_all();
+    /* The data is kept even if no client is waiting, the next query may be served with it */
+    mQueryPipeline->onEvent(channelId, buffer);
 }
 
 void HistogramDevice::prepareAtomicCommit(ExynosDisplayDrmInterface::DrmModeAtomicReq& drmReq) {
@@ -314,6 +306,11 @@ void HistogramDevice::prepareAtomicCommit(ExynosDisplayDrmInterface::DrmModeAtom
 
     /* Loop through every channel and call prepareChannelCommit */
     for (uint8_t channelId = 0; channelId < mChannels.size(); ++channelId) {
+        /* The working roi is converted again, the latest histogram data is not for it anymore */
+        if (isResolutionChanged) {
+            mQueryPipeline->invalidate(channelId);
+        }
+
         int channelRet = prepareChannelCommit(drmReq, channelId, moduleDisplayInterface,
                                               isResolutionChanged);
 
@@ -326,6 +323,8 @@ void HistogramDevice::prepareAtomicCommit(ExynosDisplayDrmInterface::DrmModeAtom
 }
 
 void HistogramDevice::postAtomicCommit() {
+    mQueryPipeline->onFrameCommitted();
+
     /* Atomic commit is success, loop through every channel and update the channel status */
     for (uint8_t channelId = 0; channelId < mChannels.size(); ++channelId) {
         ChannelInfo& channel = mChannels[channelId];
@@ -380,6 +379,27 @@ void HistogramDevice::dump(String8& result) const {
     }
 
     result.appendFormat("\n");
+
+    /* print the histogram query pipeline info */
+    const HistogramQueryPipeline::Stats stats = mQueryPipeline->stats();
+    result.appendFormat("Histogram query: async %s, maxAgeFrames %d, frameSeq %" PRIu64 "\n",
+                        mQueryPipeline->pipelined() ? "true" : "false",
+                        mQueryPipeline->maxAgeFrames(), mQueryPipeline->frameSeq());
+    result.appendFormat("\tqueries %" PRIu64 ", cacheHits %" PRIu64 ", requests %" PRIu64
+                        ", prefetches %" PRIu64 ", coalesced %" PRIu64 ", timeouts %" PRIu64
+                        ", events %" PRIu64 ", unexpectedEvents %" PRIu64 "\n",
+                        stats.queries, stats.cacheHits, stats.requests, stats.prefetches,
+                        stats.coalesced, stats.timeouts, stats.events, stats.unexpectedEvents);
+    for (uint8_t channelId = 0; channelId < mChannels.size(); ++channelId) {
+        uint64_t frameSeq;
+        bool outstanding;
+        if (mQueryPipeline->channelState(channelId, &frameSeq, &outstanding) || outstanding) {
+            result.appendFormat("\t#%u: dataFrameSeq %" PRIu64 ", requestOutstanding %s\n",
+                                channelId, frameSeq, outstanding ? "true" : "false");
+        }
+    }
+
+    result.appendFormat("\n");
 }
 
 void HistogramDevice::initChannels(uint8_t channelCount,
@@ -507,81 +527,82 @@ ndk::ScopedAStatus HistogramDevice::configHistogram(const ndk::SpAIBinder& token
     return ndk::ScopedAStatus::ok();
 }
 
+void HistogramDevice::initQueryPipeline(uint8_t channelCount) {
+    mQueryPipeline = std::make_unique<HistogramQueryPipeline>(
+            channelCount, HISTOGRAM_BIN_COUNT,
+            [this](uint8_t channelId) -> int32_t {
+                ExynosDisplayDrmInterface* moduleDisplayInterface =
+                        static_cast<ExynosDisplayDrmInterface*>(mDisplay->mDisplayInterface.get());
+                if (!moduleDisplayInterface) {
+                    return NO_INIT;
+                }
+                /* Send the ioctl request (histogram_channel_request_ioctl) which allocate the drm
+                 * event and send back the drm event with data when available. */
+                return moduleDisplayInterface
+                        ->sendHistogramChannelIoctl(HistogramChannelIoctl_t::REQUEST, channelId);
+            },
+            [this](uint8_t channelId) {
+                ExynosDisplayDrmInterface* moduleDisplayInterface =
+                        static_cast<ExynosDisplayDrmInterface*>(mDisplay->mDisplayInterface.get());
+                if (!moduleDisplayInterface) {
+                    return;
+                }
+                ALOGI("%s: histogram channel #%u: cancel histogram data request", __func__,
+                      channelId);
+                int32_t ret;
+                if ((ret = moduleDisplayInterface
+                                   ->sendHistogramChannelIoctl(HistogramChannelIoctl_t::CANCEL,
+                                                               channelId)) != NO_ERROR) {
+                    ALOGE("%s: histogram channel #%u: sendHistogramChannelIoctl (CANCEL) error "
+                          "(%d)",
+                          __func__, channelId, ret);
+                }
+            });
+
+    if (property_get_bool("vendor.display.histogram.async_query", false)) {
+        mQueryPipeline->setMaxAgeFrames(
+                property_get_int32("vendor.display.histogram.max_age_frames", 0));
+        mQueryPipeline->setPipelined(true);
+    }
+    ALOGI("%s: histogram query async %s, maxAgeFrames %d", __func__,
+          mQueryPipeline->pipelined() ? "true" : "false", mQueryPipeline->maxAgeFrames());
+}
+
 void HistogramDevice::getHistogramData(uint8_t channelId, std::vector<char16_t>* histogramBuffer,
                                        HistogramErrorCode* histogramErrorCode) {
     ATRACE_NAME(String8::format("%s #%u", __func__, channelId).c_str());
-    int32_t ret;
-    ExynosDisplayDrmInterface* moduleDisplayInterface =
-            static_cast<ExynosDisplayDrmInterface*>(mDisplay->mDisplayInterface.get());
-    if (!moduleDisplayInterface) {
-        *histogramErrorCode = HistogramErrorCode::BAD_HIST_DATA;
-        ALOGE("%s: histogram channel #%u: BAD_HIST_DATA, moduleDisplayInterface is nullptr",
-              __func__, channelId);
-        return;
-    }
-
-    ChannelInfo& channel = mChannels[channelId];
-
-    std::unique_lock<std::mutex> lock(channel.histDataCollectingMutex);
-
-    /* Check if the previous queryHistogram is finished */
-    if (channel.histDataCollecting) {
-        *histogramErrorCode = HistogramErrorCode::BAD_HIST_DATA;
-        ALOGE("%s: histogram channel #%u: BAD_HIST_DATA, previous %s not finished", __func__,
-              channelId, __func__);
-        return;
-    }
-
-    /* Send the ioctl request (histogram_channel_request_ioctl) which allocate the drm event and
-     * send back the drm event with data when available. */
-    if ((ret = moduleDisplayInterface->sendHistogramChannelIoctl(HistogramChannelIoctl_t::REQUEST,
-                                                                 channelId)) != NO_ERROR) {
-        *histogramErrorCode = HistogramErrorCode::BAD_HIST_DATA;
-        ALOGE("%s: histogram channel #%u: BAD_HIST_DATA, sendHistogramChannelIoctl (REQUEST) "
-              "error "
-              "(%d)",
-              __func__, channelId, ret);
-        return;
-    }
-    channel.histDataCollecting = true;
+    HistogramQueryPipeline::Result result;
+    uint64_t frameSeq = 0;
 
     {
         ATRACE_NAME(String8::format("waitDrmEvent #%u", channelId).c_str());
-        /* Wait until the condition variable is notified or timeout. */
-        channel.histDataCollecting_cv.wait_for(lock, std::chrono::milliseconds(50),
-                                               [this, &channel]() {
-                                                   return (!mDisplay->isPowerModeOff() &&
-                                                           !channel.histDataCollecting);
-                                               });
+        result = mQueryPipeline->query(channelId, std::chrono::milliseconds(50), histogramBuffer,
+                                       &frameSeq);
     }
 
-    /* If the histDataCollecting is not cleared, check the reason and clear the histogramBuffer.
-     */
-    if (channel.histDataCollecting) {
-        if (mDisplay->isPowerModeOff()) {
-            *histogramErrorCode = HistogramErrorCode::DISPLAY_POWEROFF;
-            ALOGW("%s: histogram channel #%u: DISPLAY_POWEROFF, histogram is not available "
-                  "when "
-                  "display is off",
-                  __func__, channelId);
-        } else {
+    switch (result) {
+        case HistogramQueryPipeline::Result::OK:
+            break;
+        case HistogramQueryPipeline::Result::REQUEST_ERROR:
             *histogramErrorCode = HistogramErrorCode::BAD_HIST_DATA;
-            ALOGE("%s: histogram channel #%u: BAD_HIST_DATA, no histogram channel event is "
-                  "handled",
+            ALOGE("%s: histogram channel #%u: BAD_HIST_DATA, sendHistogramChannelIoctl (REQUEST) "
+                  "error",
                   __func__, channelId);
-        }
-
-        /* Cancel the histogram data request */
-        ALOGI("%s: histogram channel #%u: cancel histogram data request", __func__, channelId);
-        if ((ret = moduleDisplayInterface
-                           ->sendHistogramChannelIoctl(HistogramChannelIoctl_t::CANCEL,
-                                                       channelId)) != NO_ERROR) {
-            ALOGE("%s: histogram channel #%u: sendHistogramChannelIoctl (CANCEL) error (%d)",
-                  __func__, channelId, ret);
-        }
-
-        channel.histDataCollecting = false;
-        return;
+            return;
+        case HistogramQueryPipeline::Result::TIMEOUT:
+            if (mDisplay->isPowerModeOff()) {
+                *histogramErrorCode = HistogramErrorCode::DISPLAY_POWEROFF;
+                ALOGW("%s: histogram channel #%u: DISPLAY_POWEROFF, histogram is not available "
+                      "when "
+                      "display is off",
+                      __func__, channelId);
+            } else {
+                *histogramErrorCode = HistogramErrorCode::BAD_HIST_DATA;
+                ALOGE("%s: histogram channel #%u: BAD_HIST_DATA, no histogram channel event is "
+                      "handled",
+                      __func__, channelId);
+            }
+            return;
     }
 
     if (mDisplay->isSecureContentPresenting()) {
@@ -592,8 +613,8 @@ void HistogramDevice::getHistogramData(uint8_t channelId, std::vector<char16_t>*
         return;
     }
 
-    /* Copy the histogram data from histogram info to histogramBuffer */
-    histogramBuffer->assign(channel.histData, channel.histData + HISTOGRAM_BIN_COUNT);
+    ALOGV("%s: histogram channel #%u: histogram data of frame %" PRIu64, __func__, channelId,
+          frameSeq);
 }
 
 int HistogramDevice::parseDrmEvent(void* event, uint8_t& channelId, char16_t*& buffer) const {
@@ -658,6 +679,7 @@ void HistogramDevice::cleanupChannelInfo(uint8_t channelId) {
                              .samplePos = HistogramSamplePos::POST_POSTPROC,
                              .blockingRoi = DISABLED_ROI};
     channel.threshold = 0;
+    mQueryPipeline->invalidate(channelId);
 }
 
 void HistogramDevice::fillupChannelInfo(uint8_t channelId, const ndk::SpAIBinder& token,
@@ -673,6 +695,7 @@ void HistogramDevice::fillupChannelInfo(uint8_t channelId, const ndk::SpAIBinder
     channel.workingConfig = histogramConfig;
     channel.workingConfig.roi = DISABLED_ROI;
     channel.workingConfig.blockingRoi = DISABLED_ROI;
+    mQueryPipeline->invalidate(channelId);
 }
 
 int HistogramDevice::prepareChannelCommit(ExynosDisplayDrmInterface::DrmModeAtomicReq& drmReq,
@@ -901,9 +924,8 @@ int HistogramDevice::calculateThreshold(const HistogramRoiRect& roi) const {
     /* If roi is disabled, the targeted region is entire screen. */
     int32_t roiH = (roi != DISABLED_ROI) ? (roi.right - roi.left) : mDisplayActiveH;
     int32_t roiV = (roi != DISABLED_ROI) ? (roi.bottom - roi.top) : mDisplayActiveV;
-    int threshold = (roiV * roiH) >> 16;
     // TODO: b/294491895 - Check if the threshold plus one really need it
-    return threshold + 1;
+    return SoftwareHistogram::calculateThreshold(roiH, roiV);
 }
 
 std::string HistogramDevice::toString(const ChannelStatus_t& status) {
@@ -26,13 +26,14 @@
 #include <drm/samsung_drm.h>
 #include <utils/String8.h>
 
-#include <condition_variable>
+#include <memory>
 #include <mutex>
 #include <queue>
 #include <unordered_map>
 
 #include "ExynosDisplay.h"
 #include "ExynosDisplayDrmInterface.h"
+#include "HistogramQueryPipeline.h"
 #include "drmcrtc.h"
 
 using namespace android;
@@ -87,9 +88,6 @@ public:
         /* protect the channel info fields */
         mutable std::mutex channelInfoMutex;
 
-        /* protect histDataCollecting variable */
-        mutable std::mutex histDataCollectingMutex;
-
         /* track the channel status */
         ChannelStatus_t status GUARDED_BY(channelInfoMutex);
 
@@ -113,11 +111,6 @@ public:
          * histogram data (16 bits) overflow */
         int threshold GUARDED_BY(channelInfoMutex);
 
-        /* histogram data would be stored as part of the channel info */
-        uint16_t histData[HISTOGRAM_BIN_COUNT];
-        bool histDataCollecting; // GUARDED_BY(histDataCollectingMutex);
-        std::condition_variable histDataCollecting_cv;
-
         ChannelInfo();
         ChannelInfo(const ChannelInfo& other);
     };
@@ -249,8 +242,8 @@ public:
     /**
      * handleDrmEvent
      *
-     * Handle the histogram channel drm event (EXYNOS_DRM_HISTOGRAM_CHANNEL_EVENT) and copy the
-     * histogram data from event struct to channel info.
+     * Handle the histogram channel drm event (EXYNOS_DRM_HISTOGRAM_CHANNEL_EVENT) and publish the
+     * histogram data from event struct to the query pipeline of the channel.
      *
      * @event histogram channel drm event pointer (struct exynos_drm_histogram_channel_event *)
      */
@@ -268,7 +261,8 @@ public:
     /**
      * postAtomicCommit
      *
-     * After the atomic commit is done, update the channel status as below.
+     * After the atomic commit is done, update the channel status as below and advance the frame
+     * sequence of the query pipeline.
      * Channel_Status:
      *     CONFIG_BLOB_ADDED  -> CONFIG_COMMITTED
      *     DISABLE_BLOB_ADDED -> DISABLED
@@ -296,6 +290,9 @@ private:
     int32_t mDisplayActiveV = 0;
     ExynosDisplay* mDisplay = nullptr;
 
+    /* Histogram data requests of every channel, see HistogramQueryPipeline */
+    std::unique_ptr<HistogramQueryPipeline> mQueryPipeline;
+
     /* Death recipient for the binderdied callback, would be deleted in the destructor */
     AIBinder_DeathRecipient* mDeathRecipient = nullptr;
 
@@ -341,12 +338,25 @@ private:
                                        const HistogramConfig& histogramConfig,
                                        HistogramErrorCode* histogramErrorCode, bool isReconfig);
 
+    /**
+     * initQueryPipeline
+     *
+     * Create the mQueryPipeline for the channels. The asynchronous query mode is enabled by the
+     * vendor.display.histogram.async_query property: a query is served from the latest histogram
+     * data without a wait when it is at most vendor.display.histogram.max_age_frames commits old,
+     * and the request for the next query is sent ahead of time.
+     *
+     * @channelCount number of channels in the system including the reserved channels.
+     */
+    void initQueryPipeline(uint8_t channelCount);
+
     /**
      * getHistogramData
      *
-     * Get the histogram data by sending ioctl request which will allocate the drm event for
-     * histogram, and wait on the condition variable histDataCollecting_cv until the drm event is
-     * handled or timeout. Copy the histogram data from channel info to histogramBuffer.
+     * Get the histogram data from the query pipeline. If the latest histogram data of the channel
+     * is not fresh enough, send the ioctl request which will allocate the drm event for histogram
+     * (or join the request already sent by another client), and wait until the drm event is
+     * handled or timeout. Copy the histogram data to histogramBuffer.
      *
      * @channelId histogram channel id.
      * @histogramBuffer AIDL created buffer which will be sent back to the client.
@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "HistogramQueryPipeline.h"
+
+#include <algorithm>
+
+HistogramQueryPipeline::HistogramQueryPipeline(size_t channelCount, size_t binCount,
+                                               RequestFn request, CancelFn cancel)
+      : mBinCount(binCount),
+        mRequest(std::move(request)),
+        mCancel(std::move(cancel)),
+        mChannels(new Channel[channelCount]),
+        mChannelCount(channelCount) {
+    for (size_t i = 0; i < mChannelCount; ++i) {
+        for (auto& buffer : mChannels[i].buffers) {
+            buffer.assign(mBinCount, 0);
+        }
+    }
+}
+
+void HistogramQueryPipeline::count(uint64_t Stats::*counter) {
+    std::scoped_lock lock(mStatsMutex);
+    mStats.*counter += 1;
+}
+
+bool HistogramQueryPipeline::frontFreshLocked(const Channel& channel) const {
+    const int32_t maxAgeFrames = mMaxAgeFrames.load(std::memory_order_relaxed);
+    if (maxAgeFrames < 0 || !channel.frontValid || channel.frontFrameSeq < channel.minFrameSeq) {
+        return false;
+    }
+    return frameSeq() - channel.frontFrameSeq <= static_cast<uint64_t>(maxAgeFrames);
+}
+
+int32_t HistogramQueryPipeline::sendRequestLocked(uint8_t channelId, Channel& channel) {
+    if (channel.outstanding) {
+        return 0;
+    }
+    if (int32_t ret = mRequest(channelId); ret != 0) {
+        return ret;
+    }
+    channel.requested++;
+    channel.outstanding = true;
+    count(&Stats::requests);
+    return 0;
+}
+
+HistogramQueryPipeline::Result HistogramQueryPipeline::query(uint8_t channelId,
+                                                             std::chrono::nanoseconds timeout,
+                                                             std::vector<char16_t>* out,
+                                                             uint64_t* outFrameSeq) {
+    if (channelId >= mChannelCount) {
+        return Result::REQUEST_ERROR;
+    }
+    count(&Stats::queries);
+
+    Channel& channel = mChannels[channelId];
+    std::unique_lock<std::mutex> lock(channel.mutex);
+
+    if (frontFreshLocked(channel)) {
+        count(&Stats::cacheHits);
+    } else {
+        if (channel.outstanding) {
+            count(&Stats::coalesced);
+        } else if (sendRequestLocked(channelId, channel) != 0) {
+            return Result::REQUEST_ERROR;
+        }
+
+        const uint64_t target = channel.requested;
+        channel.cv.wait_for(lock, timeout, [&channel, target]() {
+            return channel.delivered >= target || !channel.outstanding;
+        });
+
+        if (channel.delivered < target) {
+            // the first waiter to give up cancels the request for everybody
+            if (channel.outstanding && channel.requested == target) {
+                mCancel(channelId);
+                channel.outstanding = false;
+                channel.cv.notify_all();
+            }
+            count(&Stats::timeouts);
+            return Result::TIMEOUT;
+        }
+    }
+
+    const std::vector<char16_t>& front = channel.buffers[channel.front];
+    out->assign(front.begin(), front.end());
+    if (outFrameSeq) {
+        *outFrameSeq = channel.frontFrameSeq;
+    }
+
+    // the next query finds the data of a later frame waiting
+    if (mPipelined.load(std::memory_order_relaxed) && !channel.outstanding &&
+        sendRequestLocked(channelId, channel) == 0) {
+        count(&Stats::prefetches);
+    }
+    return Result::OK;
+}
+
+void HistogramQueryPipeline::onEvent(uint8_t channelId, const char16_t* data) {
+    if (channelId >= mChannelCount) {
+        return;
+    }
+    count(&Stats::events);
+
+    Channel& channel = mChannels[channelId];
+    std::scoped_lock lock(channel.mutex);
+    const int back = 1 - channel.front;
+    std::copy(data, data + mBinCount, channel.buffers[back].begin());
+    channel.front = back;
+    channel.frontValid = true;
+    channel.frontFrameSeq = frameSeq();
+
+    if (channel.outstanding) {
+        channel.delivered = channel.requested;
+        channel.outstanding = false;
+    } else {
+        count(&Stats::unexpectedEvents);
+    }
+    channel.cv.notify_all();
+}
+
+void HistogramQueryPipeline::invalidate(uint8_t channelId) {
+    if (channelId >= mChannelCount) {
+        return;
+    }
+    Channel& channel = mChannels[channelId];
+    std::scoped_lock lock(channel.mutex);
+    channel.minFrameSeq = frameSeq() + 1;
+}
+
+HistogramQueryPipeline::Stats HistogramQueryPipeline::stats() const {
+    std::scoped_lock lock(mStatsMutex);
+    return mStats;
+}
+
+bool HistogramQueryPipeline::channelState(uint8_t channelId, uint64_t* frameSeq,
+                                          bool* outstanding) const {
+    if (channelId >= mChannelCount) {
+        return false;
+    }
+    const Channel& channel = mChannels[channelId];
+    std::scoped_lock lock(channel.mutex);
+    *frameSeq = channel.frontValid ? channel.frontFrameSeq : 0;
+    *outstanding = channel.outstanding;
+    return channel.frontValid;
+}
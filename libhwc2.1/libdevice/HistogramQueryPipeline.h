@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// Histogram data requests of the channels of one display.
+//
+// A histogram request (the REQUEST ioctl) is answered by one drm event carrying
+// the data of the next frame. The event lands in the back buffer of a per
+// channel double buffer and is published by flipping it to the front, stamped
+// with the frame sequence (the number of atomic commits so far) it arrived at.
+// The published sample stays intact while a newer request is in flight.
+//
+// query() returns the front sample without waiting when it is at most
+// maxAgeFrames commits old, else it waits for the event of the outstanding
+// request of the channel, sending one when there is none. Concurrent callers
+// of a channel share one outstanding request. In pipelined mode every served
+// query sends the request for the next one ahead of time.
+//
+// Thread safe. onEvent() is called by the single drm event thread.
+class HistogramQueryPipeline {
+public:
+    enum class Result : uint32_t {
+        OK = 0,
+        // the request could not be sent
+        REQUEST_ERROR,
+        // no event arrived in time, the request was cancelled
+        TIMEOUT,
+    };
+
+    struct Stats {
+        uint64_t queries = 0;
+        // served from the front sample without a wait
+        uint64_t cacheHits = 0;
+        // requests sent, and those sent ahead of time by the pipelining
+        uint64_t requests = 0;
+        uint64_t prefetches = 0;
+        // callers that joined an outstanding request
+        uint64_t coalesced = 0;
+        uint64_t timeouts = 0;
+        uint64_t events = 0;
+        // events that arrived with no request outstanding
+        uint64_t unexpectedEvents = 0;
+    };
+
+    // Sends the REQUEST ioctl of the channel, returns 0 on success
+    using RequestFn = std::function<int32_t(uint8_t channelId)>;
+    // Sends the CANCEL ioctl of the channel
+    using CancelFn = std::function<void(uint8_t channelId)>;
+
+    // maxAgeFrames below 0 never serves the front sample, every query waits
+    // for an event like the blocking mode always did
+    static constexpr int32_t kAlwaysRequest = -1;
+
+    HistogramQueryPipeline(size_t channelCount, size_t binCount, RequestFn request,
+                           CancelFn cancel);
+
+    void setMaxAgeFrames(int32_t maxAgeFrames) { mMaxAgeFrames = maxAgeFrames; }
+    int32_t maxAgeFrames() const { return mMaxAgeFrames; }
+    void setPipelined(bool pipelined) { mPipelined = pipelined; }
+    bool pipelined() const { return mPipelined; }
+
+    // Copies the histogram of the channel into out. The frame sequence of the
+    // sample goes to outFrameSeq when not null.
+    Result query(uint8_t channelId, std::chrono::nanoseconds timeout, std::vector<char16_t>* out,
+                 uint64_t* outFrameSeq = nullptr);
+
+    // Drm event of the channel with binCount bins of data
+    void onEvent(uint8_t channelId, const char16_t* data);
+
+    // An atomic commit has been done
+    void onFrameCommitted() { mFrameSeq.fetch_add(1, std::memory_order_relaxed); }
+    uint64_t frameSeq() const { return mFrameSeq.load(std::memory_order_relaxed); }
+
+    // The config of the channel changes from the next commit on, samples
+    // taken before it are not served from the cache anymore
+    void invalidate(uint8_t channelId);
+
+    Stats stats() const;
+    // Frame sequence of the front sample and whether a request is outstanding
+    bool channelState(uint8_t channelId, uint64_t* frameSeq, bool* outstanding) const;
+
+private:
+    struct Channel {
+        mutable std::mutex mutex;
+        std::condition_variable cv;
+
+        std::vector<char16_t> buffers[2];
+        // index of the published buffer
+        int front = 0;
+        bool frontValid = false;
+        uint64_t frontFrameSeq = 0;
+        // front samples stamped before this are stale
+        uint64_t minFrameSeq = 0;
+
+        // requests sent and events received, a caller waiting for request n
+        // is done once delivered reaches n
+        uint64_t requested = 0;
+        uint64_t delivered = 0;
+        bool outstanding = false;
+    };
+
+    bool frontFreshLocked(const Channel& channel) const;
+    void count(uint64_t Stats::*counter);
+    // Sends a request when none is outstanding, returns 0 on success
+    int32_t sendRequestLocked(uint8_t channelId, Channel& channel);
+
+    const size_t mBinCount;
+    const RequestFn mRequest;
+    const CancelFn mCancel;
+    std::unique_ptr<Channel[]> mChannels;
+    const size_t mChannelCount;
+
+    std::atomic<int32_t> mMaxAgeFrames{kAlwaysRequest};
+    std::atomic_bool mPipelined{false};
+    std::atomic<uint64_t> mFrameSeq{0};
+
+    mutable std::mutex mStatsMutex;
+    Stats mStats;
+};
@@ -0,0 +1,188 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "RefreshRateVoteEngine.h"
+
+#include <errno.h>
+#include <limits.h>
+
+#include <algorithm>
+#include <fstream>
+
+RefreshRateVoteEngine::RefreshRateVoteEngine(const Config& config)
+      : mConfig(config),
+        mMinIdleFpsVotes(config.throttlePriorities.size(), 0),
+        mThrottleVotes(config.throttlePriorities.size(), 0),
+        mIdleDelayVotes(std::max(config.numIdleRequesters, config.throttleIdleRequester + 1), 0) {}
+
+void RefreshRateVoteEngine::setMinIdleFpsVote(size_t requester, int fps) {
+    mMinIdleFpsVotes[requester] = std::max(fps, 0);
+}
+
+void RefreshRateVoteEngine::setThrottleVote(size_t requester, int64_t delayNs) {
+    mThrottleVotes[requester] = std::max<int64_t>(delayNs, 0);
+}
+
+void RefreshRateVoteEngine::setIdleDelayVote(size_t requester, int64_t delayNs) {
+    // the throttle requester follows the applied throttle
+    if (requester == mConfig.throttleIdleRequester) {
+        return;
+    }
+    mIdleDelayVotes[requester] = std::max<int64_t>(delayNs, 0);
+}
+
+void RefreshRateVoteEngine::setPanelIdleVote(bool enabled) {
+    mPanelIdleVote = enabled;
+}
+
+void RefreshRateVoteEngine::setPanelIdleState(bool enabled) {
+    mPanelIdleVote = enabled;
+    mApplied.panelIdle = enabled;
+}
+
+template <typename T>
+int64_t RefreshRateVoteEngine::aggregate(const std::vector<T>& votes,
+                                         const std::vector<int>& priorities,
+                                         int64_t floor) const {
+    int topPriority = INT_MIN;
+    int64_t result = 0;
+    auto consider = [&](int priority, int64_t vote) {
+        if (vote <= 0) {
+            return;
+        }
+        if (priority > topPriority) {
+            topPriority = priority;
+            result = vote;
+        } else if (priority == topPriority) {
+            result = std::max(result, vote);
+        }
+    };
+
+    consider(0, floor);
+    for (size_t i = 0; i < votes.size(); i++) {
+        consider(i < priorities.size() ? priorities[i] : 0, votes[i]);
+    }
+    return result;
+}
+
+bool RefreshRateVoteEngine::shouldApply(Output& output, int64_t target, int64_t holdNs,
+                                        int64_t nowNs) {
+    if (target >= output.applied || holdNs <= 0) {
+        if (output.relaxSinceNs >= 0) {
+            mStats.relaxCancelled++;
+            output.relaxSinceNs = -1;
+        }
+        return target != output.applied;
+    }
+
+    if (output.relaxSinceNs < 0) {
+        mStats.relaxDeferred++;
+        output.relaxSinceNs = nowNs;
+        return false;
+    }
+    return nowNs - output.relaxSinceNs >= holdNs;
+}
+
+void RefreshRateVoteEngine::commit(Output& output, int64_t target) {
+    output.applied = target;
+    output.relaxSinceNs = -1;
+}
+
+void RefreshRateVoteEngine::backOff(Output& output, int64_t nowNs) {
+    // A relaxation that failed to apply waits a full hold again, its old
+    // deadline is in the past and would wake the caller right away
+    if (output.relaxSinceNs >= 0) {
+        output.relaxSinceNs = nowNs;
+    }
+}
+
+int32_t RefreshRateVoteEngine::writeNode(const char* node, int64_t value) {
+    std::ofstream ofs(mConfig.sysfsDir + node);
+    if (!ofs.is_open()) {
+        mStats.writeErrors++;
+        return errno ? errno : EIO;
+    }
+    ofs << value;
+    ofs.close();
+    if (ofs.fail()) {
+        mStats.writeErrors++;
+        return errno ? errno : EIO;
+    }
+    return 0;
+}
+
+int32_t RefreshRateVoteEngine::decide(int64_t nowNs) {
+    mStats.decisions++;
+    int32_t error = 0;
+
+    // The throttle is in memory only, it feeds the idle delay of this decision
+    const int64_t throttleNs = aggregate(mThrottleVotes, mConfig.throttlePriorities, 0);
+    if (shouldApply(mThrottle, throttleNs, mConfig.throttleRelaxHoldNs, nowNs)) {
+        commit(mThrottle, throttleNs);
+        mApplied.throttleNs = throttleNs;
+    }
+    mIdleDelayVotes[mConfig.throttleIdleRequester] = mApplied.throttleNs;
+
+    const int64_t idleDelayNs = aggregate(mIdleDelayVotes, {}, 0);
+    if (shouldApply(mIdleDelay, idleDelayNs, mConfig.idleDelayRelaxHoldNs, nowNs)) {
+        if (int32_t ret = writeNode("idle_delay_ms", idleDelayNs / 1000000); ret != 0) {
+            backOff(mIdleDelay, nowNs);
+            error = ret;
+        } else {
+            commit(mIdleDelay, idleDelayNs);
+            mApplied.idleDelayNs = idleDelayNs;
+            mStats.idleDelayWrites++;
+        }
+    }
+
+    if (mPanelIdleVote != mApplied.panelIdle) {
+        if (int32_t ret = writeNode("panel_idle", mPanelIdleVote); ret != 0) {
+            error = error ? error : ret;
+        } else {
+            mApplied.panelIdle = mPanelIdleVote;
+            mStats.panelIdleWrites++;
+        }
+    }
+
+    const int64_t minIdleFps =
+            aggregate(mMinIdleFpsVotes, mConfig.minIdleFpsPriorities, mConfig.defaultMinIdleFps);
+    if (shouldApply(mMinIdleFps, minIdleFps, mConfig.minIdleFpsRelaxHoldNs, nowNs)) {
+        if (int32_t ret = writeNode("min_vrefresh", minIdleFps); ret != 0) {
+            backOff(mMinIdleFps, nowNs);
+            error = error ? error : ret;
+        } else {
+            commit(mMinIdleFps, minIdleFps);
+            mApplied.minIdleFps = static_cast<int>(minIdleFps);
+            mStats.minIdleFpsWrites++;
+        }
+    }
+    return error;
+}
+
+int64_t RefreshRateVoteEngine::nextDeadlineNs() const {
+    int64_t deadlineNs = -1;
+    auto consider = [&deadlineNs](const Output& output, int64_t holdNs) {
+        if (output.relaxSinceNs < 0) {
+            return;
+        }
+        const int64_t dueNs = output.relaxSinceNs + holdNs;
+        deadlineNs = deadlineNs < 0 ? dueNs : std::min(deadlineNs, dueNs);
+    };
+    consider(mThrottle, mConfig.throttleRelaxHoldNs);
+    consider(mIdleDelay, mConfig.idleDelayRelaxHoldNs);
+    consider(mMinIdleFps, mConfig.minIdleFpsRelaxHoldNs);
+    return deadlineNs;
+}
@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+// Aggregates the votes on the idle refresh rate policy of a panel and applies
+// the result to its sysfs nodes:
+//   min_vrefresh   min idle refresh rate, votes per throttle requester
+//   idle_delay_ms  panel idle timer delay, votes per idle timer requester,
+//                  the refresh rate throttle is one of them
+//   panel_idle     panel idle timer enable
+// The refresh rate throttle itself is kept in memory for the config change
+// timeline.
+//
+// Every requester has a priority per output, votes of the highest priority
+// with any vote win and are combined by max within it. Lower priorities are
+// ignored, e.g. a test override of the throttle beats the product votes. The
+// min refresh rate has its own priorities, so it can keep combining every
+// vote by max and no requester can lower a floor set by another one.
+//
+// Higher values of the min refresh rate, the idle delay and the throttle keep
+// the panel faster. They are applied right away, lower values only once they
+// have held for the relax hold time of the output. A vote that bounces back
+// within the hold never reaches the panel.
+//
+// Votes are set first and applied together by decide(), each node is written
+// at most once per decision and only when its value changes. Not thread safe.
+class RefreshRateVoteEngine {
+public:
+    struct Config {
+        // panel sysfs directory, with the trailing slash
+        std::string sysfsDir;
+        // priority of each throttle requester, its size is the number of
+        // requesters
+        std::vector<int> throttlePriorities;
+        // priority of each min idle refresh rate requester, the same
+        // requesters as the throttle; missing entries are 0
+        std::vector<int> minIdleFpsPriorities;
+        // number of idle timer requesters, and the one standing for the
+        // refresh rate throttle
+        size_t numIdleRequesters = 0;
+        size_t throttleIdleRequester = 0;
+        // min idle refresh rate when no requester votes, at priority 0
+        int defaultMinIdleFps = 0;
+        int64_t minIdleFpsRelaxHoldNs = 0;
+        int64_t idleDelayRelaxHoldNs = 0;
+        int64_t throttleRelaxHoldNs = 0;
+    };
+
+    struct Decision {
+        int minIdleFps = 0;
+        int64_t idleDelayNs = 0;
+        bool panelIdle = false;
+        int64_t throttleNs = 0;
+    };
+
+    struct Stats {
+        uint64_t decisions = 0;
+        uint64_t minIdleFpsWrites = 0;
+        uint64_t idleDelayWrites = 0;
+        uint64_t panelIdleWrites = 0;
+        uint64_t writeErrors = 0;
+        // lower values held back by the hysteresis, and those of them that
+        // were cancelled by a higher vote before they were applied
+        uint64_t relaxDeferred = 0;
+        uint64_t relaxCancelled = 0;
+    };
+
+    explicit RefreshRateVoteEngine(const Config& config);
+
+    // fps <= 0 withdraws the vote
+    void setMinIdleFpsVote(size_t requester, int fps);
+    // 0 withdraws the vote
+    void setThrottleVote(size_t requester, int64_t delayNs);
+    void setIdleDelayVote(size_t requester, int64_t delayNs);
+    void setPanelIdleVote(bool enabled);
+    // Takes the current panel idle enable as applied, without writing it
+    void setPanelIdleState(bool enabled);
+
+    // Applies the votes. Returns 0, or the errno of the first node that
+    // could not be written; that output is retried by the next decision, a
+    // held back lower value only after another relax hold.
+    int32_t decide(int64_t nowNs);
+    // When decide() has a held back value to apply, -1 when none
+    int64_t nextDeadlineNs() const;
+
+    const Decision& applied() const { return mApplied; }
+    int minIdleFpsVote(size_t requester) const { return mMinIdleFpsVotes[requester]; }
+    int64_t throttleVote(size_t requester) const { return mThrottleVotes[requester]; }
+    int64_t idleDelayVote(size_t requester) const { return mIdleDelayVotes[requester]; }
+    const Stats& stats() const { return mStats; }
+
+private:
+    // An output with hysteresis on lower values
+    struct Output {
+        int64_t applied = 0;
+        // lower target waiting since relaxSinceNs, -1 when none
+        int64_t relaxSinceNs = -1;
+    };
+
+    template <typename T>
+    int64_t aggregate(const std::vector<T>& votes, const std::vector<int>& priorities,
+                      int64_t floor) const;
+    // Whether target should be applied now, tracks the held back relaxation
+    bool shouldApply(Output& output, int64_t target, int64_t holdNs, int64_t nowNs);
+    static void commit(Output& output, int64_t target);
+    static void backOff(Output& output, int64_t nowNs);
+    int32_t writeNode(const char* node, int64_t value);
+
+    const Config mConfig;
+    std::vector<int> mMinIdleFpsVotes;
+    std::vector<int64_t> mThrottleVotes;
+    std::vector<int64_t> mIdleDelayVotes;
+    bool mPanelIdleVote = false;
+
+    Output mMinIdleFps;
+    Output mThrottle;
+    Output mIdleDelay;
+    Decision mApplied;
+    Stats mStats;
+};
@@ -0,0 +1,177 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SoftwareHistogram.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include <algorithm>
+
+namespace {
+
+// Pixels are converted to luma a block at a time before they are counted
+constexpr int32_t kBlockPixels = 64;
+
+// Four lanes map to one NEON or SSE register
+typedef uint32_t U32x4 __attribute__((vector_size(16)));
+constexpr int32_t kLanes = 4;
+
+inline uint32_t lumaOf(uint32_t pixel, uint32_t weightR, uint32_t weightG, uint32_t weightB) {
+    // RGBA8888, R in the lowest byte
+    const uint32_t r = pixel & 0xff;
+    const uint32_t g = (pixel >> 8) & 0xff;
+    const uint32_t b = (pixel >> 16) & 0xff;
+    return (r * weightR + g * weightG + b * weightB + SoftwareHistogram::kWeightSum / 2) >> 10;
+}
+
+void lumaScalar(const uint32_t* pixels, int32_t n, const SoftwareHistogram::Config& config,
+                uint32_t* luma) {
+    for (int32_t i = 0; i < n; ++i) {
+        luma[i] = lumaOf(pixels[i], config.weightR, config.weightG, config.weightB);
+    }
+}
+
+void lumaSimd(const uint32_t* pixels, int32_t n, const SoftwareHistogram::Config& config,
+              uint32_t* luma) {
+    const U32x4 mask = {0xff, 0xff, 0xff, 0xff};
+    const U32x4 weightR = {config.weightR, config.weightR, config.weightR, config.weightR};
+    const U32x4 weightG = {config.weightG, config.weightG, config.weightG, config.weightG};
+    const U32x4 weightB = {config.weightB, config.weightB, config.weightB, config.weightB};
+    constexpr uint32_t kRound = SoftwareHistogram::kWeightSum / 2;
+    const U32x4 round = {kRound, kRound, kRound, kRound};
+    const U32x4 shift = {10, 10, 10, 10};
+
+    int32_t i = 0;
+    for (; i + kLanes <= n; i += kLanes) {
+        U32x4 pixel;
+        memcpy(&pixel, pixels + i, sizeof(pixel));
+        const U32x4 y = ((pixel & mask) * weightR + ((pixel >> 8) & mask) * weightG +
+                         ((pixel >> 16) & mask) * weightB + round) >>
+                shift;
+        memcpy(luma + i, &y, sizeof(y));
+    }
+    lumaScalar(pixels + i, n - i, config, luma + i);
+}
+
+inline bool rectValid(const SoftwareHistogram::Rect& rect, int32_t width, int32_t height) {
+    return rect.left >= 0 && rect.top >= 0 && rect.right > rect.left && rect.bottom > rect.top &&
+            rect.right <= width && rect.bottom <= height;
+}
+
+} // namespace
+
+bool SoftwareHistogram::validate(const Config& config, int32_t width, int32_t height) {
+    if (config.weightR > kWeightSum || config.weightG > kWeightSum ||
+        config.weightB > kWeightSum ||
+        config.weightR + config.weightG + config.weightB != kWeightSum) {
+        return false;
+    }
+    if (!config.roi.disabled() && !rectValid(config.roi, width, height)) {
+        return false;
+    }
+    if (!config.blockingRoi.disabled() && !rectValid(config.blockingRoi, width, height)) {
+        return false;
+    }
+    return true;
+}
+
+void SoftwareHistogram::countSpan(const uint32_t* pixels, int32_t n, const Config& config,
+                                  uint32_t (*counts)[kBinCount]) const {
+    const bool useLut = mPostProcLut && config.samplePos == SamplePos::POST_POSTPROC;
+    uint32_t processed[kBlockPixels];
+    uint32_t luma[kBlockPixels];
+
+    for (int32_t start = 0; start < n; start += kBlockPixels) {
+        const int32_t count = std::min(kBlockPixels, n - start);
+        const uint32_t* block = pixels + start;
+        if (useLut) {
+            const PostProcLut& lut = *mPostProcLut;
+            for (int32_t i = 0; i < count; ++i) {
+                const uint32_t pixel = block[i];
+                processed[i] = lut[0][pixel & 0xff] | lut[1][(pixel >> 8) & 0xff] << 8 |
+                        lut[2][(pixel >> 16) & 0xff] << 16;
+            }
+            block = processed;
+        }
+
+        if (mImpl == Impl::SIMD) {
+            lumaSimd(block, count, config, luma);
+        } else {
+            lumaScalar(block, count, config, luma);
+        }
+
+        // four partial histograms so that runs of the same luma do not stall
+        // on the previous increment
+        int32_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+            counts[0][luma[i]]++;
+            counts[1][luma[i + 1]]++;
+            counts[2][luma[i + 2]]++;
+            counts[3][luma[i + 3]]++;
+        }
+        for (; i < count; ++i) {
+            counts[0][luma[i]]++;
+        }
+    }
+}
+
+int SoftwareHistogram::count(const Buffer& buffer, const Config& config,
+                             std::array<uint32_t, kBinCount>* counts) const {
+    if (!buffer.pixels || buffer.width <= 0 || buffer.height <= 0 ||
+        buffer.stride < buffer.width || !validate(config, buffer.width, buffer.height)) {
+        return -EINVAL;
+    }
+
+    const Rect roi = config.roi.disabled() ? Rect{0, 0, buffer.width, buffer.height} : config.roi;
+    const Rect& blocking = config.blockingRoi;
+    // the blocking roi clamped to the roi horizontally
+    const int32_t blockLeft = std::clamp(blocking.left, roi.left, roi.right);
+    const int32_t blockRight = std::clamp(blocking.right, roi.left, roi.right);
+
+    uint32_t partial[4][kBinCount] = {};
+    for (int32_t y = roi.top; y < roi.bottom; ++y) {
+        const uint32_t* row = buffer.pixels + static_cast<size_t>(y) * buffer.stride;
+        if (blocking.disabled() || y < blocking.top || y >= blocking.bottom) {
+            countSpan(row + roi.left, roi.right - roi.left, config, partial);
+            continue;
+        }
+        countSpan(row + roi.left, blockLeft - roi.left, config, partial);
+        countSpan(row + blockRight, roi.right - blockRight, config, partial);
+    }
+
+    for (size_t bin = 0; bin < kBinCount; ++bin) {
+        (*counts)[bin] = partial[0][bin] + partial[1][bin] + partial[2][bin] + partial[3][bin];
+    }
+    return 0;
+}
+
+int SoftwareHistogram::compute(const Buffer& buffer, const Config& config, Bins* bins) const {
+    std::array<uint32_t, kBinCount> counts;
+    if (int ret = count(buffer, config, &counts); ret != 0) {
+        return ret;
+    }
+
+    const int32_t roiW =
+            config.roi.disabled() ? buffer.width : config.roi.right - config.roi.left;
+    const int32_t roiH =
+            config.roi.disabled() ? buffer.height : config.roi.bottom - config.roi.top;
+    const uint32_t threshold = calculateThreshold(roiW, roiH);
+    for (size_t bin = 0; bin < kBinCount; ++bin) {
+        (*bins)[bin] = static_cast<uint16_t>(std::min<uint32_t>(counts[bin] / threshold, 0xffff));
+    }
+    return 0;
+}
@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <array>
+
+// Software model of the DPU luma histogram, for host side tests and
+// benchmarks of the histogram channel logic and as a fallback when no
+// histogram hardware is available.
+//
+// For every RGBA8888 pixel of the roi that is not in the blocking roi:
+//   luma = (R * weightR + G * weightG + B * weightB + WEIGHT_SUM / 2) / WEIGHT_SUM
+// where the weights add up to WEIGHT_SUM (1024), and the bin of that luma is
+// counted. At POST_POSTPROC the pixel goes through the post processing lut
+// first, when there is one. Each bin is then divided by the threshold
+// (calculateThreshold() of the roi area) and saturated to 16 bits, the way
+// the hardware keeps its bins from overflowing.
+//
+// The SIMD path uses the compiler vector extensions (NEON on arm64, SSE on
+// x86) and gives the same bins as the scalar path.
+class SoftwareHistogram {
+public:
+    static constexpr size_t kBinCount = 256;
+    static constexpr uint32_t kWeightSum = 1024;
+
+    using Bins = std::array<uint16_t, kBinCount>;
+
+    // Rect in pixels, right and bottom exclusive. (0, 0, 0, 0) is disabled,
+    // that is the entire buffer for the roi and nothing for the blocking roi.
+    struct Rect {
+        int32_t left = 0;
+        int32_t top = 0;
+        int32_t right = 0;
+        int32_t bottom = 0;
+
+        bool disabled() const { return left == 0 && top == 0 && right == 0 && bottom == 0; }
+    };
+
+    // Same as HistogramSamplePos
+    enum class SamplePos : uint32_t {
+        POST_POSTPROC = 0,
+        PRE_POSTPROC = 1,
+    };
+
+    struct Config {
+        Rect roi;
+        Rect blockingRoi;
+        uint32_t weightR = 341;
+        uint32_t weightG = 342;
+        uint32_t weightB = 341;
+        SamplePos samplePos = SamplePos::POST_POSTPROC;
+    };
+
+    // Per component post processing lut, index 0 for R, 1 for G and 2 for B
+    using PostProcLut = std::array<std::array<uint8_t, 256>, 3>;
+
+    enum class Impl : uint32_t {
+        SCALAR,
+        SIMD,
+    };
+
+    struct Buffer {
+        const uint32_t* pixels = nullptr;
+        int32_t width = 0;
+        int32_t height = 0;
+        // in pixels
+        int32_t stride = 0;
+    };
+
+    // Threshold of a roi of roiW x roiH pixels, the bins of the hardware are
+    // 16 bits
+    static int calculateThreshold(int32_t roiW, int32_t roiH) {
+        return ((roiW * roiH) >> 16) + 1;
+    }
+
+    // Returns false when the config is not valid for the buffer: a roi out of
+    // the buffer or empty, or weights not adding up to kWeightSum
+    static bool validate(const Config& config, int32_t width, int32_t height);
+
+    // The lut is used at POST_POSTPROC only, may be null
+    explicit SoftwareHistogram(Impl impl = Impl::SIMD) : mImpl(impl) {}
+    void setPostProcLut(const PostProcLut* lut) { mPostProcLut = lut; }
+
+    // Computes the bins of the buffer, returns 0 or -EINVAL for an invalid
+    // config or buffer
+    int compute(const Buffer& buffer, const Config& config, Bins* bins) const;
+
+    // Raw 32 bit counts before the threshold is applied
+    int count(const Buffer& buffer, const Config& config,
+              std::array<uint32_t, kBinCount>* counts) const;
+
+private:
+    // Counts the luma of n pixels
+    void countSpan(const uint32_t* pixels, int32_t n, const Config& config,
+                   uint32_t (*counts)[kBinCount]) const;
+
+    const Impl mImpl;
+    const PostProcLut* mPostProcLut = nullptr;
+};
@@ -0,0 +1,309 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SysfsWatcher.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+
+namespace {
+
+constexpr int kMaxEvents = 8;
+constexpr int64_t kNsPerMs = 1000000;
+
+} // namespace
+
+SysfsWatcher::Ops SysfsWatcher::sysfsOps() {
+    Ops ops;
+    ops.open = [](const std::string& path) -> int {
+        const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        return fd < 0 ? -errno : fd;
+    };
+    ops.read = [](int fd, std::string* value) -> int {
+        // the read also acks the notification, sysfs keeps raising POLLPRI
+        // until the node is read again
+        char buf[64];
+        const ssize_t size = pread(fd, buf, sizeof(buf), 0);
+        if (size <= 0) {
+            return size < 0 ? -errno : -EIO;
+        }
+        value->assign(buf, size);
+        return 0;
+    };
+    ops.events = EPOLLPRI | EPOLLERR;
+    return ops;
+}
+
+SysfsWatcher::SysfsWatcher(Ops ops)
+      : mOps(std::move(ops)),
+        mEpollFd(epoll_create1(EPOLL_CLOEXEC)),
+        mWakeFd(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) {
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.fd = mWakeFd;
+    epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mWakeFd, &ev);
+}
+
+SysfsWatcher::~SysfsWatcher() {
+    {
+        std::scoped_lock lock(mMutex);
+        mExit = true;
+    }
+    wakeThread();
+    if (mThread.joinable()) {
+        mThread.join();
+    }
+
+    for (auto& [fd, node] : mNodes) {
+        for (auto& watch : node.watches) {
+            watch.callback(-ECANCELED, node.value);
+        }
+        close(fd);
+    }
+    close(mWakeFd);
+    close(mEpollFd);
+}
+
+int64_t SysfsWatcher::nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+}
+
+bool SysfsWatcher::matches(const Watch& watch, const std::string& value) {
+    return std::find(watch.expected.begin(), watch.expected.end(), value) != watch.expected.end();
+}
+
+SysfsWatcher::Node* SysfsWatcher::nodeLocked(const std::string& path, int* error) {
+    if (auto it = mFds.find(path); it != mFds.end()) {
+        return &mNodes[it->second];
+    }
+
+    const int fd = mOps.open(path);
+    if (fd < 0) {
+        *error = fd;
+        return nullptr;
+    }
+    struct epoll_event ev = {};
+    ev.events = mOps.events;
+    ev.data.fd = fd;
+    if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+        *error = -errno;
+        close(fd);
+        return nullptr;
+    }
+
+    mStats.opens++;
+    mFds[path] = fd;
+    Node& node = mNodes[fd];
+    node.path = path;
+    node.fd = fd;
+    return &node;
+}
+
+void SysfsWatcher::startThreadLocked() {
+    if (!mThread.joinable()) {
+        mThread = std::thread(&SysfsWatcher::threadLoop, this);
+    }
+}
+
+void SysfsWatcher::wakeThread() {
+    eventfd_write(mWakeFd, 1);
+}
+
+void SysfsWatcher::watch(const std::string& path, const std::vector<std::string>& expected,
+                         int64_t timeoutNs, Callback callback) {
+    if (expected.empty()) {
+        callback(-EINVAL, {});
+        return;
+    }
+
+    std::vector<Completion> completions;
+    {
+        std::scoped_lock lock(mMutex);
+        mStats.watches++;
+        int status = 0;
+        Node* node = nodeLocked(path, &status);
+        if (node) {
+            // the node is in the epoll set already, a change after this read
+            // is not missed
+            status = readLocked(*node);
+        }
+        if (status != 0) {
+            mStats.immediate++;
+            completions.push_back({std::move(callback), status, {}});
+        } else {
+            // the read acked the notification the watcher thread would have
+            // seen, so the older watches of the node are completed here first
+            completeMatchingLocked(*node, &completions);
+
+            Watch watch{expected, nowNs() + timeoutNs, std::move(callback)};
+            if (matches(watch, node->value)) {
+                mStats.immediate++;
+                mStats.matched++;
+                completions.push_back({std::move(watch.callback), 0, node->value});
+            } else if (timeoutNs <= 0) {
+                // not get the expected value and no intention to wait
+                mStats.immediate++;
+                completions.push_back({std::move(watch.callback), -EINVAL, node->value});
+            } else {
+                node->watches.push_back(std::move(watch));
+                startThreadLocked();
+                wakeThread();
+            }
+        }
+    }
+
+    for (auto& completion : completions) {
+        completion.callback(completion.status, completion.value);
+    }
+}
+
+std::future<int> SysfsWatcher::watch(const std::string& path,
+                                     const std::vector<std::string>& expected, int64_t timeoutNs) {
+    auto promise = std::make_shared<std::promise<int>>();
+    std::future<int> future = promise->get_future();
+    watch(path, expected, timeoutNs,
+          [promise](int status, const std::string&) { promise->set_value(status); });
+    return future;
+}
+
+int SysfsWatcher::read(const std::string& path, std::string* value) {
+    std::vector<Completion> completions;
+    {
+        std::scoped_lock lock(mMutex);
+        int error = 0;
+        Node* node = nodeLocked(path, &error);
+        if (!node) {
+            return error;
+        }
+        if (int ret = readLocked(*node); ret != 0) {
+            return ret;
+        }
+        *value = node->value;
+        // like in watch(), the notification of this value is acked already
+        completeMatchingLocked(*node, &completions);
+    }
+
+    for (auto& completion : completions) {
+        completion.callback(completion.status, completion.value);
+    }
+    return 0;
+}
+
+int SysfsWatcher::readLocked(Node& node) {
+    std::string value;
+    if (int ret = mOps.read(node.fd, &value); ret != 0) {
+        return ret;
+    }
+    // without the trailing '\n' of sysfs
+    if (!value.empty() && value.back() == '\n') {
+        value.pop_back();
+    }
+    node.value = std::move(value);
+    return 0;
+}
+
+void SysfsWatcher::onNotifiedLocked(Node& node, std::vector<Completion>* completions) {
+    mStats.notifications++;
+    if (readLocked(node) != 0) {
+        for (auto& watch : node.watches) {
+            completions->push_back({std::move(watch.callback), -EIO, node.value});
+        }
+        node.watches.clear();
+        return;
+    }
+
+    completeMatchingLocked(node, completions);
+}
+
+void SysfsWatcher::completeMatchingLocked(Node& node, std::vector<Completion>* completions) {
+    for (auto it = node.watches.begin(); it != node.watches.end();) {
+        if (matches(*it, node.value)) {
+            mStats.matched++;
+            completions->push_back({std::move(it->callback), 0, node.value});
+            it = node.watches.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+int SysfsWatcher::expireLocked(int64_t now, std::vector<Completion>* completions) {
+    int64_t next = -1;
+    for (auto& [fd, node] : mNodes) {
+        for (auto it = node.watches.begin(); it != node.watches.end();) {
+            if (it->deadlineNs <= now) {
+                mStats.timeouts++;
+                completions->push_back({std::move(it->callback), -ETIMEDOUT, node.value});
+                it = node.watches.erase(it);
+                continue;
+            }
+            if (next < 0 || it->deadlineNs < next) {
+                next = it->deadlineNs;
+            }
+            ++it;
+        }
+    }
+    if (next < 0) {
+        return -1;
+    }
+    // rounded up, the deadline is not reached a ms early
+    return static_cast<int>((next - now + kNsPerMs - 1) / kNsPerMs);
+}
+
+void SysfsWatcher::threadLoop() {
+    int timeoutMs = -1;
+    while (true) {
+        struct epoll_event events[kMaxEvents];
+        const int count = epoll_wait(mEpollFd, events, kMaxEvents, timeoutMs);
+
+        std::vector<Completion> completions;
+        {
+            std::scoped_lock lock(mMutex);
+            if (mExit) {
+                return;
+            }
+            for (int i = 0; i < count; ++i) {
+                const int fd = events[i].data.fd;
+                if (fd == mWakeFd) {
+                    eventfd_t value;
+                    eventfd_read(mWakeFd, &value);
+                    continue;
+                }
+                if (auto it = mNodes.find(fd); it != mNodes.end()) {
+                    onNotifiedLocked(it->second, &completions);
+                }
+            }
+            timeoutMs = expireLocked(nowNs(), &completions);
+        }
+
+        for (auto& completion : completions) {
+            completion.callback(completion.status, completion.value);
+        }
+    }
+}
+
+SysfsWatcher::Stats SysfsWatcher::stats() const {
+    std::scoped_lock lock(mMutex);
+    return mStats;
+}
@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <functional>
+#include <future>
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Waits for sysfs nodes to reach one of a set of values without blocking the
+// caller.
+//
+// Every node is opened once and stays open, registered with the epoll loop of
+// the watcher thread for the POLLPRI the kernel raises on sysfs_notify(). A
+// notification reads the node again and completes the watches whose expected
+// values it matches. Watches that see no match in time complete with
+// -ETIMEDOUT.
+//
+// Each watch completes exactly once: on the caller's thread when the node has
+// an expected value already or cannot be read, else on the watcher thread.
+// Any read of a node, on either thread, completes all the pending watches its
+// value matches, oldest first.
+// Watches still pending when the watcher is destroyed complete with
+// -ECANCELED. Thread safe.
+class SysfsWatcher {
+public:
+    // status is 0 for a match, else -ETIMEDOUT, -EINVAL (no match and no
+    // timeout), -ECANCELED or the -errno of a failed open or read. value is
+    // the last value read, without the trailing newline.
+    using Callback = std::function<void(int status, const std::string& value)>;
+
+    // How nodes are opened and read, the sysfs ones by default
+    struct Ops {
+        // Returns the fd to poll for changes of the node, or -errno
+        std::function<int(const std::string& path)> open;
+        // Reads the value of the node from the start, returns 0 or -errno
+        std::function<int(int fd, std::string* value)> read;
+        // epoll events of a change
+        uint32_t events = 0;
+    };
+    static Ops sysfsOps();
+
+    struct Stats {
+        uint64_t opens = 0;
+        uint64_t watches = 0;
+        // completed on the caller's thread without a wait
+        uint64_t immediate = 0;
+        uint64_t notifications = 0;
+        uint64_t matched = 0;
+        uint64_t timeouts = 0;
+    };
+
+    explicit SysfsWatcher(Ops ops = sysfsOps());
+    ~SysfsWatcher();
+
+    void watch(const std::string& path, const std::vector<std::string>& expected,
+               int64_t timeoutNs, Callback callback);
+    // The status of the watch
+    std::future<int> watch(const std::string& path, const std::vector<std::string>& expected,
+                           int64_t timeoutNs);
+
+    // Reads the node through its open fd, returns 0 or -errno
+    int read(const std::string& path, std::string* value);
+
+    Stats stats() const;
+
+private:
+    struct Watch {
+        std::vector<std::string> expected;
+        int64_t deadlineNs;
+        Callback callback;
+    };
+
+    struct Node {
+        std::string path;
+        int fd = -1;
+        std::string value;
+        std::list<Watch> watches;
+    };
+
+    struct Completion {
+        Callback callback;
+        int status;
+        std::string value;
+    };
+
+    static int64_t nowNs();
+    static bool matches(const Watch& watch, const std::string& value);
+
+    // Opens the node and adds it to the epoll set on first use
+    Node* nodeLocked(const std::string& path, int* error);
+    // Reads the node into its value, returns 0 or -errno
+    int readLocked(Node& node);
+    void startThreadLocked();
+    void wakeThread();
+    void threadLoop();
+    // Reads a notified node and completes its watches
+    void onNotifiedLocked(Node& node, std::vector<Completion>* completions);
+    // Completes the watches of the node matching its last read value, oldest
+    // first. Every read acks the notification, so every read must call it.
+    void completeMatchingLocked(Node& node, std::vector<Completion>* completions);
+    // Completes the expired watches, returns the time to the next deadline
+    // in ms or -1 when there is none
+    int expireLocked(int64_t now, std::vector<Completion>* completions);
+
+    const Ops mOps;
+    int mEpollFd = -1;
+    int mWakeFd = -1;
+
+    mutable std::mutex mMutex;
+    // by fd
+    std::map<int, Node> mNodes;
+    std::map<std::string, int> mFds;
+    std::thread mThread;
+    bool mExit = false;
+    Stats mStats;
+};
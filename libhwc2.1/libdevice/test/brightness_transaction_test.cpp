@@ -0,0 +1,272 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "../BrightnessTransaction.h"
+
+namespace {
+
+using Attr = BrightnessTransaction::Attr;
+using Change = BrightnessTransaction::Change;
+
+constexpr uint32_t kDrmAttrs = BrightnessTransaction::bit(Attr::BRIGHTNESS_LEVEL) |
+        BrightnessTransaction::bit(Attr::HBM_MODE) | BrightnessTransaction::bit(Attr::DIMMING) |
+        BrightnessTransaction::bit(Attr::LHBM) | BrightnessTransaction::bit(Attr::OPERATION_RATE);
+constexpr uint32_t kSysfsAttrs = BrightnessTransaction::bit(Attr::BRIGHTNESS_LEVEL) |
+        BrightnessTransaction::bit(Attr::ACL_MODE) | BrightnessTransaction::bit(Attr::CABC_MODE);
+
+// Backlight nodes of a panel in a temporary directory
+class FakeSysfs {
+public:
+    static constexpr const char* kNodes[] = {"brightness", "acl_mode", "cabc_mode"};
+
+    FakeSysfs() {
+        std::string pattern = ::testing::TempDir() + "backlight_XXXXXX";
+        mDir = mkdtemp(pattern.data());
+        mDir += "/";
+        for (const char* node : kNodes) {
+            std::ofstream(mDir + node).flush();
+        }
+    }
+    ~FakeSysfs() {
+        for (const char* node : kNodes) {
+            unlink((mDir + node).c_str());
+        }
+        rmdir(mDir.c_str());
+    }
+
+    std::string path(const char* node) const { return mDir + node; }
+    std::string read(const char* node) const {
+        std::ifstream ifs(mDir + node);
+        std::string value;
+        std::getline(ifs, value);
+        return value;
+    }
+
+    void open(BrightnessTransaction& transaction) const {
+        ASSERT_EQ(0, transaction.openSysfsNode(Attr::BRIGHTNESS_LEVEL, path("brightness")));
+        ASSERT_EQ(0, transaction.openSysfsNode(Attr::ACL_MODE, path("acl_mode")));
+        ASSERT_EQ(0, transaction.openSysfsNode(Attr::CABC_MODE, path("cabc_mode")));
+    }
+
+private:
+    std::string mDir;
+};
+
+// Connector properties of one atomic request, like DrmModeAtomicReq
+class FakeDrmRequest {
+public:
+    BrightnessTransaction::PropertyWriter writer() {
+        return [this](Attr attr, uint64_t value) -> int {
+            if (mFailing.count(attr)) {
+                return -ENOMEM;
+            }
+            mProperties.push_back({attr, value});
+            return 0;
+        };
+    }
+    void setFailing(Attr attr, bool failing) {
+        if (failing) {
+            mFailing.insert(attr);
+        } else {
+            mFailing.erase(attr);
+        }
+    }
+    // the properties of the request, the next one starts empty
+    std::vector<Change> take() { return std::move(mProperties); }
+
+private:
+    std::vector<Change> mProperties;
+    std::set<Attr> mFailing;
+};
+
+} // namespace
+
+TEST(BrightnessTransactionTest, ChangesGoIntoOneCommit) {
+    BrightnessTransaction transaction;
+    FakeDrmRequest request;
+
+    transaction.store(Attr::DIMMING, 1);
+    transaction.store(Attr::LHBM, 1);
+    transaction.store(Attr::BRIGHTNESS_LEVEL, 1200);
+    transaction.store(Attr::HBM_MODE, 1);
+    transaction.store(Attr::OPERATION_RATE, 120);
+    // not a drm property
+    transaction.store(Attr::ACL_MODE, 2);
+
+    std::vector<Change> committed;
+    ASSERT_EQ(0, transaction.commit(request.writer(), kDrmAttrs, &committed));
+    const std::vector<Change> expected = {{Attr::BRIGHTNESS_LEVEL, 1200},
+                                          {Attr::HBM_MODE, 1},
+                                          {Attr::DIMMING, 1},
+                                          {Attr::LHBM, 1},
+                                          {Attr::OPERATION_RATE, 120}};
+    EXPECT_EQ(expected, request.take());
+    EXPECT_EQ(expected, committed);
+    EXPECT_EQ(1u, transaction.stats().commits);
+    EXPECT_TRUE(transaction.isPending(Attr::ACL_MODE));
+
+    // nothing left for the next frame
+    EXPECT_EQ(0, transaction.commit(request.writer(), kDrmAttrs));
+    EXPECT_TRUE(request.take().empty());
+    EXPECT_EQ(1u, transaction.stats().commits);
+}
+
+TEST(BrightnessTransactionTest, OnlyTheDiffIsWritten) {
+    BrightnessTransaction transaction;
+    FakeDrmRequest request;
+
+    transaction.store(Attr::BRIGHTNESS_LEVEL, 500);
+    transaction.store(Attr::OPERATION_RATE, 60);
+    ASSERT_EQ(0, transaction.commit(request.writer(), kDrmAttrs));
+    request.take();
+
+    // changed and changed back within a frame
+    transaction.store(Attr::BRIGHTNESS_LEVEL, 800);
+    transaction.store(Attr::BRIGHTNESS_LEVEL, 500);
+    // the same value again
+    transaction.store(Attr::OPERATION_RATE, 60);
+    transaction.store(Attr::DIMMING, 0);
+    EXPECT_EQ((std::vector<Change>{{Attr::DIMMING, 0}}), transaction.diff());
+
+    ASSERT_EQ(0, transaction.commit(request.writer(), kDrmAttrs));
+    EXPECT_EQ((std::vector<Change>{{Attr::DIMMING, 0}}), request.take());
+    EXPECT_EQ(2u, transaction.stats().dropped);
+    EXPECT_EQ(500u, transaction.value(Attr::BRIGHTNESS_LEVEL));
+}
+
+TEST(BrightnessTransactionTest, FailedPropertyIsRetried) {
+    BrightnessTransaction transaction;
+    FakeDrmRequest request;
+
+    transaction.store(Attr::HBM_MODE, 1);
+    transaction.store(Attr::BRIGHTNESS_LEVEL, 3000);
+    request.setFailing(Attr::HBM_MODE, true);
+    std::vector<Change> committed;
+    EXPECT_EQ(-ENOMEM, transaction.commit(request.writer(), kDrmAttrs, &committed));
+    EXPECT_EQ((std::vector<Change>{{Attr::BRIGHTNESS_LEVEL, 3000}}), committed);
+    EXPECT_TRUE(transaction.isPending(Attr::HBM_MODE));
+    EXPECT_FALSE(transaction.applied(Attr::HBM_MODE).has_value());
+    request.take();
+
+    request.setFailing(Attr::HBM_MODE, false);
+    ASSERT_EQ(0, transaction.commit(request.writer(), kDrmAttrs));
+    EXPECT_EQ((std::vector<Change>{{Attr::HBM_MODE, 1}}), request.take());
+    EXPECT_EQ(1u, transaction.stats().errors);
+}
+
+TEST(BrightnessTransactionTest, ResetAndInvalidate) {
+    BrightnessTransaction transaction;
+    FakeDrmRequest request;
+
+    // e.g. the panel turned lhbm off by itself
+    transaction.store(Attr::LHBM, 1);
+    ASSERT_EQ(0, transaction.commit(request.writer(), kDrmAttrs));
+    transaction.reset(Attr::LHBM, 0);
+    transaction.store(Attr::LHBM, 0);
+    ASSERT_EQ(0, transaction.commit(request.writer(), kDrmAttrs));
+    EXPECT_EQ((std::vector<Change>{{Attr::LHBM, 1}}), request.take());
+
+    // the value of the panel is unknown, the same value is written again
+    transaction.store(Attr::LHBM, 1);
+    ASSERT_EQ(0, transaction.commit(request.writer(), kDrmAttrs));
+    transaction.invalidate(Attr::LHBM);
+    transaction.store(Attr::LHBM, 1);
+    ASSERT_EQ(0, transaction.commit(request.writer(), kDrmAttrs));
+    EXPECT_EQ((std::vector<Change>{{Attr::LHBM, 1}, {Attr::LHBM, 1}}), request.take());
+
+    // a failed frame commit writes the last committed value again
+    transaction.invalidate(Attr::LHBM);
+    ASSERT_EQ(0, transaction.commit(request.writer(), kDrmAttrs));
+    EXPECT_EQ((std::vector<Change>{{Attr::LHBM, 1}}), request.take());
+}
+
+TEST(BrightnessTransactionTest, SysfsFlushWritesChangedNodes) {
+    FakeSysfs sysfs;
+    BrightnessTransaction transaction;
+    sysfs.open(transaction);
+
+    transaction.store(Attr::ACL_MODE, 2);
+    transaction.store(Attr::CABC_MODE, 1);
+    transaction.store(Attr::BRIGHTNESS_LEVEL, 100);
+    // no sysfs node
+    transaction.store(Attr::HBM_MODE, 1);
+
+    std::vector<Change> written;
+    ASSERT_EQ(0, transaction.flush(kSysfsAttrs, &written));
+    EXPECT_EQ("100", sysfs.read("brightness"));
+    EXPECT_EQ("2", sysfs.read("acl_mode"));
+    EXPECT_EQ("1", sysfs.read("cabc_mode"));
+    EXPECT_EQ(3u, written.size());
+    EXPECT_TRUE(transaction.isPending(Attr::HBM_MODE));
+
+    transaction.store(Attr::ACL_MODE, 0);
+    transaction.store(Attr::ACL_MODE, 2);
+    transaction.store(Attr::BRIGHTNESS_LEVEL, 200);
+    ASSERT_EQ(0, transaction.flush(kSysfsAttrs));
+    EXPECT_EQ("200", sysfs.read("brightness"));
+
+    const auto stats = transaction.stats();
+    EXPECT_EQ(2u, stats.flushes);
+    EXPECT_EQ(4u, stats.sysfsWrites);
+    EXPECT_EQ(1u, stats.dropped);
+}
+
+TEST(BrightnessTransactionTest, PathsShareTheAppliedState) {
+    FakeSysfs sysfs;
+    BrightnessTransaction transaction;
+    sysfs.open(transaction);
+    FakeDrmRequest request;
+
+    // set by a frame, then asked for again through sysfs
+    transaction.store(Attr::BRIGHTNESS_LEVEL, 300);
+    ASSERT_EQ(0, transaction.commit(request.writer(), kDrmAttrs));
+    transaction.store(Attr::BRIGHTNESS_LEVEL, 300);
+    ASSERT_EQ(0, transaction.flush(kSysfsAttrs));
+    EXPECT_EQ("", sysfs.read("brightness"));
+
+    // set through sysfs, then the frame has nothing to add
+    transaction.store(Attr::BRIGHTNESS_LEVEL, 400);
+    ASSERT_EQ(0, transaction.flush(kSysfsAttrs));
+    EXPECT_EQ("400", sysfs.read("brightness"));
+    transaction.store(Attr::BRIGHTNESS_LEVEL, 400);
+    ASSERT_EQ(0, transaction.commit(request.writer(), kDrmAttrs));
+    EXPECT_EQ((std::vector<Change>{{Attr::BRIGHTNESS_LEVEL, 300}}), request.take());
+}
+
+TEST(BrightnessTransactionTest, SysfsErrors) {
+    BrightnessTransaction transaction;
+    EXPECT_EQ(-ENOENT,
+              transaction.openSysfsNode(Attr::BRIGHTNESS_LEVEL, "/nonexistent/backlight/brightness"));
+    EXPECT_FALSE(transaction.hasSysfsNode(Attr::BRIGHTNESS_LEVEL));
+
+    // every write fails with ENOSPC
+    ASSERT_EQ(0, transaction.openSysfsNode(Attr::ACL_MODE, "/dev/full"));
+    transaction.store(Attr::ACL_MODE, 1);
+    EXPECT_EQ(-ENOSPC, transaction.flush());
+    EXPECT_TRUE(transaction.isPending(Attr::ACL_MODE));
+    EXPECT_EQ(-ENOSPC, transaction.flush());
+    EXPECT_EQ(2u, transaction.stats().errors);
+}
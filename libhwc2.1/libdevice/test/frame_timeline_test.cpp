@@ -0,0 +1,349 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstring>
+#include <thread>
+
+#include "../FrameTimeline.h"
+
+namespace {
+
+constexpr int64_t kMsToNs = 1000000;
+constexpr int64_t k60HzNs = 16666667;
+constexpr int64_t kStartNs = 1000 * kMsToNs;
+
+using Record = FrameTimelineRecord;
+
+// Per stage durations of a frame, in ms
+struct FrameWork {
+    int64_t validate = 2;
+    int64_t assign = 1;
+    int64_t m2m = 0;
+    int64_t present = 1;
+    int64_t commit = 2;
+};
+
+// Runs one validated frame due on the vsync after startNs, returns the end of
+// present.
+int64_t runFrame(FrameTimeline& timeline, int64_t startNs, const FrameWork& work) {
+    int64_t nowNs = startNs;
+    timeline.beginFrame(nowNs, startNs + k60HzNs, k60HzNs, true);
+    nowNs += work.validate * kMsToNs / 2;
+    timeline.addStage(Record::STAGE_ASSIGN, nowNs, nowNs + work.assign * kMsToNs);
+    nowNs += work.assign * kMsToNs + work.validate * kMsToNs / 2;
+    timeline.endValidate(nowNs);
+
+    timeline.beginPresent(nowNs);
+    timeline.addStage(Record::STAGE_M2M, nowNs, nowNs + work.m2m * kMsToNs);
+    nowNs += work.m2m * kMsToNs + work.present * kMsToNs;
+    timeline.addStage(Record::STAGE_COMMIT, nowNs, nowNs + work.commit * kMsToNs);
+    nowNs += work.commit * kMsToNs;
+    timeline.endFrame(nowNs);
+    return nowNs;
+}
+
+} // namespace
+
+TEST(FrameTimelineTest, RecordsStagesOfAFrame) {
+    FrameTimeline timeline;
+    runFrame(timeline, kStartNs, {.validate = 2, .assign = 1, .m2m = 3, .present = 1, .commit = 2});
+    EXPECT_EQ(1u, timeline.lastFrameNumber());
+    ASSERT_TRUE(timeline.setPresentFenceTime(1, kStartNs + k60HzNs));
+    timeline.collectPresentFenceTimes();
+
+    const auto records = timeline.snapshot();
+    ASSERT_EQ(1u, records.size());
+    const Record& record = records[0];
+    EXPECT_EQ(1u, record.frameNumber);
+    EXPECT_EQ(kStartNs, record.validateStartNs);
+    EXPECT_EQ(kStartNs + 3 * kMsToNs, record.validateEndNs);
+    EXPECT_EQ(2 * kMsToNs, record.stageNs[Record::STAGE_VALIDATE]);
+    EXPECT_EQ(1 * kMsToNs, record.stageNs[Record::STAGE_ASSIGN]);
+    EXPECT_EQ(3 * kMsToNs, record.stageNs[Record::STAGE_M2M]);
+    EXPECT_EQ(1 * kMsToNs, record.stageNs[Record::STAGE_PRESENT]);
+    EXPECT_EQ(2 * kMsToNs, record.stageNs[Record::STAGE_COMMIT]);
+    EXPECT_EQ(kStartNs + 7 * kMsToNs, record.commitStartNs);
+    EXPECT_EQ(kStartNs + 9 * kMsToNs, record.presentEndNs);
+    EXPECT_EQ(kStartNs + k60HzNs, record.presentFenceNs);
+    EXPECT_EQ(Record::kNoStage, record.lateStage);
+
+    const auto stats = timeline.stats();
+    EXPECT_EQ(1u, stats.frames);
+    EXPECT_EQ(0u, stats.lateFrames);
+}
+
+TEST(FrameTimelineTest, LateFrameBlamesWorstOverrun) {
+    FrameTimeline timeline;
+    // 6 ms of M2M overruns its 5 ms budget, 10 ms of commit overruns its
+    // 5 ms budget by more.
+    runFrame(timeline, kStartNs, {.m2m = 6, .commit = 10});
+    timeline.setPresentFenceTime(1, kStartNs + 2 * k60HzNs);
+    timeline.collectPresentFenceTimes();
+
+    const auto records = timeline.snapshot();
+    ASSERT_EQ(1u, records.size());
+    EXPECT_EQ(Record::STAGE_COMMIT, records[0].lateStage);
+    EXPECT_EQ(k60HzNs, records[0].lateNs);
+
+    const auto stats = timeline.stats();
+    EXPECT_EQ(1u, stats.lateFrames);
+    EXPECT_EQ(1u, stats.lateByStage[Record::STAGE_COMMIT]);
+}
+
+TEST(FrameTimelineTest, LateFrameWithinBudgetBlamesFence) {
+    FrameTimeline timeline;
+    runFrame(timeline, kStartNs, {});
+    timeline.setPresentFenceTime(1, kStartNs + 2 * k60HzNs);
+    timeline.collectPresentFenceTimes();
+
+    EXPECT_EQ(Record::STAGE_FENCE, timeline.snapshot()[0].lateStage);
+    EXPECT_EQ(1u, timeline.stats().lateByStage[Record::STAGE_FENCE]);
+}
+
+TEST(FrameTimelineTest, SkippedValidationAndLostFences) {
+    FrameTimeline timeline;
+    timeline.beginFrame(kStartNs, kStartNs + k60HzNs, k60HzNs, false);
+    timeline.beginPresent(kStartNs);
+    timeline.endFrame(kStartNs + 4 * kMsToNs);
+    EXPECT_FALSE(timeline.frameOpen());
+
+    // the fence of the first frame is never handed over, the one of the next
+    // frame is lost
+    runFrame(timeline, kStartNs + k60HzNs, {});
+    timeline.setPresentFenceTime(2, -1);
+    timeline.collectPresentFenceTimes();
+
+    const auto records = timeline.snapshot();
+    ASSERT_EQ(2u, records.size());
+    EXPECT_EQ(0, records[0].validateStartNs);
+    EXPECT_EQ(0, records[0].stageNs[Record::STAGE_VALIDATE]);
+    EXPECT_EQ(4 * kMsToNs, records[0].stageNs[Record::STAGE_PRESENT]);
+    EXPECT_EQ(-1, records[0].presentFenceNs);
+    EXPECT_EQ(-1, records[1].presentFenceNs);
+    EXPECT_EQ(0u, timeline.stats().frames);
+}
+
+// A fence that signals after later frames were published still counts.
+TEST(FrameTimelineTest, LateFenceResolvedAfterLaterFrames) {
+    FrameTimeline timeline;
+    runFrame(timeline, kStartNs, {.commit = 10});
+    runFrame(timeline, kStartNs + k60HzNs, {});
+    runFrame(timeline, kStartNs + 2 * k60HzNs, {});
+    EXPECT_EQ(0, timeline.snapshot()[0].presentFenceNs);
+
+    timeline.setPresentFenceTime(1, kStartNs + 3 * k60HzNs);
+    timeline.setPresentFenceTime(2, kStartNs + 2 * k60HzNs);
+    runFrame(timeline, kStartNs + 3 * k60HzNs, {});
+    timeline.setPresentFenceTime(3, kStartNs + 4 * k60HzNs);
+    timeline.collectPresentFenceTimes();
+
+    const auto records = timeline.snapshot();
+    ASSERT_EQ(4u, records.size());
+    EXPECT_EQ(Record::STAGE_COMMIT, records[0].lateStage);
+    EXPECT_EQ(2 * k60HzNs, records[0].lateNs);
+    EXPECT_EQ(Record::kNoStage, records[1].lateStage);
+    EXPECT_EQ(Record::STAGE_FENCE, records[2].lateStage);
+    EXPECT_EQ(0, records[3].presentFenceNs);
+
+    const auto stats = timeline.stats();
+    EXPECT_EQ(3u, stats.frames);
+    EXPECT_EQ(2u, stats.lateFrames);
+    EXPECT_EQ(1u, stats.lateByStage[Record::STAGE_COMMIT]);
+    EXPECT_EQ(1u, stats.lateByStage[Record::STAGE_FENCE]);
+}
+
+TEST(FrameTimelineTest, AwaitingFencesAreBounded) {
+    FrameTimeline timeline;
+    int64_t startNs = kStartNs;
+    for (size_t i = 0; i <= FrameTimeline::kMaxAwaitingFences; ++i) {
+        runFrame(timeline, startNs, {});
+        startNs += k60HzNs;
+    }
+    // frame 1 was given up to make room, its late fence is ignored
+    timeline.setPresentFenceTime(1, kStartNs + k60HzNs);
+    timeline.setPresentFenceTime(2, kStartNs + 2 * k60HzNs);
+    timeline.collectPresentFenceTimes();
+
+    const auto records = timeline.snapshot();
+    ASSERT_EQ(FrameTimeline::kMaxAwaitingFences + 1, records.size());
+    EXPECT_EQ(-1, records[0].presentFenceNs);
+    EXPECT_EQ(kStartNs + 2 * k60HzNs, records[1].presentFenceNs);
+    EXPECT_EQ(0, records[2].presentFenceNs);
+    EXPECT_EQ(1u, timeline.stats().frames);
+}
+
+TEST(FrameTimelineTest, UnpresentedFrameIsDropped) {
+    FrameTimeline timeline;
+    timeline.beginFrame(kStartNs, kStartNs + k60HzNs, k60HzNs, true);
+    timeline.endValidate(kStartNs + kMsToNs);
+    runFrame(timeline, kStartNs + 2 * kMsToNs, {});
+
+    const auto records = timeline.snapshot();
+    ASSERT_EQ(1u, records.size());
+    EXPECT_EQ(kStartNs + 2 * kMsToNs, records[0].validateStartNs);
+}
+
+TEST(FrameTimelineTest, PresentAfterEarlyReturnedPresent) {
+    FrameTimeline timeline;
+    // validated, then present returned early (e.g. skipped frame) and
+    // aborted the frame
+    timeline.beginFrame(kStartNs, kStartNs + k60HzNs, k60HzNs, true);
+    timeline.endValidate(kStartNs + kMsToNs);
+    EXPECT_TRUE(timeline.frameValidated());
+    timeline.beginPresent(kStartNs + kMsToNs);
+    timeline.abortFrame();
+    EXPECT_FALSE(timeline.frameOpen());
+    EXPECT_FALSE(timeline.frameValidated());
+
+    // the next present skips validation, it begins a frame of its own due on
+    // its own vsync, like presentDisplay() does
+    const int64_t presentNs = kStartNs + 3 * k60HzNs;
+    if (!timeline.frameValidated()) {
+        timeline.beginFrame(presentNs, presentNs + k60HzNs, k60HzNs, false);
+    }
+    timeline.beginPresent(presentNs);
+    timeline.endFrame(presentNs + 2 * kMsToNs);
+    timeline.abortFrame();
+    timeline.setPresentFenceTime(1, presentNs + k60HzNs);
+    timeline.collectPresentFenceTimes();
+
+    const auto records = timeline.snapshot();
+    ASSERT_EQ(1u, records.size());
+    EXPECT_EQ(0, records[0].validateStartNs);
+    EXPECT_EQ(presentNs + k60HzNs, records[0].expectedPresentNs);
+    EXPECT_EQ(2 * kMsToNs, records[0].stageNs[Record::STAGE_PRESENT]);
+    EXPECT_EQ(Record::kNoStage, records[0].lateStage);
+    EXPECT_EQ(0u, timeline.stats().lateFrames);
+}
+
+TEST(FrameTimelineTest, RingKeepsLatestFrames) {
+    FrameTimeline timeline(4);
+    int64_t startNs = kStartNs;
+    for (int i = 0; i < 10; ++i) {
+        runFrame(timeline, startNs, {});
+        timeline.setPresentFenceTime(i + 1, startNs + k60HzNs);
+        startNs += k60HzNs;
+    }
+    timeline.collectPresentFenceTimes();
+
+    const auto records = timeline.snapshot();
+    ASSERT_EQ(4u, records.size());
+    for (size_t i = 0; i < records.size(); ++i) {
+        EXPECT_EQ(7 + i, records[i].frameNumber);
+        EXPECT_GT(records[i].presentFenceNs, 0);
+    }
+    EXPECT_EQ(10u, timeline.stats().frames);
+}
+
+TEST(FrameTimelineTest, ExportBinary) {
+    FrameTimeline timeline;
+    runFrame(timeline, kStartNs, {.commit = 12});
+    timeline.setPresentFenceTime(1, kStartNs + 2 * k60HzNs);
+    runFrame(timeline, kStartNs + k60HzNs, {});
+
+    const auto blob = timeline.exportBinary();
+    constexpr size_t kHeaderSize = 4 * sizeof(uint32_t);
+    constexpr size_t kRecordSize = FrameTimeline::kRecordWords * sizeof(int64_t);
+    ASSERT_EQ(kHeaderSize + 2 * kRecordSize, blob.size());
+
+    uint32_t header[4];
+    memcpy(header, blob.data(), kHeaderSize);
+    EXPECT_EQ(FrameTimeline::kExportMagic, header[0]);
+    EXPECT_EQ(FrameTimeline::kExportVersion, header[1]);
+    EXPECT_EQ(2u, header[2]);
+    EXPECT_EQ(FrameTimeline::kRecordWords, header[3]);
+
+    int64_t words[FrameTimeline::kRecordWords];
+    memcpy(words, blob.data() + kHeaderSize, kRecordSize);
+    EXPECT_EQ(1, words[0]);
+    EXPECT_EQ(k60HzNs, words[1]);
+    EXPECT_EQ(kStartNs + 2 * k60HzNs, words[9]);
+    EXPECT_EQ(Record::STAGE_COMMIT, words[FrameTimeline::kRecordWords - 2]);
+    memcpy(words, blob.data() + kHeaderSize + kRecordSize, kRecordSize);
+    EXPECT_EQ(2, words[0]);
+    EXPECT_EQ(0, words[9]);
+}
+
+// Fences resolved on a thread of their own, the way the display's fence
+// worker does it.
+TEST(FrameTimelineTest, ResolverThread) {
+    constexpr uint64_t kFrames = 2000;
+    FrameTimeline timeline(kFrames);
+    std::atomic<uint64_t> handedOver{0};
+    std::thread resolver([&] {
+        for (uint64_t frameNumber = 1; frameNumber <= kFrames; ++frameNumber) {
+            while (timeline.lastFrameNumber() < frameNumber) {
+                std::this_thread::yield();
+            }
+            const int64_t startNs = kStartNs + static_cast<int64_t>(frameNumber) * k60HzNs;
+            ASSERT_TRUE(timeline.setPresentFenceTime(frameNumber, startNs + k60HzNs));
+            handedOver = frameNumber;
+        }
+    });
+
+    for (uint64_t frame = 1; frame <= kFrames; ++frame) {
+        // a display does not run ahead of its fences by much
+        while (frame > handedOver.load() + FrameTimeline::kMaxAwaitingFences / 2) {
+            std::this_thread::yield();
+        }
+        runFrame(timeline, kStartNs + static_cast<int64_t>(frame) * k60HzNs, {});
+    }
+    resolver.join();
+    timeline.collectPresentFenceTimes();
+
+    for (const Record& record : timeline.snapshot()) {
+        const int64_t startNs = kStartNs + static_cast<int64_t>(record.frameNumber) * k60HzNs;
+        ASSERT_EQ(startNs + k60HzNs, record.presentFenceNs);
+    }
+    EXPECT_EQ(kFrames, timeline.stats().frames);
+    EXPECT_EQ(0u, timeline.stats().lateFrames);
+}
+
+// A reader must only ever see whole records while the writer keeps going.
+TEST(FrameTimelineTest, ConcurrentReadersSeeConsistentRecords) {
+    FrameTimeline timeline(8);
+    std::atomic_bool done{false};
+    std::atomic<uint64_t> seen{0};
+    std::thread reader([&] {
+        // at least one pass after the writer is done
+        bool last = false;
+        while (!last) {
+            last = done.load();
+            for (const Record& record : timeline.snapshot()) {
+                const int64_t startNs = kStartNs + static_cast<int64_t>(record.frameNumber) * k60HzNs;
+                ASSERT_EQ(startNs, record.validateStartNs);
+                ASSERT_EQ(startNs + k60HzNs, record.expectedPresentNs);
+                ASSERT_TRUE(record.presentFenceNs == 0 ||
+                            record.presentFenceNs == startNs + k60HzNs);
+                seen++;
+            }
+        }
+    });
+
+    for (int frame = 1; frame <= 20000; ++frame) {
+        const int64_t startNs = kStartNs + frame * k60HzNs;
+        runFrame(timeline, startNs, {});
+        timeline.setPresentFenceTime(frame, startNs + k60HzNs);
+    }
+    timeline.collectPresentFenceTimes();
+    done = true;
+    reader.join();
+    EXPECT_GT(seen.load(), 0u);
+    EXPECT_EQ(20000u, timeline.stats().frames);
+}
@@ -0,0 +1,177 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../../libhwchelper/HandleSlotTable.h"
+
+class HandleSlotTableTest : public ::testing::Test {
+protected:
+    // Freeing a slot 2^32 times takes too long, start it close to the wrap
+    static void setGeneration(HandleSlotTable<int>& table, uint32_t index, uint32_t generation) {
+        table.mSlots.at(index).generation = generation;
+    }
+
+    int mObjects[3] = {};
+};
+
+TEST_F(HandleSlotTableTest, StaleHandleIsRejected) {
+    HandleSlotTable<int> table;
+    const uint64_t first = table.insert(&mObjects[0]);
+    EXPECT_NE(0u, first);
+    EXPECT_EQ(&mObjects[0], table.get(first));
+
+    ASSERT_TRUE(table.remove(first));
+    EXPECT_EQ(nullptr, table.get(first));
+    EXPECT_FALSE(table.remove(first));
+
+    // the slot is reused, the old handle still doesn't resolve
+    const uint64_t second = table.insert(&mObjects[1]);
+    EXPECT_EQ(static_cast<uint32_t>(first), static_cast<uint32_t>(second));
+    EXPECT_NE(first, second);
+    EXPECT_EQ(nullptr, table.get(first));
+    EXPECT_FALSE(table.remove(first));
+    EXPECT_EQ(&mObjects[1], table.get(second));
+
+    // neither a pointer nor an index past the table resolves
+    EXPECT_EQ(nullptr, table.get(reinterpret_cast<uintptr_t>(&mObjects[1])));
+    EXPECT_EQ(nullptr, table.get(second + 1));
+    EXPECT_EQ(nullptr, table.get(0));
+    EXPECT_EQ(1u, table.size());
+}
+
+TEST_F(HandleSlotTableTest, SlotsAreReusedAfterClear) {
+    HandleSlotTable<int> table(2);
+    const uint64_t first = table.insert(&mObjects[0]);
+    const uint64_t second = table.insert(&mObjects[1]);
+    ASSERT_TRUE(table.remove(second));
+    ASSERT_EQ(1u, table.size());
+
+    table.clear();
+    EXPECT_EQ(0u, table.size());
+    EXPECT_EQ(nullptr, table.get(first));
+    EXPECT_EQ(nullptr, table.get(second));
+    EXPECT_FALSE(table.remove(first));
+
+    // both slots come back, no new one is added
+    const uint64_t third = table.insert(&mObjects[2]);
+    const uint64_t fourth = table.insert(&mObjects[0]);
+    EXPECT_LT(static_cast<uint32_t>(third), 2u);
+    EXPECT_LT(static_cast<uint32_t>(fourth), 2u);
+    EXPECT_NE(static_cast<uint32_t>(third), static_cast<uint32_t>(fourth));
+    EXPECT_NE(first, third);
+    EXPECT_NE(first, fourth);
+    EXPECT_NE(second, third);
+    EXPECT_NE(second, fourth);
+    EXPECT_EQ(&mObjects[2], table.get(third));
+    EXPECT_EQ(&mObjects[0], table.get(fourth));
+    EXPECT_EQ(2u, table.size());
+
+    // a fresh slot after the reused ones
+    EXPECT_EQ(2u, static_cast<uint32_t>(table.insert(&mObjects[1])));
+}
+
+TEST_F(HandleSlotTableTest, GenerationWrapsAroundToOne) {
+    constexpr uint32_t kLastGeneration = std::numeric_limits<uint32_t>::max();
+    HandleSlotTable<int> table;
+    ASSERT_TRUE(table.remove(table.insert(&mObjects[0])));
+
+    setGeneration(table, 0, kLastGeneration);
+    const uint64_t last = table.insert(&mObjects[1]);
+    EXPECT_EQ(kLastGeneration, static_cast<uint32_t>(last >> 32));
+    ASSERT_TRUE(table.remove(last));
+
+    // 0 is skipped, so a handle is never 0
+    const uint64_t wrapped = table.insert(&mObjects[2]);
+    EXPECT_EQ(1u, static_cast<uint32_t>(wrapped >> 32));
+    EXPECT_EQ(0u, static_cast<uint32_t>(wrapped));
+    EXPECT_NE(0u, wrapped);
+    EXPECT_EQ(nullptr, table.get(last));
+    EXPECT_EQ(&mObjects[2], table.get(wrapped));
+
+    // clear() wraps the same way
+    setGeneration(table, 0, kLastGeneration);
+    table.clear();
+    EXPECT_EQ(nullptr, table.get(wrapped));
+    EXPECT_EQ(1u, static_cast<uint32_t>(table.insert(&mObjects[0]) >> 32));
+}
+
+// Layer command lookups of a 64 layer frame, 10 commands per layer: the
+// linear scan checkLayer() used to do over mLayers and mIgnoreLayers, then
+// the slot table.
+TEST_F(HandleSlotTableTest, Benchmark) {
+    constexpr size_t kLayers = 64;
+    constexpr int kCommandsPerLayer = 10;
+    constexpr int kFrames = 1000;
+
+    std::vector<std::unique_ptr<int>> objects;
+    std::vector<int*> layers;
+    std::vector<int*> ignoreLayers;
+    HandleSlotTable<int> table(kLayers);
+    std::vector<uint64_t> handles;
+    for (size_t i = 0; i < kLayers; i++) {
+        objects.push_back(std::make_unique<int>(static_cast<int>(i)));
+        layers.push_back(objects.back().get());
+        handles.push_back(table.insert(objects.back().get()));
+    }
+
+    auto linearLookup = [&](uint64_t addr) -> int* {
+        int* temp = reinterpret_cast<int*>(addr);
+        for (size_t i = 0; i < layers.size(); i++) {
+            if (layers[i] == temp) return layers[i];
+        }
+        auto it = std::find(ignoreLayers.begin(), ignoreLayers.end(), temp);
+        return (it == ignoreLayers.end()) ? nullptr : *it;
+    };
+
+    int64_t sum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < kFrames; frame++) {
+        for (int* layer : layers) {
+            for (int command = 0; command < kCommandsPerLayer; command++) {
+                sum += *linearLookup(reinterpret_cast<uintptr_t>(layer));
+            }
+        }
+    }
+    const auto linearNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                  std::chrono::steady_clock::now() - start)
+                                  .count();
+
+    start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < kFrames; frame++) {
+        for (uint64_t handle : handles) {
+            for (int command = 0; command < kCommandsPerLayer; command++) {
+                sum -= *table.get(handle);
+            }
+        }
+    }
+    const auto slotTableNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                     std::chrono::steady_clock::now() - start)
+                                     .count();
+
+    // both found the same layers
+    EXPECT_EQ(0, sum);
+    ::testing::Test::RecordProperty("linear_scan_frame_ns", std::to_string(linearNs / kFrames));
+    ::testing::Test::RecordProperty("slot_table_frame_ns", std::to_string(slotTableNs / kFrames));
+}
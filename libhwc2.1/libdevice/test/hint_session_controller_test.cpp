@@ -0,0 +1,238 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <stdlib.h>
+
+#include <random>
+#include <vector>
+
+#include "../HintSessionController.h"
+
+namespace {
+
+constexpr int64_t kMsToNs = 1000000;
+constexpr int64_t k60HzNs = 16666667;
+constexpr int64_t k120HzNs = 8333333;
+
+// Stands in for IPowerHintSession, one entry per binder call.
+struct FakeHintSession {
+    std::vector<int64_t> targets;
+    std::vector<std::vector<HintWorkDuration>> reports;
+
+    size_t binderCalls() const { return targets.size() + reports.size(); }
+    size_t durations() const {
+        size_t count = 0;
+        for (const auto& report : reports) count += report.size();
+        return count;
+    }
+    int64_t maxReportGapNs() const {
+        int64_t gap = 0;
+        for (size_t i = 1; i < reports.size(); ++i) {
+            gap = std::max(gap, reports[i].back().timeStampNanos -
+                                   reports[i - 1].back().timeStampNanos);
+        }
+        return gap;
+    }
+};
+
+// What PowerHalHintWorker::Routine() does once woken up.
+void pump(HintSessionController& controller, FakeHintSession& session, int64_t nowNs) {
+    if (controller.needReport(nowNs)) {
+        session.reports.push_back(controller.takeReport(nowNs));
+    }
+    if (controller.needTargetUpdate()) {
+        session.targets.push_back(controller.takeTargetUpdate());
+    }
+}
+
+struct Frame {
+    int64_t vsyncPeriodNs;
+    int64_t validateNs;
+    int64_t presentNs;
+};
+
+// Runs the frames back to back, one per vsync, pumping the session after each
+// signal like the worker thread would. Frames start up to maxPhaseNs into
+// their vsync.
+void run(HintSessionController& controller, FakeHintSession& session,
+         const std::vector<Frame>& frames, std::mt19937& rng, int64_t& nowNs,
+         int64_t maxPhaseNs = kMsToNs) {
+    std::uniform_int_distribution<int64_t> phase(0, maxPhaseNs);
+    for (const Frame& frame : frames) {
+        const int64_t startNs = nowNs + phase(rng);
+        controller.beginFrame(startNs, frame.vsyncPeriodNs, nowNs + frame.vsyncPeriodNs - startNs,
+                              true);
+        pump(controller, session, startNs);
+        const int64_t endNs = startNs + frame.validateNs + frame.presentNs;
+        controller.endFrame(endNs, frame.validateNs, frame.presentNs);
+        pump(controller, session, endNs);
+        nowNs += frame.vsyncPeriodNs;
+    }
+}
+
+std::vector<Frame> noisyFrames(int count, int64_t vsyncPeriodNs, int64_t workNs,
+                               std::mt19937& rng) {
+    std::normal_distribution<double> noise(0, workNs * 0.1);
+    std::vector<Frame> frames;
+    for (int i = 0; i < count; ++i) {
+        const int64_t work = workNs + static_cast<int64_t>(noise(rng));
+        frames.push_back({vsyncPeriodNs, work / 4, work - work / 4});
+    }
+    return frames;
+}
+
+std::vector<Frame> steadyFrames(int count, int64_t vsyncPeriodNs, int64_t workNs) {
+    return std::vector<Frame>(count, {vsyncPeriodNs, workNs / 4, workNs - workNs / 4});
+}
+
+TEST(HintSessionControllerTest, BatchesReportsAtBoundedRate) {
+    std::mt19937 rng(1);
+    const auto frames = noisyFrames(240, k120HzNs, 5 * kMsToNs, rng);
+
+    HintSessionController batched;
+    FakeHintSession batchedSession;
+    int64_t nowNs = 0;
+    rng.seed(2);
+    run(batched, batchedSession, frames, rng, nowNs);
+    batchedSession.reports.push_back(batched.takeReport(nowNs));
+
+    HintSessionController::Config config;
+    config.useRateLimiter = false;
+    HintSessionController legacy(config);
+    FakeHintSession legacySession;
+    nowNs = 0;
+    rng.seed(2);
+    run(legacy, legacySession, frames, rng, nowNs);
+    legacySession.reports.push_back(legacy.takeReport(nowNs));
+
+    // Two seconds at 120Hz with at most one report per 16ms, plus the final flush
+    const int64_t durationNs = frames.size() * k120HzNs;
+    EXPECT_LE(batchedSession.reports.size(),
+              static_cast<size_t>(durationNs / HintSessionController::Config().minReportIntervalNs +
+                                  2));
+    EXPECT_LT(batchedSession.binderCalls() * 3, legacySession.binderCalls());
+    // Only grouped, nothing lost
+    EXPECT_EQ(0u, batched.stats().durationsDropped);
+    EXPECT_EQ(legacySession.durations(), batchedSession.durations());
+    EXPECT_LE(batchedSession.maxReportGapNs(), 80 * kMsToNs + k120HzNs);
+
+    RecordProperty("batched_binder_calls", static_cast<int>(batchedSession.binderCalls()));
+    RecordProperty("legacy_binder_calls", static_cast<int>(legacySession.binderCalls()));
+}
+
+TEST(HintSessionControllerTest, KeepsSessionAliveWithoutDeviation) {
+    HintSessionController controller;
+    FakeHintSession session;
+    std::mt19937 rng(1);
+    int64_t nowNs = 0;
+    run(controller, session, steadyFrames(240, k120HzNs, 5 * kMsToNs), rng, nowNs, 0);
+
+    // The error term never moves, only the stale timeout triggers reports
+    const int64_t durationNs = 240 * k120HzNs;
+    EXPECT_LE(session.reports.size(), static_cast<size_t>(durationNs / (80 * kMsToNs) + 2));
+    EXPECT_LE(session.maxReportGapNs(), 80 * kMsToNs + k120HzNs);
+}
+
+TEST(HintSessionControllerTest, PredictsPerRefreshRate) {
+    HintSessionController controller;
+    FakeHintSession session;
+    std::mt19937 rng(1);
+    int64_t nowNs = 0;
+
+    EXPECT_FALSE(controller.predict(k60HzNs, true).has_value());
+    run(controller, session, steadyFrames(30, k60HzNs, 10 * kMsToNs), rng, nowNs);
+    run(controller, session, steadyFrames(30, k120HzNs, 4 * kMsToNs), rng, nowNs);
+    const auto warmUp = controller.stats();
+
+    // Each rate keeps its own model, a switch doesn't start from scratch
+    for (int i = 0; i < 4; ++i) {
+        run(controller, session, steadyFrames(30, k60HzNs, 10 * kMsToNs), rng, nowNs);
+        run(controller, session, steadyFrames(30, k120HzNs, 4 * kMsToNs), rng, nowNs);
+    }
+    const auto& stats = controller.stats();
+    EXPECT_EQ(240u, stats.predictions - warmUp.predictions);
+    EXPECT_LT((stats.predictionErrorNs - warmUp.predictionErrorNs) /
+                      static_cast<int64_t>(stats.predictions - warmUp.predictions),
+              100000);
+    EXPECT_NEAR(10 * kMsToNs, *controller.predict(k60HzNs, true), 100000);
+    EXPECT_NEAR(4 * kMsToNs, *controller.predict(k120HzNs, true), 100000);
+    // Present alone was never measured
+    EXPECT_FALSE(controller.predict(k120HzNs, false).has_value());
+}
+
+TEST(HintSessionControllerTest, FollowsSmoothedTarget) {
+    std::mt19937 rng(1);
+    const auto frames = noisyFrames(240, k120HzNs, 5 * kMsToNs, rng);
+
+    HintSessionController controller;
+    FakeHintSession session;
+    int64_t nowNs = 0;
+    rng.seed(2);
+    run(controller, session, frames, rng, nowNs);
+
+    HintSessionController::Config config;
+    config.useRateLimiter = false;
+    HintSessionController legacy(config);
+    FakeHintSession legacySession;
+    nowNs = 0;
+    rng.seed(2);
+    run(legacy, legacySession, frames, rng, nowNs);
+
+    // The start phase jitters the frame target by a millisecond
+    EXPECT_LT(session.targets.size() * 5, legacySession.targets.size());
+
+    // A refresh rate switch moves the target on its first frame
+    const size_t targets = session.targets.size();
+    run(controller, session, steadyFrames(1, k60HzNs, 5 * kMsToNs), rng, nowNs);
+    ASSERT_EQ(targets + 1, session.targets.size());
+    EXPECT_NEAR(k60HzNs - 2 * kMsToNs, session.targets.back(), kMsToNs);
+}
+
+TEST(HintSessionControllerTest, NormalizedTargetIsNeverUpdated) {
+    HintSessionController::Config config;
+    config.normalizeTarget = true;
+    HintSessionController controller(config);
+    FakeHintSession session;
+    std::mt19937 rng(1);
+    int64_t nowNs = 0;
+    run(controller, session, noisyFrames(120, k60HzNs, 8 * kMsToNs, rng), rng, nowNs);
+
+    EXPECT_TRUE(session.targets.empty());
+    EXPECT_EQ(config.defaultTargetNs, controller.takeSessionTarget());
+    // Durations are shifted as if the frame target were the constant one
+    controller.beginFrame(nowNs, k60HzNs, k60HzNs, true);
+    controller.endFrame(nowNs + 8 * kMsToNs, 2 * kMsToNs, 6 * kMsToNs);
+    EXPECT_EQ(8 * kMsToNs + config.defaultTargetNs - controller.frameTargetNs(),
+              *controller.lastReportedDurationNs());
+}
+
+TEST(HintSessionControllerTest, DropsOldestDurationsWithoutSession) {
+    HintSessionController controller;
+    for (int i = 0; i < 40; ++i) {
+        controller.beginFrame(i * k60HzNs, k60HzNs, k60HzNs, true);
+        controller.endFrame(i * k60HzNs + 5 * kMsToNs, kMsToNs, 4 * kMsToNs);
+    }
+    EXPECT_TRUE(controller.needReport(40 * k60HzNs));
+    auto batch = controller.takeReport(40 * k60HzNs);
+    ASSERT_EQ(HintSessionController::Config().maxQueuedDurations, batch.size());
+    // 40 measured plus 39 predicted durations
+    EXPECT_EQ(79u - batch.size(), controller.stats().durationsDropped);
+    EXPECT_EQ(39 * k60HzNs + 5 * kMsToNs, batch.back().timeStampNanos);
+}
+
+}  // namespace
@@ -0,0 +1,309 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <limits.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "../HistogramQueryPipeline.h"
+
+namespace {
+
+using namespace std::chrono_literals;
+using Result = HistogramQueryPipeline::Result;
+
+constexpr size_t kChannels = 4;
+constexpr size_t kBins = 256;
+constexpr auto kTimeout = 50ms;
+
+// Stands in for the drm event thread: every REQUEST ioctl is answered by one
+// histogram event, like handleDrmEvent delivers it, while the source has
+// events left to deliver. The bins of an event all hold the number of the
+// event.
+class FakeEventSource {
+public:
+    FakeEventSource()
+          : mPipeline(
+                    kChannels, kBins,
+                    [this](uint8_t channelId) -> int32_t {
+                        std::scoped_lock lock(mMutex);
+                        if (mFailRequests) {
+                            return -5;
+                        }
+                        mRequests++;
+                        mPending.push_back(channelId);
+                        mCv.notify_all();
+                        return 0;
+                    },
+                    [this](uint8_t channelId) {
+                        std::scoped_lock lock(mMutex);
+                        mCancels++;
+                        for (auto it = mPending.begin(); it != mPending.end(); ++it) {
+                            if (*it == channelId) {
+                                mPending.erase(it);
+                                break;
+                            }
+                        }
+                    }),
+            mThread([this] { run(); }) {}
+
+    ~FakeEventSource() {
+        {
+            std::scoped_lock lock(mMutex);
+            mExit = true;
+            mCv.notify_all();
+        }
+        mThread.join();
+    }
+
+    HistogramQueryPipeline& pipeline() { return mPipeline; }
+
+    void setStalled(bool stalled) { allowEvents(stalled ? 0 : kUnlimited); }
+    // Delivers the next count events only
+    void allowEvents(int count) {
+        std::scoped_lock lock(mMutex);
+        mAllowed = count;
+        mCv.notify_all();
+    }
+    void setFailRequests(bool fail) {
+        std::scoped_lock lock(mMutex);
+        mFailRequests = fail;
+    }
+    // Waits until the allowed events are delivered
+    void drain() {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mCv.wait(lock, [this] { return mAllowed == 0 && !mDelivering; });
+    }
+    int requests() {
+        std::scoped_lock lock(mMutex);
+        return mRequests;
+    }
+    int cancels() {
+        std::scoped_lock lock(mMutex);
+        return mCancels;
+    }
+
+private:
+    void run() {
+        std::unique_lock<std::mutex> lock(mMutex);
+        while (true) {
+            mCv.wait(lock, [this] { return mExit || (mAllowed > 0 && !mPending.empty()); });
+            if (mExit) {
+                return;
+            }
+            const uint8_t channelId = mPending.front();
+            mPending.pop_front();
+            mDelivering = true;
+            if (mAllowed != kUnlimited) {
+                mAllowed--;
+            }
+            const std::vector<char16_t> data(kBins, ++mEvents);
+            lock.unlock();
+
+            mPipeline.onEvent(channelId, data.data());
+
+            lock.lock();
+            mDelivering = false;
+            mCv.notify_all();
+        }
+    }
+
+    static constexpr int kUnlimited = INT_MAX;
+
+    std::mutex mMutex;
+    std::condition_variable mCv;
+    std::deque<uint8_t> mPending;
+    int mAllowed = kUnlimited;
+    bool mFailRequests = false;
+    bool mDelivering = false;
+    bool mExit = false;
+    int mRequests = 0;
+    int mCancels = 0;
+    char16_t mEvents = 0;
+
+    HistogramQueryPipeline mPipeline;
+    std::thread mThread;
+};
+
+} // namespace
+
+TEST(HistogramQueryPipelineTest, BlockingModeWaitsForEveryQuery) {
+    FakeEventSource source;
+    auto& pipeline = source.pipeline();
+    std::vector<char16_t> data;
+
+    ASSERT_EQ(Result::OK, pipeline.query(1, kTimeout, &data));
+    ASSERT_EQ(kBins, data.size());
+    EXPECT_EQ(1, data[0]);
+    EXPECT_EQ(1, data[kBins - 1]);
+
+    // nothing changed on screen, still a new request
+    ASSERT_EQ(Result::OK, pipeline.query(1, kTimeout, &data));
+    EXPECT_EQ(2, data[0]);
+    EXPECT_EQ(2, source.requests());
+    EXPECT_EQ(0u, pipeline.stats().cacheHits);
+}
+
+TEST(HistogramQueryPipelineTest, ConcurrentCallersShareOneRequest) {
+    FakeEventSource source;
+    auto& pipeline = source.pipeline();
+    source.setStalled(true);
+
+    constexpr int kCallers = 4;
+    std::vector<std::vector<char16_t>> data(kCallers);
+    std::vector<Result> results(kCallers, Result::TIMEOUT);
+    std::vector<std::thread> callers;
+    for (int i = 0; i < kCallers; ++i) {
+        callers.emplace_back([&, i] { results[i] = pipeline.query(2, 500ms, &data[i]); });
+    }
+    // let every caller join before the event is delivered
+    while (pipeline.stats().queries < kCallers) {
+        std::this_thread::sleep_for(1ms);
+    }
+    source.setStalled(false);
+    for (auto& caller : callers) {
+        caller.join();
+    }
+
+    for (int i = 0; i < kCallers; ++i) {
+        EXPECT_EQ(Result::OK, results[i]);
+        EXPECT_EQ(1, data[i][0]);
+    }
+    EXPECT_EQ(1, source.requests());
+    EXPECT_EQ(kCallers - 1, static_cast<int>(pipeline.stats().coalesced));
+}
+
+TEST(HistogramQueryPipelineTest, FreshDataIsServedWithoutWait) {
+    FakeEventSource source;
+    auto& pipeline = source.pipeline();
+    pipeline.setMaxAgeFrames(1);
+    std::vector<char16_t> data;
+    uint64_t frameSeq = 0;
+
+    pipeline.onFrameCommitted();
+    ASSERT_EQ(Result::OK, pipeline.query(0, kTimeout, &data, &frameSeq));
+    EXPECT_EQ(1u, frameSeq);
+
+    // a stalled source proves no request is sent
+    source.setStalled(true);
+    pipeline.onFrameCommitted();
+    ASSERT_EQ(Result::OK, pipeline.query(0, kTimeout, &data, &frameSeq));
+    EXPECT_EQ(1, data[0]);
+    EXPECT_EQ(1u, frameSeq);
+    EXPECT_EQ(1u, pipeline.stats().cacheHits);
+
+    // two commits old is too old
+    pipeline.onFrameCommitted();
+    source.setStalled(false);
+    ASSERT_EQ(Result::OK, pipeline.query(0, kTimeout, &data, &frameSeq));
+    EXPECT_EQ(2, data[0]);
+    EXPECT_EQ(3u, frameSeq);
+    EXPECT_EQ(2, source.requests());
+}
+
+TEST(HistogramQueryPipelineTest, PipelinedQueriesFindTheNextFrameWaiting) {
+    FakeEventSource source;
+    auto& pipeline = source.pipeline();
+    pipeline.setMaxAgeFrames(0);
+    pipeline.setPipelined(true);
+    std::vector<char16_t> data;
+    uint64_t frameSeq = 0;
+
+    source.allowEvents(1);
+    ASSERT_EQ(Result::OK, pipeline.query(3, kTimeout, &data));
+    for (uint64_t frame = 1; frame <= 10; ++frame) {
+        pipeline.onFrameCommitted();
+        // the event of the request sent ahead arrives during the frame
+        source.allowEvents(1);
+        source.drain();
+        ASSERT_EQ(Result::OK, pipeline.query(3, kTimeout, &data, &frameSeq));
+        EXPECT_EQ(frame, frameSeq);
+        EXPECT_EQ(frame + 1, data[0]);
+    }
+
+    const auto stats = pipeline.stats();
+    EXPECT_EQ(10u, stats.cacheHits);
+    EXPECT_EQ(11u, stats.prefetches);
+    EXPECT_EQ(0u, stats.unexpectedEvents);
+}
+
+TEST(HistogramQueryPipelineTest, TimeoutCancelsTheRequestOnce) {
+    FakeEventSource source;
+    auto& pipeline = source.pipeline();
+    source.setStalled(true);
+
+    std::vector<char16_t> first;
+    std::vector<char16_t> second;
+    Result secondResult = Result::OK;
+    std::thread caller([&] { secondResult = pipeline.query(0, 200ms, &second); });
+    EXPECT_EQ(Result::TIMEOUT, pipeline.query(0, 20ms, &first));
+    caller.join();
+    EXPECT_EQ(Result::TIMEOUT, secondResult);
+    EXPECT_EQ(1, source.cancels());
+
+    bool outstanding = true;
+    uint64_t frameSeq = 0;
+    EXPECT_FALSE(pipeline.channelState(0, &frameSeq, &outstanding));
+    EXPECT_FALSE(outstanding);
+
+    // the channel recovers with a new request
+    source.setStalled(false);
+    ASSERT_EQ(Result::OK, pipeline.query(0, kTimeout, &first));
+    EXPECT_EQ(2, source.requests());
+}
+
+TEST(HistogramQueryPipelineTest, InvalidatedDataIsNotServed) {
+    FakeEventSource source;
+    auto& pipeline = source.pipeline();
+    pipeline.setMaxAgeFrames(2);
+    std::vector<char16_t> data;
+
+    ASSERT_EQ(Result::OK, pipeline.query(1, kTimeout, &data));
+    pipeline.invalidate(1);
+    ASSERT_EQ(Result::OK, pipeline.query(1, kTimeout, &data));
+    // the new config is committed only with the next frame
+    EXPECT_EQ(0u, pipeline.stats().cacheHits);
+
+    pipeline.onFrameCommitted();
+    ASSERT_EQ(Result::OK, pipeline.query(1, kTimeout, &data));
+    ASSERT_EQ(Result::OK, pipeline.query(1, kTimeout, &data));
+    EXPECT_EQ(1u, pipeline.stats().cacheHits);
+    EXPECT_EQ(3, data[0]);
+}
+
+TEST(HistogramQueryPipelineTest, RequestErrorAndLateEvents) {
+    FakeEventSource source;
+    auto& pipeline = source.pipeline();
+    std::vector<char16_t> data;
+
+    source.setFailRequests(true);
+    EXPECT_EQ(Result::REQUEST_ERROR, pipeline.query(0, kTimeout, &data));
+    EXPECT_EQ(Result::REQUEST_ERROR, pipeline.query(kChannels, kTimeout, &data));
+
+    // an event nobody asked for is kept, but does not complete a request
+    const std::vector<char16_t> late(kBins, 7);
+    pipeline.onEvent(0, late.data());
+    EXPECT_EQ(1u, pipeline.stats().unexpectedEvents);
+    pipeline.setMaxAgeFrames(0);
+    ASSERT_EQ(Result::OK, pipeline.query(0, kTimeout, &data));
+    EXPECT_EQ(7, data[0]);
+}
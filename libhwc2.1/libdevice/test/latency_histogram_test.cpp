@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "../../libhwchelper/LatencyHistogram.h"
+
+namespace {
+
+constexpr int64_t kUsToNs = 1000;
+
+// nearest rank percentile of sorted samples, the reference the histogram
+// approximates
+int64_t exactPercentileUs(const std::vector<int64_t>& sortedUs, float percentile) {
+    const size_t rank = std::max<size_t>(1, std::ceil(sortedUs.size() * percentile / 100.0));
+    return sortedUs[rank - 1];
+}
+
+} // namespace
+
+TEST(LatencyHistogramTest, BucketsCoverEveryValueOnce) {
+    int64_t nextUs = 0;
+    for (size_t i = 0; i < LatencyHistogram::kBucketCount - 1; i++) {
+        EXPECT_EQ(nextUs, LatencyHistogram::bucketLowerUs(i));
+        EXPECT_EQ(i, LatencyHistogram::bucketIndex(LatencyHistogram::bucketLowerUs(i)));
+        const int64_t widthUs = LatencyHistogram::bucketWidthUs(i);
+        EXPECT_EQ(i, LatencyHistogram::bucketIndex(nextUs + widthUs - 1));
+        // exact below kSubBuckets, then the width bounds the relative error
+        if (nextUs < LatencyHistogram::kSubBuckets) {
+            EXPECT_EQ(1, widthUs);
+        } else {
+            EXPECT_LE(widthUs * LatencyHistogram::kSubBuckets, nextUs);
+        }
+        nextUs += widthUs;
+    }
+    EXPECT_EQ(LatencyHistogram::kBucketCount - 1, LatencyHistogram::bucketIndex(nextUs));
+    EXPECT_EQ(nextUs, LatencyHistogram::bucketLowerUs(LatencyHistogram::kBucketCount - 1));
+    EXPECT_EQ(LatencyHistogram::kBucketCount - 1, LatencyHistogram::bucketIndex(INT64_MAX));
+}
+
+TEST(LatencyHistogramTest, SmallValuesAreExact) {
+    LatencyHistogram histogram;
+    for (int64_t us = 1; us <= 10; us++) {
+        histogram.insert(us * kUsToNs);
+    }
+    EXPECT_EQ(5, histogram.percentileUs(50));
+    EXPECT_EQ(9, histogram.percentileUs(90));
+    EXPECT_EQ(10, histogram.percentileUs(100));
+    EXPECT_EQ(10u, histogram.count());
+}
+
+// Frame-like latencies from 20 us to 200 ms, log-uniform so every order of
+// magnitude is hit.
+TEST(LatencyHistogramTest, PercentileErrorIsBounded) {
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<double> exponent(std::log(20.0), std::log(200000.0));
+    LatencyHistogram histogram;
+    std::vector<int64_t> samplesUs;
+    for (int i = 0; i < 100000; i++) {
+        const int64_t us = static_cast<int64_t>(std::exp(exponent(rng)));
+        samplesUs.push_back(us);
+        histogram.insert(us * kUsToNs);
+    }
+    std::sort(samplesUs.begin(), samplesUs.end());
+
+    for (float percentile : {1.0f, 10.0f, 50.0f, 90.0f, 99.0f, 99.9f}) {
+        const int64_t exactUs = exactPercentileUs(samplesUs, percentile);
+        const int64_t estimatedUs = histogram.percentileUs(percentile);
+        EXPECT_LE(std::abs(estimatedUs - exactUs), exactUs / LatencyHistogram::kSubBuckets + 1)
+                << "p" << percentile << " exact " << exactUs << "us estimated " << estimatedUs
+                << "us";
+    }
+    EXPECT_EQ(samplesUs.back(), histogram.percentileUs(100));
+    EXPECT_EQ(samplesUs.back(), histogram.maxUs());
+}
+
+TEST(LatencyHistogramTest, OverflowIsBoundedByMax) {
+    LatencyHistogram histogram;
+    histogram.insert(100 * kUsToNs);
+    histogram.insert(30'000'000 * kUsToNs);
+    EXPECT_EQ(1u, histogram.buckets[LatencyHistogram::kBucketCount - 1].load());
+    EXPECT_EQ(30'000'000, histogram.percentileUs(100));
+    EXPECT_LE(histogram.percentileUs(75), 30'000'000);
+    EXPECT_GE(histogram.percentileUs(75), int64_t(1) << LatencyHistogram::kMaxBits);
+}
+
+TEST(LatencyHistogramTest, MergeMatchesSingleHistogram) {
+    LatencyHistogram whole;
+    LatencyHistogram shards[3];
+    for (int64_t us = 0; us < 30000; us += 7) {
+        whole.insert(us * kUsToNs);
+        shards[us % 3].insert(us * kUsToNs);
+    }
+    LatencyHistogram merged;
+    for (const auto& shard : shards) {
+        merged.merge(shard);
+    }
+    EXPECT_EQ(whole.count(), merged.count());
+    EXPECT_EQ(whole.maxUs(), merged.maxUs());
+    for (float percentile : {50.0f, 90.0f, 99.0f}) {
+        EXPECT_EQ(whole.percentileUs(percentile), merged.percentileUs(percentile));
+    }
+
+    merged.reset();
+    EXPECT_EQ(0u, merged.count());
+    EXPECT_EQ(0, merged.percentileUs(50));
+}
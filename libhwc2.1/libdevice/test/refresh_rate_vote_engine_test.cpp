@@ -0,0 +1,319 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "../RefreshRateVoteEngine.h"
+
+namespace {
+
+constexpr int64_t kMsToNs = 1000000;
+
+// Same layout as RrThrottleRequester and DispIdleTimerRequester
+enum Requester : size_t { PIXEL_DISP = 0, TEST, LHBM, BRIGHTNESS, NUM_REQUESTERS };
+enum IdleRequester : size_t { SF = 0, RR_THROTTLE, NUM_IDLE_REQUESTERS };
+
+constexpr int kDefaultMinIdleFps = 1;
+constexpr int kBlockingZoneFps = 10;
+
+// A panel sysfs directory in the test temp dir
+class FakeSysfs {
+public:
+    FakeSysfs() {
+        std::string pattern = ::testing::TempDir() + "rr_votes_XXXXXX";
+        mDir = mkdtemp(pattern.data());
+        mDir += "/";
+    }
+    ~FakeSysfs() {
+        for (const char* node : {"min_vrefresh", "idle_delay_ms", "panel_idle"}) {
+            unlink((mDir + node).c_str());
+        }
+        rmdir(mDir.c_str());
+    }
+
+    const std::string& dir() const { return mDir; }
+    std::string read(const char* node) const {
+        std::ifstream ifs(mDir + node);
+        std::string value;
+        std::getline(ifs, value);
+        return value;
+    }
+
+private:
+    std::string mDir;
+};
+
+RefreshRateVoteEngine::Config makeConfig(const std::string& dir, int64_t holdNs) {
+    return {.sysfsDir = dir,
+            .throttlePriorities = {0, 1, 0, 0},
+            .numIdleRequesters = NUM_IDLE_REQUESTERS,
+            .throttleIdleRequester = RR_THROTTLE,
+            .defaultMinIdleFps = kDefaultMinIdleFps,
+            .minIdleFpsRelaxHoldNs = holdNs};
+}
+
+struct Vote {
+    int64_t timeMs;
+    size_t requester;
+    int fps;
+};
+
+// Replays votes like the primary display does, a held back value is applied
+// by the worker at its deadline. Returns the number of min_vrefresh writes.
+uint64_t replay(const std::vector<Vote>& votes, int64_t holdNs, int* outFinalFps) {
+    FakeSysfs sysfs;
+    RefreshRateVoteEngine engine(makeConfig(sysfs.dir(), holdNs));
+    auto runDeadlinesUntil = [&engine](int64_t nowNs) {
+        for (int64_t deadlineNs = engine.nextDeadlineNs();
+             deadlineNs >= 0 && deadlineNs <= nowNs; deadlineNs = engine.nextDeadlineNs()) {
+            engine.decide(deadlineNs);
+        }
+    };
+
+    for (const Vote& vote : votes) {
+        runDeadlinesUntil(vote.timeMs * kMsToNs);
+        engine.setMinIdleFpsVote(vote.requester, vote.fps);
+        EXPECT_EQ(0, engine.decide(vote.timeMs * kMsToNs));
+    }
+    runDeadlinesUntil(INT64_MAX);
+    *outFinalFps = engine.applied().minIdleFps;
+    EXPECT_EQ(std::to_string(*outFinalFps), sysfs.read("min_vrefresh"));
+    return engine.stats().minIdleFpsWrites;
+}
+
+// Auto brightness hovering around the blocking zone threshold, e.g. under
+// flickering ambient light: the zone is entered and left every 50 to 400 ms.
+std::vector<Vote> brightnessHoverWorkload() {
+    std::vector<Vote> votes;
+    const int64_t gapsMs[] = {120, 80, 350, 60, 200, 50, 400, 90, 150, 70};
+    int64_t timeMs = 0;
+    for (int i = 0; i < 60; ++i) {
+        timeMs += gapsMs[i % 10];
+        votes.push_back({timeMs, BRIGHTNESS, i % 2 ? kDefaultMinIdleFps : kBlockingZoneFps});
+    }
+    // then settles out of the zone
+    votes.push_back({timeMs + 2000, BRIGHTNESS, kDefaultMinIdleFps});
+    return votes;
+}
+
+// A video app raising the min idle rate in bursts between scene changes
+std::vector<Vote> pixelDispBurstWorkload() {
+    std::vector<Vote> votes;
+    int64_t timeMs = 0;
+    for (int i = 0; i < 20; ++i) {
+        votes.push_back({timeMs, PIXEL_DISP, 60});
+        votes.push_back({timeMs + 300, PIXEL_DISP, 0});
+        // every fourth gap is long enough to really go idle
+        timeMs += i % 4 == 3 ? 3000 : 400;
+    }
+    return votes;
+}
+
+} // namespace
+
+TEST(RefreshRateVoteEngineTest, MaxOfVotesWithinAPriority) {
+    FakeSysfs sysfs;
+    RefreshRateVoteEngine engine(makeConfig(sysfs.dir(), 0));
+
+    ASSERT_EQ(0, engine.decide(0));
+    EXPECT_EQ("1", sysfs.read("min_vrefresh"));
+
+    engine.setMinIdleFpsVote(BRIGHTNESS, kBlockingZoneFps);
+    engine.setMinIdleFpsVote(PIXEL_DISP, 30);
+    ASSERT_EQ(0, engine.decide(kMsToNs));
+    EXPECT_EQ(30, engine.applied().minIdleFps);
+    EXPECT_EQ("30", sysfs.read("min_vrefresh"));
+
+    engine.setMinIdleFpsVote(PIXEL_DISP, 0);
+    ASSERT_EQ(0, engine.decide(2 * kMsToNs));
+    EXPECT_EQ("10", sysfs.read("min_vrefresh"));
+    EXPECT_EQ(3u, engine.stats().minIdleFpsWrites);
+}
+
+TEST(RefreshRateVoteEngineTest, HigherPriorityOverrides) {
+    FakeSysfs sysfs;
+    RefreshRateVoteEngine engine(makeConfig(sysfs.dir(), 0));
+
+    engine.setThrottleVote(LHBM, 1000 * kMsToNs);
+    engine.setThrottleVote(TEST, 100 * kMsToNs);
+    ASSERT_EQ(0, engine.decide(0));
+    EXPECT_EQ(100 * kMsToNs, engine.applied().throttleNs);
+
+    engine.setThrottleVote(TEST, 0);
+    ASSERT_EQ(0, engine.decide(kMsToNs));
+    EXPECT_EQ(1000 * kMsToNs, engine.applied().throttleNs);
+}
+
+TEST(RefreshRateVoteEngineTest, MinIdleFpsHasItsOwnPriorities) {
+    FakeSysfs sysfs;
+    auto config = makeConfig(sysfs.dir(), 0);
+    RefreshRateVoteEngine engine(config);
+
+    // the test override of the throttle can't lower the blocking zone floor
+    engine.setMinIdleFpsVote(BRIGHTNESS, kBlockingZoneFps);
+    engine.setMinIdleFpsVote(TEST, 5);
+    ASSERT_EQ(0, engine.decide(0));
+    EXPECT_EQ("10", sysfs.read("min_vrefresh"));
+
+    engine.setMinIdleFpsVote(TEST, 60);
+    ASSERT_EQ(0, engine.decide(kMsToNs));
+    EXPECT_EQ("60", sysfs.read("min_vrefresh"));
+
+    // unless the min idle refresh rate is given priorities of its own
+    config.minIdleFpsPriorities = {0, 1, 0, 0};
+    RefreshRateVoteEngine overridden(config);
+    overridden.setMinIdleFpsVote(BRIGHTNESS, kBlockingZoneFps);
+    overridden.setMinIdleFpsVote(TEST, 5);
+    ASSERT_EQ(0, overridden.decide(2 * kMsToNs));
+    EXPECT_EQ("5", sysfs.read("min_vrefresh"));
+}
+
+TEST(RefreshRateVoteEngineTest, ThrottleFeedsIdleDelayInOneDecision) {
+    FakeSysfs sysfs;
+    RefreshRateVoteEngine engine(makeConfig(sysfs.dir(), 0));
+
+    engine.setIdleDelayVote(SF, 80 * kMsToNs);
+    engine.setPanelIdleVote(true);
+    ASSERT_EQ(0, engine.decide(0));
+    EXPECT_EQ("80", sysfs.read("idle_delay_ms"));
+    EXPECT_EQ("1", sysfs.read("panel_idle"));
+
+    engine.setThrottleVote(LHBM, 1000 * kMsToNs);
+    ASSERT_EQ(0, engine.decide(kMsToNs));
+    EXPECT_EQ(1000 * kMsToNs, engine.applied().throttleNs);
+    EXPECT_EQ(1000 * kMsToNs, engine.idleDelayVote(RR_THROTTLE));
+    EXPECT_EQ("1000", sysfs.read("idle_delay_ms"));
+
+    // the throttle requester of the idle delay can't be voted from outside
+    engine.setIdleDelayVote(RR_THROTTLE, 0);
+    engine.setThrottleVote(LHBM, 0);
+    ASSERT_EQ(0, engine.decide(2 * kMsToNs));
+    EXPECT_EQ("80", sysfs.read("idle_delay_ms"));
+
+    // nothing changed, nothing written
+    const auto stats = engine.stats();
+    ASSERT_EQ(0, engine.decide(3 * kMsToNs));
+    EXPECT_EQ(3u, stats.idleDelayWrites);
+    EXPECT_EQ(1u, stats.panelIdleWrites);
+    EXPECT_EQ(stats.idleDelayWrites, engine.stats().idleDelayWrites);
+    EXPECT_EQ(stats.minIdleFpsWrites, engine.stats().minIdleFpsWrites);
+}
+
+TEST(RefreshRateVoteEngineTest, LowerValuesWaitForTheHold) {
+    constexpr int64_t kHoldNs = 500 * kMsToNs;
+    FakeSysfs sysfs;
+    RefreshRateVoteEngine engine(makeConfig(sysfs.dir(), kHoldNs));
+
+    engine.setMinIdleFpsVote(BRIGHTNESS, kBlockingZoneFps);
+    ASSERT_EQ(0, engine.decide(0));
+    EXPECT_EQ("10", sysfs.read("min_vrefresh"));
+    EXPECT_EQ(-1, engine.nextDeadlineNs());
+
+    engine.setMinIdleFpsVote(BRIGHTNESS, kDefaultMinIdleFps);
+    ASSERT_EQ(0, engine.decide(100 * kMsToNs));
+    EXPECT_EQ("10", sysfs.read("min_vrefresh"));
+    EXPECT_EQ(600 * kMsToNs, engine.nextDeadlineNs());
+
+    ASSERT_EQ(0, engine.decide(599 * kMsToNs));
+    EXPECT_EQ("10", sysfs.read("min_vrefresh"));
+    ASSERT_EQ(0, engine.decide(600 * kMsToNs));
+    EXPECT_EQ("1", sysfs.read("min_vrefresh"));
+    EXPECT_EQ(-1, engine.nextDeadlineNs());
+
+    // bouncing back within the hold never reaches the panel
+    engine.setMinIdleFpsVote(BRIGHTNESS, kBlockingZoneFps);
+    ASSERT_EQ(0, engine.decide(700 * kMsToNs));
+    engine.setMinIdleFpsVote(BRIGHTNESS, kDefaultMinIdleFps);
+    ASSERT_EQ(0, engine.decide(800 * kMsToNs));
+    engine.setMinIdleFpsVote(BRIGHTNESS, kBlockingZoneFps);
+    ASSERT_EQ(0, engine.decide(900 * kMsToNs));
+    EXPECT_EQ(-1, engine.nextDeadlineNs());
+    EXPECT_EQ(3u, engine.stats().minIdleFpsWrites);
+    EXPECT_EQ(2u, engine.stats().relaxDeferred);
+    EXPECT_EQ(1u, engine.stats().relaxCancelled);
+}
+
+TEST(RefreshRateVoteEngineTest, FailedWriteIsRetried) {
+    RefreshRateVoteEngine engine(makeConfig("/nonexistent/", 0));
+    engine.setMinIdleFpsVote(PIXEL_DISP, 60);
+    EXPECT_NE(0, engine.decide(0));
+    EXPECT_EQ(0, engine.applied().minIdleFps);
+    EXPECT_NE(0, engine.decide(kMsToNs));
+    EXPECT_EQ(2u, engine.stats().writeErrors);
+}
+
+TEST(RefreshRateVoteEngineTest, FailedRelaxBacksOff) {
+    constexpr int64_t kHoldNs = 100 * kMsToNs;
+    FakeSysfs sysfs;
+    RefreshRateVoteEngine engine(makeConfig(sysfs.dir(), kHoldNs));
+    engine.setMinIdleFpsVote(PIXEL_DISP, 60);
+    ASSERT_EQ(0, engine.decide(0));
+
+    // the node can't be written anymore
+    const std::string node = sysfs.dir() + "min_vrefresh";
+    ASSERT_EQ(0, unlink(node.c_str()));
+    ASSERT_EQ(0, mkdir(node.c_str(), 0700));
+
+    engine.setMinIdleFpsVote(PIXEL_DISP, 0);
+    EXPECT_EQ(0, engine.decide(kMsToNs));
+    EXPECT_EQ(kMsToNs + kHoldNs, engine.nextDeadlineNs());
+    EXPECT_NE(0, engine.decide(kMsToNs + kHoldNs));
+    EXPECT_EQ(60, engine.applied().minIdleFps);
+
+    // the retry is a full hold away, not already due
+    EXPECT_EQ(kMsToNs + 2 * kHoldNs, engine.nextDeadlineNs());
+    EXPECT_EQ(0, engine.decide(2 * kMsToNs + kHoldNs));
+    EXPECT_EQ(1u, engine.stats().writeErrors);
+
+    ASSERT_EQ(0, rmdir(node.c_str()));
+    EXPECT_EQ(0, engine.decide(kMsToNs + 2 * kHoldNs));
+    EXPECT_EQ(kDefaultMinIdleFps, engine.applied().minIdleFps);
+    EXPECT_EQ(-1, engine.nextDeadlineNs());
+}
+
+// Panel rate switches of recorded vote sequences, legacy behaviour (every
+// change written right away) against the 500 ms relax hold.
+TEST(RefreshRateVoteEngineTest, HysteresisSavesPanelRateSwitches) {
+    constexpr int64_t kHoldNs = 500 * kMsToNs;
+    const struct {
+        const char* name;
+        std::vector<Vote> votes;
+    } workloads[] = {
+            {"brightness_hover", brightnessHoverWorkload()},
+            {"pixel_disp_burst", pixelDispBurstWorkload()},
+    };
+
+    for (const auto& workload : workloads) {
+        int legacyFps = 0;
+        int heldFps = 0;
+        const uint64_t legacy = replay(workload.votes, 0, &legacyFps);
+        const uint64_t held = replay(workload.votes, kHoldNs, &heldFps);
+        EXPECT_EQ(legacyFps, heldFps) << workload.name;
+        EXPECT_LT(held * 2, legacy) << workload.name;
+        ::testing::Test::RecordProperty(std::string(workload.name) + "_legacy_switches",
+                                        std::to_string(legacy));
+        ::testing::Test::RecordProperty(std::string(workload.name) + "_held_switches",
+                                        std::to_string(held));
+    }
+}
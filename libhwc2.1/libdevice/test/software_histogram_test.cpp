@@ -0,0 +1,269 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../HistogramQueryPipeline.h"
+#include "../SoftwareHistogram.h"
+
+namespace {
+
+using Config = SoftwareHistogram::Config;
+using Rect = SoftwareHistogram::Rect;
+using Counts = std::array<uint32_t, SoftwareHistogram::kBinCount>;
+
+constexpr uint32_t rgba(uint32_t r, uint32_t g, uint32_t b) {
+    return r | g << 8 | b << 16 | 0xffu << 24;
+}
+
+struct Image {
+    Image(int32_t width, int32_t height, int32_t stride, uint32_t fill = 0)
+          : pixels(static_cast<size_t>(stride) * height, fill),
+            buffer{pixels.data(), width, height, stride} {}
+    // moving keeps the pixels where the buffer points to
+    Image(Image&&) = default;
+    Image(const Image&) = delete;
+
+    uint32_t& at(int32_t x, int32_t y) { return pixels[static_cast<size_t>(y) * buffer.stride + x]; }
+
+    std::vector<uint32_t> pixels;
+    SoftwareHistogram::Buffer buffer;
+};
+
+// Gray ramp, the luma of a pixel is its x (mod 256) with any weights
+Image rampImage(int32_t width, int32_t height) {
+    Image image(width, height, width);
+    for (int32_t y = 0; y < height; ++y) {
+        for (int32_t x = 0; x < width; ++x) {
+            image.at(x, y) = rgba(x % 256, x % 256, x % 256);
+        }
+    }
+    return image;
+}
+
+Counts countOf(const SoftwareHistogram& engine, const Image& image, const Config& config) {
+    Counts counts{};
+    EXPECT_EQ(0, engine.count(image.buffer, config, &counts));
+    return counts;
+}
+
+} // namespace
+
+TEST(SoftwareHistogramTest, UniformColorFillsOneBin) {
+    // 1080x2400 like a full resolution panel, threshold (2592000 >> 16) + 1
+    Image image(1080, 2400, 1088, rgba(200, 100, 50));
+    SoftwareHistogram engine;
+    SoftwareHistogram::Bins bins;
+    ASSERT_EQ(0, engine.compute(image.buffer, {}, &bins));
+
+    // (200 * 341 + 100 * 342 + 50 * 341 + 512) >> 10
+    constexpr size_t bin = 117;
+    EXPECT_EQ(40, SoftwareHistogram::calculateThreshold(1080, 2400));
+    EXPECT_EQ(1080 * 2400 / 40, bins[bin]);
+    for (size_t i = 0; i < bins.size(); ++i) {
+        if (i != bin) {
+            ASSERT_EQ(0, bins[i]) << i;
+        }
+    }
+}
+
+TEST(SoftwareHistogramTest, WeightsSelectTheComponents) {
+    Image image(16, 16, 16, rgba(255, 0, 128));
+    SoftwareHistogram engine;
+
+    EXPECT_EQ(256u, countOf(engine, image, {.weightR = 1024, .weightG = 0, .weightB = 0})[255]);
+    EXPECT_EQ(256u, countOf(engine, image, {.weightR = 0, .weightG = 1024, .weightB = 0})[0]);
+    EXPECT_EQ(256u, countOf(engine, image, {.weightR = 0, .weightG = 0, .weightB = 1024})[128]);
+    // rounds to the nearest: (255 * 512 + 128 * 512 + 512) >> 10 = 192
+    EXPECT_EQ(256u, countOf(engine, image, {.weightR = 512, .weightG = 0, .weightB = 512})[192]);
+}
+
+TEST(SoftwareHistogramTest, RoiAndBlockingRoi) {
+    Image image = rampImage(300, 40);
+    SoftwareHistogram engine;
+
+    Config config;
+    config.roi = {10, 5, 110, 25};
+    Counts counts = countOf(engine, image, config);
+    for (size_t bin = 0; bin < counts.size(); ++bin) {
+        ASSERT_EQ(bin >= 10 && bin < 110 ? 20u : 0u, counts[bin]) << bin;
+    }
+
+    // the blocking roi reaches out of the roi to the left
+    config.blockingRoi = {0, 10, 50, 30};
+    counts = countOf(engine, image, config);
+    for (size_t bin = 0; bin < counts.size(); ++bin) {
+        const uint32_t expected = bin < 10 || bin >= 110 ? 0 : bin < 50 ? 5 : 20;
+        ASSERT_EQ(expected, counts[bin]) << bin;
+    }
+
+    // a blocking roi in the middle of the rows of the entire buffer
+    config.roi = {};
+    config.blockingRoi = {100, 0, 200, 40};
+    counts = countOf(engine, image, config);
+    // x and x + 256 share a bin for x < 44
+    EXPECT_EQ(80u, counts[43]);
+    EXPECT_EQ(40u, counts[44]);
+    EXPECT_EQ(40u, counts[99]);
+    EXPECT_EQ(0u, counts[100]);
+    EXPECT_EQ(0u, counts[199]);
+    EXPECT_EQ(40u, counts[200]);
+}
+
+TEST(SoftwareHistogramTest, PostProcLutAppliesAtPostPostProcOnly) {
+    Image image(8, 8, 8, rgba(10, 10, 10));
+    SoftwareHistogram::PostProcLut lut;
+    for (auto& component : lut) {
+        for (size_t i = 0; i < component.size(); ++i) {
+            component[i] = static_cast<uint8_t>(255 - i);
+        }
+    }
+    SoftwareHistogram engine;
+    engine.setPostProcLut(&lut);
+
+    Config config;
+    EXPECT_EQ(64u, countOf(engine, image, config)[245]);
+    config.samplePos = SoftwareHistogram::SamplePos::PRE_POSTPROC;
+    EXPECT_EQ(64u, countOf(engine, image, config)[10]);
+}
+
+TEST(SoftwareHistogramTest, InvalidConfigs) {
+    Image image(64, 32, 64);
+    SoftwareHistogram engine;
+    SoftwareHistogram::Bins bins;
+
+    EXPECT_EQ(-EINVAL, engine.compute(image.buffer, {.weightR = 342}, &bins));
+    EXPECT_EQ(-EINVAL,
+              engine.compute(image.buffer, {.weightR = 2048, .weightG = 0, .weightB = 0xfffffc00},
+                             &bins));
+    EXPECT_EQ(-EINVAL, engine.compute(image.buffer, {.roi = {0, 0, 65, 32}}, &bins));
+    EXPECT_EQ(-EINVAL, engine.compute(image.buffer, {.roi = {10, 0, 10, 32}}, &bins));
+    EXPECT_EQ(-EINVAL, engine.compute(image.buffer, {.blockingRoi = {-1, 0, 4, 4}}, &bins));
+    EXPECT_EQ(0, engine.compute(image.buffer, {.roi = {0, 0, 64, 32}}, &bins));
+
+    SoftwareHistogram::Buffer narrow = image.buffer;
+    narrow.stride = 32;
+    EXPECT_EQ(-EINVAL, engine.compute(narrow, {}, &bins));
+}
+
+// The SIMD path must give the same bins as the scalar reference for any
+// roi, blocking roi, weights and row padding.
+TEST(SoftwareHistogramTest, SimdMatchesScalar) {
+    std::mt19937 rng(1234);
+    SoftwareHistogram scalar(SoftwareHistogram::Impl::SCALAR);
+    SoftwareHistogram simd(SoftwareHistogram::Impl::SIMD);
+    auto uniform = [&rng](int32_t lo, int32_t hi) {
+        return std::uniform_int_distribution<int32_t>(lo, hi)(rng);
+    };
+    auto randomRect = [&](int32_t width, int32_t height) {
+        const int32_t left = uniform(0, width - 1);
+        const int32_t top = uniform(0, height - 1);
+        return Rect{left, top, uniform(left + 1, width), uniform(top + 1, height)};
+    };
+
+    for (int iteration = 0; iteration < 200; ++iteration) {
+        const int32_t width = uniform(1, 97);
+        const int32_t height = uniform(1, 33);
+        Image image(width, height, width + uniform(0, 7));
+        for (uint32_t& pixel : image.pixels) {
+            pixel = rng();
+        }
+
+        Config config;
+        config.weightR = uniform(0, 1024);
+        config.weightG = uniform(0, 1024 - config.weightR);
+        config.weightB = 1024 - config.weightR - config.weightG;
+        if (uniform(0, 1)) {
+            config.roi = randomRect(width, height);
+        }
+        if (uniform(0, 1)) {
+            config.blockingRoi = randomRect(width, height);
+        }
+
+        SoftwareHistogram::Bins expected;
+        SoftwareHistogram::Bins actual;
+        ASSERT_EQ(0, scalar.compute(image.buffer, config, &expected));
+        ASSERT_EQ(0, simd.compute(image.buffer, config, &actual));
+        ASSERT_EQ(expected, actual) << "iteration " << iteration;
+        ASSERT_EQ(countOf(scalar, image, config), countOf(simd, image, config));
+    }
+}
+
+// Engine output fed through a fake drm event source reaches the histogram
+// client unchanged.
+TEST(SoftwareHistogramTest, FeedsTheQueryPipeline) {
+    Image image = rampImage(256, 64);
+    SoftwareHistogram engine;
+    SoftwareHistogram::Bins bins;
+    ASSERT_EQ(0, engine.compute(image.buffer, {.roi = {0, 0, 128, 64}}, &bins));
+
+    // the drm event thread answering the request
+    std::thread eventThread;
+    HistogramQueryPipeline* pipelinePtr = nullptr;
+    HistogramQueryPipeline pipeline(
+            1, SoftwareHistogram::kBinCount,
+            [&](uint8_t channelId) -> int32_t {
+                std::vector<char16_t> event(bins.begin(), bins.end());
+                eventThread = std::thread([pipelinePtr, channelId, event] {
+                    pipelinePtr->onEvent(channelId, event.data());
+                });
+                return 0;
+            },
+            [](uint8_t) {});
+    pipelinePtr = &pipeline;
+
+    std::vector<char16_t> data;
+    const auto result = pipeline.query(0, std::chrono::milliseconds(500), &data);
+    eventThread.join();
+    ASSERT_EQ(HistogramQueryPipeline::Result::OK, result);
+    ASSERT_EQ(bins.size(), data.size());
+    for (size_t bin = 0; bin < bins.size(); ++bin) {
+        ASSERT_EQ(bin < 128 ? 64u : 0u, data[bin]) << bin;
+    }
+}
+
+TEST(SoftwareHistogramTest, Benchmark) {
+    Image image(1080, 2400, 1088);
+    std::mt19937 rng(42);
+    for (uint32_t& pixel : image.pixels) {
+        pixel = rng();
+    }
+    const Config config{.roi = {0, 0, 1080, 2000}, .blockingRoi = {200, 1600, 880, 1900}};
+
+    for (auto impl : {SoftwareHistogram::Impl::SCALAR, SoftwareHistogram::Impl::SIMD}) {
+        SoftwareHistogram engine(impl);
+        SoftwareHistogram::Bins bins;
+        constexpr int kRuns = 10;
+        const auto start = std::chrono::steady_clock::now();
+        for (int run = 0; run < kRuns; ++run) {
+            ASSERT_EQ(0, engine.compute(image.buffer, config, &bins));
+        }
+        const auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+                                std::chrono::steady_clock::now() - start)
+                                .count() /
+                kRuns;
+        ::testing::Test::RecordProperty(impl == SoftwareHistogram::Impl::SIMD ? "simd_us"
+                                                                               : "scalar_us",
+                                        std::to_string(us));
+    }
+}
@@ -0,0 +1,293 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <gtest/gtest.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../SysfsWatcher.h"
+
+namespace {
+
+using namespace std::chrono_literals;
+
+constexpr int64_t kTimeoutNs = std::chrono::nanoseconds(2s).count();
+constexpr const char* kLhbmNode = "/sys/class/backlight/panel0-backlight/local_hbm_mode";
+constexpr const char* kBrightnessNode = "/sys/class/backlight/panel0-backlight/brightness";
+
+// Sysfs nodes on eventfds: a write of a node stores its value and signals the
+// eventfd the way sysfs_notify() raises POLLPRI, a read drains it.
+class FakeSysfs {
+public:
+    ~FakeSysfs() {
+        for (auto& [path, node] : mNodes) {
+            close(node.fd);
+        }
+    }
+
+    void create(const std::string& path, const std::string& value) {
+        std::scoped_lock lock(mMutex);
+        Node& node = mNodes[path];
+        node.fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        node.value = value + "\n";
+    }
+
+    // Without notify, the value changes as if another reader acked the
+    // notification already
+    void write(const std::string& path, const std::string& value, bool notify = true) {
+        std::scoped_lock lock(mMutex);
+        Node& node = mNodes.at(path);
+        node.value = value + "\n";
+        if (notify) {
+            eventfd_write(node.fd, 1);
+        }
+    }
+
+    int reads() {
+        std::scoped_lock lock(mMutex);
+        return mReads;
+    }
+
+    SysfsWatcher::Ops ops() {
+        SysfsWatcher::Ops ops;
+        ops.open = [this](const std::string& path) -> int {
+            std::scoped_lock lock(mMutex);
+            auto it = mNodes.find(path);
+            if (it == mNodes.end()) {
+                return -ENOENT;
+            }
+            const int fd = dup(it->second.fd);
+            mPaths[fd] = path;
+            return fd;
+        };
+        ops.read = [this](int fd, std::string* value) -> int {
+            std::scoped_lock lock(mMutex);
+            Node& node = mNodes.at(mPaths.at(fd));
+            eventfd_t count;
+            eventfd_read(node.fd, &count);
+            mReads++;
+            *value = node.value;
+            return 0;
+        };
+        ops.events = EPOLLIN;
+        return ops;
+    }
+
+private:
+    struct Node {
+        int fd = -1;
+        std::string value;
+    };
+
+    std::mutex mMutex;
+    std::map<std::string, Node> mNodes;
+    // by the fd the watcher polls
+    std::map<int, std::string> mPaths;
+    int mReads = 0;
+};
+
+// Collects the completions of callback watches
+class Completions {
+public:
+    SysfsWatcher::Callback callback(int id) {
+        return [this, id](int status, const std::string& value) {
+            std::scoped_lock lock(mMutex);
+            mDone.push_back({id, status, value, std::this_thread::get_id()});
+            mCv.notify_all();
+        };
+    }
+
+    struct Done {
+        int id;
+        int status;
+        std::string value;
+        std::thread::id thread;
+    };
+
+    std::vector<Done> waitFor(size_t count) {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mCv.wait_for(lock, 5s, [this, count] { return mDone.size() >= count; });
+        return mDone;
+    }
+
+private:
+    std::mutex mMutex;
+    std::condition_variable mCv;
+    std::vector<Done> mDone;
+};
+
+} // namespace
+
+TEST(SysfsWatcherTest, CurrentValueCompletesOnTheCaller) {
+    FakeSysfs sysfs;
+    sysfs.create(kLhbmNode, "0");
+    SysfsWatcher watcher(sysfs.ops());
+    Completions completions;
+
+    watcher.watch(kLhbmNode, {"0"}, kTimeoutNs, completions.callback(1));
+    auto done = completions.waitFor(1);
+    ASSERT_EQ(1u, done.size());
+    EXPECT_EQ(0, done[0].status);
+    EXPECT_EQ("0", done[0].value);
+    EXPECT_EQ(std::this_thread::get_id(), done[0].thread);
+
+    // no intention to wait
+    EXPECT_EQ(-EINVAL, watcher.watch(kLhbmNode, {"2"}, 0).get());
+    EXPECT_EQ(-ENOENT, watcher.watch("/sys/nonexistent", {"1"}, kTimeoutNs).get());
+    EXPECT_EQ(-EINVAL, watcher.watch(kLhbmNode, {}, kTimeoutNs).get());
+}
+
+TEST(SysfsWatcherTest, NotificationCompletesMatchingWatches) {
+    FakeSysfs sysfs;
+    sysfs.create(kLhbmNode, "0");
+    SysfsWatcher watcher(sysfs.ops());
+    Completions completions;
+
+    // like enabling lhbm: ENABLING or ENABLED, then ENABLED
+    watcher.watch(kLhbmNode, {"1", "2"}, kTimeoutNs, completions.callback(1));
+    watcher.watch(kLhbmNode, {"2"}, kTimeoutNs, completions.callback(2));
+
+    sysfs.write(kLhbmNode, "1");
+    auto done = completions.waitFor(1);
+    ASSERT_EQ(1u, done.size());
+    EXPECT_EQ(1, done[0].id);
+    EXPECT_EQ(0, done[0].status);
+    EXPECT_EQ("1", done[0].value);
+    EXPECT_NE(std::this_thread::get_id(), done[0].thread);
+
+    sysfs.write(kLhbmNode, "2");
+    done = completions.waitFor(2);
+    ASSERT_EQ(2u, done.size());
+    EXPECT_EQ(2, done[1].id);
+    EXPECT_EQ("2", done[1].value);
+
+    // the node is opened once for every watch
+    EXPECT_EQ(1u, watcher.stats().opens);
+}
+
+TEST(SysfsWatcherTest, ReadCompletesOlderWatchesFirst) {
+    FakeSysfs sysfs;
+    sysfs.create(kBrightnessNode, "100");
+    SysfsWatcher watcher(sysfs.ops());
+    Completions completions;
+
+    // like two brightness requests waiting for the same drm path change
+    watcher.watch(kBrightnessNode, {"200"}, kTimeoutNs, completions.callback(1));
+    sysfs.write(kBrightnessNode, "200", false);
+    watcher.watch(kBrightnessNode, {"200"}, kTimeoutNs, completions.callback(2));
+
+    auto done = completions.waitFor(2);
+    ASSERT_EQ(2u, done.size());
+    EXPECT_EQ(1, done[0].id);
+    EXPECT_EQ(0, done[0].status);
+    EXPECT_EQ(2, done[1].id);
+    EXPECT_EQ(0, done[1].status);
+    EXPECT_EQ(0u, watcher.stats().timeouts);
+
+    // a plain read completes the pending watches too
+    watcher.watch(kBrightnessNode, {"300"}, kTimeoutNs, completions.callback(3));
+    sysfs.write(kBrightnessNode, "300", false);
+    std::string value;
+    ASSERT_EQ(0, watcher.read(kBrightnessNode, &value));
+    done = completions.waitFor(3);
+    ASSERT_EQ(3u, done.size());
+    EXPECT_EQ(3, done[2].id);
+    EXPECT_EQ(0, done[2].status);
+    EXPECT_EQ(std::this_thread::get_id(), done[2].thread);
+}
+
+TEST(SysfsWatcherTest, TimeoutReportsTheLastValue) {
+    FakeSysfs sysfs;
+    sysfs.create(kBrightnessNode, "100");
+    SysfsWatcher watcher(sysfs.ops());
+    Completions completions;
+
+    const auto start = std::chrono::steady_clock::now();
+    watcher.watch(kBrightnessNode, {"300"}, std::chrono::nanoseconds(30ms).count(),
+                  completions.callback(1));
+    sysfs.write(kBrightnessNode, "200");
+    auto done = completions.waitFor(1);
+    ASSERT_EQ(1u, done.size());
+    EXPECT_EQ(-ETIMEDOUT, done[0].status);
+    EXPECT_GE(std::chrono::steady_clock::now() - start, 30ms);
+    EXPECT_EQ(1u, watcher.stats().timeouts);
+
+    // the value changed in the meantime is seen by the next watch
+    EXPECT_EQ(0, watcher.watch(kBrightnessNode, {"200"}, 0).get());
+}
+
+TEST(SysfsWatcherTest, FutureOfABlockingCaller) {
+    FakeSysfs sysfs;
+    sysfs.create(kLhbmNode, "0");
+    SysfsWatcher watcher(sysfs.ops());
+
+    auto future = watcher.watch(kLhbmNode, {"2"}, kTimeoutNs);
+    EXPECT_EQ(std::future_status::timeout, future.wait_for(10ms));
+    std::thread writer([&sysfs] {
+        sysfs.write(kLhbmNode, "1");
+        sysfs.write(kLhbmNode, "2");
+    });
+    EXPECT_EQ(0, future.get());
+    writer.join();
+
+    std::string value;
+    ASSERT_EQ(0, watcher.read(kLhbmNode, &value));
+    EXPECT_EQ("2", value);
+}
+
+TEST(SysfsWatcherTest, CallbackCanWatchAgain) {
+    FakeSysfs sysfs;
+    sysfs.create(kLhbmNode, "0");
+    sysfs.create(kBrightnessNode, "100");
+    SysfsWatcher watcher(sysfs.ops());
+    Completions completions;
+
+    // lhbm first, then the brightness
+    watcher.watch(kLhbmNode, {"1"}, kTimeoutNs,
+                  [&](int status, const std::string&) {
+                      EXPECT_EQ(0, status);
+                      watcher.watch(kBrightnessNode, {"400"}, kTimeoutNs,
+                                    completions.callback(1));
+                  });
+    sysfs.write(kBrightnessNode, "400");
+    sysfs.write(kLhbmNode, "1");
+    auto done = completions.waitFor(1);
+    ASSERT_EQ(1u, done.size());
+    EXPECT_EQ(0, done[0].status);
+}
+
+TEST(SysfsWatcherTest, PendingWatchesAreCancelled) {
+    FakeSysfs sysfs;
+    sysfs.create(kLhbmNode, "0");
+    Completions completions;
+    {
+        SysfsWatcher watcher(sysfs.ops());
+        watcher.watch(kLhbmNode, {"1"}, kTimeoutNs, completions.callback(1));
+    }
+    auto done = completions.waitFor(1);
+    ASSERT_EQ(1u, done.size());
+    EXPECT_EQ(-ECANCELED, done[0].status);
+}
@@ -21,6 +21,7 @@
 #include <cutils/properties.h>
 #include <drm.h>
 #include <drm/drm_fourcc.h>
+#include <sync/sync.h>
 #include <sys/types.h>
 #include <xf86drm.h>
 
@@ -74,20 +75,55 @@ int writeIntToKernelFile(const char* path, const int value) {
     return 0;
 }
 
+FramebufferManager::RetiredFbQueue::~RetiredFbQueue() {
+    for (Node *node = popAll(); node != nullptr;) {
+        delete std::exchange(node, node->next);
+    }
+}
+
+void FramebufferManager::RetiredFbQueue::push(uint32_t fbId, uint64_t frameNumber) {
+    Node *node = new Node{fbId, frameNumber, mHead.load(std::memory_order_relaxed)};
+    while (!mHead.compare_exchange_weak(node->next, node, std::memory_order_release,
+                                        std::memory_order_relaxed))
+        ;
+}
+
+FramebufferManager::RetiredFbQueue::Node *FramebufferManager::RetiredFbQueue::popAll() {
+    Node *head = mHead.exchange(nullptr, std::memory_order_acquire);
+    // nodes are pushed in LIFO order, reverse them to keep retire order
+    Node *fifo = nullptr;
+    while (head != nullptr) {
+        Node *next = head->next;
+        head->next = fifo;
+        fifo = head;
+        head = next;
+    }
+    return fifo;
+}
+
 FramebufferManager::~FramebufferManager()
 {
     {
-        Mutex::Autolock lock(mMutex);
+        Mutex::Autolock lock(mRmFBMutex);
         mRmFBThreadRunning = false;
     }
     mFlipDone.signal();
     mRmFBThread.join();
+
+    Mutex::Autolock lock(mRmFBMutex);
+    if (mPresentFence >= 0) {
+        close(mPresentFence);
+        mPresentFence = -1;
+    }
 }
 
 void FramebufferManager::init(int drmFd)
 {
     mDrmFd = drmFd;
-    mRmFBThreadRunning = true;
+    {
+        Mutex::Autolock lock(mRmFBMutex);
+        mRmFBThreadRunning = true;
+    }
     mRmFBThread = std::thread(&FramebufferManager::removeFBsThreadRoutine, this);
     pthread_setname_np(mRmFBThread.native_handle(), "RemoveFBsThread");
 }
@@ -147,7 +183,7 @@ void FramebufferManager::cleanup(const ExynosLayer *layer) {
     Mutex::Autolock lock(mMutex);
     auto clean = [&](std::map<const ExynosLayer *, FBList> &layerBuffs) {
         if (auto it = layerBuffs.find(layer); it != layerBuffs.end()) {
-            mCleanBuffers.splice(mCleanBuffers.end(), std::move(it->second));
+            retireBuffers(it->second);
             layerBuffs.erase(it);
         }
     };
@@ -155,20 +191,77 @@ void FramebufferManager::cleanup(const ExynosLayer *layer) {
     clean(mCachedM2mSecureLayerBuffers);
 }
 
+void FramebufferManager::retireBuffers(FBList &buffers, FBList::iterator first) {
+    // Buffers retired now may still be scanned out by the last committed frame,
+    // they are safe to remove once the next frame is presented.
+    const uint64_t frameNumber = mFlipCount.load(std::memory_order_relaxed) + 1;
+    for (auto it = first; it != buffers.end(); ++it) {
+        mRetiredFbs.push((*it)->release(), frameNumber);
+    }
+    buffers.erase(first, buffers.end());
+}
+
+void FramebufferManager::removeRetiredBuffers(std::vector<uint32_t> &fbIds) {
+    if (fbIds.empty()) {
+        return;
+    }
+
+    ATRACE_NAME("cleanup framebuffers");
+    for (const auto fbId : fbIds) {
+        drmModeRmFB(mDrmFd, fbId);
+    }
+    fbIds.clear();
+}
+
 void FramebufferManager::removeFBsThreadRoutine()
 {
-    FBList cleanupBuffers;
-    while (true) {
+    // fbIds waiting for their frame to be presented, ordered by frame number
+    std::list<std::pair<uint64_t, uint32_t>> pendingFbs;
+    std::vector<uint32_t> removeFbs;
+    uint64_t retiredFrame = 0;
+    bool running = true;
+
+    while (running) {
+        int presentFence = -1;
+        uint64_t presentedFrame = 0;
         {
-            Mutex::Autolock lock(mMutex);
-            if (!mRmFBThreadRunning) {
-                break;
+            Mutex::Autolock lock(mRmFBMutex);
+            while (mRmFBThreadRunning && !mFlipPending) {
+                mFlipDone.wait(mRmFBMutex);
+            }
+            mFlipPending = false;
+            running = mRmFBThreadRunning;
+            presentFence = std::exchange(mPresentFence, -1);
+            presentedFrame = mPresentedFrame;
+        }
+
+        // The fence of the latest frame is enough, an earlier frame is always
+        // presented before a later one.
+        if (presentFence >= 0) {
+            ATRACE_NAME("wait for present fence");
+            if (sync_wait(presentFence, PRESENT_FENCE_TIMEOUT_MS) < 0) {
+                ALOGW("FBManager: present fence of frame %" PRIu64 " not signaled in %d ms",
+                      presentedFrame, PRESENT_FENCE_TIMEOUT_MS);
+            }
+            close(presentFence);
+        }
+        retiredFrame = std::max(retiredFrame, presentedFrame);
+
+        for (auto *node = mRetiredFbs.popAll(); node != nullptr;) {
+            pendingFbs.emplace_back(node->frameNumber, node->fbId);
+            delete std::exchange(node, node->next);
+        }
+
+        const bool retireAll = !running || mRetireAllPending.exchange(false);
+        for (auto it = pendingFbs.begin(); it != pendingFbs.end();) {
+            if (!retireAll && it->first > retiredFrame) {
+                ++it;
+                continue;
             }
-            mFlipDone.wait(mMutex);
-            cleanupBuffers.splice(cleanupBuffers.end(), mCleanBuffers);
+            removeFbs.push_back(it->second);
+            it = pendingFbs.erase(it);
         }
-        ATRACE_NAME("cleanup framebuffers");
-        cleanupBuffers.clear();
+        removeRetiredBuffers(removeFbs);
     }
 }
 
@@ -307,7 +400,7 @@ int32_t FramebufferManager::getBuffer(const exynos_win_config_data &config, uint
         if (cachedBuffers.size() > maxCachedBufferSize) {
             ALOGW("FBManager: cached buffers size %zu exceeds limitation(%zu) while adding fbId %d",
                   cachedBuffers.size(), maxCachedBufferSize, fbId);
-            mCleanBuffers.splice(mCleanBuffers.end(), cachedBuffers);
+            retireBuffers(cachedBuffers);
         }
 
         if (config.state == config.WIN_STATE_COLOR) {
@@ -329,8 +422,8 @@ int32_t FramebufferManager::getBuffer(const exynos_win_config_data &config, uint
     return 0;
 }
 
-void FramebufferManager::flip(const bool hasSecureFrameBuffer, const bool hasM2mSecureLayerBuffer) {
-    bool needCleanup = false;
+void FramebufferManager::flip(const bool hasSecureFrameBuffer, const bool hasM2mSecureLayerBuffer,
+                              int presentFence) {
     {
         Mutex::Autolock lock(mMutex);
         destroyUnusedLayersLocked();
@@ -341,20 +434,34 @@ void FramebufferManager::flip(const bool hasSecureFrameBuffer, const bool hasM2m
         if (!hasM2mSecureLayerBuffer) {
             destroyM2mSecureLayerBufferLocked();
         }
-        needCleanup = mCleanBuffers.size() > 0;
     }
 
-    if (needCleanup) {
-        mFlipDone.signal();
+    const uint64_t frameNumber = mFlipCount.fetch_add(1, std::memory_order_relaxed) + 1;
+    {
+        Mutex::Autolock lock(mRmFBMutex);
+        if (mPresentFence >= 0) {
+            close(mPresentFence);
+        }
+        mPresentFence = presentFence;
+        mPresentedFrame = frameNumber;
+        mFlipPending = true;
     }
+    mFlipDone.signal();
 }
 
 void FramebufferManager::releaseAll()
 {
-    Mutex::Autolock lock(mMutex);
-    mCachedLayerBuffers.clear();
-    mCachedM2mSecureLayerBuffers.clear();
-    mCleanBuffers.clear();
+    {
+        Mutex::Autolock lock(mMutex);
+        mCachedLayerBuffers.clear();
+        mCachedM2mSecureLayerBuffers.clear();
+    }
+    mRetireAllPending = true;
+    {
+        Mutex::Autolock lock(mRmFBMutex);
+        mFlipPending = true;
+    }
+    mFlipDone.signal();
 }
 
 void FramebufferManager::freeBufHandle(uint32_t handle) {
@@ -393,7 +500,7 @@ void FramebufferManager::destroyUnusedLayersLocked() {
 
         for (auto layer = cachedLayerBuffers.begin(); layer != cachedLayerBuffers.end();) {
             if (cachedLayersInuse.find(layer->first) == cachedLayersInuse.end()) {
-                mCleanBuffers.splice(mCleanBuffers.end(), std::move(layer->second));
+                retireBuffers(layer->second);
                 layer = cachedLayerBuffers.erase(layer);
             } else {
                 ++layer;
@@ -432,7 +539,7 @@ void FramebufferManager::destroySecureFramebufferLocked() {
                 if (buffer->bufferDesc.isSecure) {
                     // Assume the latest non-secure buffer in the front
                     // TODO: have a better way to keep in-used buffers
-                    mCleanBuffers.splice(mCleanBuffers.end(), bufferList, it, bufferList.end());
+                    retireBuffers(bufferList, it);
                     return;
                 }
             }
@@ -448,11 +555,7 @@ void FramebufferManager::destroyM2mSecureLayerBufferLocked() {
     mHasM2mSecureLayerBuffer = false;
 
     for (auto &layer : mCachedM2mSecureLayerBuffers) {
-        auto &bufferList = layer.second;
-        if (bufferList.size()) {
-            mCleanBuffers.splice(mCleanBuffers.end(), bufferList, bufferList.begin(),
-                                 bufferList.end());
-        }
+        retireBuffers(layer.second);
     }
 }
 
@@ -499,15 +602,19 @@ ExynosDisplayDrmInterface::ExynosDisplayDrmInterface(ExynosDisplay *exynosDispla
 ExynosDisplayDrmInterface::~ExynosDisplayDrmInterface()
 {
     if (mActiveModeState.blob_id)
-        mDrmDevice->DestroyPropertyBlob(mActiveModeState.blob_id);
+        mDrmDevice->ReleasePropertyBlob(mActiveModeState.blob_id);
     if (mActiveModeState.old_blob_id)
-        mDrmDevice->DestroyPropertyBlob(mActiveModeState.old_blob_id);
+        mDrmDevice->ReleasePropertyBlob(mActiveModeState.old_blob_id);
     if (mDesiredModeState.blob_id)
-        mDrmDevice->DestroyPropertyBlob(mDesiredModeState.blob_id);
+        mDrmDevice->ReleasePropertyBlob(mDesiredModeState.blob_id);
     if (mDesiredModeState.old_blob_id)
-        mDrmDevice->DestroyPropertyBlob(mDesiredModeState.old_blob_id);
+        mDrmDevice->ReleasePropertyBlob(mDesiredModeState.old_blob_id);
     if (mPartialRegionState.blob_id)
-        mDrmDevice->DestroyPropertyBlob(mPartialRegionState.blob_id);
+        mDrmDevice->ReleasePropertyBlob(mPartialRegionState.blob_id);
+    if (mBlockState.mBlobId)
+        mDrmDevice->ReleasePropertyBlob(mBlockState.mBlobId);
+    for (const auto &[channelId, blobId] : mHistogramChannelBlobs)
+        mDrmDevice->ReleasePropertyBlob(blobId);
 }
 
 void ExynosDisplayDrmInterface::init(ExynosDisplay *exynosDisplay)
@@ -771,9 +878,11 @@ int32_t ExynosDisplayDrmInterface::initDrmDevice(DrmDevice *drmDevice)
 
     getLowPowerDrmModeModeInfo();
 
-    mDrmVSyncWorker.Init(mDrmDevice, drmDisplayId, mDisplayTraceName);
+    mDrmVSyncWorker.Init(mDrmDevice, drmDisplayId, mDisplayTraceName,
+                         property_get_bool("vendor.display.vsync_vblank_events", false));
     mDrmVSyncWorker.RegisterCallback(std::shared_ptr<VsyncCallback>(this));
 
+    initPlaneDescriptors();
     if (!mDrmDevice->planes().empty()) {
         auto &plane = mDrmDevice->planes().front();
         parseBlendEnums(plane->blend_property());
@@ -809,57 +918,81 @@ int32_t ExynosDisplayDrmInterface::initDrmDevice(DrmDevice *drmDevice)
 }
 
 
-void ExynosDisplayDrmInterface::Callback(
-        int display, int64_t timestamp)
+// Returns whether the vsync goes on to SurfaceFlinger
+bool ExynosDisplayDrmInterface::handleVsyncLocked(int display, int64_t timestamp)
 {
-    {
-        Mutex::Autolock lock(mExynosDisplay->getDisplayMutex());
-        bool configApplied = mVsyncCallback.Callback(display, timestamp);
-
-        if (configApplied) {
-            if (mVsyncCallback.getDesiredVsyncPeriod()) {
-                mExynosDisplay->resetConfigRequestStateLocked(mActiveModeState.mode.id());
-                mDrmConnector->set_active_mode(mActiveModeState.mode);
-                mVsyncCallback.resetDesiredVsyncPeriod();
-            }
+    bool configApplied = mVsyncCallback.Callback(display, timestamp);
 
-            /*
-             * Disable vsync if vsync config change is done
-             */
-            if (!mVsyncCallback.getVSyncEnabled()) {
-                mDrmVSyncWorker.VSyncControl(false);
-                mVsyncCallback.resetVsyncTimeStamp();
-            }
-        } else {
-            mExynosDisplay->updateConfigRequestAppliedTime();
+    if (configApplied) {
+        if (mVsyncCallback.getDesiredVsyncPeriod()) {
+            mExynosDisplay->resetConfigRequestStateLocked(mActiveModeState.mode.id());
+            mDrmConnector->set_active_mode(mActiveModeState.mode);
+            mVsyncCallback.resetDesiredVsyncPeriod();
         }
 
-        if (!mExynosDisplay->mPlugState || !mVsyncCallback.getVSyncEnabled()) {
-            return;
+        /*
+         * Disable vsync if vsync config change is done
+         */
+        if (!mVsyncCallback.getVSyncEnabled()) {
+            mDrmVSyncWorker.VSyncControl(false);
+            mVsyncCallback.resetVsyncTimeStamp();
         }
+    } else {
+        mExynosDisplay->updateConfigRequestAppliedTime();
+    }
 
-        // Refresh rate during enabling LHBM might be different from the one SF expects.
-        // HWC just reports the SF expected Vsync to make UI smoothness consistent even if
-        // HWC runs at different refresh rate temporarily.
-        if (!mExynosDisplay->isConfigSettingEnabled()) {
-            int64_t pendingPeriodNs =
-                    mExynosDisplay->getVsyncPeriod(mExynosDisplay->mPendingConfig);
-            int64_t activePeriodNs = mExynosDisplay->getVsyncPeriod(mExynosDisplay->mActiveConfig);
-            if (pendingPeriodNs && mExynosDisplay->mLastVsyncTimestamp) {
-                if (activePeriodNs > pendingPeriodNs) {
-                    DISPLAY_DRM_LOGW("wrong vsync period: %" PRId64 "us (active), %" PRId64
-                                     "us (pending)",
-                                     activePeriodNs / 1000, pendingPeriodNs / 1000);
-                } else if (activePeriodNs != pendingPeriodNs) {
-                    int64_t deltaNs = timestamp - mExynosDisplay->mLastVsyncTimestamp;
-                    if (deltaNs < (pendingPeriodNs - ms2ns(2))) {
-                        DISPLAY_DRM_LOGI("skip mismatching Vsync callback, delta=%" PRId64 "us",
-                                         deltaNs / 1000);
-                        return;
-                    }
+    if (!mExynosDisplay->mPlugState || !mVsyncCallback.getVSyncEnabled()) {
+        return false;
+    }
+
+    // Refresh rate during enabling LHBM might be different from the one SF expects.
+    // HWC just reports the SF expected Vsync to make UI smoothness consistent even if
+    // HWC runs at different refresh rate temporarily.
+    if (!mExynosDisplay->isConfigSettingEnabled()) {
+        int64_t pendingPeriodNs =
+                mExynosDisplay->getVsyncPeriod(mExynosDisplay->mPendingConfig);
+        int64_t activePeriodNs = mExynosDisplay->getVsyncPeriod(mExynosDisplay->mActiveConfig);
+        if (pendingPeriodNs && mExynosDisplay->mLastVsyncTimestamp) {
+            if (activePeriodNs > pendingPeriodNs) {
+                DISPLAY_DRM_LOGW("wrong vsync period: %" PRId64 "us (active), %" PRId64
+                                 "us (pending)",
+                                 activePeriodNs / 1000, pendingPeriodNs / 1000);
+            } else if (activePeriodNs != pendingPeriodNs) {
+                int64_t deltaNs = timestamp - mExynosDisplay->mLastVsyncTimestamp;
+                if (deltaNs < (pendingPeriodNs - ms2ns(2))) {
+                    DISPLAY_DRM_LOGI("skip mismatching Vsync callback, delta=%" PRId64 "us",
+                                     deltaNs / 1000);
+                    return false;
                 }
             }
         }
+    }
+    mExynosDisplay->mLastVsyncTimestamp = timestamp;
+    return true;
+}
+
+/*
+ * With vblank events this runs on the DrmEventListener thread, which serves
+ * every display, while the display lock is held through whole validate and
+ * present calls. So the lock is never waited for: when the display is busy
+ * the config bookkeeping is left to the next vsync, which sees the applied
+ * config again since mDesiredVsyncPeriod stays set until then.
+ */
+void ExynosDisplayDrmInterface::Callback(
+        int display, int64_t timestamp)
+{
+    Mutex &displayMutex = mExynosDisplay->getDisplayMutex();
+    if (displayMutex.tryLock() == NO_ERROR) {
+        bool deliver = handleVsyncLocked(display, timestamp);
+        displayMutex.unlock();
+        if (!deliver) return;
+    } else {
+        mVsyncCallback.Callback(display, timestamp);
+        // The mismatching vsync check below needs the configs
+        if (!mExynosDisplay->mPlugState || !mVsyncCallback.getVSyncEnabled() ||
+            !mExynosDisplay->isConfigSettingEnabled()) {
+            return;
+        }
         mExynosDisplay->mLastVsyncTimestamp = timestamp;
     }
 
@@ -1132,6 +1265,59 @@ no_mode_changes:
     return 0;
 }
 
+void ExynosDisplayDrmInterface::CommitStageStats::endFrame() {
+    accumulate(CommitStage::TOTAL, mFrameStart);
+    for (size_t i = 0; i < kStageCount; i++) {
+        if (mFrameStages[i]) {
+            mHistograms[i].insert(mFrameDurations[i]);
+        }
+    }
+}
+
+void ExynosDisplayDrmInterface::CommitStageStats::reset() {
+    for (auto &histogram : mHistograms) {
+        histogram.reset();
+    }
+}
+
+void ExynosDisplayDrmInterface::CommitStageStats::dump(String8 &result) const {
+    result.appendFormat("Commit latency:\n");
+    for (size_t i = 0; i < kStageCount; i++) {
+        mHistograms[i].dump(result, kStageNames[i]);
+    }
+}
+
+void ExynosDisplayDrmInterface::CommitStageStats::getStats(std::vector<int64_t> &outStats) const {
+    outStats.clear();
+    for (const auto &histogram : mHistograms) {
+        outStats.push_back(static_cast<int64_t>(histogram.count()));
+        outStats.push_back(histogram.percentileUs(50));
+        outStats.push_back(histogram.percentileUs(99));
+        outStats.push_back(histogram.maxUs());
+    }
+}
+
+int32_t ExynosDisplayDrmInterface::getCommitLatencyStats(bool reset,
+                                                         std::vector<int64_t> *outStats) {
+    if (outStats) {
+        mCommitStageStats.getStats(*outStats);
+    }
+    if (reset) {
+        mCommitStageStats.reset();
+    }
+    return NO_ERROR;
+}
+
+void ExynosDisplayDrmInterface::dump(String8 &result) {
+    mCommitStageStats.dump(result);
+
+    if (mDrmDevice == nullptr) return;
+
+    std::string blobCacheInfo;
+    mDrmDevice->blob_cache().Dump(&blobCacheInfo);
+    result.append(blobCacheInfo.c_str());
+}
+
 void ExynosDisplayDrmInterface::dumpDisplayConfigs()
 {
     std::lock_guard<std::recursive_mutex> lock(mDrmConnector->modesLock());
@@ -1345,7 +1531,7 @@ int32_t ExynosDisplayDrmInterface::setActiveConfigWithConstraints(
         }
 
         if (modeBlob) {
-            mDrmDevice->DestroyPropertyBlob(modeBlob);
+            mDrmDevice->ReleasePropertyBlob(modeBlob);
         }
     }
     return HWC2_ERROR_NONE;
@@ -1434,7 +1620,7 @@ int32_t ExynosDisplayDrmInterface::createModeBlob(const DrmMode &mode,
     mode.ToDrmModeModeInfo(&drm_mode);
 
     modeBlob = 0;
-    int ret = mDrmDevice->CreatePropertyBlob(&drm_mode, sizeof(drm_mode),
+    int ret = mDrmDevice->AcquirePropertyBlob(&drm_mode, sizeof(drm_mode),
             &modeBlob);
     if (ret) {
         HWC_LOGE(mExynosDisplay, "Failed to create mode property blob %d", ret);
@@ -1586,60 +1772,124 @@ int ExynosDisplayDrmInterface::getDeconChannel(ExynosMPP *otfMPP)
     return -EINVAL;
 }
 
+void ExynosDisplayDrmInterface::initPlaneDescriptors()
+{
+    mPlaneDescriptors.clear();
+    mPlaneDescriptors.reserve(mDrmDevice->planes().size());
+
+    for (const auto &plane : mDrmDevice->planes()) {
+        /* Same order as PlaneProp */
+        const std::array<const DrmProperty *, PLANE_PROP_COUNT> properties = {
+                &plane->crtc_property(),
+                &plane->fb_property(),
+                &plane->crtc_x_property(),
+                &plane->crtc_y_property(),
+                &plane->crtc_w_property(),
+                &plane->crtc_h_property(),
+                &plane->src_x_property(),
+                &plane->src_y_property(),
+                &plane->src_w_property(),
+                &plane->src_h_property(),
+                &plane->rotation_property(),
+                &plane->blend_property(),
+                &plane->zpos_property(),
+                &plane->alpha_property(),
+                &plane->in_fence_fd_property(),
+                &plane->colormap_property(),
+                &plane->standard_property(),
+                &plane->transfer_property(),
+                &plane->range_property(),
+                &plane->min_luminance_property(),
+                &plane->max_luminance_property(),
+                &plane->block_property(),
+        };
+
+        PlaneDescriptor desc;
+        desc.planeId = plane->id();
+        desc.properties = properties;
+        for (size_t i = 0; i < PLANE_PROP_COUNT; i++) {
+            desc.props[i] = properties[i]->descriptor();
+            if (desc.props[i].id)
+                desc.supportedMask |= 1u << i;
+        }
+
+        desc.zposMutable = plane->zpos_property().id() && !plane->zpos_property().isImmutable();
+        // Ignore ret and use min_zpos as 0 by default
+        std::tie(std::ignore, desc.minZpos) = plane->zpos_property().rangeMin();
+        std::tie(std::ignore, desc.minAlpha) = plane->alpha_property().rangeMin();
+        std::tie(std::ignore, desc.maxAlpha) = plane->alpha_property().rangeMax();
+
+        mPlaneDescriptors.push_back(desc);
+    }
+}
+
+int32_t ExynosDisplayDrmInterface::addPlaneProperties(DrmModeAtomicReq &drmReq,
+                                                      const PlaneDescriptor &desc,
+                                                      const PlaneConfig &planeConfig)
+{
+    const uint32_t missing = planeConfig.mask & MANDATORY_PLANE_PROPS & ~desc.supportedMask;
+    if (missing) {
+        const DrmProperty *property = desc.properties[__builtin_ctz(missing)];
+        HWC_LOGE(mExynosDisplay, "%s:: %s property for plane(%d) is not available", __func__,
+                 property->name().c_str(), desc.planeId);
+        return -EINVAL;
+    }
+
+    for (uint32_t mask = planeConfig.mask & desc.supportedMask; mask; mask &= mask - 1) {
+        const size_t i = __builtin_ctz(mask);
+        const DrmPropertyDescriptor &prop = desc.props[i];
+        const uint64_t value = planeConfig.values[i];
+
+        if (!prop.validate(value)) {
+            /* Only to log why the value is rejected, it is skipped as before */
+            desc.properties[i]->validateChange(value);
+            continue;
+        }
+
+        int ret = drmModeAtomicAddProperty(drmReq.pset(), desc.planeId, prop.id, value);
+        if (ret < 0) {
+            HWC_LOGE(mExynosDisplay, "%s:: Failed to add property %d(%s) for plane(%d), ret(%d)",
+                     __func__, prop.id, desc.properties[i]->name().c_str(), desc.planeId, ret);
+            return ret;
+        }
+    }
+
+    return NO_ERROR;
+}
+
 int32_t ExynosDisplayDrmInterface::setupCommitFromDisplayConfig(
         ExynosDisplayDrmInterface::DrmModeAtomicReq &drmReq,
         const exynos_win_config_data &config,
         const uint32_t configIndex,
-        const std::unique_ptr<DrmPlane> &plane,
+        const PlaneDescriptor &planeDesc,
         uint32_t &fbId)
 {
     ATRACE_CALL();
     int ret = NO_ERROR;
 
     if (fbId == 0) {
-        if ((ret = mFBManager.getBuffer(config, fbId)) < 0) {
+        const nsecs_t getFbStart = systemTime(SYSTEM_TIME_MONOTONIC);
+        ret = mFBManager.getBuffer(config, fbId);
+        mCommitStageStats.accumulate(CommitStage::GET_FB, getFbStart);
+        if (ret < 0) {
             HWC_LOGE(mExynosDisplay, "%s:: Failed to get FB, fbId(%d), ret(%d)", __func__, fbId,
                      ret);
             return ret;
         }
     }
 
-    if ((ret = drmReq.atomicAddProperty(plane->id(),
-                plane->crtc_property(), mDrmCrtc->id())) < 0)
-        return ret;
-    if ((ret = drmReq.atomicAddProperty(plane->id(),
-                    plane->fb_property(), fbId)) < 0)
-        return ret;
-    if ((ret = drmReq.atomicAddProperty(plane->id(),
-                    plane->crtc_x_property(), config.dst.x)) < 0)
-        return ret;
-    if ((ret = drmReq.atomicAddProperty(plane->id(),
-                    plane->crtc_y_property(), config.dst.y)) < 0)
-        return ret;
-    if ((ret = drmReq.atomicAddProperty(plane->id(),
-                    plane->crtc_w_property(), config.dst.w)) < 0)
-        return ret;
-    if ((ret = drmReq.atomicAddProperty(plane->id(),
-                    plane->crtc_h_property(), config.dst.h)) < 0)
-        return ret;
-    if ((ret = drmReq.atomicAddProperty(plane->id(),
-                    plane->src_x_property(), (int)(config.src.x) << 16)) < 0)
-        return ret;
-    if ((ret = drmReq.atomicAddProperty(plane->id(),
-                    plane->src_y_property(), (int)(config.src.y) << 16)) < 0)
-        HWC_LOGE(mExynosDisplay, "%s:: Failed to add src_y property to plane",
-                __func__);
-    if ((ret = drmReq.atomicAddProperty(plane->id(),
-                    plane->src_w_property(), (int)(config.src.w) << 16)) < 0)
-        return ret;
-    if ((ret = drmReq.atomicAddProperty(plane->id(),
-                    plane->src_h_property(), (int)(config.src.h) << 16)) < 0)
-        return ret;
-
-    if ((ret = drmReq.atomicAddProperty(plane->id(),
-            plane->rotation_property(),
-            halTransformToDrmRot(config.transform), true)) < 0)
-        return ret;
+    PlaneConfig planeConfig;
+    planeConfig.set(PlaneProp::CRTC_ID, mDrmCrtc->id());
+    planeConfig.set(PlaneProp::FB_ID, fbId);
+    planeConfig.set(PlaneProp::CRTC_X, config.dst.x);
+    planeConfig.set(PlaneProp::CRTC_Y, config.dst.y);
+    planeConfig.set(PlaneProp::CRTC_W, config.dst.w);
+    planeConfig.set(PlaneProp::CRTC_H, config.dst.h);
+    planeConfig.set(PlaneProp::SRC_X, (int)(config.src.x) << 16);
+    planeConfig.set(PlaneProp::SRC_Y, (int)(config.src.y) << 16);
+    planeConfig.set(PlaneProp::SRC_W, (int)(config.src.w) << 16);
+    planeConfig.set(PlaneProp::SRC_H, (int)(config.src.h) << 16);
+    planeConfig.set(PlaneProp::ROTATION, halTransformToDrmRot(config.transform));
 
     uint64_t drmEnum = 0;
     std::tie(drmEnum, ret) = DrmEnumParser::halToDrmEnum(config.blending, mBlendEnums);
@@ -1647,47 +1897,24 @@ int32_t ExynosDisplayDrmInterface::setupCommitFromDisplayConfig(
         HWC_LOGE(mExynosDisplay, "Fail to convert blend(%d)", config.blending);
         return ret;
     }
-    if ((ret = drmReq.atomicAddProperty(plane->id(),
-                    plane->blend_property(), drmEnum, true)) < 0)
-        return ret;
+    planeConfig.set(PlaneProp::BLEND, drmEnum);
 
-    if (plane->zpos_property().id() && !plane->zpos_property().isImmutable()) {
-        uint64_t min_zpos = 0;
+    if (planeDesc.zposMutable)
+        planeConfig.set(PlaneProp::ZPOS, configIndex + planeDesc.minZpos);
 
-        // Ignore ret and use min_zpos as 0 by default
-        std::tie(std::ignore, min_zpos) = plane->zpos_property().rangeMin();
+    planeConfig.set(PlaneProp::ALPHA,
+                    (uint64_t)(((planeDesc.maxAlpha - planeDesc.minAlpha) * config.plane_alpha) +
+                               0.5) +
+                            planeDesc.minAlpha);
 
-        if ((ret = drmReq.atomicAddProperty(plane->id(),
-                plane->zpos_property(), configIndex + min_zpos)) < 0)
-            return ret;
-    }
+    if (config.acq_fence >= 0)
+        planeConfig.set(PlaneProp::IN_FENCE_FD, config.acq_fence);
 
-    if (plane->alpha_property().id()) {
-        uint64_t min_alpha = 0;
-        uint64_t max_alpha = 0;
-        std::tie(std::ignore, min_alpha) = plane->alpha_property().rangeMin();
-        std::tie(std::ignore, max_alpha) = plane->alpha_property().rangeMax();
-        if ((ret = drmReq.atomicAddProperty(plane->id(),
-                plane->alpha_property(),
-                (uint64_t)(((max_alpha - min_alpha) * config.plane_alpha) + 0.5) + min_alpha, true)) < 0)
-            return ret;
-    }
-
-    if (config.acq_fence >= 0) {
-        if ((ret = drmReq.atomicAddProperty(plane->id(),
-                        plane->in_fence_fd_property(), config.acq_fence)) < 0)
-            return ret;
-    }
-
-    if (config.state == config.WIN_STATE_COLOR)
-    {
-        if (plane->colormap_property().id()) {
-            if ((ret = drmReq.atomicAddProperty(plane->id(),
-                            plane->colormap_property(), config.color)) < 0)
-                return ret;
-        } else {
+    if (config.state == config.WIN_STATE_COLOR) {
+        if (planeDesc.props[toUnderlying(PlaneProp::COLORMAP)].id)
+            planeConfig.set(PlaneProp::COLORMAP, config.color);
+        else
             HWC_LOGE(mExynosDisplay, "colormap property is not supported");
-        }
     }
 
     std::tie(drmEnum, ret) = DrmEnumParser::halToDrmEnum(
@@ -1697,10 +1924,7 @@ int32_t ExynosDisplayDrmInterface::setupCommitFromDisplayConfig(
                 config.dataspace & HAL_DATASPACE_STANDARD_MASK);
         return ret;
     }
-    if ((ret = drmReq.atomicAddProperty(plane->id(),
-                    plane->standard_property(),
-                    drmEnum, true)) < 0)
-        return ret;
+    planeConfig.set(PlaneProp::STANDARD, drmEnum);
 
     std::tie(drmEnum, ret) = DrmEnumParser::halToDrmEnum(
                     config.dataspace & HAL_DATASPACE_TRANSFER_MASK, mTransferEnums);
@@ -1709,9 +1933,7 @@ int32_t ExynosDisplayDrmInterface::setupCommitFromDisplayConfig(
                 config.dataspace & HAL_DATASPACE_TRANSFER_MASK);
         return ret;
     }
-    if ((ret = drmReq.atomicAddProperty(plane->id(),
-                    plane->transfer_property(), drmEnum, true)) < 0)
-        return ret;
+    planeConfig.set(PlaneProp::TRANSFER, drmEnum);
 
     std::tie(drmEnum, ret) = DrmEnumParser::halToDrmEnum(
                      config.dataspace & HAL_DATASPACE_RANGE_MASK, mRangeEnums);
@@ -1720,25 +1942,19 @@ int32_t ExynosDisplayDrmInterface::setupCommitFromDisplayConfig(
                 config.dataspace & HAL_DATASPACE_RANGE_MASK);
         return ret;
     }
-    if ((ret = drmReq.atomicAddProperty(plane->id(),
-                    plane->range_property(), drmEnum, true)) < 0)
-        return ret;
+    planeConfig.set(PlaneProp::RANGE, drmEnum);
 
     if (hasHdrInfo(config.dataspace)) {
-        if ((ret = drmReq.atomicAddProperty(plane->id(),
-                plane->min_luminance_property(), config.min_luminance)) < 0)
-            return ret;
-        if ((ret = drmReq.atomicAddProperty(plane->id(),
-                       plane->max_luminance_property(), config.max_luminance)) < 0)
-            return ret;
+        planeConfig.set(PlaneProp::MIN_LUMINANCE, config.min_luminance);
+        planeConfig.set(PlaneProp::MAX_LUMINANCE, config.max_luminance);
     }
 
     if (config.state == config.WIN_STATE_RCD) {
-        if (plane->block_property().id()) {
+        if (planeDesc.props[toUnderlying(PlaneProp::BLOCK)].id) {
             if (mBlockState != config.block_area) {
                 uint32_t blobId = 0;
-                ret = mDrmDevice->CreatePropertyBlob(&config.block_area, sizeof(config.block_area),
-                                                     &blobId);
+                ret = mDrmDevice->AcquirePropertyBlob(&config.block_area,
+                                                      sizeof(config.block_area), &blobId);
                 if (ret || (blobId == 0)) {
                     HWC_LOGE(mExynosDisplay, "Failed to create blocking region blob id=%d, ret=%d",
                              blobId, ret);
@@ -1752,15 +1968,11 @@ int32_t ExynosDisplayDrmInterface::setupCommitFromDisplayConfig(
                 mBlockState.mBlobId = blobId;
             }
 
-            if ((ret = drmReq.atomicAddProperty(plane->id(), plane->block_property(),
-                                                mBlockState.mBlobId)) < 0) {
-                HWC_LOGE(mExynosDisplay, "Failed to set blocking region property %d", ret);
-                return ret;
-            }
+            planeConfig.set(PlaneProp::BLOCK, mBlockState.mBlobId);
         }
     }
 
-    return NO_ERROR;
+    return addPlaneProperties(drmReq, planeDesc, planeConfig);
 }
 
 int32_t ExynosDisplayDrmInterface::setupPartialRegion(DrmModeAtomicReq &drmReq)
@@ -1781,7 +1993,7 @@ int32_t ExynosDisplayDrmInterface::setupPartialRegion(DrmModeAtomicReq &drmReq)
          mPartialRegionState.isUpdated(partial_rect))
     {
         uint32_t blob_id = 0;
-        ret = mDrmDevice->CreatePropertyBlob(&partial_rect,
+        ret = mDrmDevice->AcquirePropertyBlob(&partial_rect,
                 sizeof(partial_rect),&blob_id);
         if (ret || (blob_id == 0)) {
             HWC_LOGE(mExynosDisplay, "Failed to create partial region "
@@ -1876,10 +2088,14 @@ int32_t ExynosDisplayDrmInterface::deliverWinConfigData()
     bool hasM2mSecureLayerBuffer = false;
 
     mFrameCounter++;
+    mCommitStageStats.beginFrame();
 
     funcReturnCallback retCallback([&]() {
         if ((ret == NO_ERROR) && !drmReq.getError()) {
-            mFBManager.flip(hasSecureFrameBuffer, hasM2mSecureLayerBuffer);
+            mCommitStageStats.endFrame();
+            const int retireFence = mExynosDisplay->mDpuData.retire_fence;
+            mFBManager.flip(hasSecureFrameBuffer, hasM2mSecureLayerBuffer,
+                            (retireFence >= 0) ? dup(retireFence) : -1);
         } else if (ret == -ENOMEM) {
             ALOGW("OOM, release all cached buffers by FBManager");
             mFBManager.releaseAll();
@@ -1889,8 +2105,11 @@ int32_t ExynosDisplayDrmInterface::deliverWinConfigData()
     mFBManager.checkShrink();
 
     bool needModesetForReadback = false;
+    nsecs_t stageStart = systemTime(SYSTEM_TIME_MONOTONIC);
     if (mExynosDisplay->mDpuData.enable_readback) {
-        if ((ret = setupWritebackCommit(drmReq)) < 0) {
+        ret = setupWritebackCommit(drmReq);
+        mCommitStageStats.accumulate(CommitStage::WRITEBACK, stageStart);
+        if (ret < 0) {
             HWC_LOGE(mExynosDisplay, "%s:: Failed to setup writeback commit ret(%d)",
                     __func__, ret);
             return ret;
@@ -1898,7 +2117,9 @@ int32_t ExynosDisplayDrmInterface::deliverWinConfigData()
         needModesetForReadback = true;
     } else {
         if (mReadbackInfo.mNeedClearReadbackCommit) {
-            if ((ret = clearWritebackCommit(drmReq)) < 0) {
+            ret = clearWritebackCommit(drmReq);
+            mCommitStageStats.accumulate(CommitStage::WRITEBACK, stageStart);
+            if (ret < 0) {
                 HWC_LOGE(mExynosDisplay, "%s: Failed to clear writeback commit ret(%d)",
                          __func__, ret);
                 return ret;
@@ -1922,7 +2143,10 @@ int32_t ExynosDisplayDrmInterface::deliverWinConfigData()
         }
     }
 
-    if ((ret = setupPartialRegion(drmReq)) != NO_ERROR)
+    stageStart = systemTime(SYSTEM_TIME_MONOTONIC);
+    ret = setupPartialRegion(drmReq);
+    mCommitStageStats.accumulate(CommitStage::PARTIAL_REGION, stageStart);
+    if (ret != NO_ERROR)
         return ret;
 
     uint64_t out_fences[mDrmDevice->crtcs().size()];
@@ -1951,7 +2175,10 @@ int32_t ExynosDisplayDrmInterface::deliverWinConfigData()
 
     // Update of color settings could change layer's solid color. So it should
     // be called before use of layer's solid color.
-    if ((ret = updateColorSettings(drmReq, dqeEnable)) != 0) {
+    stageStart = systemTime(SYSTEM_TIME_MONOTONIC);
+    ret = updateColorSettings(drmReq, dqeEnable);
+    mCommitStageStats.accumulate(CommitStage::COLOR_SETTINGS, stageStart);
+    if (ret != 0) {
         HWC_LOGE(mExynosDisplay, "failed to update color settings (%d)", ret);
         return ret;
     }
@@ -1972,16 +2199,19 @@ int32_t ExynosDisplayDrmInterface::deliverWinConfigData()
                 config.src.w = config.dst.w;
                 config.src.h = config.dst.h;
             }
-            auto &plane = mDrmDevice->planes().at(channelId);
+            const PlaneDescriptor &planeDesc = mPlaneDescriptors.at(channelId);
             uint32_t fbId = 0;
-            if ((ret = setupCommitFromDisplayConfig(drmReq, config, i, plane, fbId)) < 0) {
+            stageStart = systemTime(SYSTEM_TIME_MONOTONIC);
+            ret = setupCommitFromDisplayConfig(drmReq, config, i, planeDesc, fbId);
+            mCommitStageStats.accumulate(CommitStage::PLANE_SETUP, stageStart);
+            if (ret < 0) {
                 HWC_LOGE(mExynosDisplay, "setupCommitFromDisplayConfig failed, config[%zu]", i);
                 return ret;
             }
             hasSecureFrameBuffer |= (isFramebuffer(config.layer) && config.protection);
             hasM2mSecureLayerBuffer |= (config.protection && config.layer && config.layer->mM2mMPP);
             /* Set this plane is enabled */
-            planeEnableInfo[plane->id()] = 1;
+            planeEnableInfo[planeDesc.planeId] = 1;
         }
     }
 
@@ -1992,12 +2222,15 @@ int32_t ExynosDisplayDrmInterface::deliverWinConfigData()
             const int32_t rcdId = static_cast<ExynosPrimaryDisplay *>(mExynosDisplay)->mRcdId;
             const int32_t channelId = getSpecialChannelId(rcdId);
             if (channelId >= 0) {
-                auto &plane = mDrmDevice->planes().at(channelId);
+                const PlaneDescriptor &planeDesc = mPlaneDescriptors.at(channelId);
                 uint32_t fbId = 0;
-                if ((ret = setupCommitFromDisplayConfig(drmReq, config, i, plane, fbId)) < 0) {
+                stageStart = systemTime(SYSTEM_TIME_MONOTONIC);
+                ret = setupCommitFromDisplayConfig(drmReq, config, i, planeDesc, fbId);
+                mCommitStageStats.accumulate(CommitStage::PLANE_SETUP, stageStart);
+                if (ret < 0) {
                     HWC_LOGE(mExynosDisplay, "setupCommitFromDisplayConfig failed, config[%zu]", i);
                 }
-                planeEnableInfo[plane->id()] = 1;
+                planeEnableInfo[planeDesc.planeId] = 1;
             }
         }
     }
@@ -2125,9 +2358,15 @@ int32_t ExynosDisplayDrmInterface::deliverWinConfigData()
         mExynosDisplay->applyExpectedPresentTime();
     }
 
-    if ((ret = drmReq.commit(flags, true)) < 0) {
+    stageStart = systemTime(SYSTEM_TIME_MONOTONIC);
+    ret = drmReq.commit(flags, true);
+    mCommitStageStats.accumulate(CommitStage::ATOMIC_COMMIT, stageStart);
+    if (ret < 0) {
         HWC_LOGE(mExynosDisplay, "%s:: Failed to commit pset ret=%d in deliverWinConfigData()\n",
                 __func__, ret);
+        if (mExynosDisplay->mBrightnessController) {
+            mExynosDisplay->mBrightnessController->onFrameCommitFailed();
+        }
         return ret;
     }
 
@@ -2829,7 +3068,7 @@ int32_t ExynosDisplayDrmInterface::setDisplayHistogramChannelSetting(
         return -ENOTSUP;
     }
 
-    ret = mDrmDevice->CreatePropertyBlob(blobData, blobLength, &blobId);
+    ret = mDrmDevice->AcquirePropertyBlob(blobData, blobLength, &blobId);
     if (ret) {
         HWC_LOGE(mExynosDisplay, "Failed to create histogram channel(%d) blob %d", channelId, ret);
         return ret;
@@ -2837,10 +3076,14 @@ int32_t ExynosDisplayDrmInterface::setDisplayHistogramChannelSetting(
 
     if ((ret = drmReq.atomicAddProperty(mDrmCrtc->id(), prop, blobId)) < 0) {
         HWC_LOGE(mExynosDisplay, "%s: Failed to add property", __func__);
+        drmReq.addOldBlob(blobId);
         return ret;
     }
 
-    // TODO: b/295794044 - Clear the old histogram channel blob
+    if (auto it = mHistogramChannelBlobs.find(channelId); it != mHistogramChannelBlobs.end()) {
+        drmReq.addOldBlob(it->second);
+    }
+    mHistogramChannelBlobs[channelId] = blobId;
 
     return ret;
 }
@@ -2862,7 +3105,10 @@ int32_t ExynosDisplayDrmInterface::clearDisplayHistogramChannelSetting(
         return ret;
     }
 
-    // TODO: b/295794044 - Clear the old histogram channel blob
+    if (auto it = mHistogramChannelBlobs.find(channelId); it != mHistogramChannelBlobs.end()) {
+        drmReq.addOldBlob(it->second);
+        mHistogramChannelBlobs.erase(it);
+    }
 
     return ret;
 }
@@ -22,6 +22,7 @@
 #include <utils/Mutex.h>
 #include <xf86drmMode.h>
 
+#include <atomic>
 #include <list>
 #include <unordered_map>
 
@@ -91,9 +92,12 @@ class FramebufferManager {
 
         // The flip function is to help clean up the cached fbIds of destroyed
         // layers after the previous fdIds were update successfully on the
-        // screen.
+        // screen. presentFence is the out fence of the committed frame, the
+        // fbIds retired before this frame are removed once it has signaled.
+        // The ownership of presentFence is taken by FramebufferManager.
         // This should be called after the frame update.
-        void flip(const bool hasSecureFrameBuffer, const bool hasM2mSecureLayerBuffer);
+        void flip(const bool hasSecureFrameBuffer, const bool hasM2mSecureLayerBuffer,
+                  int presentFence);
 
         // release all currently tracked buffers, this can be called for example when display is turned
         // off
@@ -123,7 +127,11 @@ class FramebufferManager {
                   : drmFd(fd), fbId(fb), bufferDesc(desc){};
             explicit Framebuffer(int fd, uint32_t fb, SolidColorDesc desc)
                   : drmFd(fd), fbId(fb), colorDesc(desc){};
-            ~Framebuffer() { drmModeRmFB(drmFd, fbId); };
+            ~Framebuffer() {
+                if (fbId != 0) drmModeRmFB(drmFd, fbId);
+            };
+            // hand over fbId to the caller, the framebuffer won't be removed on destruction
+            uint32_t release() { return std::exchange(fbId, 0); }
             int drmFd;
             uint32_t fbId;
             union {
@@ -133,6 +141,26 @@ class FramebufferManager {
         };
         using FBList = std::list<std::unique_ptr<Framebuffer>>;
 
+        // Multiple-producer single-consumer lock-free queue of fbIds waiting for
+        // removal. Each fbId is tagged with the frame number after which it is no
+        // longer scanned out. Producers push from any thread, only mRmFBThread pops.
+        class RetiredFbQueue {
+            public:
+                struct Node {
+                    uint32_t fbId;
+                    uint64_t frameNumber;
+                    Node *next;
+                };
+
+                ~RetiredFbQueue();
+                void push(uint32_t fbId, uint64_t frameNumber);
+                // take all queued nodes in FIFO order, the caller owns the returned list
+                Node *popAll();
+
+            private:
+                std::atomic<Node *> mHead = nullptr;
+        };
+
         template <class UnaryPredicate>
         uint32_t findCachedFbId(const ExynosLayer *layer, const bool isM2mSecureLayer,
                                 UnaryPredicate predicate);
@@ -148,6 +176,11 @@ class FramebufferManager {
         uint32_t getBufHandleFromFd(int fd);
         void freeBufHandle(uint32_t handle);
         void removeFBsThreadRoutine();
+        // move buffers to the retired queue, they will be removed after the next
+        // frame is presented
+        void retireBuffers(FBList &buffers) { retireBuffers(buffers, buffers.begin()); }
+        void retireBuffers(FBList &buffers, FBList::iterator first);
+        void removeRetiredBuffers(std::vector<uint32_t> &fbIds);
 
         void markInuseLayerLocked(const ExynosLayer *layer, const bool isM2mSecureLayer)
                 REQUIRES(mMutex);
@@ -163,9 +196,13 @@ class FramebufferManager {
         std::map<const ExynosLayer *, FBList> mCachedLayerBuffers;
         std::map<const ExynosLayer *, FBList> mCachedM2mSecureLayerBuffers;
 
-        // mCleanBuffers list keeps fbIds of destroyed layers. Those fbIds will
-        // be destroyed in mRmFBThread thread.
-        FBList mCleanBuffers;
+        // mRetiredFbs keeps fbIds of destroyed layers. Those fbIds will be
+        // destroyed in mRmFBThread thread once the frame they are tagged with
+        // was presented.
+        RetiredFbQueue mRetiredFbs;
+        // number of frames committed by flip()
+        std::atomic<uint64_t> mFlipCount = 0;
+        std::atomic<bool> mRetireAllPending = false;
 
         // mCacheShrinkPending is set when we want to clean up unused layers
         // in mCachedLayerBuffers. When the flag is set, mCachedLayersInuse will
@@ -181,10 +218,17 @@ class FramebufferManager {
         std::set<const ExynosLayer *> mCachedM2mSecureLayersInuse;
 
         std::thread mRmFBThread;
-        bool mRmFBThreadRunning = false;
+        // mRmFBMutex only protects the flip notification below, it is never
+        // held together with mMutex
+        Mutex mRmFBMutex;
+        bool mRmFBThreadRunning GUARDED_BY(mRmFBMutex) = false;
+        bool mFlipPending GUARDED_BY(mRmFBMutex) = false;
+        uint64_t mPresentedFrame GUARDED_BY(mRmFBMutex) = 0;
+        int mPresentFence GUARDED_BY(mRmFBMutex) = -1;
         Condition mFlipDone;
         Mutex mMutex;
 
+        static constexpr int PRESENT_FENCE_TIMEOUT_MS = 1000;
         static constexpr size_t MAX_CACHED_LAYERS = 16;
         static constexpr size_t MAX_CACHED_M2M_SECURE_LAYERS = 1;
         static constexpr size_t MAX_CACHED_BUFFERS_PER_LAYER = 32;
@@ -246,7 +290,7 @@ class ExynosDisplayDrmInterface :
                 };
                 int destroyOldBlobs() {
                     for (auto &blob : mOldBlobs) {
-                        int ret = mDrmDisplayInterface->mDrmDevice->DestroyPropertyBlob(blob);
+                        int ret = mDrmDisplayInterface->mDrmDevice->ReleasePropertyBlob(blob);
                         if (ret) {
                             HWC_LOGE(mDrmDisplayInterface->mExynosDisplay,
                                     "Failed to destroy old blob after commit %d", ret);
@@ -298,10 +342,11 @@ class ExynosDisplayDrmInterface :
                 void resetVsyncTimeStamp() { mVsyncTimeStamp = 0; };
                 void resetDesiredVsyncPeriod() { mDesiredVsyncPeriod = 0;};
             private:
-                bool mVsyncEnabled = false;
-                uint64_t mVsyncTimeStamp = 0;
-                uint64_t mVsyncPeriod = 0;
-                uint64_t mDesiredVsyncPeriod = 0;
+                // Also updated without the display lock while the display is busy
+                std::atomic<bool> mVsyncEnabled = false;
+                std::atomic<uint64_t> mVsyncTimeStamp = 0;
+                std::atomic<uint64_t> mVsyncPeriod = 0;
+                std::atomic<uint64_t> mDesiredVsyncPeriod = 0;
         };
         void Callback(int display, int64_t timestamp) override;
 
@@ -318,6 +363,9 @@ class ExynosDisplayDrmInterface :
                 uint32_t* outNumConfigs,
                 hwc2_config_t* outConfigs);
         virtual void dumpDisplayConfigs();
+        virtual void dump(String8 &result) override;
+        virtual int32_t getCommitLatencyStats(bool reset,
+                                              std::vector<int64_t> *outStats) override;
         virtual bool supportDataspace(int32_t dataspace);
         virtual int32_t getColorModes(uint32_t* outNumModes, int32_t* outModes);
         virtual int32_t setColorMode(int32_t mode);
@@ -364,6 +412,9 @@ class ExynosDisplayDrmInterface :
         virtual int32_t getDefaultModeId(int32_t *modeId) override;
 
         virtual int32_t waitVBlank();
+        virtual bool getPredictedVsyncTime(int64_t afterNs, int64_t* outVsyncNs) override {
+            return mDrmVSyncWorker.GetPredictedVSync(afterNs, outVsyncNs);
+        }
         float getDesiredRefreshRate() { return mDesiredModeState.mode.v_refresh(); }
         int32_t getOperationRate() {
             if (mExynosDisplay->mOperationRateManager) {
@@ -423,6 +474,49 @@ class ExynosDisplayDrmInterface :
             HAL_MIPI_CMD_SYNC_OP_RATE,
         };
 
+        enum class CommitStage : uint32_t {
+            WRITEBACK = 0,
+            PARTIAL_REGION,
+            COLOR_SETTINGS,
+            PLANE_SETUP,
+            GET_FB,
+            ATOMIC_COMMIT,
+            TOTAL,
+            COUNT,
+        };
+
+        /* Per stage latency of deliverWinConfigData() */
+        class CommitStageStats {
+            public:
+                void beginFrame() {
+                    mFrameDurations.fill(0);
+                    mFrameStages.fill(false);
+                    mFrameStart = systemTime(SYSTEM_TIME_MONOTONIC);
+                }
+                /* Add the time elapsed since start to the stage of this frame */
+                void accumulate(CommitStage stage, nsecs_t start) {
+                    mFrameDurations[toUnderlying(stage)] +=
+                            systemTime(SYSTEM_TIME_MONOTONIC) - start;
+                    mFrameStages[toUnderlying(stage)] = true;
+                }
+                /* Insert durations of the frame into the histograms */
+                void endFrame();
+                void reset();
+                void dump(String8 &result) const;
+                void getStats(std::vector<int64_t> &outStats) const;
+
+            private:
+                static constexpr size_t kStageCount = toUnderlying(CommitStage::COUNT);
+                static constexpr std::array<const char *, kStageCount> kStageNames = {
+                        "writeback",     "partialRegion", "colorSettings", "planeSetup",
+                        "getFramebuffer", "atomicCommit", "total"};
+
+                nsecs_t mFrameStart = 0;
+                std::array<nsecs_t, kStageCount> mFrameDurations{};
+                std::array<bool, kStageCount> mFrameStages{};
+                std::array<LatencyHistogram, kStageCount> mHistograms;
+        };
+
         struct ModeState {
             enum ModeStateType {
                 MODE_STATE_NONE = 0U,
@@ -475,6 +569,78 @@ class ExynosDisplayDrmInterface :
         int32_t clearDisplayPlanes(DrmModeAtomicReq &drmReq);
         int32_t choosePreferredConfig();
         int getDeconChannel(ExynosMPP *otfMPP);
+        /* Plane properties set by setupCommitFromDisplayConfig() */
+        enum class PlaneProp : uint32_t {
+            CRTC_ID = 0,
+            FB_ID,
+            CRTC_X,
+            CRTC_Y,
+            CRTC_W,
+            CRTC_H,
+            SRC_X,
+            SRC_Y,
+            SRC_W,
+            SRC_H,
+            ROTATION,
+            BLEND,
+            ZPOS,
+            ALPHA,
+            IN_FENCE_FD,
+            COLORMAP,
+            STANDARD,
+            TRANSFER,
+            RANGE,
+            MIN_LUMINANCE,
+            MAX_LUMINANCE,
+            BLOCK,
+            COUNT,
+        };
+        static constexpr size_t PLANE_PROP_COUNT = toUnderlying(PlaneProp::COUNT);
+        /* Properties which fail the commit if the plane doesn't have them */
+        static constexpr uint32_t MANDATORY_PLANE_PROPS =
+                (1u << toUnderlying(PlaneProp::CRTC_ID)) |
+                (1u << toUnderlying(PlaneProp::FB_ID)) |
+                (1u << toUnderlying(PlaneProp::CRTC_X)) |
+                (1u << toUnderlying(PlaneProp::CRTC_Y)) |
+                (1u << toUnderlying(PlaneProp::CRTC_W)) |
+                (1u << toUnderlying(PlaneProp::CRTC_H)) |
+                (1u << toUnderlying(PlaneProp::SRC_X)) |
+                (1u << toUnderlying(PlaneProp::SRC_Y)) |
+                (1u << toUnderlying(PlaneProp::SRC_W)) |
+                (1u << toUnderlying(PlaneProp::SRC_H)) |
+                (1u << toUnderlying(PlaneProp::IN_FENCE_FD)) |
+                (1u << toUnderlying(PlaneProp::MIN_LUMINANCE)) |
+                (1u << toUnderlying(PlaneProp::MAX_LUMINANCE));
+        /*
+         * Property ids and validation limits of a plane, resolved once in
+         * initDrmDevice() so adding a plane to the request is a loop over
+         * a fixed array instead of a DrmProperty lookup per property.
+         */
+        struct PlaneDescriptor {
+            uint32_t planeId = 0;
+            /* Bit n is set if the plane has PlaneProp n */
+            uint32_t supportedMask = 0;
+            std::array<DrmPropertyDescriptor, PLANE_PROP_COUNT> props;
+            /* Only used for logging */
+            std::array<const DrmProperty *, PLANE_PROP_COUNT> properties;
+            bool zposMutable = false;
+            uint64_t minZpos = 0;
+            uint64_t minAlpha = 0;
+            uint64_t maxAlpha = 0;
+        };
+        /* Values of one plane, properties not in mask are left untouched */
+        struct PlaneConfig {
+            std::array<uint64_t, PLANE_PROP_COUNT> values;
+            uint32_t mask = 0;
+            void set(PlaneProp prop, uint64_t value) {
+                values[toUnderlying(prop)] = value;
+                mask |= 1u << toUnderlying(prop);
+            }
+        };
+        static_assert(PLANE_PROP_COUNT <= 32, "PlaneConfig mask is too small");
+        void initPlaneDescriptors();
+        int32_t addPlaneProperties(DrmModeAtomicReq &drmReq, const PlaneDescriptor &desc,
+                                   const PlaneConfig &planeConfig);
         /*
          * This function adds FB and gets new fb id if fbId is 0,
          * if fbId is not 0, this reuses fbId.
@@ -482,7 +648,7 @@ class ExynosDisplayDrmInterface :
         int32_t setupCommitFromDisplayConfig(DrmModeAtomicReq &drmReq,
                 const exynos_win_config_data &config,
                 const uint32_t configIndex,
-                const std::unique_ptr<DrmPlane> &plane,
+                const PlaneDescriptor &planeDesc,
                 uint32_t &fbId);
 
         int32_t setupPartialRegion(DrmModeAtomicReq &drmReq);
@@ -504,6 +670,7 @@ class ExynosDisplayDrmInterface :
         int32_t setActiveDrmMode(DrmMode const &mode);
         void setMaxWindowNum(uint32_t num) { mMaxWindowNum = num; };
         int32_t getSpecialChannelId(uint32_t planeId);
+        bool handleVsyncLocked(int display, int64_t timestamp);
 
     protected:
         struct PartialRegionState {
@@ -567,8 +734,12 @@ class ExynosDisplayDrmInterface :
         ModeState mDesiredModeState;
         PartialRegionState mPartialRegionState;
         BlockingRegionState mBlockState;
+        /* Histogram channel blob ids, key is channel id */
+        std::unordered_map<uint8_t, uint32_t> mHistogramChannelBlobs;
         /* Mapping plane id to ExynosMPP, key is plane id */
         std::unordered_map<uint32_t, ExynosMPP*> mExynosMPPsForPlane;
+        /* Indexed by channel id, same as DrmDevice::planes() */
+        std::vector<PlaneDescriptor> mPlaneDescriptors;
 
         DrmEnumParser::MapHal2DrmEnum mBlendEnums;
         DrmEnumParser::MapHal2DrmEnum mStandardEnums;
@@ -579,6 +750,7 @@ class ExynosDisplayDrmInterface :
 
         DrmReadbackInfo mReadbackInfo;
         FramebufferManager mFBManager;
+        CommitStageStats mCommitStageStats;
         std::array<uint8_t, MONITOR_DESCRIPTOR_DATA_LENGTH> mMonitorDescription;
         nsecs_t mLastDumpDrmAtomicMessageTime;
 
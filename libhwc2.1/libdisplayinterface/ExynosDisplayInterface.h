@@ -88,6 +88,9 @@ class ExynosDisplayInterface {
         virtual uint32_t getActiveModeId() { return UINT_MAX; }
 
         virtual int32_t waitVBlank() { return 0; };
+        /* First vsync at or after afterNs as modelled from hardware vsync, false if unknown */
+        virtual bool getPredictedVsyncTime(int64_t __unused afterNs,
+                                           int64_t* __unused outVsyncNs) { return false; };
 
         virtual bool readHotplugStatus() { return true; };
         virtual int readHotplugErrorCode() { return 0; };
@@ -95,6 +98,16 @@ class ExynosDisplayInterface {
 
         virtual void setVrrSettings(const VrrSettings_t& vrrSettings);
 
+        virtual void dump(String8& __unused result){};
+        /*
+         * Returns the commit latency of each stage as {count, p50, p99, max}
+         * tuples in microseconds.
+         */
+        virtual int32_t getCommitLatencyStats(bool __unused reset,
+                                              std::vector<int64_t>* __unused outStats) {
+            return HWC2_ERROR_UNSUPPORTED;
+        }
+
     public:
         uint32_t mType = INTERFACE_TYPE_NONE;
 };
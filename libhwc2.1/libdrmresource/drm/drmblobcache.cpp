@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#define LOG_TAG "hwc-drm-blob-cache"
+
+#include "drmblobcache.h"
+#include "drmdevice.h"
+
+#include <errno.h>
+#include <string.h>
+#include <cinttypes>
+#include <string>
+#include <string_view>
+
+#include <log/log.h>
+
+namespace android {
+
+static size_t HashPayload(const void *data, size_t length) {
+  return std::hash<std::string_view>{}(
+      std::string_view(static_cast<const char *>(data), length));
+}
+
+DrmBlobCache::DrmBlobCache(DrmDevice *drm, size_t budget_bytes)
+    : drm_(drm), budget_bytes_(budget_bytes) {
+}
+
+DrmBlobCache::~DrmBlobCache() {
+  std::lock_guard<std::mutex> lock(lock_);
+  for (const auto &[blob_id, entry] : entries_) {
+    if (entry.refs)
+      ALOGW("blob %" PRIu32 " destroyed with %" PRIu32 " references", blob_id,
+            entry.refs);
+    drm_->DestroyPropertyBlob(blob_id);
+  }
+}
+
+uint32_t DrmBlobCache::FindLocked(size_t hash, const void *data,
+                                  size_t length) const {
+  auto [begin, end] = hash_index_.equal_range(hash);
+  for (auto it = begin; it != end; ++it) {
+    const Entry &entry = entries_.at(it->second);
+    if (entry.data.size() == length && !memcmp(entry.data.data(), data, length))
+      return it->second;
+  }
+  return 0;
+}
+
+int DrmBlobCache::Acquire(const void *data, size_t length, uint32_t *blob_id) {
+  const size_t hash = HashPayload(data, length);
+
+  std::lock_guard<std::mutex> lock(lock_);
+  if (uint32_t id = FindLocked(hash, data, length); id != 0) {
+    Entry &entry = entries_.at(id);
+    if (entry.refs++ == 0) {
+      lru_.erase(entry.lru_it);
+      idle_bytes_ -= entry.data.size();
+    }
+    hits_++;
+    *blob_id = id;
+    return 0;
+  }
+
+  uint32_t id = 0;
+  int ret = drm_->CreatePropertyBlob(data, length, &id);
+  if (ret)
+    return ret;
+
+  misses_++;
+  Entry &entry = entries_[id];
+  entry.hash = hash;
+  entry.data.assign(static_cast<const uint8_t *>(data),
+                    static_cast<const uint8_t *>(data) + length);
+  entry.refs = 1;
+  hash_index_.emplace(hash, id);
+  *blob_id = id;
+  return 0;
+}
+
+int DrmBlobCache::Release(uint32_t blob_id) {
+  std::lock_guard<std::mutex> lock(lock_);
+  auto it = entries_.find(blob_id);
+  if (it == entries_.end())
+    return -ENOENT;
+
+  Entry &entry = it->second;
+  if (entry.refs == 0) {
+    ALOGE("blob %" PRIu32 " released without reference", blob_id);
+    return -EINVAL;
+  }
+  if (--entry.refs == 0) {
+    lru_.push_front(blob_id);
+    entry.lru_it = lru_.begin();
+    idle_bytes_ += entry.data.size();
+    EvictLocked();
+  }
+  return 0;
+}
+
+void DrmBlobCache::EvictLocked() {
+  while (idle_bytes_ > budget_bytes_ && !lru_.empty()) {
+    uint32_t blob_id = lru_.back();
+    lru_.pop_back();
+    evictions_++;
+    DestroyLocked(blob_id);
+  }
+}
+
+void DrmBlobCache::DestroyLocked(uint32_t blob_id) {
+  auto it = entries_.find(blob_id);
+  if (it == entries_.end())
+    return;
+
+  auto [begin, end] = hash_index_.equal_range(it->second.hash);
+  for (auto index = begin; index != end; ++index) {
+    if (index->second == blob_id) {
+      hash_index_.erase(index);
+      break;
+    }
+  }
+  idle_bytes_ -= it->second.data.size();
+  entries_.erase(it);
+  drm_->DestroyPropertyBlob(blob_id);
+}
+
+void DrmBlobCache::Dump(std::string *out) const {
+  std::lock_guard<std::mutex> lock(lock_);
+  char buf[256];
+  snprintf(buf, sizeof(buf),
+           "Blob cache: %zu blobs (%zu idle, %zu/%zu bytes), hits %" PRIu64
+           ", misses %" PRIu64 ", evictions %" PRIu64 "\n",
+           entries_.size(), lru_.size(), idle_bytes_, budget_bytes_, hits_,
+           misses_, evictions_);
+  *out += buf;
+}
+}  // namespace android
@@ -39,7 +39,7 @@
 
 namespace android {
 
-DrmDevice::DrmDevice() : event_listener_(this) {
+DrmDevice::DrmDevice() : blob_cache_(this), event_listener_(this) {
 }
 
 DrmDevice::~DrmDevice() {
@@ -453,6 +453,21 @@ int DrmDevice::DestroyPropertyBlob(uint32_t blob_id) {
   return 0;
 }
 
+int DrmDevice::AcquirePropertyBlob(const void *data, size_t length,
+                                   uint32_t *blob_id) {
+  return blob_cache_.Acquire(data, length, blob_id);
+}
+
+int DrmDevice::ReleasePropertyBlob(uint32_t blob_id) {
+  if (!blob_id)
+    return 0;
+
+  int ret = blob_cache_.Release(blob_id);
+  if (ret == -ENOENT)
+    return DestroyPropertyBlob(blob_id);
+  return ret;
+}
+
 DrmEventListener *DrmDevice::event_listener() {
   return &event_listener_;
 }
@@ -202,6 +202,17 @@ int DrmEventListener::UnRegisterSysfsHandler(int sysfs_fd) {
   return 0;
 }
 
+void DrmEventListener::RegisterVblankHandler(uint32_t pipe,
+                                             std::shared_ptr<DrmVblankEventHandler> handler) {
+  std::scoped_lock lock(mutex_);
+  vblank_handlers_[pipe] = std::move(handler);
+}
+
+void DrmEventListener::UnRegisterVblankHandler(uint32_t pipe) {
+  std::scoped_lock lock(mutex_);
+  vblank_handlers_.erase(pipe);
+}
+
 bool DrmEventListener::IsDrmInTUI() {
   char buffer[1024];
   int ret;
@@ -314,6 +325,8 @@ void DrmEventListener::DRMEventHandler() {
                             user_data);
                 break;
             case DRM_EVENT_VBLANK:
+                VblankEventHandler((struct drm_event_vblank *)e);
+                break;
             case DRM_EVENT_CRTC_SEQUENCE:
                 /* These DRM events are not handled */
                 break;
@@ -352,6 +365,23 @@ void DrmEventListener::SysfsEventHandler(int fd) {
   }
 }
 
+void DrmEventListener::VblankEventHandler(struct drm_event_vblank *vblank) {
+  std::shared_ptr<DrmVblankEventHandler> handler;
+  {
+    std::scoped_lock lock(mutex_);
+    auto it = vblank_handlers_.find(static_cast<uint32_t>(vblank->user_data));
+    if (it != vblank_handlers_.end())
+      handler = it->second;
+  }
+  if (handler) {
+    handler->handleVblankEvent(vblank->sequence,
+                               (int64_t)vblank->tv_sec * 1000 * 1000 * 1000 +
+                                   (int64_t)vblank->tv_usec * 1000);
+  } else {
+    ALOGW("Unhandled vblank event for pipe %" PRIu64, (uint64_t)vblank->user_data);
+  }
+}
+
 void DrmEventListener::Routine() {
   struct epoll_event events[maxFds];
   int nfds, n;
@@ -66,6 +66,26 @@ void DrmProperty::init(drmModePropertyPtr p, uint64_t value) {
     type_ = DRM_PROPERTY_TYPE_BLOB;
   else if (flags_ & DRM_MODE_PROP_BITMASK)
     type_ = DRM_PROPERTY_TYPE_BITMASK;
+
+  updateDescriptor();
+}
+
+void DrmProperty::updateDescriptor() {
+  descriptor_ = DrmPropertyDescriptor();
+  descriptor_.id = id_;
+
+  if (isImmutable()) {
+    descriptor_.check = DrmPropertyDescriptor::CHECK_IMMUTABLE;
+  } else if ((isRange() || isSignedRange()) && values_.size() >= 2) {
+    descriptor_.check = isRange() ? DrmPropertyDescriptor::CHECK_RANGE
+                                  : DrmPropertyDescriptor::CHECK_SIGNED_RANGE;
+    descriptor_.min = values_[0];
+    descriptor_.max = values_[1];
+  } else if (isBitmask()) {
+    descriptor_.check = DrmPropertyDescriptor::CHECK_BITMASK;
+    for (auto bit : values_)
+      descriptor_.valid_mask |= (1ULL << bit);
+  }
 }
 
 uint32_t DrmProperty::id() const {
@@ -164,37 +184,31 @@ std::tuple<uint64_t, int> DrmProperty::getEnumValueWithName(std::string name) co
 }
 
 bool DrmProperty::validateChange(uint64_t value) const {
-  if (isImmutable()) {
-    ALOGE("%s: %s is immutable drm property (%zu)", __func__, name().c_str());
-    return false;
-  } else if (isRange()) {
-    if (value < values_[0] || value > values_[1]) {
+  if (descriptor_.validate(value))
+    return true;
+
+  switch (descriptor_.check) {
+    case DrmPropertyDescriptor::CHECK_IMMUTABLE:
+      ALOGE("%s: %s is immutable drm property", __func__, name().c_str());
+      break;
+    case DrmPropertyDescriptor::CHECK_RANGE:
       ALOGE("%s: range property %s set to %" PRIu64 " is invalid [%" PRIu64 "-%" PRIu64 "]",
-            __func__, name().c_str(), value, values_[0], values_[1]);
-      return false;
-    }
-  } else if (isSignedRange()) {
-    int64_t svalue = U642I64(value);
-
-    if (svalue < U642I64(values_[0]) || svalue > U642I64(values_[1])) {
+            __func__, name().c_str(), value, descriptor_.min, descriptor_.max);
+      break;
+    case DrmPropertyDescriptor::CHECK_SIGNED_RANGE:
       ALOGE("%s: signed property %s set to %" PRIi64 " is invalid [%" PRIi64 "-%" PRIi64 "]",
-            __func__, name().c_str(), svalue, U642I64(values_[0]), U642I64(values_[1]));
-      return false;
-    }
-  } else if (isBitmask()) {
-    uint64_t valid_mask = 0;
-
-    for (auto i = 0; i < values_.size(); i++) {
-      valid_mask |= (1ULL << values_[i]);
-    }
-    if (value & ~valid_mask) {
+            __func__, name().c_str(), U642I64(value), U642I64(descriptor_.min),
+            U642I64(descriptor_.max));
+      break;
+    case DrmPropertyDescriptor::CHECK_BITMASK:
       ALOGE("%s: bitmask property %s set to 0x%" PRIx64 " is invalid [0x%" PRIx64 "]", __func__,
-            name().c_str(), value, valid_mask);
-      return false;
-    }
+            name().c_str(), value, descriptor_.valid_mask);
+      break;
+    default:
+      break;
   }
 
-  return true;
+  return false;
 }
 
 void DrmProperty::updateValue(uint64_t value) {
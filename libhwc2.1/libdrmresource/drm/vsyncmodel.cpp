@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "vsyncmodel.h"
+
+#include <cmath>
+#include <cstdlib>
+
+namespace android {
+
+void VsyncModel::Reset() {
+  head_ = 0;
+  count_ = 0;
+  nominal_period_ns_ = 0;
+}
+
+int64_t VsyncModel::period_ns() const {
+  return IsLocked() ? std::llround(fitted_period_ns_) : nominal_period_ns_;
+}
+
+double VsyncModel::ModelTime(int64_t index) const {
+  return origin_ns_ + fitted_offset_ns_ +
+         static_cast<double>(index - origin_index_) * fitted_period_ns_;
+}
+
+bool VsyncModel::AddSample(int64_t timestamp_ns, int64_t nominal_period_ns) {
+  if (nominal_period_ns <= 0)
+    return false;
+
+  // A mode switch moves the grid, start over. Allow 1% for rounding of the
+  // nominal period.
+  if (count_ > 0 &&
+      std::llabs(nominal_period_ns - nominal_period_ns_) * 100 > nominal_period_ns_)
+    Reset();
+
+  int64_t index = 0;
+  if (count_ > 0) {
+    if (timestamp_ns <= last_timestamp_ns_)
+      return false;
+    const double period = IsLocked() ? fitted_period_ns_ : nominal_period_ns_;
+    const int64_t steps =
+        std::llround(static_cast<double>(timestamp_ns - last_timestamp_ns_) / period);
+    if (steps < 1)
+      return false;
+    index = last_index_ + steps;
+
+    if (IsLocked() && std::fabs(timestamp_ns - ModelTime(index)) > period / 4) {
+      Reset();
+      index = 0;
+    }
+  }
+
+  if (count_ == 0)
+    nominal_period_ns_ = nominal_period_ns;
+
+  if (count_ < kWindowSize) {
+    samples_[(head_ + count_) % kWindowSize] = {index, timestamp_ns};
+    ++count_;
+  } else {
+    samples_[head_] = {index, timestamp_ns};
+    head_ = (head_ + 1) % kWindowSize;
+  }
+  last_index_ = index;
+  last_timestamp_ns_ = timestamp_ns;
+
+  Fit();
+  return true;
+}
+
+void VsyncModel::Fit() {
+  // Fit relative to the oldest sample to keep the sums small.
+  const Sample &oldest = samples_[head_];
+  origin_index_ = oldest.index;
+  origin_ns_ = oldest.timestamp_ns;
+
+  if (count_ < 2) {
+    fitted_period_ns_ = nominal_period_ns_;
+    fitted_offset_ns_ = 0;
+    return;
+  }
+
+  double sum_x = 0, sum_y = 0, sum_xx = 0, sum_xy = 0;
+  for (size_t i = 0; i < count_; ++i) {
+    const Sample &s = samples_[(head_ + i) % kWindowSize];
+    const double x = static_cast<double>(s.index - origin_index_);
+    const double y = static_cast<double>(s.timestamp_ns - origin_ns_);
+    sum_x += x;
+    sum_y += y;
+    sum_xx += x * x;
+    sum_xy += x * y;
+  }
+  const double n = static_cast<double>(count_);
+  const double denominator = n * sum_xx - sum_x * sum_x;
+  if (denominator <= 0) {
+    fitted_period_ns_ = nominal_period_ns_;
+    fitted_offset_ns_ = 0;
+    return;
+  }
+  fitted_period_ns_ = (n * sum_xy - sum_x * sum_y) / denominator;
+  fitted_offset_ns_ = (sum_y - fitted_period_ns_ * sum_x) / n;
+}
+
+bool VsyncModel::PredictNext(int64_t after_ns, int64_t *vsync_ns) const {
+  if (!IsLocked() || fitted_period_ns_ <= 0)
+    return false;
+  if (std::llabs(after_ns - last_timestamp_ns_) > kMaxExtrapolationNs)
+    return false;
+
+  const double base_ns = origin_ns_ + fitted_offset_ns_;
+  const int64_t index =
+      static_cast<int64_t>(std::ceil((after_ns - base_ns) / fitted_period_ns_));
+  int64_t predicted = std::llround(base_ns + index * fitted_period_ns_);
+  // rounding can land one nanosecond short
+  if (predicted < after_ns)
+    predicted = std::llround(base_ns + (index + 1) * fitted_period_ns_);
+  *vsync_ns = predicted;
+  return true;
+}
+
+}  // namespace android
@@ -36,6 +36,9 @@
 using namespace std::chrono_literals;
 
 constexpr auto nsecsPerSec = std::chrono::nanoseconds(1s).count();
+// How often the vsync thread tries to go back to vblank events after the
+// driver refused them, e.g. while the crtc was off.
+constexpr int64_t kVblankEventRetryNs = std::chrono::nanoseconds(1s).count();
 
 namespace android {
 
@@ -44,19 +47,36 @@ VSyncWorker::VSyncWorker()
       mDrmDevice(NULL),
       mDisplay(-1),
       mEnabled(false),
-      mLastTimestampNs(-1) {}
+      mLastTimestampNs(-1),
+      mVblankEventsSupported(false),
+      mUseVblankEvents(false),
+      mVblankEventPending(false),
+      mVblankEventPipe(-1),
+      mVblankEventRetryNs(0) {}
 
 VSyncWorker::~VSyncWorker() {
+    // The listener may still hold the handler, a later worker on the same pipe
+    // replaces it.
+    if (mVblankEventHandler) mVblankEventHandler->Detach();
     Exit();
 }
 
-int VSyncWorker::Init(DrmDevice *drm, int display, const String8 &displayTraceName) {
+int VSyncWorker::Init(DrmDevice *drm, int display, const String8 &displayTraceName,
+                      bool useVblankEvents) {
     mDrmDevice = drm;
     mDisplay = display;
     mDisplayTraceName = displayTraceName;
     mHwVsyncPeriodTag.appendFormat("HWVsyncPeriod for %s", displayTraceName.c_str());
     mHwVsyncEnabledTag.appendFormat("HWCVsync for %s", displayTraceName.c_str());
 
+    if (useVblankEvents) {
+        mVblankEventHandler = std::make_shared<VblankEventHandler>(this);
+        mVblankEventsSupported = true;
+        mUseVblankEvents = true;
+        // The vsync thread is only started if the driver refuses the events
+        return 0;
+    }
+
     return InitWorker();
 }
 
@@ -70,13 +90,107 @@ void VSyncWorker::VSyncControl(bool enabled) {
     Lock();
     mEnabled = enabled;
     mLastTimestampNs = -1;
+    // A pending event re-arms itself once delivered. Vblank events are tried
+    // again on every enable, the crtc may be back since they were refused.
+    bool fallBack = false;
+    if (enabled && mVblankEventsSupported && !mVblankEventPending) {
+        mUseVblankEvents = RequestVBlankEventLocked() == 0;
+        fallBack = !mUseVblankEvents;
+    }
     Unlock();
 
+    if (fallBack) InitWorker();
+
     ATRACE_INT(mHwVsyncEnabledTag.c_str(), static_cast<int32_t>(enabled));
     ATRACE_INT64(mHwVsyncPeriodTag.c_str(), 0);
     Signal();
 }
 
+void VSyncWorker::VblankEventHandler::handleVblankEvent(uint32_t /*sequence*/,
+                                                      int64_t timestampNs) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mWorker) mWorker->OnVBlankEvent(timestampNs);
+}
+
+void VSyncWorker::VblankEventHandler::Detach() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mWorker = nullptr;
+}
+
+// Asks for an event on the next vblank. Never blocks, the event is read by
+// the DrmEventListener thread.
+int VSyncWorker::RequestVBlankEventLocked() {
+    DrmCrtc *crtc = mDrmDevice->GetCrtcForDisplay(mDisplay);
+    if (!crtc) {
+        ALOGE("Failed to get crtc for display");
+        return -ENODEV;
+    }
+    int pipe = crtc->pipe();
+    if (pipe != mVblankEventPipe) {
+        DrmEventListener *listener = mDrmDevice->event_listener();
+        if (mVblankEventPipe >= 0) listener->UnRegisterVblankHandler(mVblankEventPipe);
+        listener->RegisterVblankHandler(pipe, mVblankEventHandler);
+        mVblankEventPipe = pipe;
+    }
+    uint32_t highCrtc = (pipe << DRM_VBLANK_HIGH_CRTC_SHIFT);
+
+    drmVBlank vblank;
+    memset(&vblank, 0, sizeof(vblank));
+    vblank.request.type = (drmVBlankSeqType)(DRM_VBLANK_RELATIVE | DRM_VBLANK_EVENT |
+                                             (highCrtc & DRM_VBLANK_HIGH_CRTC_MASK));
+    vblank.request.sequence = 1;
+    vblank.request.signal = pipe;
+
+    if (drmWaitVBlank(mDrmDevice->fd(), &vblank)) {
+        int err = errno;
+        ALOGW("Failed to request vblank event for %s: %s, falling back to the vsync thread",
+              mDisplayTraceName.c_str(), strerror(err));
+        return -err;
+    }
+    mVblankEventPending = true;
+    return 0;
+}
+
+// Called on the DrmEventListener thread, which serves every display, so the
+// callback must not block on display state (see
+// ExynosDisplayDrmInterface::Callback). No other thread is woken.
+void VSyncWorker::OnVBlankEvent(int64_t timestampNs) {
+    Lock();
+    mVblankEventPending = false;
+    // Re-arm before the callback so the next vblank isn't missed.
+    bool fallBack = mEnabled && RequestVBlankEventLocked();
+    if (fallBack) {
+        mUseVblankEvents = false;
+        mVblankEventRetryNs = timestampNs + kVblankEventRetryNs;
+    }
+    int display = mDisplay;
+    std::shared_ptr<VsyncCallback> callback(mCallback);
+    Unlock();
+
+    if (fallBack) {
+        // -EALREADY once the thread has been started
+        InitWorker();
+        Signal();
+    }
+
+    AddModelSample(timestampNs);
+    DeliverVSync(display, callback, timestampNs);
+}
+
+// Goes back to vblank events once the driver takes the request again.
+void VSyncWorker::RetryVBlankEventsLocked(int64_t nowNs) {
+    if (!mVblankEventsSupported || mUseVblankEvents || mVblankEventPending || !mEnabled ||
+        nowNs < mVblankEventRetryNs) {
+        return;
+    }
+    if (RequestVBlankEventLocked()) {
+        mVblankEventRetryNs = nowNs + kVblankEventRetryNs;
+        return;
+    }
+    ALOGI("Vblank events of %s are back", mDisplayTraceName.c_str());
+    mUseVblankEvents = true;
+}
+
 /*
  * Returns the timestamp of the next vsync in phase with mLastTimestampNs.
  * For example:
@@ -90,6 +204,9 @@ void VSyncWorker::VSyncControl(bool enabled) {
  *  Thus, we must sleep until timestamp 687 to maintain phase with the last
  *  timestamp. But if we don't know last vblank timestamp, sleep one vblank
  *  then try to get vblank from driver again.
+ *
+ *  Once the vsync model has locked on the hardware timestamps its grid is
+ *  used instead of mLastTimestampNs.
  */
 int VSyncWorker::GetPhasedVSync(uint32_t vsyncPeriodNs, int64_t &expectTimeNs) {
     struct timespec now;
@@ -99,6 +216,10 @@ int VSyncWorker::GetPhasedVSync(uint32_t vsyncPeriodNs, int64_t &expectTimeNs) {
     }
 
     int64_t currentTimeNs = now.tv_sec * nsecsPerSec + now.tv_nsec;
+    // Prefer the fitted grid, a single timestamp carries all of its jitter forward.
+    if (GetPredictedVSync(currentTimeNs + 1, &expectTimeNs)) {
+        return 0;
+    }
     if (mLastTimestampNs < 0) {
         expectTimeNs = currentTimeNs + vsyncPeriodNs;
         return -EAGAIN;
@@ -110,21 +231,44 @@ int VSyncWorker::GetPhasedVSync(uint32_t vsyncPeriodNs, int64_t &expectTimeNs) {
     return 0;
 }
 
-int VSyncWorker::SyntheticWaitVBlank(int64_t &timestampNs) {
-    uint32_t vsyncPeriodNs = kDefaultVsyncPeriodNanoSecond;
-    int32_t refreshRate = kDefaultRefreshRateFrequency;
+bool VSyncWorker::GetPredictedVSync(int64_t afterNs, int64_t *vsyncNs) {
+    // The model only learns about a mode switch from the next hardware vsync,
+    // don't hand out the old grid in the meantime.
+    int64_t vsyncPeriodNs = GetVSyncPeriod();
+    std::lock_guard<std::mutex> lock(mModelMutex);
+    if (vsyncPeriodNs && std::llabs(mModel.period_ns() - vsyncPeriodNs) * 100 > vsyncPeriodNs) {
+        return false;
+    }
+    return mModel.PredictNext(afterNs, vsyncNs);
+}
 
+// Returns 0 when the active mode doesn't tell.
+uint32_t VSyncWorker::GetVSyncPeriod() {
     DrmConnector *conn = mDrmDevice->GetConnectorForDisplay(mDisplay);
     if (conn && conn->active_mode().te_period() != 0.0f &&
             conn->active_mode().v_refresh() != 0.0f) {
-        vsyncPeriodNs = static_cast<uint32_t>(conn->active_mode().te_period());
-        refreshRate = static_cast<int32_t>(conn->active_mode().v_refresh());
-    } else {
+        return static_cast<uint32_t>(conn->active_mode().te_period());
+    }
+    return 0;
+}
+
+// Only hardware timestamps feed the model.
+void VSyncWorker::AddModelSample(int64_t timestampNs) {
+    uint32_t vsyncPeriodNs = GetVSyncPeriod();
+    std::lock_guard<std::mutex> lock(mModelMutex);
+    mModel.AddSample(timestampNs, vsyncPeriodNs ? vsyncPeriodNs : kDefaultVsyncPeriodNanoSecond);
+}
+
+int VSyncWorker::SyntheticWaitVBlank(int64_t &timestampNs) {
+    uint32_t vsyncPeriodNs = GetVSyncPeriod();
+    if (vsyncPeriodNs == 0) {
+        DrmConnector *conn = mDrmDevice->GetConnectorForDisplay(mDisplay);
         ALOGW("Vsync worker active with conn=%p vsync=%u refresh=%d\n", conn,
             conn ? static_cast<uint32_t>(conn->active_mode().te_period()) :
                     kDefaultVsyncPeriodNanoSecond,
             conn ? static_cast<int32_t>(conn->active_mode().v_refresh()) :
                     kDefaultRefreshRateFrequency);
+        vsyncPeriodNs = kDefaultVsyncPeriodNanoSecond;
     }
 
     int64_t phasedTimestampNs;
@@ -150,12 +294,12 @@ void VSyncWorker::Routine() {
     int ret;
 
     Lock();
-    if (!mEnabled) {
-        ret = WaitForSignalOrExitLocked();
-        if (ret == -EINTR) {
-            Unlock();
-            return;
-        }
+    // Vblank events are delivered by the event listener, the thread only runs
+    // while the driver refuses them.
+    if (!mEnabled || mUseVblankEvents) {
+        WaitForSignalOrExitLocked();
+        Unlock();
+        return;
     }
 
     int display = mDisplay;
@@ -185,8 +329,18 @@ void VSyncWorker::Routine() {
     } else {
         timestampNs = (int64_t)vblank.reply.tval_sec * nsecsPerSec +
                 (int64_t)vblank.reply.tval_usec * 1000;
+        AddModelSample(timestampNs);
+        // the crtc is up, the driver may take vblank events again
+        Lock();
+        RetryVBlankEventsLocked(timestampNs);
+        Unlock();
     }
 
+    DeliverVSync(display, callback, timestampNs);
+}
+
+void VSyncWorker::DeliverVSync(int display, const std::shared_ptr<VsyncCallback> &callback,
+                               int64_t timestampNs) {
     /*
      * VSync could be disabled during routine execution so it could potentially
      * lead to crash since callback's inner hook could be invalid anymore. We have
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2015 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef ANDROID_DRM_BLOB_CACHE_H_
+#define ANDROID_DRM_BLOB_CACHE_H_
+
+#include <stdint.h>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace android {
+
+class DrmDevice;
+
+// Content addressed cache of property blobs. Blobs with the same payload are
+// shared and refcounted, unreferenced blobs are kept alive so switching back
+// to a known payload (display mode, LUT, ...) doesn't need another
+// CREATEPROPBLOB ioctl. Unreferenced blobs are destroyed in LRU order once
+// their total size exceeds the memory budget.
+class DrmBlobCache {
+ public:
+  static constexpr size_t kDefaultBudgetBytes = 256 * 1024;
+
+  explicit DrmBlobCache(DrmDevice *drm, size_t budget_bytes = kDefaultBudgetBytes);
+  DrmBlobCache(const DrmBlobCache &) = delete;
+  DrmBlobCache &operator=(const DrmBlobCache &) = delete;
+  ~DrmBlobCache();
+
+  // Returns a blob holding data, takes one reference of it.
+  int Acquire(const void *data, size_t length, uint32_t *blob_id);
+  // Drops one reference of blob_id, returns -ENOENT if the blob is not
+  // managed by the cache.
+  int Release(uint32_t blob_id);
+
+  void Dump(std::string *out) const;
+
+ private:
+  struct Entry {
+    size_t hash;
+    std::vector<uint8_t> data;
+    uint32_t refs = 0;
+    // valid only while refs is 0
+    std::list<uint32_t>::iterator lru_it;
+  };
+
+  uint32_t FindLocked(size_t hash, const void *data, size_t length) const;
+  void EvictLocked();
+  void DestroyLocked(uint32_t blob_id);
+
+  DrmDevice *drm_;
+  const size_t budget_bytes_;
+
+  mutable std::mutex lock_;
+  std::unordered_map<uint32_t, Entry> entries_;
+  std::unordered_multimap<size_t, uint32_t> hash_index_;
+  // unreferenced blobs, most recently released first
+  std::list<uint32_t> lru_;
+  size_t idle_bytes_ = 0;
+
+  uint64_t hits_ = 0;
+  uint64_t misses_ = 0;
+  uint64_t evictions_ = 0;
+};
+}  // namespace android
+
+#endif  // ANDROID_DRM_BLOB_CACHE_H_
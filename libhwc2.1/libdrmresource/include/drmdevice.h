@@ -17,6 +17,7 @@
 #ifndef ANDROID_DRM_H_
 #define ANDROID_DRM_H_
 
+#include "drmblobcache.h"
 #include "drmconnector.h"
 #include "drmcrtc.h"
 #include "drmencoder.h"
@@ -77,6 +78,14 @@ class DrmDevice {
 
   int CreatePropertyBlob(const void *data, size_t length, uint32_t *blob_id);
   int DestroyPropertyBlob(uint32_t blob_id);
+  // Shared, refcounted blobs deduplicated by payload. A blob from
+  // AcquirePropertyBlob must be given back with ReleasePropertyBlob, which
+  // falls back to DestroyPropertyBlob for blobs not owned by the cache.
+  int AcquirePropertyBlob(const void *data, size_t length, uint32_t *blob_id);
+  int ReleasePropertyBlob(uint32_t blob_id);
+  DrmBlobCache &blob_cache() {
+    return blob_cache_;
+  }
   bool HandlesDisplay(int display) const;
   void RegisterHotplugHandler(DrmEventHandler *handler) {
     event_listener_.RegisterHotplugHandler(handler);
@@ -101,6 +110,8 @@ class DrmDevice {
 
   UniqueFd fd_;
   uint32_t mode_id_ = 0;
+  // destroyed before fd_ is closed
+  DrmBlobCache blob_cache_;
 
   std::vector<std::unique_ptr<DrmConnector>> connectors_;
   std::vector<std::unique_ptr<DrmConnector>> writeback_connectors_;
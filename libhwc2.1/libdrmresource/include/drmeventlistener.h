@@ -18,6 +18,7 @@
 #define ANDROID_DRM_EVENT_LISTENER_H_
 
 #include <sys/epoll.h>
+#include <xf86drm.h>
 
 #include <map>
 
@@ -84,6 +85,14 @@ class DrmSysfsEventHandler {
   virtual int getFd() = 0;
 };
 
+class DrmVblankEventHandler {
+ public:
+  DrmVblankEventHandler() {}
+  virtual ~DrmVblankEventHandler() {}
+
+  virtual void handleVblankEvent(uint32_t sequence, int64_t timestamp_ns) = 0;
+};
+
 class DrmEventListener : public Worker {
   static constexpr const char kTUIStatusPath[] = "/sys/devices/platform/exynos-drm/tui_status";
   static const uint32_t maxFds = 4;
@@ -106,6 +115,10 @@ class DrmEventListener : public Worker {
   void UnRegisterPanelIdleHandler(DrmPanelIdleEventHandler *handler);
   int RegisterSysfsHandler(std::shared_ptr<DrmSysfsEventHandler> handler);
   int UnRegisterSysfsHandler(int sysfs_fd);
+  // Vblank events requested with DRM_VBLANK_EVENT must carry the crtc pipe in
+  // their signal field. Registering a pipe again replaces its handler.
+  void RegisterVblankHandler(uint32_t pipe, std::shared_ptr<DrmVblankEventHandler> handler);
+  void UnRegisterVblankHandler(uint32_t pipe);
 
   bool IsDrmInTUI();
 
@@ -120,6 +133,7 @@ class DrmEventListener : public Worker {
   void DRMEventHandler();
   void TUIEventHandler();
   void SysfsEventHandler(int fd);
+  void VblankEventHandler(struct drm_event_vblank *vblank);
 
   UniqueFd epoll_fd_;
   UniqueFd uevent_fd_;
@@ -133,6 +147,7 @@ class DrmEventListener : public Worker {
   std::unique_ptr<DrmPanelIdleEventHandler> panel_idle_handler_;
   std::mutex mutex_;
   std::map<int, std::shared_ptr<DrmSysfsEventHandler>> sysfs_handlers_;
+  std::map<uint32_t, std::shared_ptr<DrmVblankEventHandler>> vblank_handlers_;
 };
 
 }  // namespace android
@@ -34,6 +34,40 @@ enum DrmPropertyType {
   DRM_PROPERTY_TYPE_INVALID,
 };
 
+// Id and validation limits of a property, computed once so per-frame paths
+// can check a value without walking the property's value list.
+struct DrmPropertyDescriptor {
+  enum Check : uint8_t {
+    CHECK_NONE,
+    CHECK_IMMUTABLE,
+    CHECK_RANGE,
+    CHECK_SIGNED_RANGE,
+    CHECK_BITMASK,
+  };
+
+  uint32_t id = 0;
+  Check check = CHECK_NONE;
+  uint64_t min = 0;
+  uint64_t max = 0;
+  uint64_t valid_mask = 0;
+
+  bool validate(uint64_t value) const {
+    switch (check) {
+      case CHECK_IMMUTABLE:
+        return false;
+      case CHECK_RANGE:
+        return value >= min && value <= max;
+      case CHECK_SIGNED_RANGE:
+        return static_cast<int64_t>(value) >= static_cast<int64_t>(min) &&
+               static_cast<int64_t>(value) <= static_cast<int64_t>(max);
+      case CHECK_BITMASK:
+        return !(value & ~valid_mask);
+      default:
+        return true;
+    }
+  }
+};
+
 class DrmProperty {
  public:
   DrmProperty() = default;
@@ -61,7 +95,13 @@ class DrmProperty {
   void updateValue(const uint64_t value);
   void printProperty() const;
 
+  const DrmPropertyDescriptor &descriptor() const {
+    return descriptor_;
+  }
+
  private:
+  void updateDescriptor();
+
   class DrmPropertyEnum {
    public:
     DrmPropertyEnum(drm_mode_property_enum *e);
@@ -81,6 +121,8 @@ class DrmProperty {
   std::vector<uint64_t> values_;
   std::vector<DrmPropertyEnum> enums_;
   std::vector<uint32_t> blob_ids_;
+
+  DrmPropertyDescriptor descriptor_;
 };
 
 class DrmEnumParser {
@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_DRM_VSYNC_MODEL_H_
+#define ANDROID_DRM_VSYNC_MODEL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <array>
+
+namespace android {
+
+// Fits vsync period and phase to the last hardware vsync timestamps with a
+// least squares line over (vsync index, timestamp), so a single late or early
+// timestamp only nudges the grid instead of shifting it.
+//
+// Samples are indexed by the number of nominal periods since the previous
+// one, missed vsyncs are fine. A nominal period change or a sample off the
+// fitted grid by more than a quarter period restarts the fit. Not thread
+// safe.
+class VsyncModel {
+ public:
+  static constexpr size_t kWindowSize = 32;
+  static constexpr size_t kMinSamples = 6;
+  // Predictions further than this from the last sample are not trusted.
+  static constexpr int64_t kMaxExtrapolationNs = 1000000000;  // 1 s
+
+  // Returns false when the sample was dropped (duplicate or out of order).
+  bool AddSample(int64_t timestamp_ns, int64_t nominal_period_ns);
+  void Reset();
+
+  bool IsLocked() const { return count_ >= kMinSamples; }
+  // Fitted period, or the nominal one until the model is locked.
+  int64_t period_ns() const;
+
+  // First modelled vsync at or after after_ns. Returns false until the model
+  // is locked or when after_ns is too far from the last sample.
+  bool PredictNext(int64_t after_ns, int64_t *vsync_ns) const;
+
+ private:
+  struct Sample {
+    int64_t index;
+    int64_t timestamp_ns;
+  };
+
+  void Fit();
+  double ModelTime(int64_t index) const;
+
+  std::array<Sample, kWindowSize> samples_;
+  size_t head_ = 0;  // oldest sample
+  size_t count_ = 0;
+  int64_t nominal_period_ns_ = 0;
+  int64_t last_index_ = 0;
+  int64_t last_timestamp_ns_ = 0;
+
+  // t(index) = origin_ns_ + (index - origin_index_) * fitted_period_ns_
+  int64_t origin_index_ = 0;
+  int64_t origin_ns_ = 0;
+  double fitted_period_ns_ = 0;
+  double fitted_offset_ns_ = 0;
+};
+
+}  // namespace android
+
+#endif  // ANDROID_DRM_VSYNC_MODEL_H_
@@ -23,8 +23,10 @@
 #include <utils/String8.h>
 
 #include <map>
+#include <mutex>
 
 #include "drmdevice.h"
+#include "vsyncmodel.h"
 #include "worker.h"
 
 namespace android {
@@ -40,15 +42,44 @@ class VSyncWorker : public Worker {
         VSyncWorker();
         ~VSyncWorker() override;
 
-        int Init(DrmDevice* drm, int display, const String8& displayTraceName);
+        // With useVblankEvents every vsync is requested as a DRM_VBLANK_EVENT
+        // and delivered on the DrmEventListener thread, so no thread blocks in
+        // drmWaitVBlank. The worker thread is only started once the driver
+        // refuses the request, it polls the vblanks until the events are back.
+        int Init(DrmDevice* drm, int display, const String8& displayTraceName,
+                 bool useVblankEvents = false);
         void RegisterCallback(std::shared_ptr<VsyncCallback> callback);
 
         void VSyncControl(bool enabled);
 
+        // First vsync at or after afterNs on the grid fitted to the hardware
+        // vsync timestamps. Safe to call from any thread.
+        bool GetPredictedVSync(int64_t afterNs, int64_t* vsyncNs);
+
     protected:
         void Routine() override;
 
     private:
+        // Outlives the worker in the event listener, so events still in flight
+        // at destruction find it detached.
+        class VblankEventHandler : public DrmVblankEventHandler {
+            public:
+                explicit VblankEventHandler(VSyncWorker* worker) : mWorker(worker) {}
+                void handleVblankEvent(uint32_t sequence, int64_t timestampNs) override;
+                void Detach();
+
+            private:
+                std::mutex mMutex;
+                VSyncWorker* mWorker; // GUARDED_BY(mMutex)
+        };
+
+        int RequestVBlankEventLocked();
+        void RetryVBlankEventsLocked(int64_t nowNs);
+        void OnVBlankEvent(int64_t timestampNs);
+        void AddModelSample(int64_t timestampNs);
+        void DeliverVSync(int display, const std::shared_ptr<VsyncCallback>& callback,
+                          int64_t timestampNs);
+        uint32_t GetVSyncPeriod();
         int GetPhasedVSync(uint32_t vsyncPeriodNs, int64_t& expectTimeNs);
         int SyntheticWaitVBlank(int64_t& timestamp);
 
@@ -65,6 +96,17 @@ class VSyncWorker : public Worker {
         String8 mHwVsyncPeriodTag;
         String8 mHwVsyncEnabledTag;
         String8 mDisplayTraceName;
+
+        bool mVblankEventsSupported;
+        std::atomic_bool mUseVblankEvents;
+        std::shared_ptr<VblankEventHandler> mVblankEventHandler;
+        bool mVblankEventPending; // GUARDED_BY(mutex_)
+        int mVblankEventPipe; // GUARDED_BY(mutex_)
+        // the polling fallback tries vblank events again from then on
+        int64_t mVblankEventRetryNs; // GUARDED_BY(mutex_)
+
+        std::mutex mModelMutex;
+        VsyncModel mModel; // GUARDED_BY(mModelMutex)
 };
 }  // namespace android
 
@@ -0,0 +1,262 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+
+#include <memory>
+#include <vector>
+
+#include "drmblobcache.h"
+#include "drmconnector.h"
+#include "drmcrtc.h"
+#include "drmdevice.h"
+#include "drmplane.h"
+#include "fakedrm.h"
+
+namespace android {
+
+// One DSI panel with a 60Hz and a 120Hz mode, driven by one crtc and two
+// planes.
+static const char kPanelDescription[] = R"({
+  "crtcs": [{
+    "id": 10,
+    "properties": [
+      {"id": 100, "name": "ACTIVE", "type": "range", "values": [0, 1]},
+      {"id": 101, "name": "MODE_ID", "type": "blob"},
+      {"id": 102, "name": "OUT_FENCE_PTR", "type": "range", "values": [0, 18446744073709551615]}
+    ]
+  }],
+  "encoders": [{"id": 20, "crtc_id": 10, "possible_crtcs": 1}],
+  "connectors": [{
+    "id": 30, "type": 16, "encoder_id": 20, "encoders": [20], "connected": true,
+    "mm_width": 70, "mm_height": 155,
+    "modes": [
+      {"clock": 180000, "hdisplay": 1080, "hsync_start": 1100, "hsync_end": 1110,
+       "htotal": 1200, "vdisplay": 2400, "vsync_start": 2420, "vsync_end": 2430,
+       "vtotal": 2500, "vrefresh": 60, "type": 8},
+      {"clock": 360000, "hdisplay": 1080, "hsync_start": 1100, "hsync_end": 1110,
+       "htotal": 1200, "vdisplay": 2400, "vsync_start": 2420, "vsync_end": 2430,
+       "vtotal": 2500, "vrefresh": 120}
+    ],
+    "properties": [
+      {"id": 300, "name": "DPMS", "type": "enum", "enums": ["On", "Standby", "Suspend", "Off"]},
+      {"id": 301, "name": "CRTC_ID", "type": "object", "value": 10}
+    ]
+  }],
+  "planes": [{
+    "id": 40, "possible_crtcs": 1, "formats": [875713089, 875708993],
+    "properties": [
+      {"id": 400, "name": "type", "type": "enum", "immutable": true,
+       "enums": ["Overlay", "Primary", "Cursor"], "value": 1},
+      {"id": 401, "name": "CRTC_ID", "type": "object"},
+      {"id": 402, "name": "FB_ID", "type": "object"},
+      {"id": 403, "name": "CRTC_X", "type": "signed_range", "values": [-2147483648, 2147483647]},
+      {"id": 404, "name": "CRTC_Y", "type": "signed_range", "values": [-2147483648, 2147483647]},
+      {"id": 405, "name": "CRTC_W", "type": "range", "values": [0, 2147483647]},
+      {"id": 406, "name": "CRTC_H", "type": "range", "values": [0, 2147483647]},
+      {"id": 407, "name": "SRC_X", "type": "range", "values": [0, 4294967295]},
+      {"id": 408, "name": "SRC_Y", "type": "range", "values": [0, 4294967295]},
+      {"id": 409, "name": "SRC_W", "type": "range", "values": [0, 4294967295]},
+      {"id": 410, "name": "SRC_H", "type": "range", "values": [0, 4294967295]},
+      {"id": 411, "name": "zpos", "type": "range", "immutable": true, "values": [0, 0]},
+      {"id": 412, "name": "rotation", "type": "bitmask", "values": [0, 2, 4, 5], "value": 1},
+      {"id": 413, "name": "alpha", "type": "range", "values": [0, 65535], "value": 65535}
+    ]
+  }, {
+    "id": 41, "possible_crtcs": 1, "formats": [875713089],
+    "properties": [
+      {"name": "type", "type": "enum", "immutable": true,
+       "enums": ["Overlay", "Primary", "Cursor"], "value": 0},
+      {"name": "CRTC_ID", "type": "object"},
+      {"name": "FB_ID", "type": "object"},
+      {"name": "CRTC_X", "type": "signed_range", "values": [-2147483648, 2147483647]},
+      {"name": "CRTC_Y", "type": "signed_range", "values": [-2147483648, 2147483647]},
+      {"name": "CRTC_W", "type": "range", "values": [0, 2147483647]},
+      {"name": "CRTC_H", "type": "range", "values": [0, 2147483647]},
+      {"name": "SRC_X", "type": "range", "values": [0, 4294967295]},
+      {"name": "SRC_Y", "type": "range", "values": [0, 4294967295]},
+      {"name": "SRC_W", "type": "range", "values": [0, 4294967295]},
+      {"name": "SRC_H", "type": "range", "values": [0, 4294967295]},
+      {"name": "zpos", "type": "range", "immutable": true, "values": [1, 1], "value": 1}
+    ]
+  }]
+})";
+
+class DrmResourceTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    ASSERT_EQ(0, fake_drm_.LoadFromString(kPanelDescription));
+    int ret;
+    std::tie(ret, num_displays_) = drm_.Init(fake_drm_.node_path().c_str(), 0);
+    ASSERT_EQ(0, ret);
+  }
+
+  // declared first so it outlives the DrmDevice using it
+  FakeDrmDevice fake_drm_;
+  DrmDevice drm_;
+  int num_displays_ = 0;
+};
+
+TEST_F(DrmResourceTest, EnumeratesResources) {
+  EXPECT_EQ(1, num_displays_);
+  ASSERT_EQ(1u, drm_.crtcs().size());
+  ASSERT_EQ(2u, drm_.planes().size());
+
+  DrmConnector *connector = drm_.GetConnectorForDisplay(0);
+  ASSERT_NE(nullptr, connector);
+  EXPECT_EQ(30u, connector->id());
+  EXPECT_TRUE(connector->internal());
+
+  DrmCrtc *crtc = drm_.GetCrtcForDisplay(0);
+  ASSERT_NE(nullptr, crtc);
+  EXPECT_EQ(10u, crtc->id());
+  EXPECT_EQ(100u, crtc->active_property().id());
+  EXPECT_EQ(101u, crtc->mode_property().id());
+
+  DrmPlane *primary = drm_.GetPlane(40);
+  ASSERT_NE(nullptr, primary);
+  EXPECT_EQ(static_cast<uint32_t>(DRM_PLANE_TYPE_PRIMARY), primary->type());
+  DrmPlane *overlay = drm_.GetPlane(41);
+  ASSERT_NE(nullptr, overlay);
+  EXPECT_EQ(static_cast<uint32_t>(DRM_PLANE_TYPE_OVERLAY), overlay->type());
+}
+
+TEST_F(DrmResourceTest, ParsesModes) {
+  DrmConnector *connector = drm_.GetConnectorForDisplay(0);
+  ASSERT_NE(nullptr, connector);
+  EXPECT_EQ(1, connector->UpdateModes());
+  ASSERT_EQ(2u, connector->modes().size());
+
+  const DrmMode &mode_60 = connector->modes()[0];
+  const DrmMode &mode_120 = connector->modes()[1];
+  EXPECT_NEAR(60.0f, mode_60.v_refresh(), 0.01f);
+  EXPECT_NEAR(120.0f, mode_120.v_refresh(), 0.01f);
+  EXPECT_NEAR(16666666.0f, mode_60.te_period(), 2.0f);
+  EXPECT_EQ(mode_60.id(), connector->get_preferred_mode_id());
+
+  // Nothing changed, the modes are kept
+  EXPECT_EQ(0, connector->UpdateModes());
+
+  fake_drm_.SetConnection(30, false);
+  EXPECT_EQ(1, connector->UpdateModes());
+  EXPECT_TRUE(connector->modes().empty());
+}
+
+TEST_F(DrmResourceTest, ValidatesPropertyChanges) {
+  DrmPlane *primary = drm_.GetPlane(40);
+  ASSERT_NE(nullptr, primary);
+
+  EXPECT_TRUE(primary->alpha_property().validateChange(0));
+  EXPECT_TRUE(primary->alpha_property().validateChange(65535));
+  EXPECT_FALSE(primary->alpha_property().validateChange(65536));
+
+  // bits 0, 2, 4 and 5 are valid rotations
+  EXPECT_TRUE(primary->rotation_property().validateChange(0x1));
+  EXPECT_TRUE(primary->rotation_property().validateChange(0x35));
+  EXPECT_FALSE(primary->rotation_property().validateChange(0x2));
+
+  EXPECT_FALSE(primary->zpos_property().validateChange(0));
+
+  const DrmPropertyDescriptor &rotation = primary->rotation_property().descriptor();
+  EXPECT_EQ(412u, rotation.id);
+  EXPECT_EQ(DrmPropertyDescriptor::CHECK_BITMASK, rotation.check);
+  EXPECT_EQ(0x35u, rotation.valid_mask);
+  EXPECT_FALSE(rotation.validate(0x2));
+
+  const DrmPropertyDescriptor &crtc_x = primary->crtc_x_property().descriptor();
+  EXPECT_EQ(DrmPropertyDescriptor::CHECK_SIGNED_RANGE, crtc_x.check);
+  EXPECT_TRUE(crtc_x.validate(static_cast<uint64_t>(-16)));
+}
+
+TEST_F(DrmResourceTest, CommitsAtomicRequests) {
+  DrmPlane *primary = drm_.GetPlane(40);
+  ASSERT_NE(nullptr, primary);
+
+  drmModeAtomicReqPtr pset = drmModeAtomicAlloc();
+  ASSERT_NE(nullptr, pset);
+  EXPECT_LT(0, drmModeAtomicAddProperty(pset, primary->id(),
+                                        primary->crtc_property().id(), 10));
+  EXPECT_LT(0, drmModeAtomicAddProperty(pset, primary->id(),
+                                        primary->alpha_property().id(), 0x8000));
+
+  EXPECT_EQ(0, drmModeAtomicCommit(drm_.fd(), pset, DRM_MODE_ATOMIC_TEST_ONLY, nullptr));
+  EXPECT_EQ(65535u, fake_drm_.property_value(40, "alpha"));
+
+  EXPECT_EQ(0, drmModeAtomicCommit(drm_.fd(), pset, DRM_MODE_ATOMIC_NONBLOCK, nullptr));
+  EXPECT_EQ(0x8000u, fake_drm_.property_value(40, "alpha"));
+  EXPECT_EQ(10u, fake_drm_.property_value(40, "CRTC_ID"));
+
+  auto commits = fake_drm_.commits();
+  ASSERT_EQ(2u, commits.size());
+  EXPECT_EQ(static_cast<uint32_t>(DRM_MODE_ATOMIC_TEST_ONLY), commits[0].flags);
+  EXPECT_EQ(2u, commits[1].items.size());
+
+  fake_drm_.FailNextCommit(EINVAL);
+  EXPECT_EQ(-EINVAL, drmModeAtomicCommit(drm_.fd(), pset, 0, nullptr));
+  EXPECT_EQ(2u, fake_drm_.commits().size());
+
+  drmModeAtomicFree(pset);
+}
+
+TEST_F(DrmResourceTest, SharesCachedBlobs) {
+  std::vector<uint8_t> mode(32, 0x5a);
+  uint32_t first = 0, second = 0;
+
+  ASSERT_EQ(0, drm_.AcquirePropertyBlob(mode.data(), mode.size(), &first));
+  ASSERT_EQ(0, drm_.AcquirePropertyBlob(mode.data(), mode.size(), &second));
+  EXPECT_EQ(first, second);
+  EXPECT_EQ(1u, fake_drm_.create_blob_calls());
+
+  // Released blobs stay alive within the budget
+  EXPECT_EQ(0, drm_.ReleasePropertyBlob(first));
+  EXPECT_EQ(0, drm_.ReleasePropertyBlob(second));
+  EXPECT_EQ(1u, fake_drm_.blob_count());
+  ASSERT_EQ(0, drm_.AcquirePropertyBlob(mode.data(), mode.size(), &second));
+  EXPECT_EQ(first, second);
+  EXPECT_EQ(1u, fake_drm_.create_blob_calls());
+  EXPECT_EQ(0, drm_.ReleasePropertyBlob(second));
+
+  // Blobs created outside of the cache are destroyed on release
+  uint32_t uncached = 0;
+  ASSERT_EQ(0, drm_.CreatePropertyBlob(mode.data(), mode.size(), &uncached));
+  EXPECT_EQ(0, drm_.ReleasePropertyBlob(uncached));
+  EXPECT_EQ(nullptr, fake_drm_.blob(uncached));
+  EXPECT_EQ(1u, fake_drm_.destroy_blob_calls());
+}
+
+TEST_F(DrmResourceTest, EvictsIdleBlobsOverBudget) {
+  DrmBlobCache cache(&drm_, 64);
+  std::vector<uint8_t> small(32, 0x1), large(48, 0x2);
+  uint32_t small_id = 0, large_id = 0;
+
+  ASSERT_EQ(0, cache.Acquire(small.data(), small.size(), &small_id));
+  ASSERT_EQ(0, cache.Acquire(large.data(), large.size(), &large_id));
+  EXPECT_EQ(0, cache.Release(small_id));
+  EXPECT_EQ(0u, fake_drm_.destroy_blob_calls());
+
+  // 80 idle bytes exceed the budget, the least recently released goes
+  EXPECT_EQ(0, cache.Release(large_id));
+  EXPECT_EQ(1u, fake_drm_.destroy_blob_calls());
+  EXPECT_EQ(nullptr, fake_drm_.blob(small_id));
+  ASSERT_NE(nullptr, fake_drm_.blob(large_id));
+
+  EXPECT_EQ(-ENOENT, cache.Release(small_id));
+}
+
+}  // namespace android
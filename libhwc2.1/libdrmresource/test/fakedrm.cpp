@@ -0,0 +1,854 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "hwc-fake-drm"
+
+#include "fakedrm.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#include <json/json.h>
+#include <log/log.h>
+
+// Same layout as libdrm, ExynosDisplayDrmInterface peeks into the items
+struct _drmModeAtomicReqItem {
+  uint32_t object_id;
+  uint32_t property_id;
+  uint64_t value;
+};
+
+struct _drmModeAtomicReq {
+  uint32_t cursor;
+  uint32_t size_items;
+  struct _drmModeAtomicReqItem *items;
+};
+
+namespace android {
+
+FakeDrmDevice *FakeDrmDevice::active_ = nullptr;
+
+namespace {
+
+template <typename T>
+T *CopyArray(const std::vector<T> &v) {
+  if (v.empty())
+    return nullptr;
+  T *out = static_cast<T *>(calloc(v.size(), sizeof(T)));
+  memcpy(out, v.data(), v.size() * sizeof(T));
+  return out;
+}
+
+uint32_t PropertyFlags(const std::string &type) {
+  if (type == "range")
+    return DRM_MODE_PROP_RANGE;
+  if (type == "signed_range")
+    return DRM_MODE_PROP_SIGNED_RANGE;
+  if (type == "enum")
+    return DRM_MODE_PROP_ENUM;
+  if (type == "bitmask")
+    return DRM_MODE_PROP_BITMASK;
+  if (type == "blob")
+    return DRM_MODE_PROP_BLOB;
+  if (type == "object")
+    return DRM_MODE_PROP_OBJECT;
+  return 0;
+}
+
+void ParseMode(const Json::Value &value, drmModeModeInfo *mode) {
+  memset(mode, 0, sizeof(*mode));
+  mode->clock = value["clock"].asUInt();
+  mode->hdisplay = value["hdisplay"].asUInt();
+  mode->hsync_start = value["hsync_start"].asUInt();
+  mode->hsync_end = value["hsync_end"].asUInt();
+  mode->htotal = value["htotal"].asUInt();
+  mode->hskew = value["hskew"].asUInt();
+  mode->vdisplay = value["vdisplay"].asUInt();
+  mode->vsync_start = value["vsync_start"].asUInt();
+  mode->vsync_end = value["vsync_end"].asUInt();
+  mode->vtotal = value["vtotal"].asUInt();
+  mode->vscan = value["vscan"].asUInt();
+  mode->vrefresh = value["vrefresh"].asUInt();
+  mode->flags = value["flags"].asUInt();
+  mode->type = value["type"].asUInt();
+  std::string name = value["name"].asString();
+  if (name.empty())
+    name = std::to_string(mode->hdisplay) + "x" + std::to_string(mode->vdisplay);
+  strncpy(mode->name, name.c_str(), DRM_DISPLAY_MODE_LEN - 1);
+}
+
+}  // namespace
+
+FakeDrmDevice::FakeDrmDevice() {
+  if (pipe2(pipe_fds_, O_CLOEXEC)) {
+    ALOGE("Failed to create fake drm node: %s", strerror(errno));
+  } else {
+    node_path_ = "/proc/self/fd/" + std::to_string(pipe_fds_[0]);
+  }
+  active_ = this;
+}
+
+FakeDrmDevice::~FakeDrmDevice() {
+  if (active_ == this)
+    active_ = nullptr;
+  for (int fd : pipe_fds_) {
+    if (fd >= 0)
+      close(fd);
+  }
+}
+
+FakeDrmDevice *FakeDrmDevice::Active() {
+  return active_;
+}
+
+int FakeDrmDevice::LoadFromFile(const std::string &path) {
+  std::ifstream in(path);
+  if (!in) {
+    ALOGE("Failed to open %s", path.c_str());
+    return -ENOENT;
+  }
+  std::stringstream buf;
+  buf << in.rdbuf();
+  return LoadFromString(buf.str());
+}
+
+int FakeDrmDevice::ParseProperties(const Json::Value &value, Object *object) {
+  for (const auto &p : value) {
+    Property prop;
+    prop.id = p.isMember("id") ? p["id"].asUInt() : next_property_id_++;
+    prop.name = p["name"].asString();
+    prop.flags = PropertyFlags(p["type"].asString());
+    if (!prop.flags) {
+      ALOGE("Unknown type of property %s", prop.name.c_str());
+      return -EINVAL;
+    }
+    if (p["immutable"].asBool())
+      prop.flags |= DRM_MODE_PROP_IMMUTABLE;
+    prop.value = p["value"].asUInt64();
+    for (const auto &v : p["values"])
+      prop.values.push_back(v.isInt64() ? static_cast<uint64_t>(v.asInt64())
+                                        : v.asUInt64());
+    // enums are listed in the order of their value, as the kernel does
+    for (const auto &e : p["enums"]) {
+      uint64_t v = prop.enums.size();
+      prop.enums.emplace_back(e.asString(), v);
+      if (prop.flags & DRM_MODE_PROP_ENUM)
+        prop.values.push_back(v);
+    }
+    object->properties.push_back(std::move(prop));
+  }
+  return 0;
+}
+
+int FakeDrmDevice::LoadFromString(const std::string &description) {
+  Json::Value root;
+  Json::CharReaderBuilder builder;
+  std::string errors;
+  std::istringstream in(description);
+  if (!Json::parseFromStream(builder, in, &root, &errors)) {
+    ALOGE("Failed to parse fake drm description: %s", errors.c_str());
+    return -EINVAL;
+  }
+
+  std::lock_guard<std::mutex> lock(lock_);
+  crtcs_.clear();
+  encoders_.clear();
+  connectors_.clear();
+  planes_.clear();
+
+  if (root.isMember("max_width"))
+    max_width_ = root["max_width"].asUInt();
+  if (root.isMember("max_height"))
+    max_height_ = root["max_height"].asUInt();
+
+  int ret = 0;
+  for (const auto &c : root["crtcs"]) {
+    Crtc crtc;
+    crtc.id = c["id"].asUInt();
+    crtc.type = DRM_MODE_OBJECT_CRTC;
+    if ((ret = ParseProperties(c["properties"], &crtc)))
+      return ret;
+    crtcs_.push_back(std::move(crtc));
+  }
+
+  for (const auto &e : root["encoders"]) {
+    Encoder encoder;
+    encoder.id = e["id"].asUInt();
+    encoder.crtc_id = e["crtc_id"].asUInt();
+    encoder.type = e["type"].asUInt();
+    encoder.possible_crtcs = e["possible_crtcs"].asUInt();
+    encoder.possible_clones = e["possible_clones"].asUInt();
+    encoders_.push_back(encoder);
+  }
+
+  for (const auto &c : root["connectors"]) {
+    Connector conn;
+    conn.id = c["id"].asUInt();
+    conn.type = DRM_MODE_OBJECT_CONNECTOR;
+    conn.connector_type = c["type"].asUInt();
+    conn.connector_type_id = c.get("type_id", 1).asUInt();
+    conn.encoder_id = c["encoder_id"].asUInt();
+    conn.connected = c["connected"].asBool();
+    conn.mm_width = c["mm_width"].asUInt();
+    conn.mm_height = c["mm_height"].asUInt();
+    for (const auto &e : c["encoders"])
+      conn.encoders.push_back(e.asUInt());
+    for (const auto &m : c["modes"]) {
+      drmModeModeInfo mode;
+      ParseMode(m, &mode);
+      conn.modes.push_back(mode);
+    }
+    if ((ret = ParseProperties(c["properties"], &conn)))
+      return ret;
+    connectors_.push_back(std::move(conn));
+  }
+
+  for (const auto &p : root["planes"]) {
+    Plane plane;
+    plane.id = p["id"].asUInt();
+    plane.type = DRM_MODE_OBJECT_PLANE;
+    plane.crtc_id = p["crtc_id"].asUInt();
+    plane.possible_crtcs = p["possible_crtcs"].asUInt();
+    for (const auto &f : p["formats"])
+      plane.formats.push_back(f.asUInt());
+    if ((ret = ParseProperties(p["properties"], &plane)))
+      return ret;
+    planes_.push_back(std::move(plane));
+  }
+  return 0;
+}
+
+void FakeDrmDevice::SetConnection(uint32_t connector_id, bool connected) {
+  std::lock_guard<std::mutex> lock(lock_);
+  for (auto &conn : connectors_) {
+    if (conn.id == connector_id)
+      conn.connected = connected;
+  }
+}
+
+std::vector<FakeDrmDevice::CommitRecord> FakeDrmDevice::commits() const {
+  std::lock_guard<std::mutex> lock(lock_);
+  return commits_;
+}
+
+void FakeDrmDevice::ClearCommits() {
+  std::lock_guard<std::mutex> lock(lock_);
+  commits_.clear();
+}
+
+uint64_t FakeDrmDevice::property_value(uint32_t object_id,
+                                       const std::string &name) const {
+  std::lock_guard<std::mutex> lock(lock_);
+  const Object *object = FindObjectLocked(object_id);
+  if (!object)
+    return 0;
+  for (const auto &prop : object->properties) {
+    if (prop.name == name)
+      return prop.value;
+  }
+  return 0;
+}
+
+const std::vector<uint8_t> *FakeDrmDevice::blob(uint32_t blob_id) const {
+  std::lock_guard<std::mutex> lock(lock_);
+  auto it = blobs_.find(blob_id);
+  return it == blobs_.end() ? nullptr : &it->second;
+}
+
+size_t FakeDrmDevice::blob_count() const {
+  std::lock_guard<std::mutex> lock(lock_);
+  return blobs_.size();
+}
+
+FakeDrmDevice::Object *FakeDrmDevice::FindObjectLocked(uint32_t id) {
+  return const_cast<Object *>(
+      static_cast<const FakeDrmDevice *>(this)->FindObjectLocked(id));
+}
+
+const FakeDrmDevice::Object *FakeDrmDevice::FindObjectLocked(uint32_t id) const {
+  for (const auto &crtc : crtcs_) {
+    if (crtc.id == id)
+      return &crtc;
+  }
+  for (const auto &conn : connectors_) {
+    if (conn.id == id)
+      return &conn;
+  }
+  for (const auto &plane : planes_) {
+    if (plane.id == id)
+      return &plane;
+  }
+  return nullptr;
+}
+
+const FakeDrmDevice::Property *FakeDrmDevice::FindPropertyLocked(uint32_t id) const {
+  auto find = [id](const Object &object) -> const Property * {
+    for (const auto &prop : object.properties) {
+      if (prop.id == id)
+        return &prop;
+    }
+    return nullptr;
+  };
+  const Property *prop = nullptr;
+  for (const auto &crtc : crtcs_) {
+    if ((prop = find(crtc)))
+      return prop;
+  }
+  for (const auto &conn : connectors_) {
+    if ((prop = find(conn)))
+      return prop;
+  }
+  for (const auto &plane : planes_) {
+    if ((prop = find(plane)))
+      return prop;
+  }
+  return nullptr;
+}
+
+drmModeResPtr FakeDrmDevice::GetResources() {
+  std::lock_guard<std::mutex> lock(lock_);
+  std::vector<uint32_t> crtcs, encoders, connectors;
+  for (const auto &crtc : crtcs_)
+    crtcs.push_back(crtc.id);
+  for (const auto &encoder : encoders_)
+    encoders.push_back(encoder.id);
+  for (const auto &conn : connectors_)
+    connectors.push_back(conn.id);
+
+  auto res = static_cast<drmModeResPtr>(calloc(1, sizeof(drmModeRes)));
+  res->count_crtcs = crtcs.size();
+  res->crtcs = CopyArray(crtcs);
+  res->count_encoders = encoders.size();
+  res->encoders = CopyArray(encoders);
+  res->count_connectors = connectors.size();
+  res->connectors = CopyArray(connectors);
+  res->min_width = min_width_;
+  res->min_height = min_height_;
+  res->max_width = max_width_;
+  res->max_height = max_height_;
+  return res;
+}
+
+drmModePlaneResPtr FakeDrmDevice::GetPlaneResources() {
+  std::lock_guard<std::mutex> lock(lock_);
+  std::vector<uint32_t> planes;
+  for (const auto &plane : planes_)
+    planes.push_back(plane.id);
+
+  auto res = static_cast<drmModePlaneResPtr>(calloc(1, sizeof(drmModePlaneRes)));
+  res->count_planes = planes.size();
+  res->planes = CopyArray(planes);
+  return res;
+}
+
+drmModeCrtcPtr FakeDrmDevice::GetCrtc(uint32_t id) {
+  std::lock_guard<std::mutex> lock(lock_);
+  for (const auto &crtc : crtcs_) {
+    if (crtc.id != id)
+      continue;
+    auto c = static_cast<drmModeCrtcPtr>(calloc(1, sizeof(drmModeCrtc)));
+    c->crtc_id = id;
+    c->mode = crtc.mode;
+    c->mode_valid = crtc.mode.clock != 0;
+    c->width = crtc.mode.hdisplay;
+    c->height = crtc.mode.vdisplay;
+    return c;
+  }
+  errno = ENOENT;
+  return nullptr;
+}
+
+drmModeEncoderPtr FakeDrmDevice::GetEncoder(uint32_t id) {
+  std::lock_guard<std::mutex> lock(lock_);
+  for (const auto &encoder : encoders_) {
+    if (encoder.id != id)
+      continue;
+    auto e = static_cast<drmModeEncoderPtr>(calloc(1, sizeof(drmModeEncoder)));
+    e->encoder_id = id;
+    e->encoder_type = encoder.type;
+    e->crtc_id = encoder.crtc_id;
+    e->possible_crtcs = encoder.possible_crtcs;
+    e->possible_clones = encoder.possible_clones;
+    return e;
+  }
+  errno = ENOENT;
+  return nullptr;
+}
+
+drmModeConnectorPtr FakeDrmDevice::GetConnector(uint32_t id) {
+  std::lock_guard<std::mutex> lock(lock_);
+  for (const auto &conn : connectors_) {
+    if (conn.id != id)
+      continue;
+    std::vector<uint32_t> props;
+    std::vector<uint64_t> values;
+    for (const auto &prop : conn.properties) {
+      props.push_back(prop.id);
+      values.push_back(prop.value);
+    }
+
+    auto c = static_cast<drmModeConnectorPtr>(calloc(1, sizeof(drmModeConnector)));
+    c->connector_id = id;
+    c->encoder_id = conn.encoder_id;
+    c->connector_type = conn.connector_type;
+    c->connector_type_id = conn.connector_type_id;
+    c->connection = conn.connected ? DRM_MODE_CONNECTED : DRM_MODE_DISCONNECTED;
+    c->mmWidth = conn.mm_width;
+    c->mmHeight = conn.mm_height;
+    if (conn.connected) {
+      c->count_modes = conn.modes.size();
+      c->modes = CopyArray(conn.modes);
+    }
+    c->count_props = props.size();
+    c->props = CopyArray(props);
+    c->prop_values = CopyArray(values);
+    c->count_encoders = conn.encoders.size();
+    c->encoders = CopyArray(conn.encoders);
+    return c;
+  }
+  errno = ENOENT;
+  return nullptr;
+}
+
+drmModePlanePtr FakeDrmDevice::GetPlane(uint32_t id) {
+  std::lock_guard<std::mutex> lock(lock_);
+  for (const auto &plane : planes_) {
+    if (plane.id != id)
+      continue;
+    auto p = static_cast<drmModePlanePtr>(calloc(1, sizeof(drmModePlane)));
+    p->plane_id = id;
+    p->crtc_id = plane.crtc_id;
+    p->possible_crtcs = plane.possible_crtcs;
+    p->count_formats = plane.formats.size();
+    p->formats = CopyArray(plane.formats);
+    return p;
+  }
+  errno = ENOENT;
+  return nullptr;
+}
+
+drmModeObjectPropertiesPtr FakeDrmDevice::GetObjectProperties(uint32_t id,
+                                                              uint32_t type) {
+  std::lock_guard<std::mutex> lock(lock_);
+  const Object *object = FindObjectLocked(id);
+  if (!object || object->type != type) {
+    errno = ENOENT;
+    return nullptr;
+  }
+
+  std::vector<uint32_t> props;
+  std::vector<uint64_t> values;
+  for (const auto &prop : object->properties) {
+    props.push_back(prop.id);
+    values.push_back(prop.value);
+  }
+  auto p = static_cast<drmModeObjectPropertiesPtr>(
+      calloc(1, sizeof(drmModeObjectProperties)));
+  p->count_props = props.size();
+  p->props = CopyArray(props);
+  p->prop_values = CopyArray(values);
+  return p;
+}
+
+drmModePropertyPtr FakeDrmDevice::GetProperty(uint32_t id) {
+  std::lock_guard<std::mutex> lock(lock_);
+  const Property *prop = FindPropertyLocked(id);
+  if (!prop) {
+    errno = ENOENT;
+    return nullptr;
+  }
+
+  auto p = static_cast<drmModePropertyPtr>(calloc(1, sizeof(drmModePropertyRes)));
+  p->prop_id = prop->id;
+  p->flags = prop->flags;
+  strncpy(p->name, prop->name.c_str(), DRM_PROP_NAME_LEN - 1);
+  p->count_values = prop->values.size();
+  p->values = CopyArray(prop->values);
+  if (!prop->enums.empty()) {
+    p->count_enums = prop->enums.size();
+    p->enums = static_cast<struct drm_mode_property_enum *>(
+        calloc(prop->enums.size(), sizeof(struct drm_mode_property_enum)));
+    for (size_t i = 0; i < prop->enums.size(); i++) {
+      p->enums[i].value = prop->enums[i].second;
+      strncpy(p->enums[i].name, prop->enums[i].first.c_str(),
+              DRM_PROP_NAME_LEN - 1);
+    }
+  }
+  return p;
+}
+
+drmModePropertyBlobPtr FakeDrmDevice::GetPropertyBlob(uint32_t id) {
+  std::lock_guard<std::mutex> lock(lock_);
+  auto it = blobs_.find(id);
+  if (it == blobs_.end()) {
+    errno = ENOENT;
+    return nullptr;
+  }
+
+  auto b = static_cast<drmModePropertyBlobPtr>(
+      calloc(1, sizeof(drmModePropertyBlobRes)));
+  b->id = id;
+  b->length = it->second.size();
+  b->data = CopyArray(it->second);
+  return b;
+}
+
+int FakeDrmDevice::Ioctl(unsigned long request, void *arg) {
+  std::lock_guard<std::mutex> lock(lock_);
+  switch (request) {
+    case DRM_IOCTL_MODE_CREATEPROPBLOB: {
+      auto create = static_cast<struct drm_mode_create_blob *>(arg);
+      auto data = reinterpret_cast<const uint8_t *>(create->data);
+      create_blob_calls_++;
+      create->blob_id = next_blob_id_++;
+      blobs_[create->blob_id].assign(data, data + create->length);
+      return 0;
+    }
+    case DRM_IOCTL_MODE_DESTROYPROPBLOB: {
+      auto destroy = static_cast<struct drm_mode_destroy_blob *>(arg);
+      destroy_blob_calls_++;
+      if (!blobs_.erase(destroy->blob_id)) {
+        errno = ENOENT;
+        return -1;
+      }
+      return 0;
+    }
+    case DRM_IOCTL_GEM_CLOSE:
+      return 0;
+    default:
+      ALOGE("Unsupported ioctl 0x%lx", request);
+      errno = EINVAL;
+      return -1;
+  }
+}
+
+int FakeDrmDevice::WaitVBlank(drmVBlankPtr vbl) {
+  std::unique_lock<std::mutex> lock(lock_);
+  wait_vblank_calls_++;
+  if (wait_vblank_error_) {
+    errno = wait_vblank_error_;
+    return -1;
+  }
+
+  uint32_t target = vblank_sequence_ + vbl->request.sequence;
+  if (vbl->request.type & DRM_VBLANK_EVENT) {
+    if (vblank_event_error_) {
+      errno = vblank_event_error_;
+      return -1;
+    }
+    vblank_event_requests_++;
+    vblank_events_.emplace_back(target, vbl->request.signal);
+    vbl->reply.sequence = target;
+    vblank_cond_.notify_all();
+    return 0;
+  }
+
+  // The kernel gives up after a second as well
+  blocking_wait_vblank_calls_++;
+  vblank_waiters_.push_back(target);
+  vblank_cond_.notify_all();
+  bool signaled = vblank_cond_.wait_for(lock, std::chrono::seconds(1),
+                                        [&] { return vblank_sequence_ >= target; });
+  vblank_waiters_.erase(std::find(vblank_waiters_.begin(), vblank_waiters_.end(), target));
+  if (!signaled) {
+    errno = EBUSY;
+    return -1;
+  }
+  vbl->reply.sequence = vblank_sequence_;
+  vbl->reply.tval_sec = vblank_timestamp_ns_ / 1000000000;
+  vbl->reply.tval_usec = (vblank_timestamp_ns_ % 1000000000) / 1000;
+  return 0;
+}
+
+void FakeDrmDevice::SignalVBlank(int64_t timestamp_ns) {
+  std::lock_guard<std::mutex> lock(lock_);
+  vblank_sequence_++;
+  vblank_timestamp_ns_ = timestamp_ns;
+  vblank_wakeups_ += std::count(vblank_waiters_.begin(), vblank_waiters_.end(),
+                                vblank_sequence_);
+
+  std::vector<struct drm_event_vblank> events;
+  for (auto it = vblank_events_.begin(); it != vblank_events_.end();) {
+    if (it->first > vblank_sequence_) {
+      ++it;
+      continue;
+    }
+    struct drm_event_vblank event;
+    memset(&event, 0, sizeof(event));
+    event.base.type = DRM_EVENT_VBLANK;
+    event.base.length = sizeof(event);
+    event.user_data = it->second;
+    event.sequence = vblank_sequence_;
+    event.tv_sec = timestamp_ns / 1000000000;
+    event.tv_usec = (timestamp_ns % 1000000000) / 1000;
+    events.push_back(event);
+    it = vblank_events_.erase(it);
+  }
+  if (!events.empty()) {
+    ssize_t size = events.size() * sizeof(events[0]);
+    if (write(pipe_fds_[1], events.data(), size) != size)
+      ALOGE("Failed to queue vblank events: %s", strerror(errno));
+    vblank_wakeups_++;
+  }
+  vblank_cond_.notify_all();
+}
+
+bool FakeDrmDevice::WaitForVBlankRequest(std::chrono::milliseconds timeout, size_t count) {
+  std::unique_lock<std::mutex> lock(lock_);
+  return vblank_cond_.wait_for(lock, timeout, [this, count] {
+    // Waiters already released by the last vblank don't count
+    size_t requests = vblank_events_.size();
+    for (uint32_t target : vblank_waiters_) {
+      if (target > vblank_sequence_)
+        requests++;
+    }
+    return requests >= count;
+  });
+}
+
+int FakeDrmDevice::AtomicCommit(drmModeAtomicReqPtr req, uint32_t flags) {
+  std::lock_guard<std::mutex> lock(lock_);
+  if (commit_error_) {
+    int error = commit_error_;
+    commit_error_ = 0;
+    errno = error;
+    return -error;
+  }
+
+  CommitRecord commit;
+  commit.flags = flags;
+  for (uint32_t i = 0; i < req->cursor; i++) {
+    const auto &item = req->items[i];
+    commit.items.emplace_back(item.object_id, item.property_id, item.value);
+    if (flags & DRM_MODE_ATOMIC_TEST_ONLY)
+      continue;
+    Object *object = FindObjectLocked(item.object_id);
+    if (!object)
+      continue;
+    for (auto &prop : object->properties) {
+      if (prop.id == item.property_id)
+        prop.value = item.value;
+    }
+  }
+  commits_.push_back(std::move(commit));
+  return 0;
+}
+
+}  // namespace android
+
+using android::FakeDrmDevice;
+
+// libdrm entry points used by libdrmresource
+
+extern "C" {
+
+int drmIoctl(int fd, unsigned long request, void *arg) {
+  FakeDrmDevice *drm = FakeDrmDevice::Active();
+  return drm ? drm->Ioctl(request, arg) : -ENODEV;
+}
+
+int drmSetClientCap(int fd, uint64_t capability, uint64_t value) {
+  return FakeDrmDevice::Active() ? 0 : -ENODEV;
+}
+
+int drmWaitVBlank(int fd, drmVBlankPtr vbl) {
+  FakeDrmDevice *drm = FakeDrmDevice::Active();
+  return drm ? drm->WaitVBlank(vbl) : -ENODEV;
+}
+
+drmModeResPtr drmModeGetResources(int fd) {
+  FakeDrmDevice *drm = FakeDrmDevice::Active();
+  return drm ? drm->GetResources() : nullptr;
+}
+
+void drmModeFreeResources(drmModeResPtr ptr) {
+  if (!ptr)
+    return;
+  free(ptr->fbs);
+  free(ptr->crtcs);
+  free(ptr->connectors);
+  free(ptr->encoders);
+  free(ptr);
+}
+
+drmModePlaneResPtr drmModeGetPlaneResources(int fd) {
+  FakeDrmDevice *drm = FakeDrmDevice::Active();
+  return drm ? drm->GetPlaneResources() : nullptr;
+}
+
+void drmModeFreePlaneResources(drmModePlaneResPtr ptr) {
+  if (!ptr)
+    return;
+  free(ptr->planes);
+  free(ptr);
+}
+
+drmModeCrtcPtr drmModeGetCrtc(int fd, uint32_t crtcId) {
+  FakeDrmDevice *drm = FakeDrmDevice::Active();
+  return drm ? drm->GetCrtc(crtcId) : nullptr;
+}
+
+void drmModeFreeCrtc(drmModeCrtcPtr ptr) {
+  free(ptr);
+}
+
+drmModeEncoderPtr drmModeGetEncoder(int fd, uint32_t encoder_id) {
+  FakeDrmDevice *drm = FakeDrmDevice::Active();
+  return drm ? drm->GetEncoder(encoder_id) : nullptr;
+}
+
+void drmModeFreeEncoder(drmModeEncoderPtr ptr) {
+  free(ptr);
+}
+
+drmModeConnectorPtr drmModeGetConnector(int fd, uint32_t connectorId) {
+  FakeDrmDevice *drm = FakeDrmDevice::Active();
+  return drm ? drm->GetConnector(connectorId) : nullptr;
+}
+
+void drmModeFreeConnector(drmModeConnectorPtr ptr) {
+  if (!ptr)
+    return;
+  free(ptr->encoders);
+  free(ptr->prop_values);
+  free(ptr->props);
+  free(ptr->modes);
+  free(ptr);
+}
+
+drmModePlanePtr drmModeGetPlane(int fd, uint32_t plane_id) {
+  FakeDrmDevice *drm = FakeDrmDevice::Active();
+  return drm ? drm->GetPlane(plane_id) : nullptr;
+}
+
+void drmModeFreePlane(drmModePlanePtr ptr) {
+  if (!ptr)
+    return;
+  free(ptr->formats);
+  free(ptr);
+}
+
+drmModeObjectPropertiesPtr drmModeObjectGetProperties(int fd, uint32_t object_id,
+                                                      uint32_t object_type) {
+  FakeDrmDevice *drm = FakeDrmDevice::Active();
+  return drm ? drm->GetObjectProperties(object_id, object_type) : nullptr;
+}
+
+void drmModeFreeObjectProperties(drmModeObjectPropertiesPtr ptr) {
+  if (!ptr)
+    return;
+  free(ptr->props);
+  free(ptr->prop_values);
+  free(ptr);
+}
+
+drmModePropertyPtr drmModeGetProperty(int fd, uint32_t propertyId) {
+  FakeDrmDevice *drm = FakeDrmDevice::Active();
+  return drm ? drm->GetProperty(propertyId) : nullptr;
+}
+
+void drmModeFreeProperty(drmModePropertyPtr ptr) {
+  if (!ptr)
+    return;
+  free(ptr->values);
+  free(ptr->enums);
+  free(ptr->blob_ids);
+  free(ptr);
+}
+
+drmModePropertyBlobPtr drmModeGetPropertyBlob(int fd, uint32_t blob_id) {
+  FakeDrmDevice *drm = FakeDrmDevice::Active();
+  return drm ? drm->GetPropertyBlob(blob_id) : nullptr;
+}
+
+void drmModeFreePropertyBlob(drmModePropertyBlobPtr ptr) {
+  if (!ptr)
+    return;
+  free(ptr->data);
+  free(ptr);
+}
+
+drmModeAtomicReqPtr drmModeAtomicAlloc(void) {
+  return static_cast<drmModeAtomicReqPtr>(calloc(1, sizeof(struct _drmModeAtomicReq)));
+}
+
+drmModeAtomicReqPtr drmModeAtomicDuplicate(drmModeAtomicReqPtr old) {
+  if (!old)
+    return nullptr;
+  drmModeAtomicReqPtr req = drmModeAtomicAlloc();
+  if (old->size_items) {
+    req->items = static_cast<struct _drmModeAtomicReqItem *>(
+        calloc(old->size_items, sizeof(*req->items)));
+    memcpy(req->items, old->items, old->cursor * sizeof(*req->items));
+  }
+  req->size_items = old->size_items;
+  req->cursor = old->cursor;
+  return req;
+}
+
+void drmModeAtomicFree(drmModeAtomicReqPtr req) {
+  if (!req)
+    return;
+  free(req->items);
+  free(req);
+}
+
+int drmModeAtomicGetCursor(drmModeAtomicReqPtr req) {
+  return req ? req->cursor : 0;
+}
+
+void drmModeAtomicSetCursor(drmModeAtomicReqPtr req, int cursor) {
+  if (req)
+    req->cursor = cursor;
+}
+
+int drmModeAtomicAddProperty(drmModeAtomicReqPtr req, uint32_t object_id,
+                             uint32_t property_id, uint64_t value) {
+  if (!req)
+    return -EINVAL;
+  if (req->cursor >= req->size_items) {
+    uint32_t size = req->size_items ? req->size_items * 2 : 16;
+    auto items = static_cast<struct _drmModeAtomicReqItem *>(
+        realloc(req->items, size * sizeof(*req->items)));
+    if (!items)
+      return -ENOMEM;
+    req->items = items;
+    req->size_items = size;
+  }
+  req->items[req->cursor].object_id = object_id;
+  req->items[req->cursor].property_id = property_id;
+  req->items[req->cursor].value = value;
+  req->cursor++;
+  return req->cursor;
+}
+
+int drmModeAtomicCommit(int fd, drmModeAtomicReqPtr req, uint32_t flags,
+                        void *user_data) {
+  FakeDrmDevice *drm = FakeDrmDevice::Active();
+  if (!drm || !req)
+    return -EINVAL;
+  return drm->AtomicCommit(req, flags);
+}
+
+}  // extern "C"
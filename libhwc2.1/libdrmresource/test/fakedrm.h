@@ -0,0 +1,226 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_FAKE_DRM_H_
+#define ANDROID_FAKE_DRM_H_
+
+#include <stdint.h>
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace Json {
+class Value;
+}
+
+namespace android {
+
+// In-process DRM device serving the libdrm calls of libdrmresource from a
+// JSON description instead of a kernel node. The fake defines the libdrm
+// entry points itself, so the test binary must not link libdrm.
+//
+// {
+//   "crtcs": [{"id": 10, "properties": [...]}],
+//   "encoders": [{"id": 20, "crtc_id": 10, "possible_crtcs": 1}],
+//   "connectors": [{"id": 30, "type": 16, "encoder_id": 20, "encoders": [20],
+//                   "connected": true, "modes": [...], "properties": [...]}],
+//   "planes": [{"id": 40, "possible_crtcs": 1, "formats": [...],
+//               "properties": [...]}]
+// }
+//
+// Properties are {"name", "type", "value", "values", "enums", "immutable"}
+// with type one of "range", "signed_range", "enum", "bitmask", "blob" or
+// "object". Modes use the field names of drmModeModeInfo.
+class FakeDrmDevice {
+ public:
+  struct Property {
+    uint32_t id = 0;
+    std::string name;
+    uint32_t flags = 0;
+    uint64_t value = 0;
+    std::vector<uint64_t> values;
+    std::vector<std::pair<std::string, uint64_t>> enums;
+  };
+
+  struct Object {
+    uint32_t id = 0;
+    uint32_t type = 0;
+    std::vector<Property> properties;
+  };
+
+  struct CommitRecord {
+    uint32_t flags;
+    // (object id, property id, value)
+    std::vector<std::tuple<uint32_t, uint32_t, uint64_t>> items;
+  };
+
+  FakeDrmDevice();
+  FakeDrmDevice(const FakeDrmDevice &) = delete;
+  FakeDrmDevice &operator=(const FakeDrmDevice &) = delete;
+  ~FakeDrmDevice();
+
+  // The device used by the libdrm entry points, nullptr if none
+  static FakeDrmDevice *Active();
+
+  int LoadFromString(const std::string &description);
+  int LoadFromFile(const std::string &path);
+
+  // Node path to be passed to DrmDevice::Init(). It opens a pipe so the DRM
+  // fd can be added to the event listener epoll.
+  const std::string &node_path() const {
+    return node_path_;
+  }
+
+  void SetConnection(uint32_t connector_id, bool connected);
+  void SetWaitVBlankError(int error) {
+    wait_vblank_error_ = error;
+  }
+  // Fail only the DRM_VBLANK_EVENT requests with error
+  void SetVBlankEventError(int error) {
+    vblank_event_error_ = error;
+  }
+  // Ends the current vblank at timestamp_ns. Blocked drmWaitVBlank calls
+  // return and requested vblank events are written to the DRM fd, all in one
+  // write like the kernel queues them before waking the reader.
+  void SignalVBlank(int64_t timestamp_ns);
+  // Waits until count drmWaitVBlank calls are blocked or vblank events are
+  // pending
+  bool WaitForVBlankRequest(std::chrono::milliseconds timeout, size_t count = 1);
+  // Fail the next atomic commit with error
+  void FailNextCommit(int error) {
+    commit_error_ = error;
+  }
+
+  std::vector<CommitRecord> commits() const;
+  void ClearCommits();
+  uint64_t property_value(uint32_t object_id, const std::string &name) const;
+  const std::vector<uint8_t> *blob(uint32_t blob_id) const;
+  size_t blob_count() const;
+  uint32_t create_blob_calls() const {
+    return create_blob_calls_;
+  }
+  uint32_t destroy_blob_calls() const {
+    return destroy_blob_calls_;
+  }
+  uint32_t wait_vblank_calls() const {
+    return wait_vblank_calls_;
+  }
+  // drmWaitVBlank calls that put the caller to sleep
+  uint32_t blocking_wait_vblank_calls() const {
+    return blocking_wait_vblank_calls_;
+  }
+  uint32_t vblank_event_requests() const {
+    return vblank_event_requests_;
+  }
+  // Threads woken by vblanks: every blocked drmWaitVBlank caller released,
+  // and the reader of the DRM fd once for every vblank with events.
+  uint32_t vblank_wakeups() const {
+    return vblank_wakeups_;
+  }
+
+  // libdrm backend
+  drmModeResPtr GetResources();
+  drmModePlaneResPtr GetPlaneResources();
+  drmModeCrtcPtr GetCrtc(uint32_t id);
+  drmModeEncoderPtr GetEncoder(uint32_t id);
+  drmModeConnectorPtr GetConnector(uint32_t id);
+  drmModePlanePtr GetPlane(uint32_t id);
+  drmModeObjectPropertiesPtr GetObjectProperties(uint32_t id, uint32_t type);
+  drmModePropertyPtr GetProperty(uint32_t id);
+  drmModePropertyBlobPtr GetPropertyBlob(uint32_t id);
+  int Ioctl(unsigned long request, void *arg);
+  int WaitVBlank(drmVBlankPtr vbl);
+  int AtomicCommit(drmModeAtomicReqPtr req, uint32_t flags);
+
+ private:
+  struct Crtc : Object {
+    drmModeModeInfo mode{};
+  };
+  struct Encoder {
+    uint32_t id = 0;
+    uint32_t crtc_id = 0;
+    uint32_t type = 0;
+    uint32_t possible_crtcs = 0;
+    uint32_t possible_clones = 0;
+  };
+  struct Connector : Object {
+    uint32_t connector_type = 0;
+    uint32_t connector_type_id = 0;
+    uint32_t encoder_id = 0;
+    bool connected = false;
+    uint32_t mm_width = 0;
+    uint32_t mm_height = 0;
+    std::vector<uint32_t> encoders;
+    std::vector<drmModeModeInfo> modes;
+  };
+  struct Plane : Object {
+    uint32_t crtc_id = 0;
+    uint32_t possible_crtcs = 0;
+    std::vector<uint32_t> formats;
+  };
+
+  int ParseProperties(const Json::Value &value, Object *object);
+  Object *FindObjectLocked(uint32_t id);
+  const Object *FindObjectLocked(uint32_t id) const;
+  const Property *FindPropertyLocked(uint32_t id) const;
+
+  static FakeDrmDevice *active_;
+
+  mutable std::mutex lock_;
+  int pipe_fds_[2] = {-1, -1};
+  std::string node_path_;
+
+  uint32_t min_width_ = 0;
+  uint32_t min_height_ = 0;
+  uint32_t max_width_ = 8192;
+  uint32_t max_height_ = 8192;
+  std::vector<Crtc> crtcs_;
+  std::vector<Encoder> encoders_;
+  std::vector<Connector> connectors_;
+  std::vector<Plane> planes_;
+
+  uint32_t next_property_id_ = 1000;
+  uint32_t next_blob_id_ = 5000;
+  std::map<uint32_t, std::vector<uint8_t>> blobs_;
+  std::vector<CommitRecord> commits_;
+
+  uint32_t create_blob_calls_ = 0;
+  uint32_t destroy_blob_calls_ = 0;
+  uint32_t wait_vblank_calls_ = 0;
+  uint32_t blocking_wait_vblank_calls_ = 0;
+  uint32_t vblank_event_requests_ = 0;
+  uint32_t vblank_wakeups_ = 0;
+  uint32_t vblank_sequence_ = 0;
+  int64_t vblank_timestamp_ns_ = 0;
+  // Target sequences of the blocked drmWaitVBlank calls
+  std::vector<uint32_t> vblank_waiters_;
+  // (target sequence, user data) of the requested vblank events
+  std::vector<std::pair<uint32_t, uint64_t>> vblank_events_;
+  std::condition_variable vblank_cond_;
+  int wait_vblank_error_ = 0;
+  int vblank_event_error_ = 0;
+  int commit_error_ = 0;
+};
+}  // namespace android
+
+#endif  // ANDROID_FAKE_DRM_H_
@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <stdlib.h>
+
+#include <random>
+
+#include "vsyncmodel.h"
+
+namespace android {
+
+namespace {
+
+constexpr int64_t k60HzNs = 16666667;
+constexpr int64_t k120HzNs = 8333333;
+constexpr int64_t kStartNs = 5000000000;
+
+// Timestamps of an ideal vsync with the given true period, nominally
+// advertised as nominal_ns, plus uniform jitter.
+class VsyncStream {
+ public:
+  VsyncStream(double period_ns, int64_t jitter_ns, uint32_t seed)
+      : period_ns_(period_ns), jitter_(-jitter_ns, jitter_ns), rng_(seed) {}
+
+  int64_t IdealAt(int64_t index) const {
+    return kStartNs + static_cast<int64_t>(period_ns_ * index);
+  }
+  int64_t Next(int skip = 0) {
+    index_ += 1 + skip;
+    return IdealAt(index_) + jitter_(rng_);
+  }
+  int64_t index() const { return index_; }
+
+ private:
+  double period_ns_;
+  std::uniform_int_distribution<int64_t> jitter_;
+  std::mt19937 rng_;
+  int64_t index_ = 0;
+};
+
+}  // namespace
+
+TEST(VsyncModelTest, NotLockedUntilEnoughSamples) {
+  VsyncModel model;
+  VsyncStream stream(k60HzNs, 0, 1);
+  int64_t vsync;
+  for (size_t i = 1; i < VsyncModel::kMinSamples; ++i) {
+    ASSERT_TRUE(model.AddSample(stream.Next(), k60HzNs));
+    EXPECT_FALSE(model.IsLocked());
+    EXPECT_FALSE(model.PredictNext(stream.IdealAt(stream.index()) + 1, &vsync));
+  }
+  ASSERT_TRUE(model.AddSample(stream.Next(), k60HzNs));
+  EXPECT_TRUE(model.IsLocked());
+  EXPECT_TRUE(model.PredictNext(stream.IdealAt(stream.index()) + 1, &vsync));
+}
+
+TEST(VsyncModelTest, ExactStreamPredictsExactly) {
+  VsyncModel model;
+  VsyncStream stream(k60HzNs, 0, 1);
+  for (int i = 0; i < 20; ++i)
+    model.AddSample(stream.Next(), k60HzNs);
+
+  int64_t vsync;
+  const int64_t last = stream.IdealAt(stream.index());
+  ASSERT_TRUE(model.PredictNext(last + 1, &vsync));
+  EXPECT_NEAR(static_cast<double>(stream.IdealAt(stream.index() + 1)), vsync, 2);
+  ASSERT_TRUE(model.PredictNext(last, &vsync));
+  EXPECT_NEAR(static_cast<double>(last), vsync, 2);
+  EXPECT_NEAR(static_cast<double>(k60HzNs), model.period_ns(), 1);
+}
+
+// Over the next few vsyncs the fitted grid must stay closer to the true vsync
+// than extrapolating the last jittered timestamp with the nominal period.
+TEST(VsyncModelTest, FitBeatsLastTimestampUnderJitter) {
+  constexpr int64_t kJitterNs = 500000;  // +-0.5 ms
+  constexpr int kAhead = 4;
+  constexpr uint32_t kStreams = 50;
+  int64_t model_error = 0;
+  int64_t naive_error = 0;
+  for (uint32_t seed = 1; seed <= kStreams; ++seed) {
+    VsyncModel model;
+    VsyncStream stream(k120HzNs + 1234.5, kJitterNs, seed);
+    int64_t last = 0;
+    for (int i = 0; i < 200; ++i) {
+      last = stream.Next();
+      model.AddSample(last, k120HzNs);
+    }
+
+    for (int ahead = 1; ahead <= kAhead; ++ahead) {
+      const int64_t truth = stream.IdealAt(stream.index() + ahead);
+      int64_t vsync;
+      ASSERT_TRUE(model.PredictNext(truth - k120HzNs / 2, &vsync));
+      model_error += llabs(vsync - truth);
+      naive_error += llabs(last + ahead * k120HzNs - truth);
+    }
+  }
+  model_error /= kStreams * kAhead;
+  naive_error /= kStreams * kAhead;
+  EXPECT_LT(model_error, kJitterNs / 4);
+  EXPECT_LT(model_error * 2, naive_error);
+}
+
+TEST(VsyncModelTest, MissedVsyncsKeepTheGrid) {
+  VsyncModel model;
+  VsyncStream stream(k60HzNs, 100000, 3);
+  for (int i = 0; i < 40; ++i)
+    model.AddSample(stream.Next(i % 5 == 0 ? 2 : 0), k60HzNs);
+
+  int64_t vsync;
+  const int64_t truth = stream.IdealAt(stream.index() + 1);
+  ASSERT_TRUE(model.PredictNext(truth - k60HzNs / 2, &vsync));
+  EXPECT_LT(llabs(vsync - truth), 100000);
+}
+
+TEST(VsyncModelTest, ModeSwitchRestarts) {
+  VsyncModel model;
+  VsyncStream stream(k60HzNs, 0, 1);
+  int64_t last = 0;
+  for (int i = 0; i < 20; ++i) {
+    last = stream.Next();
+    model.AddSample(last, k60HzNs);
+  }
+  ASSERT_TRUE(model.IsLocked());
+
+  model.AddSample(last + k120HzNs, k120HzNs);
+  EXPECT_FALSE(model.IsLocked());
+  EXPECT_EQ(k120HzNs, model.period_ns());
+  for (size_t i = 2; i <= VsyncModel::kMinSamples; ++i)
+    model.AddSample(last + i * k120HzNs, k120HzNs);
+  EXPECT_TRUE(model.IsLocked());
+  EXPECT_NEAR(static_cast<double>(k120HzNs), model.period_ns(), 1);
+}
+
+TEST(VsyncModelTest, PhaseJumpRestarts) {
+  VsyncModel model;
+  VsyncStream stream(k60HzNs, 0, 1);
+  int64_t last = 0;
+  for (int i = 0; i < 20; ++i) {
+    last = stream.Next();
+    model.AddSample(last, k60HzNs);
+  }
+  ASSERT_TRUE(model.IsLocked());
+
+  // Half a period off the grid, e.g. after the panel resynchronized.
+  EXPECT_TRUE(model.AddSample(last + k60HzNs + k60HzNs / 2, k60HzNs));
+  EXPECT_FALSE(model.IsLocked());
+}
+
+TEST(VsyncModelTest, DropsOutOfOrderSamples) {
+  VsyncModel model;
+  EXPECT_TRUE(model.AddSample(kStartNs, k60HzNs));
+  EXPECT_FALSE(model.AddSample(kStartNs, k60HzNs));
+  EXPECT_FALSE(model.AddSample(kStartNs - 1, k60HzNs));
+  EXPECT_FALSE(model.AddSample(kStartNs + 1000, k60HzNs));
+  EXPECT_FALSE(model.AddSample(kStartNs + k60HzNs, 0));
+}
+
+TEST(VsyncModelTest, StalePredictionsRefused) {
+  VsyncModel model;
+  VsyncStream stream(k60HzNs, 0, 1);
+  for (int i = 0; i < 20; ++i)
+    model.AddSample(stream.Next(), k60HzNs);
+
+  int64_t vsync;
+  const int64_t last = stream.IdealAt(stream.index());
+  EXPECT_TRUE(model.PredictNext(last + VsyncModel::kMaxExtrapolationNs, &vsync));
+  EXPECT_FALSE(model.PredictNext(last + VsyncModel::kMaxExtrapolationNs + 1, &vsync));
+
+  model.Reset();
+  EXPECT_FALSE(model.IsLocked());
+  EXPECT_FALSE(model.PredictNext(last + 1, &vsync));
+}
+
+}  // namespace android
@@ -0,0 +1,361 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <errno.h>
+#include <time.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "drmdevice.h"
+#include "fakedrm.h"
+#include "vsyncworker.h"
+
+namespace android {
+
+namespace {
+
+using namespace std::chrono_literals;
+
+// One DSI panel on one crtc with a single primary plane.
+const char kPanelDescription[] = R"({
+  "crtcs": [{
+    "id": 10,
+    "properties": [
+      {"id": 100, "name": "ACTIVE", "type": "range", "values": [0, 1]},
+      {"id": 101, "name": "MODE_ID", "type": "blob"},
+      {"id": 102, "name": "OUT_FENCE_PTR", "type": "range", "values": [0, 18446744073709551615]}
+    ]
+  }],
+  "encoders": [{"id": 20, "crtc_id": 10, "possible_crtcs": 1}],
+  "connectors": [{
+    "id": 30, "type": 16, "encoder_id": 20, "encoders": [20], "connected": true,
+    "modes": [
+      {"clock": 180000, "hdisplay": 1080, "hsync_start": 1100, "hsync_end": 1110,
+       "htotal": 1200, "vdisplay": 2400, "vsync_start": 2420, "vsync_end": 2430,
+       "vtotal": 2500, "vrefresh": 60, "type": 8}
+    ],
+    "properties": [
+      {"id": 300, "name": "DPMS", "type": "enum", "enums": ["On", "Standby", "Suspend", "Off"]},
+      {"id": 301, "name": "CRTC_ID", "type": "object", "value": 10}
+    ]
+  }],
+  "planes": [{
+    "id": 40, "possible_crtcs": 1, "formats": [875713089],
+    "properties": [
+      {"name": "type", "type": "enum", "immutable": true,
+       "enums": ["Overlay", "Primary", "Cursor"], "value": 1},
+      {"name": "CRTC_ID", "type": "object"},
+      {"name": "FB_ID", "type": "object"},
+      {"name": "CRTC_X", "type": "signed_range", "values": [-2147483648, 2147483647]},
+      {"name": "CRTC_Y", "type": "signed_range", "values": [-2147483648, 2147483647]},
+      {"name": "CRTC_W", "type": "range", "values": [0, 2147483647]},
+      {"name": "CRTC_H", "type": "range", "values": [0, 2147483647]},
+      {"name": "SRC_X", "type": "range", "values": [0, 4294967295]},
+      {"name": "SRC_Y", "type": "range", "values": [0, 4294967295]},
+      {"name": "SRC_W", "type": "range", "values": [0, 4294967295]},
+      {"name": "SRC_H", "type": "range", "values": [0, 4294967295]},
+      {"name": "zpos", "type": "range", "immutable": true, "values": [0, 0]}
+    ]
+  }]
+})";
+
+// The same panel twice, each on its own crtc.
+const char kTwoPanelDescription[] = R"({
+  "crtcs": [{
+    "id": 10,
+    "properties": [
+      {"id": 100, "name": "ACTIVE", "type": "range", "values": [0, 1]},
+      {"id": 101, "name": "MODE_ID", "type": "blob"},
+      {"id": 102, "name": "OUT_FENCE_PTR", "type": "range", "values": [0, 18446744073709551615]}
+    ]
+  }, {
+    "id": 11,
+    "properties": [
+      {"id": 110, "name": "ACTIVE", "type": "range", "values": [0, 1]},
+      {"id": 111, "name": "MODE_ID", "type": "blob"},
+      {"id": 112, "name": "OUT_FENCE_PTR", "type": "range", "values": [0, 18446744073709551615]}
+    ]
+  }],
+  "encoders": [
+    {"id": 20, "crtc_id": 10, "possible_crtcs": 1},
+    {"id": 21, "crtc_id": 11, "possible_crtcs": 2}
+  ],
+  "connectors": [{
+    "id": 30, "type": 16, "encoder_id": 20, "encoders": [20], "connected": true,
+    "modes": [
+      {"clock": 180000, "hdisplay": 1080, "hsync_start": 1100, "hsync_end": 1110,
+       "htotal": 1200, "vdisplay": 2400, "vsync_start": 2420, "vsync_end": 2430,
+       "vtotal": 2500, "vrefresh": 60, "type": 8}
+    ],
+    "properties": [
+      {"id": 300, "name": "DPMS", "type": "enum", "enums": ["On", "Standby", "Suspend", "Off"]},
+      {"id": 301, "name": "CRTC_ID", "type": "object", "value": 10}
+    ]
+  }, {
+    "id": 31, "type": 16, "encoder_id": 21, "encoders": [21], "connected": true,
+    "modes": [
+      {"clock": 180000, "hdisplay": 1080, "hsync_start": 1100, "hsync_end": 1110,
+       "htotal": 1200, "vdisplay": 2400, "vsync_start": 2420, "vsync_end": 2430,
+       "vtotal": 2500, "vrefresh": 60, "type": 8}
+    ],
+    "properties": [
+      {"id": 310, "name": "DPMS", "type": "enum", "enums": ["On", "Standby", "Suspend", "Off"]},
+      {"id": 311, "name": "CRTC_ID", "type": "object", "value": 11}
+    ]
+  }],
+  "planes": [{
+    "id": 40, "possible_crtcs": 1, "formats": [875713089],
+    "properties": [
+      {"name": "type", "type": "enum", "immutable": true,
+       "enums": ["Overlay", "Primary", "Cursor"], "value": 1},
+      {"name": "CRTC_ID", "type": "object"},
+      {"name": "FB_ID", "type": "object"},
+      {"name": "CRTC_X", "type": "signed_range", "values": [-2147483648, 2147483647]},
+      {"name": "CRTC_Y", "type": "signed_range", "values": [-2147483648, 2147483647]},
+      {"name": "CRTC_W", "type": "range", "values": [0, 2147483647]},
+      {"name": "CRTC_H", "type": "range", "values": [0, 2147483647]},
+      {"name": "SRC_X", "type": "range", "values": [0, 4294967295]},
+      {"name": "SRC_Y", "type": "range", "values": [0, 4294967295]},
+      {"name": "SRC_W", "type": "range", "values": [0, 4294967295]},
+      {"name": "SRC_H", "type": "range", "values": [0, 4294967295]},
+      {"name": "zpos", "type": "range", "immutable": true, "values": [0, 0]}
+    ]
+  }, {
+    "id": 41, "possible_crtcs": 2, "formats": [875713089],
+    "properties": [
+      {"name": "type", "type": "enum", "immutable": true,
+       "enums": ["Overlay", "Primary", "Cursor"], "value": 1},
+      {"name": "CRTC_ID", "type": "object"},
+      {"name": "FB_ID", "type": "object"},
+      {"name": "CRTC_X", "type": "signed_range", "values": [-2147483648, 2147483647]},
+      {"name": "CRTC_Y", "type": "signed_range", "values": [-2147483648, 2147483647]},
+      {"name": "CRTC_W", "type": "range", "values": [0, 2147483647]},
+      {"name": "CRTC_H", "type": "range", "values": [0, 2147483647]},
+      {"name": "SRC_X", "type": "range", "values": [0, 4294967295]},
+      {"name": "SRC_Y", "type": "range", "values": [0, 4294967295]},
+      {"name": "SRC_W", "type": "range", "values": [0, 4294967295]},
+      {"name": "SRC_H", "type": "range", "values": [0, 4294967295]},
+      {"name": "zpos", "type": "range", "immutable": true, "values": [0, 0]}
+    ]
+  }]
+})";
+
+constexpr int kVsyncs = 30;
+
+int64_t NowNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Vblank timestamps only carry microseconds
+int64_t VBlankNowNs() {
+  return NowNs() / 1000 * 1000;
+}
+
+class RecordingCallback : public VsyncCallback {
+ public:
+  void Callback(int /*display*/, int64_t timestamp) override {
+    int64_t now = NowNs();
+    std::lock_guard<std::mutex> lock(mutex_);
+    timestamps_.push_back(timestamp);
+    latencies_ns_.push_back(now - timestamp);
+    cond_.notify_all();
+  }
+
+  bool WaitFor(size_t count) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return cond_.wait_for(lock, 1s, [&] { return timestamps_.size() >= count; });
+  }
+
+  std::vector<int64_t> timestamps() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return timestamps_;
+  }
+
+  int64_t median_latency_ns() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<int64_t> sorted(latencies_ns_);
+    std::sort(sorted.begin(), sorted.end());
+    return sorted.empty() ? 0 : sorted[sorted.size() / 2];
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::vector<int64_t> timestamps_;
+  std::vector<int64_t> latencies_ns_;
+};
+
+struct VSyncRun {
+  // timestamps signaled, and the ones each display's callback saw in order
+  std::vector<int64_t> signaled;
+  std::vector<std::vector<int64_t>> delivered;
+  // vblank_wakeups() while vsync was on
+  uint32_t wakeups = 0;
+  // displays whose worker started its own thread
+  int worker_threads = 0;
+  int64_t median_latency_ns = 0;
+};
+
+class VSyncWorkerTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    Load(kPanelDescription, 1);
+  }
+
+  void Load(const char *description, int displays) {
+    ASSERT_EQ(0, fake_drm_.LoadFromString(description));
+    int ret, num_displays;
+    std::tie(ret, num_displays) = drm_.Init(fake_drm_.node_path().c_str(), 0);
+    ASSERT_EQ(0, ret);
+    ASSERT_EQ(displays, num_displays);
+    for (int display = 0; display < displays; display++)
+      ASSERT_NE(nullptr, drm_.GetCrtcForDisplay(display));
+    drm_.event_listener()->InitWorker();
+    displays_ = displays;
+  }
+
+  // Drives kVsyncs vblanks through one worker per display.
+  VSyncRun RunVSyncs(bool use_vblank_events) {
+    VSyncRun run;
+    // declared first so the workers are gone before the callbacks
+    std::vector<std::unique_ptr<RecordingCallback>> callbacks;
+    std::vector<std::unique_ptr<VSyncWorker>> workers;
+    for (int display = 0; display < displays_; display++) {
+      workers.push_back(std::make_unique<VSyncWorker>());
+      callbacks.push_back(std::make_unique<RecordingCallback>());
+      workers.back()->Init(&drm_, display, String8("test"), use_vblank_events);
+      workers.back()->RegisterCallback(
+          std::shared_ptr<VsyncCallback>(callbacks.back().get(), [](VsyncCallback *) {}));
+      workers.back()->VSyncControl(true);
+    }
+
+    uint32_t wakeups = fake_drm_.vblank_wakeups();
+    for (int i = 0; i < kVsyncs; i++) {
+      if (!fake_drm_.WaitForVBlankRequest(1000ms, displays_))
+        break;
+      int64_t timestamp = VBlankNowNs();
+      run.signaled.push_back(timestamp);
+      fake_drm_.SignalVBlank(timestamp);
+      bool delivered = true;
+      for (auto &callback : callbacks)
+        delivered = callback->WaitFor(i + 1) && delivered;
+      if (!delivered)
+        break;
+    }
+    run.wakeups = fake_drm_.vblank_wakeups() - wakeups;
+
+    for (auto &worker : workers) {
+      if (worker->initialized())
+        run.worker_threads++;
+      worker->VSyncControl(false);
+    }
+    // Release whatever request is still outstanding
+    fake_drm_.WaitForVBlankRequest(100ms, displays_);
+    fake_drm_.SignalVBlank(VBlankNowNs());
+    for (auto &callback : callbacks)
+      run.delivered.push_back(callback->timestamps());
+    run.median_latency_ns = callbacks.front()->median_latency_ns();
+    return run;
+  }
+
+  // declared first so it outlives the DrmDevice using it
+  FakeDrmDevice fake_drm_;
+  DrmDevice drm_;
+  int displays_ = 0;
+};
+
+class VSyncWorkerTwoPanelTest : public VSyncWorkerTest {
+ protected:
+  void SetUp() override {
+    Load(kTwoPanelDescription, 2);
+  }
+};
+
+TEST_F(VSyncWorkerTest, WorkerThreadBlocksForEachVSync) {
+  VSyncRun run = RunVSyncs(false);
+  EXPECT_EQ(run.signaled, run.delivered[0]);
+  EXPECT_EQ(kVsyncs, (int)run.signaled.size());
+  EXPECT_EQ(1, run.worker_threads);
+
+  // One sleeping drmWaitVBlank per vsync, plus the one released at the end
+  // if the thread got there before vsync was disabled
+  EXPECT_GE(fake_drm_.blocking_wait_vblank_calls(), (uint32_t)kVsyncs);
+  EXPECT_LE(fake_drm_.blocking_wait_vblank_calls(), kVsyncs + 1u);
+  EXPECT_EQ(0u, fake_drm_.vblank_event_requests());
+  EXPECT_EQ((uint32_t)kVsyncs, run.wakeups);
+  RecordProperty("median_latency_ns", (int)run.median_latency_ns);
+}
+
+TEST_F(VSyncWorkerTest, VBlankEventsNeverBlock) {
+  VSyncRun run = RunVSyncs(true);
+  EXPECT_EQ(run.signaled, run.delivered[0]);
+  EXPECT_EQ(kVsyncs, (int)run.signaled.size());
+
+  // No vsync thread is started, the callback runs on the listener thread,
+  // which is the only one woken. Nothing sleeps in the driver and each event
+  // re-arms the next one before running the callback.
+  EXPECT_EQ(0, run.worker_threads);
+  EXPECT_EQ(0u, fake_drm_.blocking_wait_vblank_calls());
+  EXPECT_EQ(kVsyncs + 1u, fake_drm_.vblank_event_requests());
+  EXPECT_EQ((uint32_t)kVsyncs, run.wakeups);
+  RecordProperty("median_latency_ns", (int)run.median_latency_ns);
+}
+
+TEST_F(VSyncWorkerTest, FallsBackToWorkerThread) {
+  fake_drm_.SetVBlankEventError(EINVAL);
+
+  VSyncRun run = RunVSyncs(true);
+  EXPECT_EQ(run.signaled, run.delivered[0]);
+  EXPECT_EQ(kVsyncs, (int)run.signaled.size());
+  EXPECT_EQ(1, run.worker_threads);
+  EXPECT_EQ(0u, fake_drm_.vblank_event_requests());
+  EXPECT_GE(fake_drm_.blocking_wait_vblank_calls(), (uint32_t)kVsyncs);
+}
+
+TEST_F(VSyncWorkerTwoPanelTest, VBlankEventsWakeFewerThreads) {
+  VSyncRun blocking = RunVSyncs(false);
+  ASSERT_EQ(kVsyncs, (int)blocking.signaled.size());
+  EXPECT_EQ(blocking.signaled, blocking.delivered[0]);
+  EXPECT_EQ(blocking.signaled, blocking.delivered[1]);
+
+  VSyncRun events = RunVSyncs(true);
+  ASSERT_EQ(kVsyncs, (int)events.signaled.size());
+  EXPECT_EQ(events.signaled, events.delivered[0]);
+  EXPECT_EQ(events.signaled, events.delivered[1]);
+
+  // A vsync thread per display against the one listener reading the events
+  // of both displays
+  EXPECT_EQ(2, blocking.worker_threads);
+  EXPECT_EQ(0, events.worker_threads);
+  EXPECT_EQ(2u * kVsyncs, blocking.wakeups);
+  EXPECT_EQ((uint32_t)kVsyncs, events.wakeups);
+  EXPECT_LT(events.wakeups, blocking.wakeups);
+  RecordProperty("blocking_wakeups_per_vsync", (int)(blocking.wakeups / kVsyncs));
+  RecordProperty("event_wakeups_per_vsync", (int)(events.wakeups / kVsyncs));
+}
+
+}  // namespace
+
+}  // namespace android
@@ -82,6 +82,8 @@ int ExynosExternalDisplay::openExternalDisplay()
     mPlugState = true;
 
     if (mLayers.size() != 0) {
+        for (size_t i = 0; i < mLayers.size(); i++)
+            mLayerHandles.remove(mLayers[i]->mHandle);
         mLayers.clear();
     }
 
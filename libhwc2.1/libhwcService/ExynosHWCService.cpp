@@ -551,4 +551,25 @@ int32_t ExynosHWCService::triggerRefreshRateIndicatorUpdate(uint32_t displayId,
     return NO_ERROR;
 }
 
+int32_t ExynosHWCService::getDisplayCommitLatency(int32_t displayId, bool reset,
+                                                  std::vector<int64_t>* outStats) {
+    auto display = mHWCCtx->device->getDisplay(displayId);
+
+    if (display == nullptr || display->mDisplayInterface == nullptr) return -EINVAL;
+
+    ALOGD("ExynosHWCService::%s() displayID(%d) reset=%d", __func__, displayId, reset);
+    return display->mDisplayInterface->getCommitLatencyStats(reset, outStats);
+}
+
+int32_t ExynosHWCService::getDisplayFrameTimeline(int32_t displayId,
+                                                  std::vector<uint8_t>* outTimeline) {
+    auto display = mHWCCtx->device->getDisplay(displayId);
+
+    if (display == nullptr || outTimeline == nullptr) return -EINVAL;
+
+    ALOGD("ExynosHWCService::%s() displayID(%d)", __func__, displayId);
+    *outTimeline = display->exportFrameTimeline();
+    return NO_ERROR;
+}
+
 } //namespace android
@@ -86,6 +86,10 @@ public:
                                                    const bool& enable) override;
     virtual int32_t triggerRefreshRateIndicatorUpdate(uint32_t displayId,
                                                       uint32_t refreshRate) override;
+    virtual int32_t getDisplayCommitLatency(int32_t displayId, bool reset,
+                                            std::vector<int64_t>* outStats) override;
+    virtual int32_t getDisplayFrameTimeline(int32_t displayId,
+                                            std::vector<uint8_t>* outTimeline) override;
 
 private:
     friend class Singleton<ExynosHWCService>;
@@ -69,6 +69,8 @@ enum {
     IGNORE_DISPLAY_BRIGHTNESS_UPDATE_REQUESTS = 1012,
     SET_DISPLAY_BRIGHTNESS_NITS = 1013,
     SET_DISPLAY_BRIGHTNESS_DBV = 1014,
+    GET_DISPLAY_COMMIT_LATENCY = 1015,
+    GET_DISPLAY_FRAME_TIMELINE = 1016,
 };
 
 class BpExynosHWCService : public BpInterface<IExynosHWCService> {
@@ -520,6 +522,41 @@ public:
                  result);
         return result;
     }
+
+    virtual int32_t getDisplayCommitLatency(int32_t displayId, bool reset,
+                                            std::vector<int64_t>* outStats) override {
+        Parcel data, reply;
+        data.writeInterfaceToken(IExynosHWCService::getInterfaceDescriptor());
+        data.writeInt32(displayId);
+        data.writeBool(reset);
+        int result = remote()->transact(GET_DISPLAY_COMMIT_LATENCY, data, &reply);
+        if (result) {
+            ALOGE("GET_DISPLAY_COMMIT_LATENCY transact error(%d)", result);
+            return result;
+        }
+        result = reply.readInt32();
+        if (result == NO_ERROR && outStats) {
+            reply.readInt64Vector(outStats);
+        }
+        return result;
+    }
+
+    virtual int32_t getDisplayFrameTimeline(int32_t displayId,
+                                            std::vector<uint8_t>* outTimeline) override {
+        Parcel data, reply;
+        data.writeInterfaceToken(IExynosHWCService::getInterfaceDescriptor());
+        data.writeInt32(displayId);
+        int result = remote()->transact(GET_DISPLAY_FRAME_TIMELINE, data, &reply);
+        if (result) {
+            ALOGE("GET_DISPLAY_FRAME_TIMELINE transact error(%d)", result);
+            return result;
+        }
+        result = reply.readInt32();
+        if (result == NO_ERROR && outTimeline) {
+            reply.readByteVector(outTimeline);
+        }
+        return result;
+    }
 };
 
 IMPLEMENT_META_INTERFACE(ExynosHWCService, "android.hal.ExynosHWCService");
@@ -817,6 +854,31 @@ status_t BnExynosHWCService::onTransact(
             return NO_ERROR;
         } break;
 
+        case GET_DISPLAY_COMMIT_LATENCY: {
+            CHECK_INTERFACE(IExynosHWCService, data, reply);
+            int32_t displayId = data.readInt32();
+            bool reset = data.readBool();
+            std::vector<int64_t> stats;
+            int32_t error = getDisplayCommitLatency(displayId, reset, &stats);
+            reply->writeInt32(error);
+            if (error == NO_ERROR) {
+                reply->writeInt64Vector(stats);
+            }
+            return NO_ERROR;
+        } break;
+
+        case GET_DISPLAY_FRAME_TIMELINE: {
+            CHECK_INTERFACE(IExynosHWCService, data, reply);
+            int32_t displayId = data.readInt32();
+            std::vector<uint8_t> timeline;
+            int32_t error = getDisplayFrameTimeline(displayId, &timeline);
+            reply->writeInt32(error);
+            if (error == NO_ERROR) {
+                reply->writeByteVector(timeline);
+            }
+            return NO_ERROR;
+        } break;
+
         default:
             return BBinder::onTransact(code, data, reply, flags);
     }
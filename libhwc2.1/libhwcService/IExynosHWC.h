@@ -80,6 +80,18 @@ public:
     virtual int32_t setDisplayMultiThreadedPresent(const int32_t& displayId,
                                                    const bool& enable) = 0;
     virtual int32_t triggerRefreshRateIndicatorUpdate(uint32_t displayId, uint32_t refreshRate) = 0;
+    /*
+     * getDisplayCommitLatency() returns the commit latency histogram summary of
+     * each commit stage as {count, p50, p99, max} tuples in microseconds.
+     */
+    virtual int32_t getDisplayCommitLatency(int32_t displayId, bool reset,
+                                            std::vector<int64_t>* outStats) = 0;
+    /*
+     * getDisplayFrameTimeline() returns the latest frame timelines of the
+     * display, in the FrameTimeline::exportBinary() format.
+     */
+    virtual int32_t getDisplayFrameTimeline(int32_t displayId,
+                                            std::vector<uint8_t>* outTimeline) = 0;
 };
 
 /* Native Interface */
@@ -24,6 +24,8 @@
 #include <utils/CallStack.h>
 #include <utils/Errors.h>
 
+#include <algorithm>
+#include <cmath>
 #include <iomanip>
 
 #include "ExynosHWC.h"
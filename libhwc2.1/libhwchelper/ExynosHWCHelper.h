@@ -21,6 +21,7 @@
 #include <hardware/hwcomposer2.h>
 #include <utils/String8.h>
 
+#include <atomic>
 #include <fstream>
 #include <list>
 #include <optional>
@@ -30,6 +31,8 @@
 #include <vector>
 
 #include "DeconCommonHeader.h"
+#include "HandleSlotTable.h"
+#include "LatencyHistogram.h"
 #include "VendorGraphicBuffer.h"
 #include "VendorVideoAPI.h"
 #include "exynos_format.h"
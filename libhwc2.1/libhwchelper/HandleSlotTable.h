@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+// winds slot generations forward to the wrap-around
+class HandleSlotTableTest;
+
+// Resolves opaque 64-bit handles to objects in constant time. A handle packs
+// the slot index in the low 32 bits and the slot generation in the high 32
+// bits. The generation is bumped when a slot is freed, so a stale handle (or
+// a raw pointer) never resolves to an object that later reuses the slot.
+// Not thread safe, callers serialize insert/remove as they did for the
+// containers this replaces.
+template <typename T>
+class HandleSlotTable {
+public:
+    explicit HandleSlotTable(size_t reserved = 0) {
+        mSlots.reserve(reserved);
+        mFreeSlots.reserve(reserved);
+    }
+
+    uint64_t insert(T* object) {
+        uint32_t index;
+        if (!mFreeSlots.empty()) {
+            index = mFreeSlots.back();
+            mFreeSlots.pop_back();
+        } else {
+            index = static_cast<uint32_t>(mSlots.size());
+            mSlots.emplace_back();
+        }
+        mSlots[index].object = object;
+        return makeHandle(index, mSlots[index].generation);
+    }
+
+    T* get(uint64_t handle) const {
+        const uint32_t index = static_cast<uint32_t>(handle);
+        if (index >= mSlots.size()) return nullptr;
+        const Slot& slot = mSlots[index];
+        return (slot.generation == static_cast<uint32_t>(handle >> 32)) ? slot.object : nullptr;
+    }
+
+    bool remove(uint64_t handle) {
+        if (get(handle) == nullptr) return false;
+        const uint32_t index = static_cast<uint32_t>(handle);
+        Slot& slot = mSlots[index];
+        slot.object = nullptr;
+        // 0 is never a valid generation so no handle is ever 0
+        if (++slot.generation == 0) slot.generation = 1;
+        mFreeSlots.push_back(index);
+        return true;
+    }
+
+    // Invalidates every handle, slots are kept for reuse
+    void clear() {
+        mFreeSlots.clear();
+        for (uint32_t i = 0; i < mSlots.size(); i++) {
+            if (mSlots[i].object) {
+                mSlots[i].object = nullptr;
+                if (++mSlots[i].generation == 0) mSlots[i].generation = 1;
+            }
+            mFreeSlots.push_back(i);
+        }
+    }
+
+    size_t size() const { return mSlots.size() - mFreeSlots.size(); }
+
+private:
+    friend class ::HandleSlotTableTest;
+
+    struct Slot {
+        T* object = nullptr;
+        uint32_t generation = 1;
+    };
+
+    static uint64_t makeHandle(uint32_t index, uint32_t generation) {
+        return (static_cast<uint64_t>(generation) << 32) | index;
+    }
+
+    std::vector<Slot> mSlots;
+    std::vector<uint32_t> mFreeSlots;
+};
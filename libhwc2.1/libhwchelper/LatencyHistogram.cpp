@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "LatencyHistogram.h"
+
+#include <inttypes.h>
+#include <utils/String8.h>
+
+#include <algorithm>
+#include <cmath>
+
+size_t LatencyHistogram::bucketIndex(int64_t us) {
+    if (us < kSubBuckets) {
+        return static_cast<size_t>(std::max<int64_t>(us, 0));
+    }
+    const int bits = 63 - __builtin_clzll(static_cast<uint64_t>(us));
+    if (bits >= kMaxBits) {
+        return kBucketCount - 1;
+    }
+    const int shift = bits - kSubBucketBits;
+    return static_cast<size_t>((shift + 1) * kSubBuckets + (us >> shift) - kSubBuckets);
+}
+
+int64_t LatencyHistogram::bucketLowerUs(size_t index) {
+    if (index < static_cast<size_t>(kSubBuckets)) {
+        return static_cast<int64_t>(index);
+    }
+    if (index == kBucketCount - 1) {
+        return int64_t(1) << kMaxBits;
+    }
+    const int64_t major = static_cast<int64_t>(index) / kSubBuckets;
+    const int64_t sub = static_cast<int64_t>(index) % kSubBuckets;
+    return (kSubBuckets + sub) << (major - 1);
+}
+
+int64_t LatencyHistogram::bucketWidthUs(size_t index) {
+    if (index < static_cast<size_t>(kSubBuckets)) {
+        return 1;
+    }
+    if (index == kBucketCount - 1) {
+        return 0;
+    }
+    return int64_t(1) << (static_cast<int64_t>(index) / kSubBuckets - 1);
+}
+
+void LatencyHistogram::insert(int64_t durationNs) {
+    const int64_t us = std::max<int64_t>(durationNs / 1000, 0);
+    buckets[bucketIndex(us)].fetch_add(1, std::memory_order_relaxed);
+    total.fetch_add(1, std::memory_order_relaxed);
+    sumUs.fetch_add(us, std::memory_order_relaxed);
+
+    int64_t prevMax = max.load(std::memory_order_relaxed);
+    while (prevMax < us &&
+           !max.compare_exchange_weak(prevMax, us, std::memory_order_relaxed))
+        ;
+}
+
+void LatencyHistogram::reset() {
+    for (auto& bucket : buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    total.store(0, std::memory_order_relaxed);
+    sumUs.store(0, std::memory_order_relaxed);
+    max.store(0, std::memory_order_relaxed);
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+    for (size_t i = 0; i < buckets.size(); i++) {
+        buckets[i].fetch_add(other.buckets[i].load(std::memory_order_relaxed),
+                             std::memory_order_relaxed);
+    }
+    total.fetch_add(other.count(), std::memory_order_relaxed);
+    sumUs.fetch_add(other.sumUs.load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+    const int64_t otherMax = other.maxUs();
+    int64_t prevMax = max.load(std::memory_order_relaxed);
+    while (prevMax < otherMax &&
+           !max.compare_exchange_weak(prevMax, otherMax, std::memory_order_relaxed))
+        ;
+}
+
+int64_t LatencyHistogram::percentileUs(float percentile) const {
+    const uint64_t samples = count();
+    if (samples == 0) return 0;
+
+    // rank of the sample, samples are spread evenly over their bucket
+    const double rank = std::clamp<double>(samples * percentile / 100.0, 0, samples);
+    uint64_t accumulated = 0;
+    for (size_t i = 0; i < buckets.size(); i++) {
+        const uint64_t bucketCount = buckets[i].load(std::memory_order_relaxed);
+        if (bucketCount == 0 || accumulated + bucketCount < rank) {
+            accumulated += bucketCount;
+            continue;
+        }
+        // from the first to the last value the bucket can hold
+        const int64_t lowerUs = bucketLowerUs(i);
+        const int64_t spanUs = bucketWidthUs(i) ? bucketWidthUs(i) - 1 : maxUs() - lowerUs;
+        const double offsetUs = spanUs * (rank - accumulated) / bucketCount;
+        return std::min(lowerUs + static_cast<int64_t>(std::lround(offsetUs)), maxUs());
+    }
+    return maxUs();
+}
+
+void LatencyHistogram::dump(android::String8& result, const char* name) const {
+    const uint64_t samples = count();
+    if (samples == 0) {
+        result.appendFormat("\t%s: no samples\n", name);
+        return;
+    }
+    result.appendFormat("\t%s: count %" PRIu64 ", avg %" PRId64 "us, p50 %" PRId64
+                        "us, p90 %" PRId64 "us, p99 %" PRId64 "us, p99.9 %" PRId64
+                        "us, max %" PRId64 "us\n",
+                        name, samples, sumUs.load(std::memory_order_relaxed) / (int64_t)samples,
+                        percentileUs(50), percentileUs(90), percentileUs(99), percentileUs(99.9f),
+                        maxUs());
+    result.appendFormat("\t\t");
+    for (size_t i = 0; i < buckets.size(); i++) {
+        const uint64_t bucketCount = buckets[i].load(std::memory_order_relaxed);
+        if (bucketCount == 0) continue;
+        if (bucketWidthUs(i)) {
+            result.appendFormat("<=%" PRId64 "us:%" PRIu64 " ",
+                                bucketLowerUs(i) + bucketWidthUs(i) - 1, bucketCount);
+        } else {
+            result.appendFormat(">=%" PRId64 "us:%" PRIu64 " ", bucketLowerUs(i), bucketCount);
+        }
+    }
+    result.appendFormat("\n");
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <array>
+#include <atomic>
+
+namespace android {
+class String8;
+} // namespace android
+
+// Log-linear latency histogram in microseconds, cheap enough to be updated on
+// every frame. Values below kSubBuckets get a bucket each, every power of two
+// above is split into kSubBuckets linear buckets, so a bucket is never wider
+// than 1/kSubBuckets of its lower bound. Percentiles interpolate within their
+// bucket. Counters are relaxed atomics so it can be dumped from another thread
+// while the owner keeps inserting samples.
+struct LatencyHistogram {
+    static constexpr int kSubBucketBits = 4;
+    static constexpr int64_t kSubBuckets = 1 << kSubBucketBits;
+    // the last bucket starts at 2^kMaxBits us (~16.8 s) and holds the overflow
+    static constexpr int kMaxBits = 24;
+    static constexpr size_t kBucketCount = kSubBuckets * (kMaxBits - kSubBucketBits + 1) + 1;
+
+    static size_t bucketIndex(int64_t us);
+    static int64_t bucketLowerUs(size_t index);
+    // width of the bucket, 0 for the overflow bucket
+    static int64_t bucketWidthUs(size_t index);
+
+    void insert(int64_t durationNs);
+    void reset();
+    // adds the samples of other, used to sum up sharded histograms
+    void merge(const LatencyHistogram& other);
+    uint64_t count() const { return total.load(std::memory_order_relaxed); }
+    int64_t maxUs() const { return max.load(std::memory_order_relaxed); }
+    // the given percentile (0-100), interpolated within its bucket
+    int64_t percentileUs(float percentile) const;
+    void dump(android::String8& result, const char* name) const;
+
+    std::array<std::atomic<uint64_t>, kBucketCount> buckets{};
+    std::atomic<uint64_t> total = 0;
+    std::atomic<int64_t> sumUs = 0;
+    std::atomic<int64_t> max = 0;
+};
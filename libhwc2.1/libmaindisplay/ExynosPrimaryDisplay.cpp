@@ -101,14 +101,9 @@ ExynosPrimaryDisplay::ExynosPrimaryDisplay(uint32_t index, ExynosDevice *device,
                                            const std::string &displayName)
       : ExynosDisplay(HWC_DISPLAY_PRIMARY, index, device, displayName),
         mUseBlockingZoneForMinIdleRefreshRate(false),
-        mMinIdleRefreshRate(0),
-        mRrThrottleFps{0},
-        mRrThrottleNanos{0},
         mRefreshRateDelayNanos(0),
         mLastRefreshRateAppliedNanos(0),
         mAppliedActiveConfig(0),
-        mDisplayIdleTimerEnabled(false),
-        mDisplayIdleTimerNanos{0},
         mDisplayNeedHandleIdleExit(false) {
     // TODO : Hard coded here
     mNumMaxPriorityAllowed = 5;
@@ -132,6 +127,22 @@ ExynosPrimaryDisplay::ExynosPrimaryDisplay(uint32_t index, ExynosDevice *device,
               mDbvThresholdForBlockingZone);
     }
 
+    RefreshRateVoteEngine::Config rateVoteConfig = {
+            .sysfsDir = getPanelSysfsPath(),
+            .throttlePriorities = std::vector<int>(toUnderlying(RrThrottleRequester::MAX), 0),
+            .numIdleRequesters = toUnderlying(DispIdleTimerRequester::MAX),
+            .throttleIdleRequester = toUnderlying(DispIdleTimerRequester::RR_THROTTLE),
+            .defaultMinIdleFps = mDefaultMinIdleRefreshRate,
+            .minIdleFpsRelaxHoldNs = ms2ns(property_get_int32(
+                    "vendor.primarydisplay.min_idle_refresh_rate.relax_hold_ms", 500)),
+    };
+    // test overrides beat the product votes on the throttle. The min idle
+    // refresh rate keeps max over every requester, a test vote must not drop
+    // it below the blocking zone floor.
+    rateVoteConfig.throttlePriorities[toUnderlying(RrThrottleRequester::TEST)] = 1;
+    mRateVotes = std::make_unique<RefreshRateVoteEngine>(rateVoteConfig);
+    mRateVoteWorker = std::make_unique<RateVoteWorker>(this);
+
     DisplayType displayType = getDcDisplayType();
     std::string displayTypeIdentifier;
     if (displayType == DisplayType::DISPLAY_PRIMARY) {
@@ -533,7 +544,10 @@ int32_t ExynosPrimaryDisplay::setPowerMode(int32_t mode) {
 void ExynosPrimaryDisplay::firstPowerOn() {
     SetCurrentPanelGammaSource(DisplayType::DISPLAY_PRIMARY, PanelGammaSource::GAMMA_CALIBRATION);
     mFirstPowerOn = false;
-    getDisplayIdleTimerEnabled(mDisplayIdleTimerEnabled);
+    if (bool enabled; getDisplayIdleTimerEnabled(enabled) == NO_ERROR) {
+        std::lock_guard<std::mutex> lock(mRateVoteMutex);
+        mRateVotes->setPanelIdleState(enabled);
+    }
     initDisplayHandleIdleExit();
 }
 
@@ -1000,19 +1014,13 @@ int32_t ExynosPrimaryDisplay::setDisplayIdleTimer(const int32_t timeoutMs) {
         return HWC2_ERROR_BAD_PARAMETER;
     }
 
+    // the delay and the enable are written by the same decision
+    std::lock_guard<std::mutex> lock(mRateVoteMutex);
     if (timeoutMs > 0) {
-        setDisplayIdleDelayNanos(std::chrono::duration_cast<std::chrono::nanoseconds>(
-                                         std::chrono::milliseconds(timeoutMs))
-                                         .count(),
-                                 DispIdleTimerRequester::SF);
-    }
-
-    bool enabled = (timeoutMs > 0);
-    if (enabled != mDisplayIdleTimerEnabled) {
-        if (setDisplayIdleTimerEnabled(enabled) == NO_ERROR) {
-            mDisplayIdleTimerEnabled = enabled;
-        }
+        mRateVotes->setIdleDelayVote(toUnderlying(DispIdleTimerRequester::SF), ms2ns(timeoutMs));
     }
+    mRateVotes->setPanelIdleVote(timeoutMs > 0);
+    applyRateVotesLocked();
 
     return HWC2_ERROR_NONE;
 }
@@ -1038,55 +1046,6 @@ int32_t ExynosPrimaryDisplay::getDisplayIdleTimerEnabled(bool &enabled) {
     return NO_ERROR;
 }
 
-int32_t ExynosPrimaryDisplay::setDisplayIdleTimerEnabled(const bool enabled) {
-    const std::string path = getPanelSysfsPath() + "panel_idle";
-    std::ofstream ofs(path);
-    if (!ofs.is_open()) {
-        ALOGW("%s() unable to open node '%s', error = %s", __func__, path.c_str(), strerror(errno));
-        return errno;
-    } else {
-        ofs << enabled;
-        ofs.close();
-        ALOGI("%s() writes panel_idle(%d) to the sysfs node", __func__, enabled);
-    }
-    return NO_ERROR;
-}
-
-int32_t ExynosPrimaryDisplay::setDisplayIdleDelayNanos(const int32_t delayNanos,
-                                                       const DispIdleTimerRequester requester) {
-    std::lock_guard<std::mutex> lock(mDisplayIdleDelayMutex);
-
-    int64_t maxDelayNanos = 0;
-    mDisplayIdleTimerNanos[toUnderlying(requester)] = delayNanos;
-    for (uint32_t i = 0; i < toUnderlying(DispIdleTimerRequester::MAX); i++) {
-        if (mDisplayIdleTimerNanos[i] > maxDelayNanos) {
-            maxDelayNanos = mDisplayIdleTimerNanos[i];
-        }
-    }
-
-    if (mDisplayIdleDelayNanos == maxDelayNanos) {
-        return NO_ERROR;
-    }
-
-    mDisplayIdleDelayNanos = maxDelayNanos;
-
-    const int32_t displayIdleDelayMs = std::chrono::duration_cast<std::chrono::milliseconds>(
-                                               std::chrono::nanoseconds(mDisplayIdleDelayNanos))
-                                               .count();
-    const std::string path = getPanelSysfsPath() + "idle_delay_ms";
-    std::ofstream ofs(path);
-    if (!ofs.is_open()) {
-        ALOGW("%s() unable to open node '%s', error = %s", __func__, path.c_str(), strerror(errno));
-        return errno;
-    } else {
-        ofs << displayIdleDelayMs;
-        ALOGI("%s() writes idle_delay_ms(%d) to the sysfs node (0x%x)", __func__,
-              displayIdleDelayMs, ofs.rdstate());
-        ofs.close();
-    }
-    return NO_ERROR;
-}
-
 void ExynosPrimaryDisplay::initDisplayHandleIdleExit() {
     if (bool support; getDisplayIdleTimerSupport(support) || support == false) {
         return;
@@ -1149,39 +1108,20 @@ void ExynosPrimaryDisplay::handleDisplayIdleEnter(const uint32_t idleTeRefreshRa
 
 int ExynosPrimaryDisplay::setMinIdleRefreshRate(const int targetFps,
                                                 const RrThrottleRequester requester) {
-    int fps = (targetFps <= 0) ? mDefaultMinIdleRefreshRate : targetFps;
+    // a vote <= 0 is withdrawn, the engine falls back on mDefaultMinIdleRefreshRate
+    int fps = std::max(targetFps, 0);
     if (requester == RrThrottleRequester::BRIGHTNESS && mUseBlockingZoneForMinIdleRefreshRate) {
         uint32_t level = mBrightnessController->getBrightnessLevel();
         fps = (level < mDbvThresholdForBlockingZone) ? mMinIdleRefreshRateForBlockingZone
                                                      : mDefaultMinIdleRefreshRate;
     }
 
-    std::lock_guard<std::mutex> lock(mMinIdleRefreshRateMutex);
-    if (fps == mRrThrottleFps[toUnderlying(requester)]) return NO_ERROR;
+    std::lock_guard<std::mutex> lock(mRateVoteMutex);
+    if (fps == mRateVotes->minIdleFpsVote(toUnderlying(requester))) return NO_ERROR;
 
     ALOGD("%s requester %u, fps %d", __func__, toUnderlying(requester), fps);
-    mRrThrottleFps[toUnderlying(requester)] = fps;
-    int maxMinIdleFps = 0;
-    for (uint32_t i = 0; i < toUnderlying(RrThrottleRequester::MAX); i++) {
-        if (mRrThrottleFps[i] > maxMinIdleFps) {
-            maxMinIdleFps = mRrThrottleFps[i];
-        }
-    }
-    if (maxMinIdleFps == mMinIdleRefreshRate) return NO_ERROR;
-
-    const std::string path = getPanelSysfsPath() + "min_vrefresh";
-    std::ofstream ofs(path);
-    if (!ofs.is_open()) {
-        ALOGW("%s Unable to open node '%s', error = %s", __func__, path.c_str(), strerror(errno));
-        return errno;
-    } else {
-        ofs << maxMinIdleFps;
-        ofs.close();
-        ALOGI("ExynosPrimaryDisplay::%s() writes min_vrefresh(%d) to the sysfs node", __func__,
-              maxMinIdleFps);
-    }
-    mMinIdleRefreshRate = maxMinIdleFps;
-    return NO_ERROR;
+    mRateVotes->setMinIdleFpsVote(toUnderlying(requester), fps);
+    return applyRateVotesLocked();
 }
 
 int ExynosPrimaryDisplay::setRefreshRateThrottleNanos(const int64_t delayNanos,
@@ -1192,37 +1132,97 @@ int ExynosPrimaryDisplay::setRefreshRateThrottleNanos(const int64_t delayNanos,
         return BAD_VALUE;
     }
 
-    std::lock_guard<std::mutex> lock(mIdleRefreshRateThrottleMutex);
-    if (delayNanos == mRrThrottleNanos[toUnderlying(requester)]) return NO_ERROR;
+    std::lock_guard<std::mutex> lock(mRateVoteMutex);
+    if (delayNanos == mRateVotes->throttleVote(toUnderlying(requester))) return NO_ERROR;
 
     ALOGI("%s() requester(%u) set delay to %" PRId64 "ns", __func__, toUnderlying(requester),
           delayNanos);
-    mRrThrottleNanos[toUnderlying(requester)] = delayNanos;
-    int64_t maxDelayNanos = 0;
-    for (uint32_t i = 0; i < toUnderlying(RrThrottleRequester::MAX); i++) {
-        if (mRrThrottleNanos[i] > maxDelayNanos) {
-            maxDelayNanos = mRrThrottleNanos[i];
-        }
+    mRateVotes->setThrottleVote(toUnderlying(requester), delayNanos);
+    return applyRateVotesLocked();
+}
+
+int32_t ExynosPrimaryDisplay::applyRateVotesLocked() {
+    const RefreshRateVoteEngine::Decision prev = mRateVotes->applied();
+    int32_t ret = mRateVotes->decide(systemTime(SYSTEM_TIME_MONOTONIC));
+    const RefreshRateVoteEngine::Decision& applied = mRateVotes->applied();
+
+    if (ret != NO_ERROR) {
+        ALOGW("%s() unable to write the panel sysfs nodes, error = %s", __func__, strerror(ret));
+    }
+    if (applied.minIdleFps != prev.minIdleFps) {
+        ALOGI("%s() writes min_vrefresh(%d) to the sysfs node", __func__, applied.minIdleFps);
+    }
+    if (applied.idleDelayNs != prev.idleDelayNs) {
+        ALOGI("%s() writes idle_delay_ms(%" PRId64 ") to the sysfs node", __func__,
+              ns2ms(applied.idleDelayNs));
+    }
+    if (applied.panelIdle != prev.panelIdle) {
+        ALOGI("%s() writes panel_idle(%d) to the sysfs node", __func__, applied.panelIdle);
     }
 
-    DISPLAY_ATRACE_INT64("RefreshRateDelay", ns2ms(maxDelayNanos));
-    if (mRefreshRateDelayNanos == maxDelayNanos) {
-        return NO_ERROR;
+    mRefreshRateDelayNanos = applied.throttleNs;
+    DISPLAY_ATRACE_INT64("RefreshRateDelay", ns2ms(applied.throttleNs));
+    mRateVoteWorker->schedule(mRateVotes->nextDeadlineNs());
+    return ret;
+}
+
+void ExynosPrimaryDisplay::onRateVoteDeadline() {
+    std::lock_guard<std::mutex> lock(mRateVoteMutex);
+    applyRateVotesLocked();
+}
+
+ExynosPrimaryDisplay::RateVoteWorker::RateVoteWorker(ExynosPrimaryDisplay* display)
+      : Worker("RateVotes", HAL_PRIORITY_URGENT_DISPLAY), mDisplay(display) {}
+
+ExynosPrimaryDisplay::RateVoteWorker::~RateVoteWorker() {
+    Exit();
+}
+
+void ExynosPrimaryDisplay::RateVoteWorker::schedule(int64_t deadlineNs) {
+    // started on the first held back vote
+    if (deadlineNs >= 0 && !initialized()) {
+        InitWorker();
+    }
+
+    Lock();
+    mDeadlineNs = deadlineNs;
+    Unlock();
+    Signal();
+}
+
+void ExynosPrimaryDisplay::RateVoteWorker::Routine() {
+    Lock();
+    if (mDeadlineNs < 0 || mDeadlineNs > systemTime(SYSTEM_TIME_MONOTONIC)) {
+        const int64_t timeoutNs =
+                mDeadlineNs < 0 ? -1 : mDeadlineNs - systemTime(SYSTEM_TIME_MONOTONIC);
+        if (WaitForSignalOrExitLocked(timeoutNs) == -EINTR) {
+            Unlock();
+            return;
+        }
     }
+    const bool due = mDeadlineNs >= 0 && mDeadlineNs <= systemTime(SYSTEM_TIME_MONOTONIC);
+    if (due) {
+        mDeadlineNs = -1;
+    }
+    Unlock();
 
-    mRefreshRateDelayNanos = maxDelayNanos;
-    return setDisplayIdleDelayNanos(mRefreshRateDelayNanos, DispIdleTimerRequester::RR_THROTTLE);
+    if (due) {
+        mDisplay->onRateVoteDeadline();
+    }
 }
 
 void ExynosPrimaryDisplay::dump(String8 &result) {
     ExynosDisplay::dump(result);
-    result.appendFormat("Display idle timer: %s\n",
-                        (mDisplayIdleTimerEnabled) ? "enabled" : "disabled");
+
+    std::lock_guard<std::mutex> lock(mRateVoteMutex);
+    const RefreshRateVoteEngine::Decision& applied = mRateVotes->applied();
+    result.appendFormat("Display idle timer: %s, delay: %" PRId64 " ns\n",
+                        applied.panelIdle ? "enabled" : "disabled", applied.idleDelayNs);
     for (uint32_t i = 0; i < toUnderlying(DispIdleTimerRequester::MAX); i++) {
-        result.appendFormat("\t[%u] vote to %" PRId64 " ns\n", i, mDisplayIdleTimerNanos[i]);
+        result.appendFormat("\t[%u] vote to %" PRId64 " ns\n", i, mRateVotes->idleDelayVote(i));
     }
 
-    result.appendFormat("Min idle refresh rate: %d, default: %d", mMinIdleRefreshRate,
+    result.appendFormat("Min idle refresh rate: %d, default: %d", applied.minIdleFps,
                         mDefaultMinIdleRefreshRate);
     if (mUseBlockingZoneForMinIdleRefreshRate) {
         result.appendFormat(", blocking zone level: %d, min refresh rate: %d\n",
@@ -1232,13 +1232,21 @@ void ExynosPrimaryDisplay::dump(String8 &result) {
     }
 
     for (uint32_t i = 0; i < toUnderlying(RrThrottleRequester::MAX); i++) {
-        result.appendFormat("\t[%u] vote to %d hz\n", i, mRrThrottleFps[i]);
+        result.appendFormat("\t[%u] vote to %d hz\n", i, mRateVotes->minIdleFpsVote(i));
     }
 
-    result.appendFormat("Refresh rate delay: %" PRId64 " ns\n", mRefreshRateDelayNanos);
+    result.appendFormat("Refresh rate delay: %" PRId64 " ns\n", applied.throttleNs);
     for (uint32_t i = 0; i < toUnderlying(RrThrottleRequester::MAX); i++) {
-        result.appendFormat("\t[%u] vote to %" PRId64 " ns\n", i, mRrThrottleNanos[i]);
+        result.appendFormat("\t[%u] vote to %" PRId64 " ns\n", i, mRateVotes->throttleVote(i));
     }
+
+    const RefreshRateVoteEngine::Stats& stats = mRateVotes->stats();
+    result.appendFormat("Rate vote decisions: %" PRIu64 ", writes: min_vrefresh %" PRIu64
+                        ", idle_delay_ms %" PRIu64 ", panel_idle %" PRIu64 ", errors %" PRIu64
+                        ", held back lower values: %" PRIu64 " (%" PRIu64 " cancelled)\n",
+                        stats.decisions, stats.minIdleFpsWrites, stats.idleDelayWrites,
+                        stats.panelIdleWrites, stats.writeErrors, stats.relaxDeferred,
+                        stats.relaxCancelled);
     result.appendFormat("\n");
 }
 
@@ -19,6 +19,7 @@
 #include <map>
 
 #include "../libdevice/ExynosDisplay.h"
+#include "../libdevice/RefreshRateVoteEngine.h"
 #include "../libvrr/VariableRefreshRateController.h"
 #include "../libvrr/VariableRefreshRateInterface.h"
 
@@ -124,11 +125,10 @@ class ExynosPrimaryDisplay : public ExynosDisplay {
         int32_t setPowerOff();
         int32_t setPowerDoze(hwc2_power_mode_t mode);
         void firstPowerOn();
-        int32_t setDisplayIdleTimerEnabled(const bool enabled);
         int32_t getDisplayIdleTimerEnabled(bool& enabled);
         void setDisplayNeedHandleIdleExit(const bool needed, const bool force);
-        int32_t setDisplayIdleDelayNanos(int32_t delayNanos,
-                                         const DispIdleTimerRequester requester);
+        // applies the votes of mRateVotes, mRateVoteMutex must be held
+        int32_t applyRateVotesLocked();
         void initDisplayHandleIdleExit();
         int32_t setLhbmDisplayConfigLocked(uint32_t peakRate);
         void restoreLhbmDisplayConfigLocked();
@@ -169,21 +169,35 @@ class ExynosPrimaryDisplay : public ExynosDisplay {
         // blocking zone threshold, e.g. 492 means entering the zone if DBV < 492
         uint32_t mDbvThresholdForBlockingZone;
         bool mUseBlockingZoneForMinIdleRefreshRate;
-        int mMinIdleRefreshRate;
-        int mRrThrottleFps[toUnderlying(RrThrottleRequester::MAX)];
-        std::mutex mMinIdleRefreshRateMutex;
 
-        std::mutex mIdleRefreshRateThrottleMutex;
-        int64_t mRrThrottleNanos[toUnderlying(RrThrottleRequester::MAX)];
-        int64_t mRefreshRateDelayNanos;
+        // Applies the lower values the vote engine held back once they are due
+        class RateVoteWorker : public Worker {
+        public:
+            explicit RateVoteWorker(ExynosPrimaryDisplay* display);
+            ~RateVoteWorker() override;
+            // -1 cancels
+            void schedule(int64_t deadlineNs);
+
+        protected:
+            void Routine() override;
+
+        private:
+            ExynosPrimaryDisplay* mDisplay;
+            int64_t mDeadlineNs = -1;
+        };
+        void onRateVoteDeadline();
+
+        // min idle refresh rate, refresh rate throttle and display idle timer
+        // votes, see RefreshRateVoteEngine
+        std::mutex mRateVoteMutex;
+        std::unique_ptr<RefreshRateVoteEngine> mRateVotes;
+        std::unique_ptr<RateVoteWorker> mRateVoteWorker;
+        // the applied throttle, for calculateTimeline()
+        std::atomic<int64_t> mRefreshRateDelayNanos;
         int64_t mLastRefreshRateAppliedNanos;
         hwc2_config_t mAppliedActiveConfig;
 
-        std::mutex mDisplayIdleDelayMutex;
-        bool mDisplayIdleTimerEnabled;
-        int64_t mDisplayIdleTimerNanos[toUnderlying(DispIdleTimerRequester::MAX)];
         std::ofstream mDisplayNeedHandleIdleExitOfs;
-        int64_t mDisplayIdleDelayNanos;
         bool mDisplayNeedHandleIdleExit;
 
         // Function and variables related to Vrr.
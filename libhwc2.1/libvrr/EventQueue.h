@@ -0,0 +1,213 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <algorithm>
+#include <array>
+#include <vector>
+
+namespace android::hardware::graphics::composer {
+
+// Timed event queue with cancellation by handle and by event type.
+//
+// Events are ordered by mWhenNs, earliest first; events due at the same time
+// come out in the order they were pushed. The heap stores slot indices and
+// every slot remembers its heap position, so cancelling one event is
+// O(log n) and cancelling every event of a type is O(k log n) for the k
+// events of that type, without touching the others.
+//
+// EventT needs an mWhenNs (int64_t) and an mEventType convertible to an index
+// below NumTypes. Not thread safe, callers hold their own lock.
+template <class EventT, size_t NumTypes>
+class EventQueue {
+public:
+    typedef uint64_t Handle;
+    static constexpr Handle kInvalidHandle = 0;
+
+    EventQueue() = default;
+    ~EventQueue() = default;
+
+    bool empty() const { return mHeap.empty(); }
+
+    size_t size() const { return mHeap.size(); }
+
+    const EventT& top() const { return mSlots[mHeap.front()].event; }
+
+    Handle push(const EventT& event) {
+        uint32_t slot;
+        if (mFreeSlots.empty()) {
+            slot = static_cast<uint32_t>(mSlots.size());
+            mSlots.emplace_back();
+        } else {
+            slot = mFreeSlots.back();
+            mFreeSlots.pop_back();
+        }
+        Slot& s = mSlots[slot];
+        s.event = event;
+        s.sequence = mNextSequence++;
+        s.inUse = true;
+        s.heapIndex = mHeap.size();
+        mHeap.push_back(slot);
+        siftUp(s.heapIndex);
+
+        auto& byType = mByType[typeIndex(event)];
+        s.typeIndex = byType.size();
+        byType.push_back(slot);
+        return makeHandle(slot, s.generation);
+    }
+
+    void pop() { removeSlot(mHeap.front()); }
+
+    // Returns false when the event already fired or was cancelled.
+    bool cancel(Handle handle) {
+        const uint32_t slot = static_cast<uint32_t>(handle);
+        const uint32_t generation = static_cast<uint32_t>(handle >> 32);
+        if (handle == kInvalidHandle || slot >= mSlots.size() || !mSlots[slot].inUse ||
+            mSlots[slot].generation != generation) {
+            return false;
+        }
+        removeSlot(slot);
+        return true;
+    }
+
+    // Returns the number of events dropped.
+    size_t cancelType(size_t type) {
+        auto& byType = mByType[type];
+        const size_t count = byType.size();
+        while (!byType.empty()) {
+            removeSlot(byType.back());
+        }
+        return count;
+    }
+
+    size_t count(size_t type) const { return mByType[type].size(); }
+
+    void clear() {
+        mHeap.clear();
+        mFreeSlots.clear();
+        for (uint32_t i = 0; i < mSlots.size(); ++i) {
+            if (mSlots[i].inUse) {
+                mSlots[i].inUse = false;
+                ++mSlots[i].generation;
+            }
+            mFreeSlots.push_back(i);
+        }
+        for (auto& byType : mByType) {
+            byType.clear();
+        }
+    }
+
+    // Visits the pending events in the order they will fire.
+    template <class Visitor>
+    void forEachOrdered(Visitor&& visitor) const {
+        std::vector<uint32_t> ordered(mHeap);
+        std::sort(ordered.begin(), ordered.end(),
+                  [this](uint32_t a, uint32_t b) { return before(a, b); });
+        for (uint32_t slot : ordered) {
+            visitor(mSlots[slot].event);
+        }
+    }
+
+private:
+    struct Slot {
+        EventT event;
+        uint64_t sequence = 0;
+        size_t heapIndex = 0;
+        size_t typeIndex = 0;
+        // Bumped on release so stale handles never match a reused slot.
+        uint32_t generation = 1;
+        bool inUse = false;
+    };
+
+    static size_t typeIndex(const EventT& event) { return static_cast<size_t>(event.mEventType); }
+
+    static Handle makeHandle(uint32_t slot, uint32_t generation) {
+        return (static_cast<Handle>(generation) << 32) | slot;
+    }
+
+    bool before(uint32_t a, uint32_t b) const {
+        const Slot& sa = mSlots[a];
+        const Slot& sb = mSlots[b];
+        if (sa.event.mWhenNs != sb.event.mWhenNs) {
+            return sa.event.mWhenNs < sb.event.mWhenNs;
+        }
+        return sa.sequence < sb.sequence;
+    }
+
+    void place(size_t index, uint32_t slot) {
+        mHeap[index] = slot;
+        mSlots[slot].heapIndex = index;
+    }
+
+    void siftUp(size_t index) {
+        const uint32_t slot = mHeap[index];
+        while (index > 0) {
+            const size_t parent = (index - 1) / 2;
+            if (!before(slot, mHeap[parent])) break;
+            place(index, mHeap[parent]);
+            index = parent;
+        }
+        place(index, slot);
+    }
+
+    void siftDown(size_t index) {
+        const uint32_t slot = mHeap[index];
+        const size_t size = mHeap.size();
+        for (;;) {
+            size_t child = 2 * index + 1;
+            if (child >= size) break;
+            if (child + 1 < size && before(mHeap[child + 1], mHeap[child])) ++child;
+            if (!before(mHeap[child], slot)) break;
+            place(index, mHeap[child]);
+            index = child;
+        }
+        place(index, slot);
+    }
+
+    void removeSlot(uint32_t slot) {
+        Slot& s = mSlots[slot];
+
+        const size_t index = s.heapIndex;
+        const uint32_t last = mHeap.back();
+        mHeap.pop_back();
+        if (last != slot) {
+            place(index, last);
+            siftDown(index);
+            siftUp(mSlots[last].heapIndex);
+        }
+
+        auto& byType = mByType[typeIndex(s.event)];
+        const uint32_t lastOfType = byType.back();
+        byType[s.typeIndex] = lastOfType;
+        mSlots[lastOfType].typeIndex = s.typeIndex;
+        byType.pop_back();
+
+        s.inUse = false;
+        ++s.generation;
+        mFreeSlots.push_back(slot);
+    }
+
+    std::vector<Slot> mSlots;
+    std::vector<uint32_t> mFreeSlots;
+    std::vector<uint32_t> mHeap;
+    std::array<std::vector<uint32_t>, NumTypes> mByType;
+    uint64_t mNextSequence = 0;
+};
+
+} // namespace android::hardware::graphics::composer
@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "FrameInsertionPolicy.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+namespace android::hardware::graphics::composer {
+
+std::unique_ptr<FrameInsertionPolicy> FrameInsertionPolicy::create(const std::string& name) {
+    if (name == "fixed") {
+        return std::make_unique<FixedFrameInsertionPolicy>();
+    }
+    return std::make_unique<CadenceFrameInsertionPolicy>();
+}
+
+FrameInsertionPlan FixedFrameInsertionPolicy::plan(const FrameInsertionInput& input) {
+    FrameInsertionPlan plan = {.numFrames = kDefaultNumFramesToInsert,
+                               .firstDelayNs = kDefaultFrameInsertionTimer,
+                               .intervalNs = input.minFrameIntervalNs};
+    if (input.maxFrameIntervalNs > 0) {
+        plan.firstDelayNs = std::min(plan.firstDelayNs, input.maxFrameIntervalNs);
+    }
+    return plan;
+}
+
+int64_t CadenceFrameInsertionPolicy::reschedule(const FrameInsertionInput& input, int64_t delayNs,
+                                                int64_t previousNs, int64_t nextPresentNs) {
+    const int64_t lateFromNs = nextPresentNs - input.minFrameIntervalNs;
+    if (delayNs < lateFromNs || delayNs >= nextPresentNs) {
+        return delayNs;
+    }
+    const int64_t afterNs = nextPresentNs + input.minFrameIntervalNs;
+    if (input.maxFrameIntervalNs <= 0 || afterNs - previousNs <= input.maxFrameIntervalNs) {
+        return afterNs;
+    }
+    if (lateFromNs - previousNs >= input.minFrameIntervalNs) {
+        return lateFromNs;
+    }
+    return delayNs;
+}
+
+FrameInsertionPlan CadenceFrameInsertionPolicy::plan(const FrameInsertionInput& input) {
+    FrameInsertionPlan fixed = FixedFrameInsertionPolicy().plan(input);
+
+    const std::vector<int64_t>& times = *input.presentTimesNs;
+    if (times.size() < kMinIntervals + 1) {
+        return fixed;
+    }
+
+    const size_t first = times.size() - std::min(times.size() - 1, kCadenceWindow) - 1;
+    mIntervals.clear();
+    for (size_t i = first + 1; i < times.size(); ++i) {
+        const int64_t interval = times[i] - times[i - 1];
+        if (interval <= 0) {
+            return fixed;
+        }
+        mIntervals.push_back(interval);
+    }
+
+    auto middle = mIntervals.begin() + mIntervals.size() / 2;
+    std::nth_element(mIntervals.begin(), middle, mIntervals.end());
+    const int64_t cadenceNs = *middle;
+    for (int64_t interval : mIntervals) {
+        if (std::abs(interval - cadenceNs) * 100 > cadenceNs * kMaxJitterPercent) {
+            return fixed;
+        }
+    }
+
+    // Delays are relative to now, the present is the previous frame of the
+    // first inserted one. The frames after the second keep its spacing.
+    const int64_t nextPresentNs = times.back() + cadenceNs - input.nowNs;
+    FrameInsertionPlan plan = fixed;
+    plan.firstDelayNs = reschedule(input, fixed.firstDelayNs, 0, nextPresentNs);
+    if (plan.numFrames > 1) {
+        const int64_t secondNs = reschedule(input, plan.firstDelayNs + fixed.intervalNs,
+                                            plan.firstDelayNs, nextPresentNs);
+        plan.intervalNs = secondNs - plan.firstDelayNs;
+    }
+    return plan;
+}
+
+} // namespace android::hardware::graphics::composer
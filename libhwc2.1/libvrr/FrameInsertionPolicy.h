@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace android::hardware::graphics::composer {
+
+// Frames to insert after a present. The first one fires firstDelayNs after the
+// present and the others follow intervalNs apart. A later present cancels
+// whatever has not fired yet.
+typedef struct FrameInsertionPlan {
+    int numFrames = 0;
+    int64_t firstDelayNs = 0;
+    int64_t intervalNs = 0;
+} FrameInsertionPlan;
+
+typedef struct FrameInsertionInput {
+    // When the present happened.
+    int64_t nowNs;
+    // Expected present times of the most recent presents, oldest first, the
+    // current present last.
+    const std::vector<int64_t>* presentTimesNs;
+    // Shortest frame interval the panel supports.
+    int64_t minFrameIntervalNs;
+    // Longest the panel may go without a frame, from its minimum refresh rate.
+    // 0 when unknown.
+    int64_t maxFrameIntervalNs;
+} FrameInsertionInput;
+
+// Decides how many frames VariableRefreshRateController inserts after each
+// present. Called with the controller lock held, must not block.
+class FrameInsertionPolicy {
+public:
+    virtual ~FrameInsertionPolicy() = default;
+
+    virtual FrameInsertionPlan plan(const FrameInsertionInput& input) = 0;
+
+    virtual std::string getName() const = 0;
+
+    // "fixed" or "cadence", anything else falls back to the cadence policy.
+    static std::unique_ptr<FrameInsertionPolicy> create(const std::string& name);
+};
+
+// Always inserts the same frames, whatever the content does, no later than the
+// panel minimum refresh rate allows.
+class FixedFrameInsertionPolicy : public FrameInsertionPolicy {
+public:
+    static constexpr int kDefaultNumFramesToInsert = 2;
+    static constexpr int64_t kDefaultFrameInsertionTimer = 33 * 1000000; // 33 ms
+
+    FrameInsertionPlan plan(const FrameInsertionInput& input) override;
+    std::string getName() const override { return "fixed"; }
+};
+
+// Predicts the next present from the recent present cadence and keeps the
+// inserted frames out of the panel frame in front of it, where they would hold
+// that present back. Such a frame is moved one panel frame past the predicted
+// present, so it still fires when the content stops and is cancelled for free
+// when the present arrives. If that would break the panel minimum refresh rate
+// it is moved in front of the panel frame instead. Without a steady cadence it
+// behaves like the fixed policy.
+class CadenceFrameInsertionPolicy : public FrameInsertionPolicy {
+public:
+    // Intervals used to learn the cadence.
+    static constexpr size_t kCadenceWindow = 8;
+    static constexpr size_t kMinIntervals = 3;
+    // The cadence is steady when every interval is within this share of the
+    // median interval, in percent.
+    static constexpr int64_t kMaxJitterPercent = 25;
+
+    FrameInsertionPlan plan(const FrameInsertionInput& input) override;
+    std::string getName() const override { return "cadence"; }
+
+private:
+    // Delay after the present of an inserted frame wanted at delayNs, moved out
+    // of the panel frame before the predicted present at nextPresentNs. The
+    // previous frame, present or inserted, was at previousNs.
+    static int64_t reschedule(const FrameInsertionInput& input, int64_t delayNs,
+                              int64_t previousNs, int64_t nextPresentNs);
+
+    // Scratch storage, reused across frames.
+    std::vector<int64_t> mIntervals;
+};
+
+} // namespace android::hardware::graphics::composer
@@ -19,18 +19,24 @@
 #include "VariableRefreshRateController.h"
 
 #include <android-base/logging.h>
+#include <android-base/properties.h>
 #include <sync/sync.h>
 #include <utils/Trace.h>
 
 #include "ExynosHWCHelper.h"
 #include "drmmode.h"
 
+#include <algorithm>
 #include <chrono>
 #include <tuple>
 
 namespace android::hardware::graphics::composer {
 
 const std::string VariableRefreshRateController::kFrameInsertionNodeName = "refresh_ctrl";
+const std::string VariableRefreshRateController::kFrameInsertionPolicyProperty =
+        "vendor.display.vrr.frame_insertion_policy";
+const std::string VariableRefreshRateController::kMinRefreshRateProperty =
+        "vendor.display.vrr.min_refresh_rate";
 
 namespace {
 
@@ -64,6 +70,14 @@ auto VariableRefreshRateController::CreateInstance(ExynosDisplay* display)
 VariableRefreshRateController::VariableRefreshRateController(ExynosDisplay* display)
       : mDisplay(display) {
     mState = VrrControllerState::kDisable;
+    mFrameInsertionPolicy = FrameInsertionPolicy::create(
+            base::GetProperty(kFrameInsertionPolicyProperty, "cadence"));
+    mRecentPresentTimes.reserve(CadenceFrameInsertionPolicy::kCadenceWindow + 1);
+    const int minRefreshRate =
+            base::GetIntProperty(kMinRefreshRateProperty, kDefaultMinRefreshRate);
+    mMaxFrameIntervalNs = minRefreshRate > 0 ? std::nano::den / minRefreshRate : 0;
+    LOG(INFO) << "VrrController: frame insertion policy = " << mFrameInsertionPolicy->getName()
+              << ", min refresh rate = " << minRefreshRate;
     std::string displayFileNodePath = mDisplay->getPanelSysfsPath();
     if (displayFileNodePath.empty()) {
         LOG(WARNING) << "VrrController: Cannot find file node of display: "
@@ -76,6 +90,11 @@ VariableRefreshRateController::VariableRefreshRateController(ExynosDisplay* disp
 VariableRefreshRateController::~VariableRefreshRateController() {
     stopThread(true);
 
+    int fence;
+    while (mPresentFences.pop(fence)) {
+        close(fence);
+    }
+
     const std::lock_guard<std::mutex> lock(mMutex);
     if (mLastPresentFence.has_value()) {
         if (close(mLastPresentFence.value())) {
@@ -102,7 +121,6 @@ void VariableRefreshRateController::reset() {
     ATRACE_CALL();
 
     const std::lock_guard<std::mutex> lock(mMutex);
-    mEventQueue = std::priority_queue<VrrControllerEvent>();
     mRecord.clear();
     dropEventLocked();
     if (mLastPresentFence.has_value()) {
@@ -244,32 +262,32 @@ void VariableRefreshRateController::onPresent(int fence) {
         }
     }
 
-    // Prior to pushing the most recent fence update, verify the release timestamps of all preceding
-    // fences.
-    // TODO(b/309873055): delegate the task of executing updateVsyncHistory to the Vrr controller's
-    // loop thread in order to reduce the workload of calling thread.
-    updateVsyncHistory();
+    // Reading the fence signal times takes syscalls, leave that to the controller thread and only
+    // hand over a duplicate of the fence here.
     int dupFence = dup(fence);
     if (dupFence < 0) {
         LOG(ERROR) << "VrrController: duplicate fence file failed." << errno;
+    } else if (!mPresentFences.push(dupFence)) {
+        LOG(WARNING) << "VrrController: present fence ring is full, dropping fence.";
+        close(dupFence);
     }
 
     {
         const std::lock_guard<std::mutex> lock(mMutex);
-        if (mLastPresentFence.has_value()) {
-            LOG(WARNING) << "VrrController: last present fence remains open.";
-        }
-        mLastPresentFence = dupFence;
         // Drop the out of date timeout.
         dropEventLocked(kRenderingTimeout);
         cancelFrameInsertionLocked();
         // Post next rendering timeout.
         postEvent(VrrControllerEventType::kRenderingTimeout,
                   getNowNs() + mVrrConfigs[mVrrActiveConfig].notifyExpectedPresentConfig.TimeoutNs);
-        // Post next frmae insertion event.
-        mPendingFramesToInsert = kDefaultNumFramesToInsert;
-        postEvent(VrrControllerEventType::kNextFrameInsertion,
-                  getNowNs() + kDefaultFrameInsertionTimer);
+        // Post next frame insertion event, if the policy wants any.
+        const auto plan = planFrameInsertionLocked();
+        mPendingFramesToInsert = plan.numFrames;
+        mFrameInsertionIntervalNs = plan.intervalNs;
+        if (plan.numFrames > 0) {
+            postEvent(VrrControllerEventType::kNextFrameInsertion,
+                      getNowNs() + plan.firstDelayNs);
+        }
     }
     mCondition.notify_all();
 }
@@ -315,49 +333,47 @@ int VariableRefreshRateController::doFrameInsertionLocked() {
     }
     if (--mPendingFramesToInsert > 0) {
         postEvent(VrrControllerEventType::kNextFrameInsertion,
-                  getNowNs() + mVrrConfigs[mVrrActiveConfig].minFrameIntervalNs);
+                  getNowNs() + mFrameInsertionIntervalNs);
     }
     return 0;
 }
 
 int VariableRefreshRateController::doFrameInsertionLocked(int frames) {
     mPendingFramesToInsert = frames;
+    mFrameInsertionIntervalNs = mVrrConfigs[mVrrActiveConfig].minFrameIntervalNs;
     return doFrameInsertionLocked();
 }
 
+FrameInsertionPlan VariableRefreshRateController::planFrameInsertionLocked() {
+    const auto& history = mRecord.mPresentHistory;
+    const size_t count = std::min(history.size(), CadenceFrameInsertionPolicy::kCadenceWindow + 1);
+    mRecentPresentTimes.clear();
+    for (size_t i = history.size() - count; i < history.size(); ++i) {
+        mRecentPresentTimes.push_back(history[i].mTime);
+    }
+    return mFrameInsertionPolicy->plan(
+            {.nowNs = getNowNs(),
+             .presentTimesNs = &mRecentPresentTimes,
+             .minFrameIntervalNs = mVrrConfigs[mVrrActiveConfig].minFrameIntervalNs,
+             .maxFrameIntervalNs = mMaxFrameIntervalNs});
+}
+
 void VariableRefreshRateController::dropEventLocked() {
-    mEventQueue = std::priority_queue<VrrControllerEvent>();
+    mEventQueue.clear();
     mPendingFramesToInsert = 0;
 }
 
 void VariableRefreshRateController::dropEventLocked(VrrControllerEventType event_type) {
-    std::priority_queue<VrrControllerEvent> q;
-    while (!mEventQueue.empty()) {
-        const auto& it = mEventQueue.top();
-        if (it.mEventType != event_type) {
-            q.push(it);
-        }
-        mEventQueue.pop();
-    }
-    mEventQueue = std::move(q);
+    mEventQueue.cancelType(event_type);
 }
 
 std::string VariableRefreshRateController::dumpEventQueueLocked() {
     std::string content;
-    if (mEventQueue.empty()) {
-        return content;
-    }
-
-    std::priority_queue<VrrControllerEvent> q;
-    while (!mEventQueue.empty()) {
-        const auto& it = mEventQueue.top();
+    mEventQueue.forEachOrdered([&content](const VrrControllerEvent& event) {
         content += "VrrController: event = ";
-        content += it.toString();
+        content += event.toString();
         content += "\n";
-        q.push(it);
-        mEventQueue.pop();
-    }
-    mEventQueue = std::move(q);
+    });
     return content;
 }
 
@@ -402,6 +418,21 @@ int64_t VariableRefreshRateController::getNextEventTimeLocked() const {
     return event.mWhenNs;
 }
 
+void VariableRefreshRateController::harvestPresentFences() {
+    int fence;
+    while (mPresentFences.pop(fence)) {
+        // Prior to keeping the most recent fence, record the signal time of the preceding one.
+        updateVsyncHistory();
+
+        const std::lock_guard<std::mutex> lock(mMutex);
+        if (mLastPresentFence.has_value()) {
+            LOG(WARNING) << "VrrController: last present fence remains open.";
+            close(mLastPresentFence.value());
+        }
+        mLastPresentFence = fence;
+    }
+}
+
 std::string VariableRefreshRateController::getStateName(VrrControllerState state) const {
     switch (state) {
         case VrrControllerState::kDisable:
@@ -458,6 +489,8 @@ void VariableRefreshRateController::threadBody() {
         return;
     }
     for (;;) {
+        harvestPresentFences();
+
         bool stateChanged = false;
         {
             std::unique_lock<std::mutex> lock(mMutex);
@@ -547,7 +580,7 @@ void VariableRefreshRateController::postEvent(VrrControllerEventType type, int64
     VrrControllerEvent event;
     event.mEventType = type;
     event.mWhenNs = when;
-    mEventQueue.emplace(event);
+    mEventQueue.push(event);
 }
 
 void VariableRefreshRateController::updateVsyncHistory() {
@@ -21,11 +21,13 @@
 #include <list>
 #include <map>
 #include <optional>
-#include <queue>
 #include <thread>
 
 #include "../libdevice/ExynosDisplay.h"
+#include "EventQueue.h"
+#include "FrameInsertionPolicy.h"
 #include "RingBuffer.h"
+#include "SpscRing.h"
 #include "VariableRefreshRateInterface.h"
 
 namespace android::hardware::graphics::composer {
@@ -61,10 +63,14 @@ private:
     static constexpr int64_t SIGNAL_TIME_PENDING = INT64_MAX;
     static constexpr int64_t SIGNAL_TIME_INVALID = -1;
 
+    // Present fences waiting for the controller thread, a few frames at most.
+    static constexpr size_t kPresentFenceRingCapacity = 8;
+
     static const std::string kFrameInsertionNodeName;
-    static constexpr int kDefaultNumFramesToInsert = 2;
-    static constexpr int64_t kDefaultFrameInsertionTimer =
-            33 * (std::nano::den / std::milli::den); // 33 ms
+    static const std::string kFrameInsertionPolicyProperty;
+    static const std::string kMinRefreshRateProperty;
+    // The panel minimum refresh rate the 33 ms frame insertion timer kept.
+    static constexpr int kDefaultMinRefreshRate = 30;
 
     enum class VrrControllerState {
         kDisable = 0,
@@ -112,10 +118,12 @@ private:
         kNotifyExpectedPresentConfig,
         kNextFrameInsertion,
         // Sensors, outer events...
+
+        // Keep last.
+        kNumVrrControllerEventTypes,
     };
 
     struct VrrControllerEvent {
-        bool operator<(const VrrControllerEvent& b) const { return mWhenNs > b.mWhenNs; }
         std::string getName() const {
             switch (mEventType) {
                 case kRenderingTimeout:
@@ -157,6 +165,8 @@ private:
     int doFrameInsertionLocked();
     int doFrameInsertionLocked(int frames);
 
+    FrameInsertionPlan planFrameInsertionLocked();
+
     void dropEventLocked();
     void dropEventLocked(VrrControllerEventType event_type);
 
@@ -166,6 +176,9 @@ private:
 
     int64_t getNextEventTimeLocked() const;
 
+    // Controller thread only, takes the present fences handed over by onPresent().
+    void harvestPresentFences();
+
     std::string getStateName(VrrControllerState state) const;
 
     // Functions responsible for state machine transitions.
@@ -187,7 +200,13 @@ private:
 
     // The subsequent variables must be guarded by mMutex when accessed.
     int mPendingFramesToInsert = 0;
-    std::priority_queue<VrrControllerEvent> mEventQueue;
+    int64_t mFrameInsertionIntervalNs = 0;
+    // From the panel minimum refresh rate, 0 when there is none.
+    int64_t mMaxFrameIntervalNs = 0;
+    std::unique_ptr<FrameInsertionPolicy> mFrameInsertionPolicy;
+    // Scratch copy of the recent present times handed to mFrameInsertionPolicy.
+    std::vector<int64_t> mRecentPresentTimes;
+    EventQueue<VrrControllerEvent, kNumVrrControllerEventTypes> mEventQueue;
     VrrRecord mRecord;
     int32_t mPowerMode = -1;
     VrrControllerState mState;
@@ -195,6 +214,9 @@ private:
     std::unordered_map<hwc2_config_t, VrrConfig_t> mVrrConfigs;
     std::optional<int> mLastPresentFence;
 
+    // Duplicated present fences from onPresent() to the controller thread.
+    SpscRing<int, kPresentFenceRingCapacity> mPresentFences;
+
     std::unique_ptr<FileNodeWriter> mFileNodeWritter;
 
     bool mEnabled = false;
@@ -0,0 +1,370 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <queue>
+#include <random>
+#include <vector>
+
+#include "../EventQueue.h"
+
+namespace android::hardware::graphics::composer {
+
+namespace {
+
+enum EventType {
+    kRenderingTimeout = 0,
+    kHibernateTimeout,
+    kNotifyExpectedPresentConfig,
+    kNextFrameInsertion,
+    kNumEventTypes,
+};
+
+struct Event {
+    EventType mEventType;
+    int64_t mWhenNs;
+    int mId = 0;
+};
+
+typedef EventQueue<Event, kNumEventTypes> Queue;
+
+constexpr int64_t kMsToNs = 1000000;
+constexpr int64_t kRenderingTimeoutNs = 100 * kMsToNs;
+constexpr int64_t kHibernateTimeoutNs = 500 * kMsToNs;
+constexpr int64_t kFrameInsertionNs = 33 * kMsToNs;
+constexpr int kFramesToInsert = 2;
+
+std::vector<int> drainIds(Queue& queue) {
+    std::vector<int> ids;
+    while (!queue.empty()) {
+        ids.push_back(queue.top().mId);
+        queue.pop();
+    }
+    return ids;
+}
+
+// Drives the queue on a fake clock the way VariableRefreshRateController does:
+// every present drops the pending rendering timeout and frame insertion and
+// posts new ones, a rendering timeout moves to hibernate, an expected present
+// notification while hibernating resumes rendering, and disabling drops all.
+class FakeController {
+public:
+    enum class State { kDisable, kRendering, kHibernate };
+
+    void enable() {
+        mState = State::kRendering;
+        post(kRenderingTimeout, mNowNs + kRenderingTimeoutNs);
+    }
+
+    void disable() {
+        mState = State::kDisable;
+        mQueue.clear();
+        mPendingFrames = 0;
+    }
+
+    void present() {
+        if (mState == State::kDisable) return;
+        if (mState == State::kHibernate) {
+            mState = State::kRendering;
+            mQueue.cancelType(kHibernateTimeout);
+        }
+        mQueue.cancelType(kRenderingTimeout);
+        mQueue.cancelType(kNextFrameInsertion);
+        post(kRenderingTimeout, mNowNs + kRenderingTimeoutNs);
+        mPendingFrames = kFramesToInsert;
+        post(kNextFrameInsertion, mNowNs + kFrameInsertionNs);
+    }
+
+    void notifyExpectedPresent() { post(kNotifyExpectedPresentConfig, mNowNs); }
+
+    // Moves the clock forward, firing every event that falls due on the way.
+    void advanceTo(int64_t nowNs) {
+        while (!mQueue.empty() && mQueue.top().mWhenNs <= nowNs) {
+            const Event event = mQueue.top();
+            mQueue.pop();
+            ASSERT_GE(event.mWhenNs, mLastFiredNs);
+            mLastFiredNs = event.mWhenNs;
+            mNowNs = event.mWhenNs;
+            handle(event);
+        }
+        mNowNs = nowNs;
+    }
+
+    State state() const { return mState; }
+    int64_t now() const { return mNowNs; }
+    const Queue& queue() const { return mQueue; }
+    int insertedFrames() const { return mInsertedFrames; }
+    int hibernations() const { return mHibernations; }
+
+private:
+    void post(EventType type, int64_t whenNs) { mQueue.push({type, whenNs}); }
+
+    void handle(const Event& event) {
+        if (mState == State::kRendering) {
+            switch (event.mEventType) {
+                case kRenderingTimeout:
+                    mState = State::kHibernate;
+                    ++mHibernations;
+                    post(kHibernateTimeout, mNowNs + kHibernateTimeoutNs);
+                    break;
+                case kNextFrameInsertion:
+                    ++mInsertedFrames;
+                    if (--mPendingFrames > 0) {
+                        post(kNextFrameInsertion, mNowNs + kFrameInsertionNs);
+                    }
+                    break;
+                default:
+                    break;
+            }
+        } else if (mState == State::kHibernate) {
+            switch (event.mEventType) {
+                case kHibernateTimeout:
+                    post(kHibernateTimeout, mNowNs + kHibernateTimeoutNs);
+                    break;
+                case kNotifyExpectedPresentConfig:
+                    mState = State::kRendering;
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+
+    Queue mQueue;
+    State mState = State::kDisable;
+    int64_t mNowNs = 0;
+    int64_t mLastFiredNs = 0;
+    int mPendingFrames = 0;
+    int mInsertedFrames = 0;
+    int mHibernations = 0;
+};
+
+} // namespace
+
+TEST(EventQueueTest, PopsInTimeOrder) {
+    Queue queue;
+    queue.push({kRenderingTimeout, 30, 3});
+    queue.push({kHibernateTimeout, 10, 1});
+    queue.push({kNextFrameInsertion, 20, 2});
+    queue.push({kNotifyExpectedPresentConfig, 40, 4});
+
+    EXPECT_EQ(4u, queue.size());
+    EXPECT_EQ((std::vector<int>{1, 2, 3, 4}), drainIds(queue));
+}
+
+TEST(EventQueueTest, TiesPopInPushOrder) {
+    Queue queue;
+    for (int i = 0; i < 16; ++i) {
+        queue.push({static_cast<EventType>(i % kNumEventTypes), 100, i});
+    }
+    std::vector<int> expected(16);
+    for (int i = 0; i < 16; ++i) expected[i] = i;
+    EXPECT_EQ(expected, drainIds(queue));
+}
+
+TEST(EventQueueTest, CancelByType) {
+    Queue queue;
+    queue.push({kRenderingTimeout, 10, 1});
+    queue.push({kNextFrameInsertion, 20, 2});
+    queue.push({kRenderingTimeout, 30, 3});
+    queue.push({kHibernateTimeout, 40, 4});
+
+    EXPECT_EQ(2u, queue.count(kRenderingTimeout));
+    EXPECT_EQ(2u, queue.cancelType(kRenderingTimeout));
+    EXPECT_EQ(0u, queue.count(kRenderingTimeout));
+    EXPECT_EQ(0u, queue.cancelType(kRenderingTimeout));
+    EXPECT_EQ((std::vector<int>{2, 4}), drainIds(queue));
+}
+
+TEST(EventQueueTest, CancelByHandle) {
+    Queue queue;
+    queue.push({kRenderingTimeout, 10, 1});
+    auto handle = queue.push({kNextFrameInsertion, 20, 2});
+    queue.push({kRenderingTimeout, 30, 3});
+
+    EXPECT_TRUE(queue.cancel(handle));
+    EXPECT_FALSE(queue.cancel(handle));
+    EXPECT_FALSE(queue.cancel(Queue::kInvalidHandle));
+    EXPECT_EQ(0u, queue.count(kNextFrameInsertion));
+    EXPECT_EQ((std::vector<int>{1, 3}), drainIds(queue));
+}
+
+TEST(EventQueueTest, StaleHandleDoesNotCancelReusedSlot) {
+    Queue queue;
+    auto stale = queue.push({kRenderingTimeout, 10, 1});
+    queue.pop();
+    queue.push({kRenderingTimeout, 20, 2});
+
+    EXPECT_FALSE(queue.cancel(stale));
+    EXPECT_EQ(1u, queue.size());
+
+    queue.clear();
+    EXPECT_TRUE(queue.empty());
+    EXPECT_EQ(0u, queue.count(kRenderingTimeout));
+}
+
+TEST(EventQueueTest, ForEachOrderedKeepsQueue) {
+    Queue queue;
+    queue.push({kRenderingTimeout, 30, 3});
+    queue.push({kHibernateTimeout, 10, 1});
+    queue.push({kNextFrameInsertion, 20, 2});
+
+    std::vector<int> ids;
+    queue.forEachOrdered([&ids](const Event& event) { ids.push_back(event.mId); });
+    EXPECT_EQ((std::vector<int>{1, 2, 3}), ids);
+    EXPECT_EQ(3u, queue.size());
+    EXPECT_EQ((std::vector<int>{1, 2, 3}), drainIds(queue));
+}
+
+// Random pushes and cancellations checked against a rebuild-the-queue
+// reference, which is what dropEventLocked() used to do.
+TEST(EventQueueTest, MatchesReferenceQueue) {
+    struct Later {
+        bool operator()(const Event& a, const Event& b) const {
+            return a.mWhenNs != b.mWhenNs ? a.mWhenNs > b.mWhenNs : a.mId > b.mId;
+        }
+    };
+    typedef std::priority_queue<Event, std::vector<Event>, Later> Reference;
+
+    std::mt19937 rng(42);
+    Queue queue;
+    Reference reference;
+    int nextId = 0;
+    for (int step = 0; step < 5000; ++step) {
+        const int op = rng() % 10;
+        if (op < 6) {
+            Event event{static_cast<EventType>(rng() % kNumEventTypes),
+                        static_cast<int64_t>(rng() % 64), nextId++};
+            queue.push(event);
+            reference.push(event);
+        } else if (op < 8) {
+            const auto type = static_cast<EventType>(rng() % kNumEventTypes);
+            queue.cancelType(type);
+            Reference rebuilt;
+            while (!reference.empty()) {
+                if (reference.top().mEventType != type) rebuilt.push(reference.top());
+                reference.pop();
+            }
+            reference = std::move(rebuilt);
+        } else if (!reference.empty()) {
+            ASSERT_EQ(reference.top().mId, queue.top().mId);
+            queue.pop();
+            reference.pop();
+        }
+        ASSERT_EQ(reference.size(), queue.size());
+    }
+    while (!reference.empty()) {
+        ASSERT_EQ(reference.top().mId, queue.top().mId);
+        queue.pop();
+        reference.pop();
+    }
+    EXPECT_TRUE(queue.empty());
+}
+
+class EventQueueCadenceTest : public ::testing::TestWithParam<int> {};
+
+// Steady presents leave the controller rendering with exactly one pending
+// rendering timeout and frame insertion, whatever the refresh rate. Cadences
+// slower than the rendering timeout hibernate between every two frames.
+TEST_P(EventQueueCadenceTest, StaysRenderingWhilePresenting) {
+    const int64_t periodNs = 1000 * kMsToNs / GetParam();
+    FakeController controller;
+    controller.enable();
+
+    for (int frame = 1; frame <= 240; ++frame) {
+        controller.advanceTo(frame * periodNs);
+        controller.present();
+        ASSERT_EQ(FakeController::State::kRendering, controller.state()) << "frame " << frame;
+        ASSERT_EQ(1u, controller.queue().count(kRenderingTimeout));
+        ASSERT_EQ(1u, controller.queue().count(kNextFrameInsertion));
+        ASSERT_EQ(0u, controller.queue().count(kHibernateTimeout));
+    }
+    EXPECT_EQ(periodNs >= kRenderingTimeoutNs ? 240 : 0, controller.hibernations());
+
+    // Frame insertion only completes when the cadence is slower than the
+    // insertion timer.
+    const int expectedInserted = periodNs > 2 * kFrameInsertionNs
+            ? 239 * kFramesToInsert
+            : (periodNs > kFrameInsertionNs ? 239 : 0);
+    EXPECT_EQ(expectedInserted, controller.insertedFrames());
+}
+
+// Stop presenting: rendering times out into hibernate, stays there, and the
+// next expected present resumes rendering.
+TEST_P(EventQueueCadenceTest, HibernatesAndResumes) {
+    const int64_t periodNs = 1000 * kMsToNs / GetParam();
+    FakeController controller;
+    controller.enable();
+    for (int frame = 1; frame <= 10; ++frame) {
+        controller.advanceTo(frame * periodNs);
+        controller.present();
+    }
+
+    const int hibernations = controller.hibernations();
+    const int64_t lastPresentNs = controller.now();
+    controller.advanceTo(lastPresentNs + kRenderingTimeoutNs - 1);
+    EXPECT_EQ(FakeController::State::kRendering, controller.state());
+    controller.advanceTo(lastPresentNs + kRenderingTimeoutNs);
+    EXPECT_EQ(FakeController::State::kHibernate, controller.state());
+    EXPECT_EQ(hibernations + 1, controller.hibernations());
+
+    controller.advanceTo(lastPresentNs + kRenderingTimeoutNs + 3 * kHibernateTimeoutNs);
+    EXPECT_EQ(FakeController::State::kHibernate, controller.state());
+    EXPECT_EQ(1u, controller.queue().count(kHibernateTimeout));
+
+    controller.notifyExpectedPresent();
+    controller.advanceTo(controller.now());
+    EXPECT_EQ(FakeController::State::kRendering, controller.state());
+
+    // Like the controller, resuming leaves the hibernate timeout queued and
+    // it is ignored once it fires while rendering.
+    const int64_t resumeNs = controller.now();
+    for (int64_t t = resumeNs; t <= resumeNs + kHibernateTimeoutNs; t += kRenderingTimeoutNs / 2) {
+        controller.advanceTo(t);
+        controller.present();
+        ASSERT_EQ(FakeController::State::kRendering, controller.state());
+    }
+    EXPECT_EQ(hibernations + 1, controller.hibernations());
+    EXPECT_EQ(0u, controller.queue().count(kHibernateTimeout));
+}
+
+// Disabling drops every pending event and ignores presents until enabled.
+TEST_P(EventQueueCadenceTest, DisableDropsEverything) {
+    const int64_t periodNs = 1000 * kMsToNs / GetParam();
+    FakeController controller;
+    controller.enable();
+    for (int frame = 1; frame <= 10; ++frame) {
+        controller.advanceTo(frame * periodNs);
+        controller.present();
+    }
+
+    controller.disable();
+    EXPECT_TRUE(controller.queue().empty());
+    controller.present();
+    controller.advanceTo(controller.now() + kHibernateTimeoutNs);
+    EXPECT_TRUE(controller.queue().empty());
+    EXPECT_EQ(FakeController::State::kDisable, controller.state());
+
+    controller.enable();
+    EXPECT_EQ(1u, controller.queue().size());
+    EXPECT_EQ(1u, controller.queue().count(kRenderingTimeout));
+}
+
+INSTANTIATE_TEST_SUITE_P(RefreshRates, EventQueueCadenceTest,
+                         ::testing::Values(1, 10, 24, 30, 48, 60, 90, 120, 144, 240));
+
+} // namespace android::hardware::graphics::composer
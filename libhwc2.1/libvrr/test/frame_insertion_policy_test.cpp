@@ -0,0 +1,185 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <random>
+#include <vector>
+
+#include "../FrameInsertionPolicy.h"
+#include "frame_insertion_replay.h"
+
+namespace android::hardware::graphics::composer {
+
+namespace {
+
+constexpr int64_t kMsToNs = 1000000;
+// 120Hz panel, refreshed at 30Hz at least.
+constexpr int64_t kMinFrameIntervalNs = 8333333;
+constexpr int64_t kMaxFrameIntervalNs = 33333333;
+
+std::vector<int64_t> steadyTrace(int64_t intervalNs, int frames) {
+    std::vector<int64_t> trace;
+    for (int i = 0; i < frames; ++i) {
+        trace.push_back(1000 * kMsToNs + i * intervalNs);
+    }
+    return trace;
+}
+
+FrameInsertionPlan planFor(FrameInsertionPolicy& policy, const std::vector<int64_t>& history) {
+    return policy.plan({.nowNs = history.back(),
+                        .presentTimesNs = &history,
+                        .minFrameIntervalNs = kMinFrameIntervalNs,
+                        .maxFrameIntervalNs = kMaxFrameIntervalNs});
+}
+
+FrameInsertionScore replay(FrameInsertionPolicy& policy, const std::vector<int64_t>& trace) {
+    return replayFrameInsertion(policy, trace, kMinFrameIntervalNs, kMaxFrameIntervalNs);
+}
+
+} // namespace
+
+TEST(FrameInsertionPolicyTest, CreateByName) {
+    EXPECT_EQ("fixed", FrameInsertionPolicy::create("fixed")->getName());
+    EXPECT_EQ("cadence", FrameInsertionPolicy::create("cadence")->getName());
+    EXPECT_EQ("cadence", FrameInsertionPolicy::create("")->getName());
+}
+
+TEST(FrameInsertionPolicyTest, FixedIgnoresHistory) {
+    FixedFrameInsertionPolicy policy;
+    const auto plan = planFor(policy, steadyTrace(16 * kMsToNs, 9));
+    EXPECT_EQ(FixedFrameInsertionPolicy::kDefaultNumFramesToInsert, plan.numFrames);
+    EXPECT_EQ(FixedFrameInsertionPolicy::kDefaultFrameInsertionTimer, plan.firstDelayNs);
+    EXPECT_EQ(kMinFrameIntervalNs, plan.intervalNs);
+}
+
+TEST(FrameInsertionPolicyTest, CadenceFallsBackWithoutHistory) {
+    CadenceFrameInsertionPolicy policy;
+    const auto plan = planFor(policy, steadyTrace(16 * kMsToNs, 2));
+    EXPECT_EQ(FixedFrameInsertionPolicy::kDefaultNumFramesToInsert, plan.numFrames);
+}
+
+TEST(FrameInsertionPolicyTest, CadenceFallsBackOnJitter) {
+    CadenceFrameInsertionPolicy policy;
+    std::vector<int64_t> history = {0, 16 * kMsToNs, 60 * kMsToNs, 70 * kMsToNs, 140 * kMsToNs};
+    const auto plan = planFor(policy, history);
+    EXPECT_EQ(FixedFrameInsertionPolicy::kDefaultNumFramesToInsert, plan.numFrames);
+}
+
+TEST(FrameInsertionPolicyTest, FixedKeepsMinRefreshRate) {
+    FixedFrameInsertionPolicy policy;
+    std::vector<int64_t> history = {0};
+    const auto plan = policy.plan({.nowNs = 0,
+                                   .presentTimesNs = &history,
+                                   .minFrameIntervalNs = kMinFrameIntervalNs,
+                                   .maxFrameIntervalNs = 20 * kMsToNs});
+    EXPECT_EQ(20 * kMsToNs, plan.firstDelayNs);
+}
+
+TEST(FrameInsertionPolicyTest, CadenceKeepsFramesAtHighRate) {
+    CadenceFrameInsertionPolicy policy;
+    // The next present cancels them, they only fire if the content stops.
+    for (int64_t intervalNs : {int64_t{8333333}, int64_t{16666667}}) {
+        const auto plan = planFor(policy, steadyTrace(intervalNs, 9));
+        EXPECT_EQ(FixedFrameInsertionPolicy::kDefaultNumFramesToInsert, plan.numFrames);
+        EXPECT_EQ(FixedFrameInsertionPolicy::kDefaultFrameInsertionTimer, plan.firstDelayNs);
+        EXPECT_EQ(kMinFrameIntervalNs, plan.intervalNs);
+    }
+}
+
+TEST(FrameInsertionPolicyTest, CadenceMovesFramesPastNextPresent) {
+    CadenceFrameInsertionPolicy policy;
+    // 24fps: one frame at 33ms, the second at 41.3ms would hold the present at
+    // 41.7ms back and moves one panel frame past it.
+    auto plan = planFor(policy, steadyTrace(41666667, 9));
+    EXPECT_EQ(2, plan.numFrames);
+    EXPECT_EQ(FixedFrameInsertionPolicy::kDefaultFrameInsertionTimer, plan.firstDelayNs);
+    EXPECT_EQ(41666667 + kMinFrameIntervalNs, plan.firstDelayNs + plan.intervalNs);
+    // 10fps: both frames fit.
+    plan = planFor(policy, steadyTrace(100 * kMsToNs, 9));
+    EXPECT_EQ(FixedFrameInsertionPolicy::kDefaultFrameInsertionTimer, plan.firstDelayNs);
+    EXPECT_EQ(kMinFrameIntervalNs, plan.intervalNs);
+}
+
+TEST(FrameInsertionPolicyTest, CadenceKeepsMinRefreshRate) {
+    CadenceFrameInsertionPolicy policy;
+    // 30fps: past the present at 34ms would leave the panel 42ms without a
+    // frame if the content stops, the frame goes in front of it instead.
+    const auto plan = planFor(policy, steadyTrace(34 * kMsToNs, 9));
+    EXPECT_EQ(34 * kMsToNs - kMinFrameIntervalNs, plan.firstDelayNs);
+    EXPECT_LE(plan.firstDelayNs, kMaxFrameIntervalNs);
+}
+
+TEST(FrameInsertionReplayTest, CadenceNeverWorseOnSteadyContent) {
+    FixedFrameInsertionPolicy fixed;
+    CadenceFrameInsertionPolicy cadence;
+    const std::vector<int64_t> intervalsNs = {8333333,      16666667,      33333333,      41666667,
+                                              50 * kMsToNs, 100 * kMsToNs, 1000 * kMsToNs};
+    for (int64_t intervalNs : intervalsNs) {
+        const auto trace = steadyTrace(intervalNs, 240);
+        const auto fixedScore = replay(fixed, trace);
+        const auto cadenceScore = replay(cadence, trace);
+        SCOPED_TRACE("interval " + std::to_string(intervalNs) + "ns, fixed: " +
+                     fixedScore.toString() + ", cadence: " + cadenceScore.toString());
+        EXPECT_LE(cadenceScore.cost(), fixedScore.cost());
+        // Only while the cadence is still being learned.
+        EXPECT_LE(cadenceScore.lateFrames, CadenceFrameInsertionPolicy::kMinIntervals);
+    }
+}
+
+TEST(FrameInsertionReplayTest, ScoresLateFramesOn24fps) {
+    FixedFrameInsertionPolicy fixed;
+    CadenceFrameInsertionPolicy cadence;
+    const auto trace = steadyTrace(41666667, 240);
+    const auto fixedScore = replay(fixed, trace);
+    const auto cadenceScore = replay(cadence, trace);
+    EXPECT_GT(fixedScore.lateFrames, 200);
+    EXPECT_LE(cadenceScore.lateFrames, CadenceFrameInsertionPolicy::kMinIntervals);
+    EXPECT_EQ(0, cadenceScore.uncoveredGaps);
+    EXPECT_LT(cadenceScore.insertedFrames, fixedScore.insertedFrames);
+}
+
+TEST(FrameInsertionReplayTest, ContentStopsAfterSteadyRun) {
+    for (int64_t intervalNs : {int64_t{8333333}, int64_t{16666667}}) {
+        CadenceFrameInsertionPolicy cadence;
+        const auto score = replay(cadence, steadyTrace(intervalNs, 240));
+        SCOPED_TRACE("interval " + std::to_string(intervalNs) + "ns: " + score.toString());
+        // the frames after the last present, nothing while the content runs
+        EXPECT_EQ(FixedFrameInsertionPolicy::kDefaultNumFramesToInsert, score.insertedFrames);
+        EXPECT_EQ(0, score.uncoveredGaps);
+        EXPECT_EQ(0, score.lateFrames);
+    }
+}
+
+// Mostly too jittery to learn, the occasional short run of equal intervals
+// may mispredict but must not cost more than the fixed policy overall.
+TEST(FrameInsertionReplayTest, BurstyContentNoWorseThanFixed) {
+    std::mt19937 rng(7);
+    std::vector<int64_t> trace;
+    int64_t nowNs = 0;
+    for (int i = 0; i < 500; ++i) {
+        nowNs += (rng() % 2 ? 8 : 200) * kMsToNs;
+        trace.push_back(nowNs);
+    }
+    FixedFrameInsertionPolicy fixed;
+    CadenceFrameInsertionPolicy cadence;
+    const auto fixedScore = replay(fixed, trace);
+    const auto cadenceScore = replay(cadence, trace);
+    SCOPED_TRACE("fixed: " + fixedScore.toString() + ", cadence: " + cadenceScore.toString());
+    EXPECT_LE(cadenceScore.cost(), fixedScore.cost());
+}
+
+} // namespace android::hardware::graphics::composer
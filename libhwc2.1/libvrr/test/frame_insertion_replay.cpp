@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "frame_insertion_replay.h"
+
+#include <algorithm>
+#include <sstream>
+
+namespace android::hardware::graphics::composer {
+
+std::string FrameInsertionScore::toString() const {
+    std::ostringstream os;
+    os << "inserted = " << insertedFrames << ", late = " << lateFrames
+       << ", uncovered = " << uncoveredGaps << ", cost = " << cost();
+    return os.str();
+}
+
+FrameInsertionScore replayFrameInsertion(FrameInsertionPolicy& policy,
+                                         const std::vector<int64_t>& presentTimesNs,
+                                         int64_t minFrameIntervalNs, int64_t maxFrameIntervalNs) {
+    FrameInsertionScore score;
+    std::vector<int64_t> history;
+    for (size_t i = 0; i < presentTimesNs.size(); ++i) {
+        const int64_t nowNs = presentTimesNs[i];
+        const int64_t nextNs =
+                i + 1 < presentTimesNs.size() ? presentTimesNs[i + 1] : nowNs + kTrailingIdleNs;
+        const size_t first =
+                i - std::min(i, CadenceFrameInsertionPolicy::kCadenceWindow);
+        history.assign(presentTimesNs.begin() + first, presentTimesNs.begin() + i + 1);
+
+        const auto plan = policy.plan({.nowNs = nowNs,
+                                       .presentTimesNs = &history,
+                                       .minFrameIntervalNs = minFrameIntervalNs,
+                                       .maxFrameIntervalNs = maxFrameIntervalNs});
+        int fired = 0;
+        for (int k = 0; k < plan.numFrames; ++k) {
+            const int64_t whenNs = nowNs + plan.firstDelayNs + k * plan.intervalNs;
+            if (whenNs >= nextNs) break;
+            ++fired;
+            if (nextNs - whenNs < minFrameIntervalNs) {
+                ++score.lateFrames;
+            }
+        }
+        score.insertedFrames += fired;
+        const int64_t limitNs = maxFrameIntervalNs > 0
+                ? maxFrameIntervalNs
+                : FixedFrameInsertionPolicy::kDefaultFrameInsertionTimer;
+        if (nextNs - nowNs > limitNs && (fired == 0 || plan.firstDelayNs > limitNs)) {
+            ++score.uncoveredGaps;
+        }
+    }
+    return score;
+}
+
+} // namespace android::hardware::graphics::composer
@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "../FrameInsertionPolicy.h"
+
+namespace android::hardware::graphics::composer {
+
+// Outcome of replaying a present trace through a frame insertion policy.
+struct FrameInsertionScore {
+    // Inserted frames that fired before the next present, each one a panel
+    // refresh paid for in power.
+    int insertedFrames = 0;
+    // Inserted frames that fired less than one panel frame before the next
+    // present and so held it back.
+    int lateFrames = 0;
+    // Present intervals longer than the panel may go without a frame in which
+    // the policy inserted no frame in time, the trailing idle included.
+    int uncoveredGaps = 0;
+
+    // Lower is better, a late frame costs as much as four wasted refreshes.
+    int cost() const { return insertedFrames + 4 * lateFrames + 2 * uncoveredGaps; }
+    std::string toString() const;
+};
+
+// Idle time scored after the last present of a trace, the content stopped.
+constexpr int64_t kTrailingIdleNs = 1000 * 1000000; // 1 s
+
+// Replays the presents of a trace, given as present times in nanoseconds, the
+// way VariableRefreshRateController would: plan after every present with the
+// history so far, and cancel whatever is pending when the next present lands.
+// The last present is followed by kTrailingIdleNs without any.
+FrameInsertionScore replayFrameInsertion(FrameInsertionPolicy& policy,
+                                         const std::vector<int64_t>& presentTimesNs,
+                                         int64_t minFrameIntervalNs, int64_t maxFrameIntervalNs);
+
+} // namespace android::hardware::graphics::composer
@@ -0,0 +1,171 @@
+/*
+ * Copyright (C) 2024 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <linux/sync_file.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+#include "../SpscRing.h"
+
+namespace android::hardware::graphics::composer {
+
+namespace {
+
+// What sync_file_info() costs: the fence count, then the fence infos into a
+// fresh buffer.
+void readFenceInfo(int fd) {
+    struct sync_file_info info = {};
+    ioctl(fd, SYNC_IOC_FILE_INFO, &info);
+    info.num_fences = 1;
+    auto* fences = static_cast<sync_fence_info*>(calloc(1, sizeof(sync_fence_info)));
+    info.sync_fence_info = reinterpret_cast<uint64_t>(fences);
+    ioctl(fd, SYNC_IOC_FILE_INFO, &info);
+    free(fences);
+}
+
+} // namespace
+
+TEST(SpscRingTest, FifoUntilFull) {
+    SpscRing<int, 4> ring;
+    int value = -1;
+    EXPECT_TRUE(ring.empty());
+    EXPECT_FALSE(ring.pop(value));
+
+    for (int i = 0; i < 4; ++i) {
+        EXPECT_TRUE(ring.push(i));
+    }
+    EXPECT_FALSE(ring.push(4));
+
+    for (int i = 0; i < 4; ++i) {
+        ASSERT_TRUE(ring.pop(value));
+        EXPECT_EQ(i, value);
+    }
+    EXPECT_FALSE(ring.pop(value));
+    EXPECT_TRUE(ring.empty());
+}
+
+TEST(SpscRingTest, WrapsAround) {
+    SpscRing<int, 4> ring;
+    int value = -1;
+    for (int i = 0; i < 100; ++i) {
+        ASSERT_TRUE(ring.push(i));
+        ASSERT_TRUE(ring.push(i + 1000));
+        ASSERT_TRUE(ring.pop(value));
+        EXPECT_EQ(i, value);
+        ASSERT_TRUE(ring.pop(value));
+        EXPECT_EQ(i + 1000, value);
+    }
+}
+
+TEST(SpscRingTest, HandsOverAcrossThreads) {
+    constexpr int kCount = 200000;
+    SpscRing<int, 8> ring;
+
+    std::thread producer([&ring] {
+        for (int i = 0; i < kCount;) {
+            if (ring.push(i)) {
+                ++i;
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    int expected = 0;
+    int value;
+    while (expected < kCount) {
+        if (ring.pop(value)) {
+            ASSERT_EQ(expected, value);
+            ++expected;
+        } else {
+            std::this_thread::yield();
+        }
+    }
+    producer.join();
+    EXPECT_TRUE(ring.empty());
+}
+
+// Present path cost of VariableRefreshRateController::onPresent() reading the
+// previous fence itself, against handing a duplicate over to the controller
+// thread. An eventfd stands in for the fence, the ioctls fail early on it so
+// the fence-info path is a lower bound on a real sync file.
+TEST(SpscRingTest, PresentPathBenchmark) {
+    constexpr int kPresents = 20000;
+    const int fence = eventfd(0, EFD_CLOEXEC);
+    ASSERT_GE(fence, 0);
+
+    int lastFence = -1;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < kPresents; ++i) {
+        if (lastFence >= 0) {
+            readFenceInfo(lastFence);
+            close(lastFence);
+        }
+        lastFence = dup(fence);
+    }
+    const auto fenceInfoNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                     std::chrono::steady_clock::now() - start)
+                                     .count() /
+            kPresents;
+    close(lastFence);
+
+    SpscRing<int, 64> ring;
+    std::atomic_bool done{false};
+    std::thread controller([&] {
+        int harvested = -1;
+        bool last = false;
+        while (!last) {
+            last = done.load();
+            int next;
+            while (ring.pop(next)) {
+                if (harvested >= 0) {
+                    readFenceInfo(harvested);
+                    close(harvested);
+                }
+                harvested = next;
+            }
+            std::this_thread::yield();
+        }
+        close(harvested);
+    });
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < kPresents; ++i) {
+        const int dupFence = dup(fence);
+        if (!ring.push(dupFence)) {
+            close(dupFence);
+        }
+    }
+    const auto handoffNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                   std::chrono::steady_clock::now() - start)
+                                   .count() /
+            kPresents;
+    done = true;
+    controller.join();
+    close(fence);
+
+    ::testing::Test::RecordProperty("fence_info_ns", std::to_string(fenceInfoNs));
+    ::testing::Test::RecordProperty("spsc_handoff_ns", std::to_string(handoffNs));
+}
+
+} // namespace android::hardware::graphics::composer